@@ -0,0 +1,430 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Attach.cpp
+|
+|   Purpose:	Implementation of CAttachCache and of cSendFiles, which
+|				sends a message with any number of attachments. Before
+|				MAPISendMail is called the files are checked and copied
+|				in parallel, so a missing or unreadable file fails the
+|				send at once and the provider only opens copies.
+|
++---------------------------------------------------------------------
+*/
+
+#include "attach.h"
+#include "workpool.h"
+#include "dedup.h"
+
+// State shared by the workers of one cPrepareAttachments.
+typedef struct _ATTACHCONTEXT
+{
+	CAttachCache				*pCache;
+	std::vector<ATTACHFILE>		*prgFiles;
+	volatile LONG				iNext;			// Next file to claim
+} ATTACHCONTEXT;
+
+// TRUE if sPath starts with a drive or is a UNC path.
+static BOOL AttachIsAbsolute ( const std::string &sPath )
+{
+	if ( sPath.size ( ) >= 3 && isalpha ( (BYTE) sPath[0] ) && ':' == sPath[1] &&
+		 ( '\\' == sPath[2] || '/' == sPath[2] ) )
+		return TRUE;
+
+	return 0 == sPath.compare ( 0, 2, "\\\\" );
+}
+
+// Returns sPath made absolute. The ANSI GetFullPathName only takes paths
+// shorter than MAX_PATH, so a path that is already absolute is left as it is.
+static std::string AttachFullPath ( const std::string &sPath )
+{
+	std::vector<char> rgchFull ( MAX_PATH );
+	DWORD cch = 0;
+
+	if ( AttachIsAbsolute ( sPath ) )
+		return sPath;
+
+	cch = GetFullPathName ( sPath.c_str ( ), (DWORD) rgchFull.size ( ), &rgchFull[0], NULL );
+	if ( cch >= rgchFull.size ( ) )
+	{
+		rgchFull.resize ( cch + 1 );
+		cch = GetFullPathName ( sPath.c_str ( ), (DWORD) rgchFull.size ( ), &rgchFull[0], NULL );
+	}
+	if ( 0 == cch || cch >= rgchFull.size ( ) )
+		return sPath;
+
+	return std::string ( &rgchFull[0], cch );
+}
+
+// Returns the form of a full path the file functions accept at any length:
+// as it is if it is short, with the \\?\ prefix if it is not.
+static std::string AttachLongPath ( const std::string &sFull )
+{
+	std::string sLong;
+
+	if ( sFull.size ( ) < MAX_PATH || 0 == sFull.compare ( 0, 4, "\\\\?\\" ) )
+		return sFull;
+
+	if ( 0 == sFull.compare ( 0, 2, "\\\\" ) )
+		sLong = "\\\\?\\UNC\\" + sFull.substr ( 2 );
+	else
+		sLong = "\\\\?\\" + sFull;
+
+	// The prefix turns off the conversion of forward slashes.
+	for ( size_t i = 0; i < sLong.size ( ); i++ )
+	{
+		if ( '/' == sLong[i] )
+			sLong[i] = '\\';
+	}
+
+	return sLong;
+}
+
+static DWORD AttachWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	ATTACHCONTEXT *pCtx = (ATTACHCONTEXT *) lpvContext;
+	LONG cFiles = (LONG) pCtx -> prgFiles -> size ( );
+	LONG i = 0;
+
+	while ( ( i = InterlockedIncrement ( &pCtx -> iNext ) - 1 ) < cFiles )
+		pCtx -> pCache -> Prepare ( &( *pCtx -> prgFiles )[i] );
+
+	return SUCCESS_SUCCESS;
+}
+
+CAttachCache::CAttachCache ( )
+{
+	char szTempPath[MAX_PATH + 1] = { 0 };
+	char szProcess[16] = { 0 };
+
+	InitializeCriticalSection ( &m_csLock );
+	ZeroMemory ( &m_Stats, sizeof ( ATTACHSTATS ) );
+
+	GetTempPath ( sizeof ( szTempPath ), szTempPath );
+	m_sDir = szTempPath;
+	m_sDir += szATTACHDIR;
+	CreateDirectory ( m_sDir.c_str ( ), NULL );
+
+	// Each process keeps its copies apart, so deleting them on the way
+	// out never pulls a file from under another process's send.
+	sprintf ( szProcess, "\\%lu", GetCurrentProcessId ( ) );
+	m_sDir += szProcess;
+	CreateDirectory ( m_sDir.c_str ( ), NULL );
+}
+
+CAttachCache::~CAttachCache ( )
+{
+	for ( size_t i = 0; i < m_rgsCreated.size ( ); i++ )
+		DeleteFile ( m_rgsCreated[i].c_str ( ) );
+	RemoveDirectory ( m_sDir.c_str ( ) );
+
+	DeleteCriticalSection ( &m_csLock );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Prepare()
+|
+|	Parameters:	[IN/OUT] pFile == sPath in; the rest out.
+|
+|	Purpose:	Checks the file and finds or makes its copy. The copy
+|				made earlier for the same path is used again if the
+|				file still has the size and time it had then. Returns,
+|				and stores in pFile -> hRes, MAPI_E_ATTACHMENT_NOT_FOUND
+|				if there is no such file, and the failure of Copy if a
+|				new copy could not be made. Safe to call from several
+|				threads at once.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CAttachCache::Prepare ( ATTACHFILE *pFile )
+{
+	std::string sFull = AttachFullPath ( pFile -> sPath );
+	std::string sLong = AttachLongPath ( sFull );
+	std::string sKey = sFull;
+	std::map<std::string, ATTACHCOPY>::iterator itCopy;
+	WIN32_FILE_ATTRIBUTE_DATA Data;
+	ATTACHCOPY Copied;
+	size_t ichName = sFull.find_last_of ( "\\/:" );
+
+	pFile -> sFileName = std::string::npos == ichName ? sFull : sFull.substr ( ichName + 1 );
+	pFile -> sCopyPath.clear ( );
+	pFile -> cbFile = 0;
+
+	if ( !GetFileAttributesEx ( sLong.c_str ( ), GetFileExInfoStandard, &Data ) ||
+		 ( Data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) )
+		return pFile -> hRes = MAPI_E_ATTACHMENT_NOT_FOUND;
+
+	pFile -> cbFile = ( (ULONGLONG) Data.nFileSizeHigh << 32 ) | Data.nFileSizeLow;
+	for ( size_t i = 0; i < sKey.size ( ); i++ )
+		sKey[i] = (char) toupper ( (BYTE) sKey[i] );
+
+	EnterCriticalSection ( &m_csLock );
+	m_Stats.cPrepared++;
+	itCopy = m_Copies.find ( sKey );
+	if ( itCopy != m_Copies.end ( ) &&
+		 itCopy -> second.cbFile == pFile -> cbFile &&
+		 0 == CompareFileTime ( &itCopy -> second.ftLastWrite, &Data.ftLastWriteTime ) &&
+		 INVALID_FILE_ATTRIBUTES != GetFileAttributes ( itCopy -> second.sCopyPath.c_str ( ) ) )
+	{
+		pFile -> sCopyPath = itCopy -> second.sCopyPath;
+		m_Stats.cReused++;
+		LeaveCriticalSection ( &m_csLock );
+		return pFile -> hRes = SUCCESS_SUCCESS;
+	}
+	LeaveCriticalSection ( &m_csLock );
+
+	// The size and time are those from before the copy, so a file that
+	// changes while it is copied is copied again next time.
+	if ( SUCCESS_SUCCESS != ( pFile -> hRes = Copy ( sLong, pFile -> sFileName, &pFile -> sCopyPath ) ) )
+		return pFile -> hRes;
+
+	Copied.cbFile = pFile -> cbFile;
+	Copied.ftLastWrite = Data.ftLastWriteTime;
+	Copied.sCopyPath = pFile -> sCopyPath;
+
+	EnterCriticalSection ( &m_csLock );
+	m_Copies[sKey] = Copied;
+	LeaveCriticalSection ( &m_csLock );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Copy()
+|
+|	Purpose:	Copies the file to a temporary file, hashing each block
+|				as it goes, then renames it for the hash of the block
+|				hashes and the extension of sFileName. If a copy of the
+|				same content is there already the new one is dropped.
+|				Returns MAPI_E_ATTACHMENT_OPEN_FAILURE if the file cannot
+|				be read and MAPI_E_ATTACHMENT_WRITE_FAILURE if the copy
+|				cannot be written.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CAttachCache::Copy ( const std::string &sLongPath, const std::string &sFileName, std::string *psCopyPath )
+{
+	HRESULT hRes = SUCCESS_SUCCESS;
+	HANDLE hSource = INVALID_HANDLE_VALUE;
+	HANDLE hCopy = INVALID_HANDLE_VALUE;
+	char szTempFile[MAX_PATH + 1] = { 0 };
+	char szName[40];
+	std::vector<BYTE> rgbBlock ( ATTACH_BLOCK );
+	std::vector<ULONGLONG> rgullHashes;
+	ULONGLONG rgullHash[2];
+	ULONGLONG cbCopied = 0;
+	DWORD cbRead = 0;
+	DWORD cbWritten = 0;
+	size_t ichExt = sFileName.rfind ( '.' );
+
+	hSource = CreateFile ( sLongPath.c_str ( ), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+						   OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( INVALID_HANDLE_VALUE == hSource )
+		return MAPI_E_ATTACHMENT_OPEN_FAILURE;
+
+	if ( !GetTempFileName ( m_sDir.c_str ( ), "att", 0, szTempFile ) ||
+		 INVALID_HANDLE_VALUE == ( hCopy = CreateFile ( szTempFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+														FILE_ATTRIBUTE_NORMAL, NULL ) ) )
+	{
+		CloseHandle ( hSource );
+		if ( szTempFile[0] )
+			DeleteFile ( szTempFile );
+		return MAPI_E_ATTACHMENT_WRITE_FAILURE;
+	}
+
+	for ( ;; )
+	{
+		if ( !ReadFile ( hSource, &rgbBlock[0], ATTACH_BLOCK, &cbRead, NULL ) )
+		{
+			hRes = MAPI_E_ATTACHMENT_OPEN_FAILURE;
+			break;
+		}
+		if ( 0 == cbRead )
+			break;
+
+		DedupHash ( &rgbBlock[0], cbRead, ATTACH_SEED, rgullHash );
+		rgullHashes.push_back ( rgullHash[0] );
+		rgullHashes.push_back ( rgullHash[1] );
+
+		if ( !WriteFile ( hCopy, &rgbBlock[0], cbRead, &cbWritten, NULL ) || cbWritten != cbRead )
+		{
+			hRes = MAPI_E_ATTACHMENT_WRITE_FAILURE;
+			break;
+		}
+		cbCopied += cbRead;
+	}
+	CloseHandle ( hSource );
+	CloseHandle ( hCopy );
+
+	if ( SUCCESS_SUCCESS != hRes )
+	{
+		DeleteFile ( szTempFile );
+		return hRes;
+	}
+
+	// The length is hashed too, so an empty file has a name of its own.
+	rgullHashes.push_back ( cbCopied );
+	DedupHash ( (const BYTE *) &rgullHashes[0], rgullHashes.size ( ) * sizeof ( ULONGLONG ), ATTACH_SEED, rgullHash );
+	sprintf ( szName, "%016llx%016llx", rgullHash[0], rgullHash[1] );
+
+	*psCopyPath = m_sDir + "\\" + szName;
+	if ( std::string::npos != ichExt && sFileName.size ( ) - ichExt <= 16 )
+		*psCopyPath += sFileName.substr ( ichExt );
+
+	EnterCriticalSection ( &m_csLock );
+	if ( INVALID_FILE_ATTRIBUTES != GetFileAttributes ( psCopyPath -> c_str ( ) ) )
+	{
+		DeleteFile ( szTempFile );
+		m_Stats.cShared++;
+	}
+	else if ( MoveFileEx ( szTempFile, psCopyPath -> c_str ( ), 0L ) )
+	{
+		m_rgsCreated.push_back ( *psCopyPath );
+		m_Stats.cCopied++;
+		m_Stats.cbCopied += cbCopied;
+	}
+	else
+	{
+		DeleteFile ( szTempFile );
+		hRes = MAPI_E_ATTACHMENT_WRITE_FAILURE;
+	}
+	LeaveCriticalSection ( &m_csLock );
+
+	return hRes;
+}
+
+void CAttachCache::GetStats ( LPATTACHSTATS lpStats )
+{
+	EnterCriticalSection ( &m_csLock );
+	*lpStats = m_Stats;
+	LeaveCriticalSection ( &m_csLock );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cPrepareAttachments ( )
+|
+|	Parameters:	[IN/OUT] prgFiles == The files, with sPath set. The rest
+|				of each is filled in.
+|
+|	Purpose:	Checks every file and finds or makes its copy, on up to
+|				ATTACH_WORKERS threads. Returns the failure of the first
+|				file, in order, that failed; the others are still
+|				prepared.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cPrepareAttachments ( std::vector<ATTACHFILE> *prgFiles )
+{
+	CWorkerThreads Workers;
+	ATTACHCONTEXT Ctx;
+
+	if ( NULL == m_pAttachCache )
+		m_pAttachCache = new CAttachCache;
+
+	Ctx.pCache = m_pAttachCache;
+	Ctx.prgFiles = prgFiles;
+	Ctx.iNext = 0;
+
+	// Several files are worth the threads; their checks wait on the disk
+	// or the network rather than on each other.
+	if ( prgFiles -> size ( ) < 2 ||
+		 FAILED ( Workers.Start ( min ( (ULONG) prgFiles -> size ( ), (ULONG) ATTACH_WORKERS ), AttachWorker, &Ctx ) ) )
+		AttachWorker ( 0, &Ctx );
+	Workers.Join ( );
+
+	for ( size_t i = 0; i < prgFiles -> size ( ); i++ )
+	{
+		if ( SUCCESS_SUCCESS != ( *prgFiles )[i].hRes )
+			return ( *prgFiles )[i].hRes;
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSendFiles ( )
+|
+|	Parameters:	[IN] lpMessage == The message, without attachments.
+|
+|				[IN] rgsPaths == Files to attach, of any number and path
+|				length.
+|
+|				[IN] flFlags == MAPISendMail flags.
+|
+|				[OUT] prgFiles == Receives the outcome for each file. May
+|				be NULL.
+|
+|	Purpose:	Sends the message with the files attached. Each is sent
+|				from its copy in the attachment cache (Attach.h) under its
+|				own file name. Nothing is sent if a file is missing or
+|				cannot be copied.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSendFiles ( lpMapiMessage lpMessage, const std::vector<std::string> &rgsPaths, FLAGS flFlags,
+								std::vector<ATTACHFILE> *prgFiles )
+{
+	HRESULT hRes = S_OK;
+	std::vector<ATTACHFILE> rgFiles ( rgsPaths.size ( ) );
+	std::vector<MapiFileDesc> rgFileDescs ( rgsPaths.size ( ) );
+	ULONG nFileCount = lpMessage -> nFileCount;
+	lpMapiFileDesc lpFiles = lpMessage -> lpFiles;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	for ( size_t i = 0; i < rgsPaths.size ( ); i++ )
+	{
+		rgFiles[i].sPath = rgsPaths[i];
+		rgFiles[i].hRes = MAPI_E_ATTACHMENT_NOT_FOUND;
+	}
+
+	if ( SUCCESS_SUCCESS == ( hRes = cPrepareAttachments ( &rgFiles ) ) )
+	{
+		for ( size_t i = 0; i < rgFiles.size ( ); i++ )
+		{
+			ZeroMemory ( &rgFileDescs[i], sizeof ( MapiFileDesc ) );
+			rgFileDescs[i].nPosition = (ULONG) -1;		// Not placed in the text
+			rgFileDescs[i].lpszPathName = (LPSTR) rgFiles[i].sCopyPath.c_str ( );
+			rgFileDescs[i].lpszFileName = (LPSTR) rgFiles[i].sFileName.c_str ( );
+		}
+
+		lpMessage -> nFileCount = (ULONG) rgFileDescs.size ( );
+		lpMessage -> lpFiles = rgFileDescs.empty ( ) ? NULL : &rgFileDescs[0];
+		hRes = m_MAPISendMail ( m_lhSession, 0L, lpMessage, flFlags, 0L );
+		lpMessage -> nFileCount = nFileCount;
+		lpMessage -> lpFiles = lpFiles;
+	}
+
+	if ( prgFiles )
+		prgFiles -> swap ( rgFiles );
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cGetAttachStats ( )
+|
+|	Parameters:	[OUT] lpStats == Receives the attachment cache counters.
+|				All zero when no file has been attached.
+|
+|	Purpose:	Reports how many attached files needed a new copy.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cGetAttachStats ( LPATTACHSTATS lpStats )
+{
+	ZeroMemory ( lpStats, sizeof ( ATTACHSTATS ) );
+
+	if ( m_pAttachCache )
+		m_pAttachCache -> GetStats ( lpStats );
+
+	return SUCCESS_SUCCESS;
+}
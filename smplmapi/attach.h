@@ -0,0 +1,68 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Attach.h
+|
+|   Purpose:	Declares CAttachCache, which holds the copies of files
+|				cSendFiles attaches. MAPISendMail opens every attached
+|				file itself, so a message is only as consistent as the
+|				files are while it is sent. cSendFiles instead sends a
+|				copy made when the file is first attached, named for a
+|				hash of its content:
+|
+|					%TEMP%\smplmapi.att\<process>\<hash>.<extension>
+|
+|				The cache remembers the copy of each path, together
+|				with the size and time of the file it was made from, so
+|				a file attached to many messages is copied once and
+|				later only checked. Files with the same content share
+|				one copy. A path of any length may be attached; the
+|				copy always has a short path, which any provider can
+|				open.
+|
+|				Each process has a directory of its own, so copies this
+|				cache made are deleted with it without touching a copy
+|				another process is still sending.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _ATTACH_H
+#define _ATTACH_H
+
+#include "swap.h"
+#include <map>
+
+#define ATTACH_WORKERS			8				// Files checked and copied in parallel
+#define ATTACH_BLOCK			( 1024 * 1024 )	// Bytes read, hashed and written at a time
+#define ATTACH_SEED				0x48435441UL	// "ATCH"
+#define szATTACHDIR				"smplmapi.att"	// Under the temporary directory
+
+class CAttachCache
+{
+private:
+	// The copy of one path and the file it was made from.
+	typedef struct _ATTACHCOPY
+	{
+		ULONGLONG	cbFile;
+		FILETIME	ftLastWrite;
+		std::string	sCopyPath;
+	} ATTACHCOPY;
+
+	CRITICAL_SECTION					m_csLock;	// Guards everything below
+	std::string							m_sDir;
+	std::map<std::string, ATTACHCOPY>	m_Copies;	// By full path, in upper case
+	std::vector<std::string>			m_rgsCreated;
+	ATTACHSTATS							m_Stats;
+
+	HRESULT	Copy ( const std::string &sLongPath, const std::string &sFileName, std::string *psCopyPath );
+
+public:
+	CAttachCache ( );
+	~CAttachCache ( );
+
+	HRESULT	Prepare ( ATTACHFILE *pFile );
+	void	GetStats ( LPATTACHSTATS lpStats );
+};
+
+#endif
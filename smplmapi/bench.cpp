@@ -0,0 +1,1402 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Bench.cpp
+|
+|   Purpose:	Benchmarks for the listing, reading and sending code.
+|				Each benchmark builds a stand-in store, binds a CApp to
+|				it with cInitStandIn and reports elapsed time together
+|				with the number of provider calls made.
+|
++---------------------------------------------------------------------
+*/
+
+#include "bench.h"
+#include "standin.h"
+#include "msgidtbl.h"
+#include "rtfcomp.h"
+#include "crc32.h"
+#include "workpool.h"
+#include "textscan.h"
+#include "convtree.h"
+#include "dedup.h"
+#include "outbox.h"
+#include "mailmerge.h"
+#include "bulksend.h"
+
+#define BENCH_INBOX_SIZE		20000
+#define BENCH_LATENCY_INBOX		2000
+#define BENCH_READ_LATENCY		4		// Milliseconds per stand-in MAPIReadMail
+#define BENCH_CACHE_INBOX		5000
+#define BENCH_CACHE_LATENCY		1		// Milliseconds per stand-in MAPIReadMail
+#define BENCH_MSGID_INBOX		100000
+#define BENCH_UNREAD_INBOX		30000	// Every third stand-in message is unread
+#define BENCH_BODY_INBOX		2000
+#define BENCH_BODY_READS		10000
+#define BENCH_RTF_BODIES		1000
+#define BENCH_RTF_PASSES		20
+#define BENCH_SEARCH_INBOX		100000
+#define BENCH_SEARCH_PASSES		20
+#define BENCH_SEARCH_READS		2000
+#define BENCH_SCAN_MESSAGES		2000	// Distinct stand-in texts in the corpus
+#define BENCH_SCAN_CORPUS		( 512 * 1024 * 1024 )
+#define BENCH_GREP_INBOX		20000
+#define BENCH_THREAD_INBOX		100000
+#define BENCH_THREAD_NEW		1000	// Messages added one at a time to a built tree
+#define BENCH_DEDUP_INBOX		100000
+#define BENCH_DEDUP_EVERY		25		// One message in this many is copied
+#define BENCH_BULK_RECIPIENTS	2000
+#define BENCH_SEND_LATENCY		2		// Milliseconds per stand-in MAPISendMail
+#define BENCH_OUTBOX_MESSAGES	200
+#define BENCH_OUTBOX_LATENCY	20		// Milliseconds per stand-in MAPISendMail
+#define BENCH_MERGE_MESSAGES	100000
+#define BENCH_PACK_RECIPIENTS	5000
+#define BENCH_PACK_DUPLICATES	10		// One recipient in this many appears twice
+#define BENCH_PACK_LIMIT		100		// Recipients the stand-in accepts per message
+#define BENCH_ATTACH_FILES		20
+#define BENCH_ATTACH_SIZE		( 1024 * 1024 )
+#define BENCH_ATTACH_SENDS		50
+#define szBENCHCURSORFILE		"bench.cur"
+#define szBENCHCACHEFILE		"bench.hdc"
+#define szBENCHINDEXFILE		"bench.idx"
+#define szBENCHOUTBOXFILE		"bench.obx"
+#define szBENCHATTACHFILE		"bench%02lu.att"
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	ElapsedMs()
+|
+|	Purpose:	Returns the milliseconds elapsed since liStart was read
+|				from QueryPerformanceCounter.
+|
++---------------------------------------------------------------------
+*/
+static double ElapsedMs ( LARGE_INTEGER liStart )
+{
+	LARGE_INTEGER liNow, liFreq;
+
+	QueryPerformanceCounter ( &liNow );
+	QueryPerformanceFrequency ( &liFreq );
+
+	return (double) ( liNow.QuadPart - liStart.QuadPart ) * 1000.0 / (double) liFreq.QuadPart;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchHeaderFetch()
+|
+|	Purpose:	Lists the whole stand-in Inbox through cFetchInboxHeaders
+|				HEADER_BATCH_SIZE at a time and reports throughput and
+|				the provider calls made per header. The stand-in has no
+|				contents table, so this is the Simple MAPI path, where
+|				every header costs a MAPIFindNext and a MAPIReadMail
+|				whatever the batch size; with a table a batch is one
+|				QueryRows.
+|
++---------------------------------------------------------------------
+*/
+static void BenchHeaderFetch ( void )
+{
+	CApp App;
+	char szSeedMsgID[MAX_MSGID] = {0};
+	MSGHEADERLIST Headers;
+	ULONG cHeaders = 0L;
+	STANDINSTATS Stats;
+	LARGE_INTEGER liStart;
+	double dMs = 0.0;
+
+	printf ( "\r\nHeader fetch, %d messages.\r\n", BENCH_INBOX_SIZE );
+	StandInCreateStore ( BENCH_INBOX_SIZE );
+	StandInSetLatency ( 0L, 0L );
+
+	App.cInitStandIn ( );
+	StandInResetStats ( );
+	QueryPerformanceCounter ( &liStart );
+
+	while ( SUCCESS_SUCCESS == App.cFetchInboxHeaders ( szSeedMsgID, HEADER_BATCH_SIZE, &Headers ) )
+	{
+		cHeaders += (ULONG) Headers.size ( );
+		Headers.clear ( );
+	}
+
+	dMs = ElapsedMs ( liStart );
+	StandInGetStats ( &Stats );
+	printf ( "  %lu headers in %.1f ms (%.0f headers/s)\r\n",
+			 cHeaders, dMs, cHeaders * 1000.0 / ( dMs > 0.0 ? dMs : 1.0 ) );
+	printf ( "  %ld MAPIFindNext and %ld MAPIReadMail, %.2f calls per header\r\n",
+			 Stats.cFindNext, Stats.cReadMail,
+			 (double) ( Stats.cFindNext + Stats.cReadMail ) / ( cHeaders ? cHeaders : 1 ) );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchParallelPrefetch()
+|
+|	Purpose:	Lists a stand-in Inbox whose envelope reads take
+|				BENCH_READ_LATENCY ms, serially with cFetchInboxHeaders
+|				and then through the pipeline with 1 to 16 workers. The
+|				logons column counts the worker sessions opened; each
+|				listing reuses the sessions of the ones before it.
+|
++---------------------------------------------------------------------
+*/
+static void BenchParallelPrefetch ( void )
+{
+	ULONG rgcWorkers[] = { 1, 2, 4, 8, 16 };
+	CApp App;
+	char szSeedMsgID[MAX_MSGID] = {0};
+	MSGHEADERLIST Headers;
+	STANDINSTATS Stats;
+	LARGE_INTEGER liStart;
+	double dMs = 0.0;
+
+	printf ( "\r\nParallel header prefetch, %d messages, %d ms per envelope read.\r\n",
+			 BENCH_LATENCY_INBOX, BENCH_READ_LATENCY );
+	StandInCreateStore ( BENCH_LATENCY_INBOX );
+	StandInSetLatency ( 0L, BENCH_READ_LATENCY );
+	App.cInitStandIn ( );
+
+	QueryPerformanceCounter ( &liStart );
+	while ( SUCCESS_SUCCESS == App.cFetchInboxHeaders ( szSeedMsgID, HEADER_BATCH_SIZE, &Headers ) )
+		;
+	dMs = ElapsedMs ( liStart );
+	printf ( "  serial    : %lu headers in %8.1f ms (%7.0f headers/s)\r\n",
+			 (ULONG) Headers.size ( ), dMs, Headers.size ( ) * 1000.0 / ( dMs > 0.0 ? dMs : 1.0 ) );
+
+	for ( ULONG i = 0; i < _countof ( rgcWorkers ); i++ )
+	{
+		Headers.clear ( );
+		StandInResetStats ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cFetchInboxHeadersParallel ( rgcWorkers[i], &Headers );
+		dMs = ElapsedMs ( liStart );
+		StandInGetStats ( &Stats );
+		printf ( "  %2lu workers: %lu headers in %8.1f ms (%7.0f headers/s), %ld logons\r\n",
+				 rgcWorkers[i], (ULONG) Headers.size ( ), dMs, Headers.size ( ) * 1000.0 / ( dMs > 0.0 ? dMs : 1.0 ),
+				 Stats.cLogon );
+	}
+
+	StandInSetLatency ( 0L, 0L );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchHeaderCache()
+|
+|	Purpose:	Measures startup to first listing. A cold start has no
+|				header cache and must read every envelope; a warm start
+|				lists from the cache a previous process left behind. The
+|				warm run then reports the cost of the MAPI poll for new
+|				mail and of one revalidation batch, which follow the
+|				listing.
+|
++---------------------------------------------------------------------
+*/
+static void BenchHeaderCache ( void )
+{
+	LARGE_INTEGER liStart;
+	STANDINSTATS Stats;
+	double dMs = 0.0;
+
+	printf ( "\r\nHeader cache startup, %d messages, %d ms per envelope read.\r\n",
+			 BENCH_CACHE_INBOX, BENCH_CACHE_LATENCY );
+	StandInCreateStore ( BENCH_CACHE_INBOX );
+	StandInSetLatency ( 0L, BENCH_CACHE_LATENCY );
+	DeleteFile ( szBENCHCURSORFILE );
+	DeleteFile ( szBENCHCACHEFILE );
+
+	// Each block is a separate "process": the CApp and its mapping go away
+	// at the closing brace.
+	{
+		CApp App;
+		MSGHEADERLIST View;
+		ULONG cNew = 0L;
+
+		App.cInitStandIn ( );
+		StandInResetStats ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cOpenHeaderCache ( szBENCHCACHEFILE );
+		if ( SUCCESS_SUCCESS != App.cLoadCachedInboxHeaders ( szBENCHCURSORFILE, &View ) )
+			App.cFetchNewInboxHeaders ( szBENCHCURSORFILE, &View, &cNew );
+		dMs = ElapsedMs ( liStart );
+		StandInGetStats ( &Stats );
+		printf ( "  cold start: %lu headers listed after %8.1f ms, %ld MAPIReadMail\r\n",
+				 (ULONG) View.size ( ), dMs, Stats.cReadMail );
+	}
+
+	{
+		CApp App;
+		MSGHEADERLIST View, Current;
+		ULONG cNew = 0L;
+
+		App.cInitStandIn ( );
+		StandInResetStats ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cOpenHeaderCache ( szBENCHCACHEFILE );
+		if ( SUCCESS_SUCCESS != App.cLoadCachedInboxHeaders ( szBENCHCURSORFILE, &View ) )
+			App.cFetchNewInboxHeaders ( szBENCHCURSORFILE, &View, &cNew );
+		dMs = ElapsedMs ( liStart );
+		StandInGetStats ( &Stats );
+		printf ( "  warm start: %lu headers listed after %8.1f ms, %ld MAPIReadMail\r\n",
+				 (ULONG) View.size ( ), dMs, Stats.cReadMail );
+
+		StandInResetStats ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cFetchNewInboxHeaders ( szBENCHCURSORFILE, &Current, &cNew );
+		dMs = ElapsedMs ( liStart );
+		StandInGetStats ( &Stats );
+		printf ( "  new mail  : %lu new after %8.1f ms, %ld MAPIFindNext\r\n", cNew, dMs, Stats.cFindNext );
+
+		StandInResetStats ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cRevalidateHeaderCache ( CACHE_REVALIDATE_BATCH );
+		dMs = ElapsedMs ( liStart );
+		StandInGetStats ( &Stats );
+		printf ( "  revalidate: %d headers in %8.1f ms, %ld MAPIReadMail\r\n",
+				 CACHE_REVALIDATE_BATCH, dMs, Stats.cReadMail );
+	}
+
+	DeleteFile ( szBENCHCURSORFILE );
+	DeleteFile ( szBENCHCACHEFILE );
+	StandInSetLatency ( 0L, 0L );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchMsgIDTable()
+|
+|	Purpose:	Lists a large stand-in Inbox and reports the memory its
+|				interned message IDs take, next to what the same IDs
+|				cost as MAX_MSGID buffers, and how long it takes to
+|				look every ID up again by text.
+|
++---------------------------------------------------------------------
+*/
+static void BenchMsgIDTable ( void )
+{
+	LARGE_INTEGER liStart;
+	MSGIDSTATS Stats;
+	ULONGLONG cbTable = 0;
+	ULONG cFound = 0L;
+	double dMs = 0.0;
+	CApp App;
+	MSGHEADERLIST Headers;
+
+	printf ( "\r\nMessage ID table, %d messages.\r\n", BENCH_MSGID_INBOX );
+	StandInCreateStore ( BENCH_MSGID_INBOX );
+	StandInSetLatency ( 0L, 0L );
+	App.cInitStandIn ( );
+
+	QueryPerformanceCounter ( &liStart );
+	App.cFetchInboxHeadersParallel ( PREFETCH_WORKERS, &Headers );
+	dMs = ElapsedMs ( liStart );
+	printf ( "  listed %lu headers in %8.1f ms\r\n", (ULONG) Headers.size ( ), dMs );
+
+	App.cMsgIDTable ( ) -> GetStats ( &Stats );
+	cbTable = Stats.cbArena + Stats.cbDirectory + Stats.cbIndex;
+	printf ( "  %lu IDs: %I64u bytes of text in a %I64u byte arena, %I64u directory, %I64u index\r\n",
+			 Stats.cIDs, Stats.cbText, Stats.cbArena, Stats.cbDirectory, Stats.cbIndex );
+	printf ( "  interned total %8.2f MB, as MAX_MSGID buffers %8.2f MB\r\n",
+			 (double) cbTable / ( 1024.0 * 1024.0 ),
+			 (double) Stats.cIDs * MAX_MSGID / ( 1024.0 * 1024.0 ) );
+
+	QueryPerformanceCounter ( &liStart );
+	for ( size_t i = 0; i < Headers.size ( ); i++ )
+	{
+		if ( App.cMsgIDTable ( ) -> Find ( App.cMsgIDText ( Headers[i].hMsgID ) ) == Headers[i].hMsgID )
+			cFound++;
+	}
+	dMs = ElapsedMs ( liStart );
+	printf ( "  looked up %lu of %lu IDs by text in %8.1f ms\r\n", cFound, (ULONG) Headers.size ( ), dMs );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchUnreadCursor()
+|
+|	Purpose:	Reads and marks read every unread message in a stand-in
+|				Inbox, one at a time as cReadMail does: first finding
+|				each from a NULL seed, then with cFindNextUnread.
+|
++---------------------------------------------------------------------
+*/
+static void BenchUnreadCursor ( void )
+{
+	LARGE_INTEGER liStart;
+	STANDINSTATS Stats;
+	double dMs = 0.0;
+
+	printf ( "\r\nSequential unread reads, %d unread of %d messages.\r\n",
+			 BENCH_UNREAD_INBOX / 3, BENCH_UNREAD_INBOX );
+	StandInSetLatency ( 0L, 0L );
+
+	for ( int fCursor = 0; fCursor < 2; fCursor++ )
+	{
+		CApp App;
+		MSGIDHANDLE hMsgID = MSGID_NONE;
+		ULONG cRead = 0L;
+
+		StandInCreateStore ( BENCH_UNREAD_INBOX );
+		App.cInitStandIn ( );
+		StandInResetStats ( );
+
+		QueryPerformanceCounter ( &liStart );
+		for ( ;; )
+		{
+			HRESULT hRes = fCursor ? App.cFindNextUnread ( &hMsgID )
+								   : App.cFindMessageID ( NULL, MAPI_LONG_MSGID | MAPI_UNREAD_ONLY, &hMsgID );
+
+			if ( SUCCESS_SUCCESS != hRes || SUCCESS_SUCCESS != App.cMarkRead ( hMsgID ) )
+				break;
+			cRead++;
+		}
+		dMs = ElapsedMs ( liStart );
+		StandInGetStats ( &Stats );
+		printf ( "  %s: %lu read in %8.1f ms, %ld MAPIFindNext\r\n",
+				 fCursor ? "cursor   " : "NULL seed", cRead, dMs, Stats.cFindNext );
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchBodyCache()
+|
+|	Purpose:	Reads the text of every message in a stand-in Inbox
+|				with BENCH_CACHE_LATENCY ms per read, cold and then
+|				from the body cache, and then makes BENCH_BODY_READS
+|				reads, four in five of them to a fifth of the messages,
+|				with a budget of a quarter of the text.
+|
++---------------------------------------------------------------------
+*/
+static void BenchBodyCache ( void )
+{
+	LARGE_INTEGER liStart;
+	BODYCACHESTATS Stats;
+	double dMs = 0.0;
+	CApp App;
+	MSGHEADERLIST Headers;
+	std::string sText;
+	ULONG ulRandom = 1L;
+
+	printf ( "\r\nBody cache, %d messages, %d ms per read.\r\n", BENCH_BODY_INBOX, BENCH_CACHE_LATENCY );
+	StandInCreateStore ( BENCH_BODY_INBOX );
+	StandInSetLatency ( 0L, 0L );
+	App.cInitStandIn ( );
+	App.cFetchInboxHeadersParallel ( PREFETCH_WORKERS, &Headers );
+	StandInSetLatency ( 0L, BENCH_CACHE_LATENCY );
+
+	for ( int iPass = 0; iPass < 2; iPass++ )
+	{
+		QueryPerformanceCounter ( &liStart );
+		for ( size_t i = 0; i < Headers.size ( ); i++ )
+			App.cReadBody ( Headers[i].hMsgID, &sText );
+		dMs = ElapsedMs ( liStart );
+		App.cGetBodyCacheStats ( &Stats );
+		printf ( "  %s: %8.1f ms, %I64u hits, %I64u misses\r\n", iPass ? "warm" : "cold", dMs, Stats.cHits, Stats.cMisses );
+	}
+	printf ( "  %lu entries, %lu compressed: %I64u bytes of text held in %I64u\r\n",
+			 Stats.cEntries, Stats.cCompressed, Stats.cbText, Stats.cbResident );
+
+	App.cSetBodyCacheBudget ( 0 );
+	App.cSetBodyCacheBudget ( Stats.cbResident / 4 );
+
+	QueryPerformanceCounter ( &liStart );
+	for ( int i = 0; i < BENCH_BODY_READS; i++ )
+	{
+		size_t iMsg = 0;
+
+		ulRandom = ulRandom * 1103515245 + 12345;
+		iMsg = ( ulRandom >> 8 ) % Headers.size ( );
+		if ( ( ulRandom >> 4 ) % 5 )
+			iMsg %= Headers.size ( ) / 5;
+		App.cReadBody ( Headers[iMsg].hMsgID, &sText );
+	}
+	dMs = ElapsedMs ( liStart );
+	App.cGetBodyCacheStats ( &Stats );
+	printf ( "  skewed, budget %I64u: %8.1f ms, %I64u hits, %I64u misses, %I64u evictions\r\n",
+			 Stats.cbBudget, dMs, Stats.cHits, Stats.cMisses, Stats.cEvictions );
+
+	StandInSetLatency ( 0L, 0L );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchRtfCodec()
+|
+|	Purpose:	Turns the text of BENCH_RTF_BODIES stand-in messages
+|				into RTF bodies, compresses them as PR_RTF_COMPRESSED
+|				and decompresses them BENCH_RTF_PASSES times, and
+|				reports the ratio and the throughput of each step and
+|				of the CRC alone.
+|
++---------------------------------------------------------------------
+*/
+static void BenchRtfCodec ( void )
+{
+	LARGE_INTEGER liStart;
+	CApp App;
+	MSGHEADERLIST Headers;
+	std::string sText;
+	std::string sRtf;
+	std::vector<std::string> rgsRtf;
+	std::vector< std::vector<BYTE> > rgrgbComp;
+	ULONGLONG cbRtf = 0;
+	ULONGLONG cbComp = 0;
+	ULONG ulCrc = 0L;
+	int cFailed = 0;
+	double dMs = 0.0;
+	double dMB = 0.0;
+
+	printf ( "\r\nCompressed RTF, %d bodies.\r\n", BENCH_RTF_BODIES );
+	StandInCreateStore ( BENCH_RTF_BODIES );
+	StandInSetLatency ( 0L, 0L );
+	App.cInitStandIn ( );
+	App.cFetchInboxHeadersParallel ( PREFETCH_WORKERS, &Headers );
+
+	for ( size_t i = 0; i < Headers.size ( ); i++ )
+	{
+		App.cReadBody ( Headers[i].hMsgID, &sText );
+
+		sRtf = "{\\rtf1\\ansi\\ansicpg1252\\deff0{\\fonttbl{\\f0\\fswiss Arial;}}\r\n"
+			   "\\pard\\plain\\f0\\fs20 ";
+		for ( size_t ich = 0; ich < sText.size ( ); ich++ )
+		{
+			if ( '\n' == sText[ich] )
+				sRtf += "\\par\r\n";
+			else if ( '\r' != sText[ich] )
+				sRtf += sText[ich];
+		}
+		sRtf += "\\par\r\n}\r\n";
+
+		cbRtf += sRtf.size ( );
+		rgsRtf.push_back ( sRtf );
+	}
+	dMB = (double) cbRtf / ( 1024.0 * 1024.0 );
+
+	rgrgbComp.resize ( rgsRtf.size ( ) );
+	QueryPerformanceCounter ( &liStart );
+	for ( size_t i = 0; i < rgsRtf.size ( ); i++ )
+	{
+		RtfCompress ( (const BYTE *) rgsRtf[i].c_str ( ), rgsRtf[i].size ( ), &rgrgbComp[i] );
+		cbComp += rgrgbComp[i].size ( );
+	}
+	dMs = ElapsedMs ( liStart );
+	printf ( "  compress:   %8.1f ms, %7.1f MB/s, %.1f%% of %I64u bytes\r\n",
+			 dMs, dMB * 1000.0 / dMs, 100.0 * cbComp / cbRtf, cbRtf );
+
+	QueryPerformanceCounter ( &liStart );
+	for ( int iPass = 0; iPass < BENCH_RTF_PASSES; iPass++ )
+		for ( size_t i = 0; i < rgrgbComp.size ( ); i++ )
+			if ( S_OK != RtfDecompress ( &rgrgbComp[i][0], rgrgbComp[i].size ( ), &sRtf ) || sRtf != rgsRtf[i] )
+				cFailed++;
+	dMs = ElapsedMs ( liStart );
+	printf ( "  decompress: %8.1f ms, %7.1f MB/s of RTF, %d mismatched\r\n",
+			 dMs, dMB * BENCH_RTF_PASSES * 1000.0 / dMs, cFailed );
+
+	QueryPerformanceCounter ( &liStart );
+	for ( int iPass = 0; iPass < BENCH_RTF_PASSES; iPass++ )
+		for ( size_t i = 0; i < rgsRtf.size ( ); i++ )
+			ulCrc = Crc32 ( ulCrc, (const BYTE *) rgsRtf[i].c_str ( ), rgsRtf[i].size ( ) );
+	dMs = ElapsedMs ( liStart );
+	printf ( "  CRC:        %8.1f ms, %7.1f MB/s (%08lX)\r\n", dMs, dMB * BENCH_RTF_PASSES * 1000.0 / dMs, ulCrc );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchSearchIndex()
+|
+|	Purpose:	Indexes a BENCH_SEARCH_INBOX message stand-in Inbox
+|				with one worker and with one per processor, reopens
+|				the index as a new process would, times a mix of
+|				queries and then the cost indexing adds to reading
+|				BENCH_SEARCH_READS messages with cReadBody.
+|
++---------------------------------------------------------------------
+*/
+static void BenchSearchIndex ( void )
+{
+	LPCSTR rglpszQueries[] =
+	{
+		"budget",
+		"subject:4712",
+		"\"design review\"",
+		"lunch OR travel",
+		"from:alice -subject:re",
+		"\"stands in for the body\"",
+		"\"real message\" grace -budget"
+	};
+	ULONG rgcWorkers[] = { 1, CWorkerThreads::ProcessorCount ( ) };
+	LARGE_INTEGER liStart;
+	SEARCHSTATS Stats;
+	std::vector<MSGIDHANDLE> rghMsgIDs;
+	std::string sText;
+	double dMs = 0.0;
+
+	printf ( "\r\nFull-text index, %d messages.\r\n", BENCH_SEARCH_INBOX );
+	StandInCreateStore ( BENCH_SEARCH_INBOX );
+	StandInSetLatency ( 0L, 0L );
+
+	for ( ULONG i = 0; i < _countof ( rgcWorkers ); i++ )
+	{
+		CApp App;
+		ULONG cAdded = 0L;
+
+		DeleteFile ( szBENCHINDEXFILE );
+		App.cInitStandIn ( );
+		App.cOpenSearchIndex ( szBENCHINDEXFILE );
+
+		QueryPerformanceCounter ( &liStart );
+		App.cBuildSearchIndex ( rgcWorkers[i], &cAdded );
+		dMs = ElapsedMs ( liStart );
+		printf ( "  build, %2lu workers: %lu messages in %8.1f ms (%7.0f messages/s)\r\n",
+				 rgcWorkers[i], cAdded, dMs, cAdded * 1000.0 / ( dMs > 0.0 ? dMs : 1.0 ) );
+	}
+
+	{
+		CApp App;
+
+		App.cInitStandIn ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cOpenSearchIndex ( szBENCHINDEXFILE );
+		dMs = ElapsedMs ( liStart );
+		App.cGetSearchIndexStats ( &Stats );
+		printf ( "  reopen: %8.1f ms, %lu messages, %lu segments, %I64u bytes\r\n",
+				 dMs, Stats.cDocs, Stats.cSegments, Stats.cbFile );
+
+		for ( ULONG i = 0; i < _countof ( rglpszQueries ); i++ )
+		{
+			QueryPerformanceCounter ( &liStart );
+			for ( int iPass = 0; iPass < BENCH_SEARCH_PASSES; iPass++ )
+				App.cSearchInbox ( rglpszQueries[i], &rghMsgIDs );
+			dMs = ElapsedMs ( liStart ) / BENCH_SEARCH_PASSES;
+			printf ( "  %-32s %7.2f ms, %lu matches\r\n", rglpszQueries[i], dMs, (ULONG) rghMsgIDs.size ( ) );
+		}
+	}
+
+	// Messages read with an index open are indexed as they are read.
+	for ( int fIndex = 0; fIndex < 2; fIndex++ )
+	{
+		CApp App;
+		MSGHEADERLIST Headers;
+
+		DeleteFile ( szBENCHINDEXFILE );
+		App.cInitStandIn ( );
+		App.cFetchInboxHeadersParallel ( PREFETCH_WORKERS, &Headers );
+		if ( fIndex )
+			App.cOpenSearchIndex ( szBENCHINDEXFILE );
+
+		QueryPerformanceCounter ( &liStart );
+		for ( size_t i = 0; i < BENCH_SEARCH_READS && i < Headers.size ( ); i++ )
+			App.cReadBody ( Headers[i].hMsgID, &sText );
+		dMs = ElapsedMs ( liStart );
+		printf ( "  read %d messages %s: %8.1f ms\r\n", BENCH_SEARCH_READS, fIndex ? "and index them" : "           ", dMs );
+	}
+
+	DeleteFile ( szBENCHINDEXFILE );
+}
+
+// Work shared by the threads of BenchTextScan.
+typedef struct _BENCHSCAN
+{
+	const CTextScanner					*pScanner;
+	const std::vector<std::string>		*prgsTexts;
+	volatile LONG						iNext;
+	volatile LONG						cMatches;
+} BENCHSCAN;
+
+static DWORD BenchScanWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	BENCHSCAN *pScan = (BENCHSCAN *) lpvContext;
+	LONG cTexts = (LONG) pScan -> prgsTexts -> size ( );
+	LONG iFirst = 0;
+
+	while ( ( iFirst = InterlockedExchangeAdd ( &pScan -> iNext, SCAN_BATCH ) ) < cTexts )
+	{
+		for ( LONG i = iFirst; i < iFirst + SCAN_BATCH && i < cTexts; i++ )
+		{
+			const std::string &sText = ( *pScan -> prgsTexts )[i];
+
+			if ( pScan -> pScanner -> Find ( sText.c_str ( ), sText.size ( ) ) )
+				InterlockedIncrement ( &pScan -> cMatches );
+		}
+	}
+
+	return 0;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchTextScan()
+|
+|	Purpose:	Builds a corpus of BENCH_SCAN_CORPUS bytes from the text
+|				of stand-in messages and looks in it for a pattern it
+|				does not hold, so every byte is scanned: with strstr,
+|				which is case-sensitive, with _strnicmp at every
+|				position, and with CTextScanner at each level and on
+|				1 to ProcessorCount threads. Then greps a stand-in
+|				Inbox with cGrepInbox, reading the text and then from
+|				the body cache.
+|
++---------------------------------------------------------------------
+*/
+static void BenchTextScan ( void )
+{
+	static const char szPattern[] = "Quarterly Forecast";
+	static LPCSTR rglpszLevels[] = { "scalar", "SSE2", "AVX2" };
+	LARGE_INTEGER liStart;
+	std::vector<std::string> rgsTexts;
+	std::string sText;
+	ULONGLONG cbCorpus = 0;
+	double dMB = 0.0;
+	double dMs = 0.0;
+	LONG cMatches = 0;
+
+	printf ( "\r\nSubstring scan for \"%s\", processor supports %s.\r\n",
+			 szPattern, rglpszLevels[CTextScanner::CpuLevel ( )] );
+	StandInCreateStore ( BENCH_SCAN_MESSAGES );
+	StandInSetLatency ( 0L, 0L );
+
+	{
+		CApp App;
+		MSGHEADERLIST Headers;
+
+		App.cInitStandIn ( );
+		App.cSetBodyCacheBudget ( 0 );
+		App.cFetchInboxHeadersParallel ( PREFETCH_WORKERS, &Headers );
+		while ( cbCorpus < BENCH_SCAN_CORPUS )
+		{
+			App.cReadBody ( Headers[rgsTexts.size ( ) % Headers.size ( )].hMsgID, &sText );
+			cbCorpus += sText.size ( );
+			rgsTexts.push_back ( sText );
+		}
+	}
+	dMB = (double) cbCorpus / ( 1024.0 * 1024.0 );
+	printf ( "  %lu messages, %.0f MB\r\n", (ULONG) rgsTexts.size ( ), dMB );
+
+	QueryPerformanceCounter ( &liStart );
+	for ( size_t i = 0; i < rgsTexts.size ( ); i++ )
+		if ( strstr ( rgsTexts[i].c_str ( ), szPattern ) )
+			cMatches++;
+	dMs = ElapsedMs ( liStart );
+	printf ( "  strstr, case-sensitive:  %8.1f ms, %7.1f MB/s, %ld matches\r\n", dMs, dMB * 1000.0 / dMs, cMatches );
+
+	cMatches = 0;
+	QueryPerformanceCounter ( &liStart );
+	for ( size_t i = 0; i < rgsTexts.size ( ); i++ )
+	{
+		LPCSTR lpsz = rgsTexts[i].c_str ( );
+
+		for ( ; *lpsz; lpsz++ )
+		{
+			if ( 0 == _strnicmp ( lpsz, szPattern, sizeof ( szPattern ) - 1 ) )
+			{
+				cMatches++;
+				break;
+			}
+		}
+	}
+	dMs = ElapsedMs ( liStart );
+	printf ( "  _strnicmp at each byte:  %8.1f ms, %7.1f MB/s, %ld matches\r\n", dMs, dMB * 1000.0 / dMs, cMatches );
+
+	for ( ULONG ulLevel = SCAN_SCALAR; ulLevel <= CTextScanner::CpuLevel ( ); ulLevel++ )
+	{
+		CTextScanner Scanner;
+
+		Scanner.Init ( szPattern, ulLevel );
+		cMatches = 0;
+		QueryPerformanceCounter ( &liStart );
+		for ( size_t i = 0; i < rgsTexts.size ( ); i++ )
+			if ( Scanner.Find ( rgsTexts[i].c_str ( ), rgsTexts[i].size ( ) ) )
+				cMatches++;
+		dMs = ElapsedMs ( liStart );
+		printf ( "  CTextScanner, %-6s     %8.1f ms, %7.1f MB/s, %ld matches\r\n",
+				 rglpszLevels[ulLevel], dMs, dMB * 1000.0 / dMs, cMatches );
+	}
+
+	for ( ULONG cWorkers = 1; cWorkers <= CWorkerThreads::ProcessorCount ( ); cWorkers *= 2 )
+	{
+		CTextScanner Scanner;
+		CWorkerThreads Workers;
+		BENCHSCAN Scan = { &Scanner, &rgsTexts, 0, 0 };
+
+		Scanner.Init ( szPattern, SCAN_BEST );
+		QueryPerformanceCounter ( &liStart );
+		Workers.Start ( cWorkers, BenchScanWorker, &Scan );
+		Workers.Join ( );
+		dMs = ElapsedMs ( liStart );
+		printf ( "  CTextScanner, %2lu threads: %8.1f ms, %7.1f MB/s, %ld matches\r\n",
+				 cWorkers, dMs, dMB * 1000.0 / dMs, Scan.cMatches );
+	}
+	rgsTexts.clear ( );
+
+	{
+		CApp App;
+		MSGHEADERLIST Matches;
+
+		printf ( "  cGrepInbox, %d messages, %d ms per read:\r\n", BENCH_GREP_INBOX, BENCH_CACHE_LATENCY );
+		StandInCreateStore ( BENCH_GREP_INBOX );
+		App.cInitStandIn ( );
+		StandInSetLatency ( 0L, BENCH_CACHE_LATENCY );
+
+		for ( int iPass = 0; iPass < 2; iPass++ )
+		{
+			QueryPerformanceCounter ( &liStart );
+			App.cGrepInbox ( "grace green", CWorkerThreads::ProcessorCount ( ) * 4, &Matches );
+			dMs = ElapsedMs ( liStart );
+			printf ( "    %s: %8.1f ms, %lu matches\r\n", iPass ? "cached" : "read  ", dMs, (ULONG) Matches.size ( ) );
+		}
+		StandInSetLatency ( 0L, 0L );
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchConversations()
+|
+|	Purpose:	Threads a quarter, half and all of BENCH_THREAD_INBOX
+|				stand-in headers with CConversationTree, in delivery
+|				order and shuffled so replies often come before the
+|				messages they answer, and builds the view of each.
+|				Then adds BENCH_THREAD_NEW messages one at a time to a
+|				tree of the rest, building the view after each.
+|
++---------------------------------------------------------------------
+*/
+static void BenchConversations ( void )
+{
+	LARGE_INTEGER liStart;
+	MSGHEADERLIST Headers;
+	MSGHEADERLIST Shuffled;
+	std::vector<CONVROW> rgRows;
+	ULONG ulSeed = 1;
+	double dMsAdd = 0.0;
+	double dMsView = 0.0;
+
+	printf ( "\r\nThreading %d stand-in messages by conversation index and subject.\r\n", BENCH_THREAD_INBOX );
+	StandInCreateStore ( BENCH_THREAD_INBOX );
+	StandInSetLatency ( 0L, 0L );
+
+	{
+		CApp App;
+
+		App.cInitStandIn ( );
+		App.cFetchInboxHeadersParallel ( PREFETCH_WORKERS, &Headers );
+	}
+
+	for ( int iOrder = 0; iOrder < 2; iOrder++ )
+	{
+		printf ( "  %s:\r\n", iOrder ? "Shuffled" : "In delivery order" );
+		for ( ULONG cMessages = BENCH_THREAD_INBOX / 4; cMessages <= BENCH_THREAD_INBOX; cMessages *= 2 )
+		{
+			CConversationTree Tree;
+			ULONG cConversations = 0L;
+
+			Shuffled.assign ( Headers.begin ( ), Headers.begin ( ) + cMessages );
+			for ( ULONG i = cMessages - 1; iOrder && i > 0; i-- )
+			{
+				ulSeed = ulSeed * 1103515245 + 12345;
+				std::swap ( Shuffled[i], Shuffled[( ulSeed >> 8 ) % ( i + 1 )] );
+			}
+
+			QueryPerformanceCounter ( &liStart );
+			for ( ULONG i = 0; i < cMessages; i++ )
+				Tree.Add ( Shuffled[i] );
+			dMsAdd = ElapsedMs ( liStart );
+
+			QueryPerformanceCounter ( &liStart );
+			Tree.GetView ( &rgRows );
+			dMsView = ElapsedMs ( liStart );
+
+			for ( size_t i = 0; i < rgRows.size ( ); i++ )
+				if ( 0 == i || rgRows[i].iConversation != rgRows[i - 1].iConversation )
+					cConversations++;
+			printf ( "    %6lu messages: add %7.1f ms (%.2f us each), view %6.1f ms, %lu conversations\r\n",
+					 cMessages, dMsAdd, dMsAdd * 1000.0 / cMessages, dMsView, cConversations );
+		}
+	}
+
+	{
+		CConversationTree Tree;
+
+		for ( ULONG i = 0; i < BENCH_THREAD_INBOX - BENCH_THREAD_NEW; i++ )
+			Tree.Add ( Headers[i] );
+
+		dMsAdd = 0.0;
+		dMsView = 0.0;
+		for ( ULONG i = BENCH_THREAD_INBOX - BENCH_THREAD_NEW; i < BENCH_THREAD_INBOX; i++ )
+		{
+			QueryPerformanceCounter ( &liStart );
+			Tree.Add ( Headers[i] );
+			dMsAdd += ElapsedMs ( liStart );
+
+			QueryPerformanceCounter ( &liStart );
+			Tree.GetView ( &rgRows );
+			dMsView += ElapsedMs ( liStart );
+		}
+		printf ( "  %d new messages, one at a time: add %.2f us each, view %.1f ms each\r\n",
+				 BENCH_THREAD_NEW, dMsAdd * 1000.0 / BENCH_THREAD_NEW, dMsView / BENCH_THREAD_NEW );
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchDuplicates()
+|
+|	Purpose:	Copies one in BENCH_DEDUP_EVERY messages of a stand-in
+|				Inbox of BENCH_DEDUP_INBOX and finds the copies with
+|				cFindDuplicates on 1 to ProcessorCount workers, then
+|				deletes them with cDeleteMessages and scans again.
+|
++---------------------------------------------------------------------
+*/
+static void BenchDuplicates ( void )
+{
+	LARGE_INTEGER liStart;
+	std::vector<MSGDUPLICATE> Duplicates;
+	std::vector<MSGIDHANDLE> rghDelete;
+	DEDUPSTATS Stats;
+	STANDINSTATS CallStats;
+	double dMs = 0.0;
+	ULONG cDeleted = 0L;
+
+	printf ( "\r\nDuplicate scan of %d stand-in messages, one in %d copied.\r\n", BENCH_DEDUP_INBOX, BENCH_DEDUP_EVERY );
+	printf ( "  Fingerprints take %lu bytes each, %.1f MB for a million messages.\r\n",
+			 (ULONG) sizeof ( DEDUPPRINT ), sizeof ( DEDUPPRINT ) * 1000000.0 / ( 1024.0 * 1024.0 ) );
+	StandInCreateStore ( BENCH_DEDUP_INBOX );
+	StandInCopyMessages ( BENCH_DEDUP_EVERY );
+	StandInSetLatency ( 0L, 0L );
+
+	for ( ULONG cWorkers = 1; cWorkers <= CWorkerThreads::ProcessorCount ( ); cWorkers *= 2 )
+	{
+		CApp App;
+
+		App.cInitStandIn ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cFindDuplicates ( cWorkers, &Duplicates, &Stats );
+		dMs = ElapsedMs ( liStart );
+		printf ( "  %2lu workers: %8.1f ms, %lu messages, %lu duplicates, %.1f MB of fingerprints, %.1f MB of IDs\r\n",
+				 cWorkers, dMs, Stats.cMessages, Stats.cDuplicates, Stats.cbFingerprints / ( 1024.0 * 1024.0 ),
+				 Stats.cbMsgIDs / ( 1024.0 * 1024.0 ) );
+		printf ( "              %lu IDs kept after the scan\r\n", App.cMsgIDTable ( ) -> Count ( ) );
+	}
+
+	{
+		CApp App;
+
+		App.cInitStandIn ( );
+		App.cFindDuplicates ( CWorkerThreads::ProcessorCount ( ), &Duplicates, &Stats );
+		for ( size_t i = 0; i < Duplicates.size ( ); i++ )
+			rghDelete.push_back ( Duplicates[i].hDuplicate );
+
+		StandInResetStats ( );
+		QueryPerformanceCounter ( &liStart );
+		App.cDeleteMessages ( rghDelete, &cDeleted );
+		dMs = ElapsedMs ( liStart );
+		StandInGetStats ( &CallStats );
+		printf ( "  Delete:     %8.1f ms, %lu messages, %ld MAPIDeleteMail calls\r\n", dMs, cDeleted, CallStats.cDeleteMail );
+
+		App.cFindDuplicates ( CWorkerThreads::ProcessorCount ( ), &Duplicates, &Stats );
+		printf ( "  Rescan:     %lu messages, %lu duplicates\r\n", Stats.cMessages, Stats.cDuplicates );
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchBulkSend()
+|
+|	Purpose:	Sends a message to BENCH_BULK_RECIPIENTS recipients
+|				through cBulkSend on 1 to 32 sessions, each sending a
+|				copy of its own, with each stand-in MAPISendMail
+|				taking BENCH_SEND_LATENCY ms, and reports throughput
+|				and send latency.
+|
++---------------------------------------------------------------------
+*/
+static void BenchBulkSend ( void )
+{
+	ULONG rgcWorkers[] = { 1, 2, 4, 8, 16, 32 };
+	std::vector<BULKRECIPIENT> rgRecips;
+	BULKTEMPLATE Template;
+	BULKSENDSTATS Stats;
+	STANDINSTATS CallStats;
+	CApp App;
+	char szAddress[64];
+
+	printf ( "\r\nBulk send to %d recipients, %d ms per send.\r\n", BENCH_BULK_RECIPIENTS, BENCH_SEND_LATENCY );
+	StandInCreateStore ( 0L );
+	StandInSetLatency ( 0L, 0L );
+	App.cInitStandIn ( );
+	App.cSetRecipientLimit ( 1L );
+
+	Template.sSubject = "Nightly notification";
+	Template.sNoteText = "This message stands in for a nightly notification.\r\n";
+	for ( ULONG i = 0; i < BENCH_BULK_RECIPIENTS; i++ )
+	{
+		BULKRECIPIENT Recip;
+
+		sprintf ( szAddress, "SMTP:user%05lu@example.com", i );
+		Recip.sAddress = szAddress;
+		Recip.sName = szAddress + 5;
+		rgRecips.push_back ( Recip );
+	}
+
+	StandInSetLatency ( BENCH_SEND_LATENCY, 0L );
+	for ( ULONG i = 0; i < _countof ( rgcWorkers ); i++ )
+	{
+		StandInResetStats ( );
+		App.cBulkSend ( rgcWorkers[i], Template, rgRecips, NULL, &Stats );
+		StandInGetStats ( &CallStats );
+		printf ( "  %2lu sessions: %lu sent in %8.1f ms (%7.0f/s), latency median %5.2f ms, 99th %5.2f ms, max %6.2f ms, %ld MAPISendMail\r\n",
+				 rgcWorkers[i], Stats.cSent, Stats.dMsElapsed, Stats.dPerSecond,
+				 Stats.dMsMedian, Stats.dMsP99, Stats.dMsMax, CallStats.cSendMail );
+	}
+	StandInSetLatency ( 0L, 0L );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchOutbox()
+|
+|	Purpose:	Sends BENCH_OUTBOX_MESSAGES messages with cSendMail and
+|				submits as many to the outbox, with each stand-in
+|				MAPISendMail taking BENCH_OUTBOX_LATENCY ms. Reports
+|				how long the caller waits for each message, and how
+|				long the outbox takes to send them all.
+|
++---------------------------------------------------------------------
+*/
+static void BenchOutbox ( void )
+{
+	MapiRecipDesc Recip;
+	MapiMessage Message;
+	OUTBOXSTATS Stats;
+	STANDINSTATS CallStats;
+	LARGE_INTEGER liStart;
+	CApp App;
+	double dMs = 0.0;
+	char szAddress[] = "SMTP:someone@example.com";
+
+	printf ( "\r\nSending %d messages, %d ms per send.\r\n", BENCH_OUTBOX_MESSAGES, BENCH_OUTBOX_LATENCY );
+	StandInCreateStore ( 0L );
+	StandInSetLatency ( 0L, 0L );
+	App.cInitStandIn ( );
+	DeleteFile ( szBENCHOUTBOXFILE );
+
+	ZeroMemory ( &Recip, sizeof ( MapiRecipDesc ) );
+	Recip.ulRecipClass = MAPI_TO;
+	Recip.lpszName = szAddress + 5;
+	Recip.lpszAddress = szAddress;
+	ZeroMemory ( &Message, sizeof ( MapiMessage ) );
+	Message.lpszSubject = (LPSTR) "Nightly notification";
+	Message.lpszNoteText = (LPSTR) "This message stands in for a nightly notification.\r\n";
+	Message.nRecipCount = 1L;
+	Message.lpRecips = &Recip;
+
+	StandInSetLatency ( BENCH_OUTBOX_LATENCY, 0L );
+	StandInResetStats ( );
+	QueryPerformanceCounter ( &liStart );
+	for ( ULONG i = 0; i < BENCH_OUTBOX_MESSAGES; i++ )
+		App.cSendMail ( &Message, 0L );
+	dMs = ElapsedMs ( liStart );
+	StandInGetStats ( &CallStats );
+	printf ( "  Synchronous: %8.1f ms, %6.3f ms per message, %ld MAPISendMail\r\n",
+			 dMs, dMs / BENCH_OUTBOX_MESSAGES, CallStats.cSendMail );
+
+	if ( SUCCESS_SUCCESS != App.cOpenOutbox ( szBENCHOUTBOXFILE ) )
+	{
+		printf ( "  The outbox could not be opened.\r\n" );
+		StandInSetLatency ( 0L, 0L );
+		return;
+	}
+
+	StandInResetStats ( );
+	QueryPerformanceCounter ( &liStart );
+	for ( ULONG i = 0; i < BENCH_OUTBOX_MESSAGES; i++ )
+		App.cSubmitMail ( &Message, NULL );
+	dMs = ElapsedMs ( liStart );
+	printf ( "  Submit:      %8.1f ms, %6.3f ms per message\r\n", dMs, dMs / BENCH_OUTBOX_MESSAGES );
+
+	App.cWaitOutbox ( INFINITE );
+	dMs = ElapsedMs ( liStart );
+	StandInGetStats ( &CallStats );
+	App.cGetOutboxStats ( &Stats );
+	printf ( "  Drained:     %8.1f ms, %lu sent, %lu failed, %ld MAPISendMail\r\n",
+			 dMs, Stats.cSent, Stats.cFailed, CallStats.cSendMail );
+
+	StandInSetLatency ( 0L, 0L );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchMailMerge()
+|
+|	Purpose:	Fills in a template for BENCH_MERGE_MESSAGES recipients,
+|				once by replacing each field in a fresh copy of the
+|				template and once with the compiled merge, and reports
+|				the time per message.
+|
++---------------------------------------------------------------------
+*/
+static void BenchMailMerge ( void )
+{
+	std::vector<BULKRECIPIENT> rgRecips;
+	BULKTEMPLATE Template;
+	CMailMerge Merge;
+	MERGEBUFFERS Buffers;
+	MapiMessage Message;
+	LARGE_INTEGER liStart;
+	ULONGLONG cbRendered = 0;
+	double dMs = 0.0;
+	char szText[64];
+
+	printf ( "\r\nMail merge for %d recipients.\r\n", BENCH_MERGE_MESSAGES );
+
+	Template.sSubject = "{{FirstName}}, your {{1}} statement is ready";
+	Template.sNoteText = "Dear {{Name}},\r\n\r\n"
+						 "Your {{1}} statement for account {{2}} is ready. It has been sent to "
+						 "{{Address}} and will also be available from the customer portal for "
+						 "the next ninety days.\r\n\r\n"
+						 "If you have any questions about account {{2}}, reply to this message.\r\n";
+	for ( ULONG i = 0; i < BENCH_MERGE_MESSAGES; i++ )
+	{
+		BULKRECIPIENT Recip;
+
+		sprintf ( szText, "Customer%lu Surname%lu", i, i % 977 );
+		Recip.sName = szText;
+		sprintf ( szText, "SMTP:customer%lu@example.com", i );
+		Recip.sAddress = szText;
+		Recip.rgColumns.push_back ( 0 == i % 2 ? "monthly" : "quarterly" );
+		sprintf ( szText, "%08lu", i * 7919 % 100000000 );
+		Recip.rgColumns.push_back ( szText );
+		rgRecips.push_back ( Recip );
+	}
+
+	// Each message copies the template and replaces one field at a time.
+	QueryPerformanceCounter ( &liStart );
+	for ( ULONG i = 0; i < BENCH_MERGE_MESSAGES; i++ )
+	{
+		const BULKRECIPIENT &Recip = rgRecips[i];
+		std::string rgsFields[][2] = {
+			{ "{{Name}}", Recip.sName },
+			{ "{{FirstName}}", Recip.sName.substr ( 0, Recip.sName.find ( ' ' ) ) },
+			{ "{{Address}}", Recip.sAddress.substr ( Recip.sAddress.find ( ':' ) + 1 ) },
+			{ "{{1}}", Recip.rgColumns[0] },
+			{ "{{2}}", Recip.rgColumns[1] } };
+		std::string sSubject = Template.sSubject;
+		std::string sNoteText = Template.sNoteText;
+
+		for ( size_t j = 0; j < _countof ( rgsFields ); j++ )
+		{
+			size_t ich = 0;
+
+			while ( std::string::npos != ( ich = sSubject.find ( rgsFields[j][0], ich ) ) )
+			{
+				sSubject.replace ( ich, rgsFields[j][0].size ( ), rgsFields[j][1] );
+				ich += rgsFields[j][1].size ( );
+			}
+			ich = 0;
+			while ( std::string::npos != ( ich = sNoteText.find ( rgsFields[j][0], ich ) ) )
+			{
+				sNoteText.replace ( ich, rgsFields[j][0].size ( ), rgsFields[j][1] );
+				ich += rgsFields[j][1].size ( );
+			}
+		}
+		cbRendered += sSubject.size ( ) + sNoteText.size ( );
+	}
+	dMs = ElapsedMs ( liStart );
+	printf ( "  Replace:  %8.1f ms, %6.0f ns per message, %llu bytes\r\n",
+			 dMs, dMs * 1000000.0 / BENCH_MERGE_MESSAGES, cbRendered );
+
+	cbRendered = 0;
+	ZeroMemory ( &Message, sizeof ( MapiMessage ) );
+	QueryPerformanceCounter ( &liStart );
+	Merge.Compile ( Template, NULL );
+	for ( ULONG i = 0; i < BENCH_MERGE_MESSAGES; i++ )
+	{
+		Merge.Render ( rgRecips[i], &Buffers, &Message );
+		cbRendered += Buffers.sSubject.size ( ) + Buffers.sNoteText.size ( );
+	}
+	dMs = ElapsedMs ( liStart );
+	printf ( "  Compiled: %8.1f ms, %6.0f ns per message, %llu bytes\r\n",
+			 dMs, dMs * 1000000.0 / BENCH_MERGE_MESSAGES, cbRendered );
+	printf ( "  Last subject: %s\r\n", Message.lpszSubject );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchRecipientPacking()
+|
+|	Purpose:	Sends one message to BENCH_PACK_RECIPIENTS recipients,
+|				some listed twice, through cBulkSend on BULK_WORKERS
+|				sessions: a copy to each, then packed with the stand-in
+|				refusing more than BENCH_PACK_LIMIT recipients, then
+|				packed again with the limit cBulkSend learned.
+|
++---------------------------------------------------------------------
+*/
+static void BenchRecipientPacking ( void )
+{
+	ULONG rgcLimits[] = { 1, RECIPIENT_LIMIT, 0 };
+	LPCSTR rgszLimits[] = { "One each:", "Packed:", "Relearned:" };
+	std::vector<BULKRECIPIENT> rgRecips;
+	BULKTEMPLATE Template;
+	BULKSENDSTATS Stats;
+	STANDINSTATS CallStats;
+	CApp App;
+	char szAddress[64];
+
+	printf ( "\r\nSending to %d recipients on %d sessions, %d ms per send.\r\n",
+			 BENCH_PACK_RECIPIENTS, BULK_WORKERS, BENCH_SEND_LATENCY );
+	StandInCreateStore ( 0L );
+	StandInSetLatency ( 0L, 0L );
+	App.cInitStandIn ( );
+
+	Template.sSubject = "Service window tonight";
+	Template.sNoteText = "The mail service will be down from 22:00 to 23:00 tonight.\r\n";
+	for ( ULONG i = 0; i < BENCH_PACK_RECIPIENTS; i++ )
+	{
+		BULKRECIPIENT Recip;
+
+		// Listed in no particular order, with every tenth one again.
+		sprintf ( szAddress, "SMTP:user%05lu@example.com", ( i * 7919 ) % BENCH_PACK_RECIPIENTS );
+		Recip.sAddress = szAddress;
+		Recip.sName = szAddress + 5;
+		rgRecips.push_back ( Recip );
+		if ( 0 == i % BENCH_PACK_DUPLICATES )
+			rgRecips.push_back ( Recip );
+	}
+
+	StandInSetLatency ( BENCH_SEND_LATENCY, 0L );
+	StandInSetRecipientLimit ( BENCH_PACK_LIMIT );
+	for ( ULONG i = 0; i < _countof ( rgcLimits ); i++ )
+	{
+		if ( rgcLimits[i] )
+			App.cSetRecipientLimit ( rgcLimits[i] );
+		StandInResetStats ( );
+		App.cBulkSend ( BULK_WORKERS, Template, rgRecips, NULL, &Stats );
+		StandInGetStats ( &CallStats );
+		printf ( "  %-10s %lu sent in %8.1f ms, %3lu per message, %5ld MAPISendMail, %ld delivered, %lu duplicates\r\n",
+				 rgszLimits[i], Stats.cSent, Stats.dMsElapsed, Stats.cRecipLimit,
+				 CallStats.cSendMail, CallStats.cSentRecips, Stats.cDuplicates );
+	}
+	StandInSetRecipientLimit ( 0L );
+	StandInSetLatency ( 0L, 0L );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BenchAttachments()
+|
+|	Purpose:	Sends BENCH_ATTACH_SENDS messages, each with the same
+|				BENCH_ATTACH_FILES files attached, once copying the
+|				files for every send and once through cSendFiles, and
+|				reports the time and the bytes copied.
+|
++---------------------------------------------------------------------
+*/
+static void BenchAttachments ( void )
+{
+	std::vector<std::string> rgsPaths;
+	std::vector<std::string> rgsCopies;
+	std::vector<MapiFileDesc> rgFileDescs ( BENCH_ATTACH_FILES );
+	std::vector<BYTE> rgbFile ( BENCH_ATTACH_SIZE );
+	MapiRecipDesc Recip;
+	MapiMessage Message;
+	ATTACHSTATS Stats;
+	STANDINSTATS CallStats;
+	LARGE_INTEGER liStart;
+	ULONGLONG cbCopied = 0;
+	HRESULT hRes = SUCCESS_SUCCESS;
+	CApp App;
+	double dMs = 0.0;
+	char szPath[MAX_PATH];
+	char szTempDir[MAX_PATH];
+	char szAddress[] = "SMTP:someone@example.com";
+
+	printf ( "\r\nSending %d messages with %d attachments of %d KB.\r\n",
+			 BENCH_ATTACH_SENDS, BENCH_ATTACH_FILES, BENCH_ATTACH_SIZE / 1024 );
+	StandInCreateStore ( 0L );
+	StandInSetLatency ( 0L, 0L );
+	App.cInitStandIn ( );
+	GetTempPath ( sizeof ( szTempDir ), szTempDir );
+
+	for ( ULONG i = 0; i < BENCH_ATTACH_FILES; i++ )
+	{
+		FILE *pFile = NULL;
+
+		sprintf ( szPath, szBENCHATTACHFILE, i );
+		for ( size_t j = 0; j < rgbFile.size ( ); j++ )
+			rgbFile[j] = (BYTE) ( i * 131 + j * 7 );
+		if ( NULL == ( pFile = fopen ( szPath, "wb" ) ) )
+		{
+			printf ( "  Could not create %s.\r\n", szPath );
+			return;
+		}
+		fwrite ( &rgbFile[0], 1, rgbFile.size ( ), pFile );
+		fclose ( pFile );
+		rgsPaths.push_back ( szPath );
+	}
+
+	ZeroMemory ( &Recip, sizeof ( MapiRecipDesc ) );
+	Recip.ulRecipClass = MAPI_TO;
+	Recip.lpszName = szAddress + 5;
+	Recip.lpszAddress = szAddress;
+	ZeroMemory ( &Message, sizeof ( MapiMessage ) );
+	Message.lpszSubject = (LPSTR) "Weekly reports";
+	Message.lpszNoteText = (LPSTR) "The reports for this week are attached.\r\n";
+	Message.nRecipCount = 1L;
+	Message.lpRecips = &Recip;
+
+	// Each send copies every file, so later changes cannot reach it.
+	StandInResetStats ( );
+	QueryPerformanceCounter ( &liStart );
+	for ( ULONG i = 0; i < BENCH_ATTACH_SENDS && SUCCESS_SUCCESS == hRes; i++ )
+	{
+		rgsCopies.clear ( );
+		for ( ULONG j = 0; j < BENCH_ATTACH_FILES; j++ )
+		{
+			sprintf ( szPath, "%sbench%02lu.cpy", szTempDir, j );
+			CopyFile ( rgsPaths[j].c_str ( ), szPath, FALSE );
+			cbCopied += BENCH_ATTACH_SIZE;
+			rgsCopies.push_back ( szPath );
+		}
+		for ( ULONG j = 0; j < BENCH_ATTACH_FILES; j++ )
+		{
+			ZeroMemory ( &rgFileDescs[j], sizeof ( MapiFileDesc ) );
+			rgFileDescs[j].nPosition = (ULONG) -1;
+			rgFileDescs[j].lpszPathName = (LPSTR) rgsCopies[j].c_str ( );
+			rgFileDescs[j].lpszFileName = (LPSTR) rgsPaths[j].c_str ( );
+		}
+		Message.nFileCount = BENCH_ATTACH_FILES;
+		Message.lpFiles = &rgFileDescs[0];
+		hRes = App.cSendMail ( &Message, 0L );
+		Message.nFileCount = 0L;
+		Message.lpFiles = NULL;
+		for ( ULONG j = 0; j < BENCH_ATTACH_FILES; j++ )
+			DeleteFile ( rgsCopies[j].c_str ( ) );
+	}
+	dMs = ElapsedMs ( liStart );
+	StandInGetStats ( &CallStats );
+	printf ( "  Copy each send: %8.1f ms, %6.0f MB copied, %ld MAPISendMail, error %d\r\n",
+			 dMs, cbCopied / 1048576.0, CallStats.cSendMail, hRes );
+
+	StandInResetStats ( );
+	QueryPerformanceCounter ( &liStart );
+	for ( ULONG i = 0; i < BENCH_ATTACH_SENDS && SUCCESS_SUCCESS == hRes; i++ )
+		hRes = App.cSendFiles ( &Message, rgsPaths, 0L, NULL );
+	dMs = ElapsedMs ( liStart );
+	StandInGetStats ( &CallStats );
+	App.cGetAttachStats ( &Stats );
+	printf ( "  Cached copies:  %8.1f ms, %6.0f MB copied, %ld MAPISendMail, error %d; %lu attached, %lu reused, %lu copied\r\n",
+			 dMs, Stats.cbCopied / 1048576.0, CallStats.cSendMail, hRes, Stats.cPrepared, Stats.cReused, Stats.cCopied );
+
+	for ( ULONG i = 0; i < BENCH_ATTACH_FILES; i++ )
+		DeleteFile ( rgsPaths[i].c_str ( ) );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	RunBenchmarks()
+|
+|	Purpose:	Prints the benchmark menu and runs the one chosen.
+|
++---------------------------------------------------------------------
+*/
+void RunBenchmarks ( void )
+{
+	int nChoice = 0;
+
+	printf ( "\r\nBenchmarks against the in-process stand-in message store.\r\n\r\n" );
+	printf ( "[ 1] Inbox header fetch.\r\n" );
+	printf ( "[ 2] Parallel Inbox header prefetch, 1 to 16 workers.\r\n" );
+	printf ( "[ 3] Cold and warm startup with the header cache.\r\n" );
+	printf ( "[ 4] Memory held by interned message IDs.\r\n" );
+	printf ( "[ 5] Reading every unread message, rescanning or with a cursor.\r\n" );
+	printf ( "[ 6] Rereading message text through the body cache.\r\n" );
+	printf ( "[ 7] Compressing and decompressing RTF bodies.\r\n" );
+	printf ( "[ 8] Building and querying the full-text index.\r\n" );
+	printf ( "[ 9] Scanning message text for a substring, naive and vectorized.\r\n" );
+	printf ( "[10] Threading the Inbox into conversations.\r\n" );
+	printf ( "[11] Finding and deleting duplicate messages.\r\n" );
+	printf ( "[12] Sending to many recipients on parallel sessions.\r\n" );
+	printf ( "[13] Sending through the outbox journal.\r\n" );
+	printf ( "[14] Filling in a mail merge template.\r\n" );
+	printf ( "[15] Packing recipients into shared messages.\r\n" );
+	printf ( "[16] Sending the same attachments again and again.\r\n" );
+	printf ( "\r\nEnter your choice: " );
+	scanf ( "%d", &nChoice );
+
+	switch ( nChoice )
+	{
+	case BENCH_HEADER_FETCH:
+		BenchHeaderFetch ( );
+		break;
+	case BENCH_PARALLEL_PREFETCH:
+		BenchParallelPrefetch ( );
+		break;
+	case BENCH_HEADER_CACHE:
+		BenchHeaderCache ( );
+		break;
+	case BENCH_MSGID_TABLE:
+		BenchMsgIDTable ( );
+		break;
+	case BENCH_UNREAD_CURSOR:
+		BenchUnreadCursor ( );
+		break;
+	case BENCH_BODY_CACHE:
+		BenchBodyCache ( );
+		break;
+	case BENCH_RTF_CODEC:
+		BenchRtfCodec ( );
+		break;
+	case BENCH_SEARCH_INDEX:
+		BenchSearchIndex ( );
+		break;
+	case BENCH_TEXT_SCAN:
+		BenchTextScan ( );
+		break;
+	case BENCH_CONVERSATIONS:
+		BenchConversations ( );
+		break;
+	case BENCH_DUPLICATES:
+		BenchDuplicates ( );
+		break;
+	case BENCH_BULK_SEND:
+		BenchBulkSend ( );
+		break;
+	case BENCH_OUTBOX:
+		BenchOutbox ( );
+		break;
+	case BENCH_MAIL_MERGE:
+		BenchMailMerge ( );
+		break;
+	case BENCH_RECIPIENT_PACKING:
+		BenchRecipientPacking ( );
+		break;
+	case BENCH_ATTACHMENTS:
+		BenchAttachments ( );
+		break;
+	default:
+		printf ( "Not a valid choice.\r\n" );
+		break;
+	}
+}
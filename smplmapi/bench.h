@@ -0,0 +1,38 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Bench.h
+|
+|   Purpose:	Declares the benchmark menu. Every benchmark runs
+|				against the in-process stand-in provider (StandIn.h)
+|				so results do not depend on a real message store.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "swap.h"
+
+// Benchmark menu constants
+#define BENCH_HEADER_FETCH		1
+#define BENCH_PARALLEL_PREFETCH	2
+#define BENCH_HEADER_CACHE		3
+#define BENCH_MSGID_TABLE		4
+#define BENCH_UNREAD_CURSOR		5
+#define BENCH_BODY_CACHE		6
+#define BENCH_RTF_CODEC			7
+#define BENCH_SEARCH_INDEX		8
+#define BENCH_TEXT_SCAN			9
+#define BENCH_CONVERSATIONS		10
+#define BENCH_DUPLICATES		11
+#define BENCH_BULK_SEND			12
+#define BENCH_OUTBOX			13
+#define BENCH_MAIL_MERGE		14
+#define BENCH_RECIPIENT_PACKING	15
+#define BENCH_ATTACHMENTS		16
+
+void RunBenchmarks ( void );
+
+#endif
@@ -0,0 +1,344 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		BodyCache.cpp
+|
+|   Purpose:	Implementation of CBodyCache, and of the CApp methods
+|				that read message text through it.
+|
++---------------------------------------------------------------------
+*/
+
+#include "bodycache.h"
+#include "lzblock.h"
+
+CBodyCache::CBodyCache ( ULONGLONG cbBudget )
+{
+	InitializeCriticalSection ( &m_csLock );
+	m_cbBudget = cbBudget;
+	m_iHead = BODYCACHE_NIL;
+	m_iTail = BODYCACHE_NIL;
+	ZeroMemory ( &m_Stats, sizeof ( m_Stats ) );
+}
+
+CBodyCache::~CBodyCache ( )
+{
+	Trim ( 0 );
+	DeleteCriticalSection ( &m_csLock );
+}
+
+void CBodyCache::Unlink ( ULONG iEntry )
+{
+	BODYENTRY &Entry = m_rgEntries[iEntry];
+
+	if ( BODYCACHE_NIL != Entry.iPrev )
+		m_rgEntries[Entry.iPrev].iNext = Entry.iNext;
+	else
+		m_iHead = Entry.iNext;
+	if ( BODYCACHE_NIL != Entry.iNext )
+		m_rgEntries[Entry.iNext].iPrev = Entry.iPrev;
+	else
+		m_iTail = Entry.iPrev;
+}
+
+void CBodyCache::LinkHead ( ULONG iEntry )
+{
+	BODYENTRY &Entry = m_rgEntries[iEntry];
+
+	Entry.iPrev = BODYCACHE_NIL;
+	Entry.iNext = m_iHead;
+	if ( BODYCACHE_NIL != m_iHead )
+		m_rgEntries[m_iHead].iPrev = iEntry;
+	else
+		m_iTail = iEntry;
+	m_iHead = iEntry;
+}
+
+// Frees an entry and its slot. Called with the lock held.
+void CBodyCache::Drop ( ULONG iEntry )
+{
+	BODYENTRY &Entry = m_rgEntries[iEntry];
+
+	Unlink ( iEntry );
+	m_rgiEntries[Entry.hMsgID] = 0;
+	m_Stats.cEntries--;
+	if ( Entry.fCompressed )
+		m_Stats.cCompressed--;
+	m_Stats.cbResident -= Entry.cbStored + sizeof ( BODYENTRY );
+	m_Stats.cbText -= Entry.cchText;
+
+	free ( Entry.pbData );
+	Entry.pbData = NULL;
+	Entry.hMsgID = MSGID_NONE;
+	m_rgiFree.push_back ( iEntry );
+}
+
+// Evicts from the least recently used end until at most cbBudget bytes
+// are held. Called with the lock held.
+void CBodyCache::Trim ( ULONGLONG cbBudget )
+{
+	while ( m_Stats.cbResident > cbBudget && BODYCACHE_NIL != m_iTail )
+	{
+		Drop ( m_iTail );
+		m_Stats.cEvictions++;
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Get()
+|
+|	Purpose:	Copies the cached text of a message into psText and
+|				makes it the most recently used. Returns FALSE on a
+|				miss.
+|
++---------------------------------------------------------------------
+*/
+BOOL CBodyCache::Get ( MSGIDHANDLE hMsgID, std::string *psText )
+{
+	BOOL fHit = FALSE;
+
+	EnterCriticalSection ( &m_csLock );
+
+	if ( hMsgID < m_rgiEntries.size ( ) && m_rgiEntries[hMsgID] )
+	{
+		ULONG iEntry = m_rgiEntries[hMsgID] - 1;
+		const BODYENTRY &Entry = m_rgEntries[iEntry];
+
+		psText -> resize ( Entry.cchText );
+		if ( !Entry.fCompressed )
+		{
+			if ( Entry.cchText )
+				memcpy ( &( *psText )[0], Entry.pbData, Entry.cchText );
+			fHit = TRUE;
+		}
+		else
+			fHit = LZDecompress ( Entry.pbData, Entry.cbStored, (LPBYTE) &( *psText )[0], Entry.cchText );
+
+		if ( fHit )
+		{
+			Unlink ( iEntry );
+			LinkHead ( iEntry );
+		}
+		else
+			Drop ( iEntry );
+	}
+
+	if ( fHit )
+		m_Stats.cHits++;
+	else
+		m_Stats.cMisses++;
+
+	LeaveCriticalSection ( &m_csLock );
+
+	return fHit;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Put()
+|
+|	Purpose:	Caches the text of a message, replacing any text cached
+|				for it before, and evicts what no longer fits. Text
+|				larger than the whole budget is not cached.
+|
++---------------------------------------------------------------------
+*/
+void CBodyCache::Put ( MSGIDHANDLE hMsgID, LPCSTR lpszText )
+{
+	size_t cchText = lpszText ? strlen ( lpszText ) : 0;
+	LPCSTR pbStore = lpszText;
+	size_t cbStore = cchText;
+	BOOL fCompressed = FALSE;
+	ULONG iEntry = 0;
+
+	if ( MSGID_NONE == hMsgID )
+		return;
+
+	EnterCriticalSection ( &m_csLock );
+
+	if ( hMsgID < m_rgiEntries.size ( ) && m_rgiEntries[hMsgID] )
+		Drop ( m_rgiEntries[hMsgID] - 1 );
+
+	if ( cchText >= BODYCACHE_COMPRESS_MIN )
+	{
+		size_t cbCompressed = 0;
+
+		m_rgbScratch.resize ( cchText );
+		cbCompressed = LZCompress ( (const BYTE *) lpszText, cchText, &m_rgbScratch[0], cchText - 1 );
+		if ( cbCompressed )
+		{
+			pbStore = (LPCSTR) &m_rgbScratch[0];
+			cbStore = cbCompressed;
+			fCompressed = TRUE;
+		}
+	}
+
+	if ( cbStore + sizeof ( BODYENTRY ) <= m_cbBudget )
+	{
+		BODYENTRY Entry = { hMsgID, (LPBYTE) malloc ( cbStore ? cbStore : 1 ), (ULONG) cbStore,
+							(ULONG) cchText, fCompressed, BODYCACHE_NIL, BODYCACHE_NIL };
+
+		if ( Entry.pbData )
+		{
+			memcpy ( Entry.pbData, pbStore, cbStore );
+
+			if ( !m_rgiFree.empty ( ) )
+			{
+				iEntry = m_rgiFree.back ( );
+				m_rgiFree.pop_back ( );
+				m_rgEntries[iEntry] = Entry;
+			}
+			else
+			{
+				iEntry = (ULONG) m_rgEntries.size ( );
+				m_rgEntries.push_back ( Entry );
+			}
+
+			if ( hMsgID >= m_rgiEntries.size ( ) )
+				m_rgiEntries.resize ( hMsgID + 1, 0 );
+			m_rgiEntries[hMsgID] = iEntry + 1;
+			LinkHead ( iEntry );
+
+			m_Stats.cEntries++;
+			if ( fCompressed )
+				m_Stats.cCompressed++;
+			m_Stats.cbResident += cbStore + sizeof ( BODYENTRY );
+			m_Stats.cbText += cchText;
+
+			Trim ( m_cbBudget );
+		}
+	}
+
+	LeaveCriticalSection ( &m_csLock );
+}
+
+void CBodyCache::Remove ( MSGIDHANDLE hMsgID )
+{
+	EnterCriticalSection ( &m_csLock );
+	if ( hMsgID < m_rgiEntries.size ( ) && m_rgiEntries[hMsgID] )
+		Drop ( m_rgiEntries[hMsgID] - 1 );
+	LeaveCriticalSection ( &m_csLock );
+}
+
+void CBodyCache::SetBudget ( ULONGLONG cbBudget )
+{
+	EnterCriticalSection ( &m_csLock );
+	m_cbBudget = cbBudget;
+	Trim ( cbBudget );
+	LeaveCriticalSection ( &m_csLock );
+}
+
+void CBodyCache::GetStats ( LPBODYCACHESTATS lpStats )
+{
+	EnterCriticalSection ( &m_csLock );
+	*lpStats = m_Stats;
+	lpStats -> cbBudget = m_cbBudget;
+	LeaveCriticalSection ( &m_csLock );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cBodyCache ( )
+|
+|	Purpose:	Returns the message text cache, creating it with the current
+|				budget on first use, or NULL if it is disabled.
++------------------------------------------------------------------------------
+*/
+CBodyCache *CApp::cBodyCache ( void )
+{
+	if ( NULL == m_pBodyCache && m_cbBodyCache )
+		m_pBodyCache = new CBodyCache ( m_cbBodyCache );
+
+	return m_pBodyCache;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSetBodyCacheBudget ( )
+|
+|	Parameters:	[IN] cbBudget == Bytes of message text, entry overhead
+|				included, the cache may hold. 0 disables it and frees
+|				everything cached.
+|
+|	Purpose:	Sizes the message text cache, evicting the least recently
+|				used text if it holds more than the new budget.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSetBodyCacheBudget ( ULONGLONG cbBudget )
+{
+	m_cbBodyCache = cbBudget;
+
+	if ( 0 == cbBudget )
+	{
+		delete m_pBodyCache;
+		m_pBodyCache = NULL;
+	}
+	else if ( m_pBodyCache )
+		m_pBodyCache -> SetBudget ( cbBudget );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cGetBodyCacheStats ( )
+|
+|	Parameters:	[OUT] lpStats == Receives the cache counters and sizes. All
+|				zero when the cache has not been used.
+|
+|	Purpose:	Reports how well the message text cache is doing, to size
+|				its budget.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cGetBodyCacheStats ( LPBODYCACHESTATS lpStats )
+{
+	ZeroMemory ( lpStats, sizeof ( BODYCACHESTATS ) );
+
+	if ( m_pBodyCache )
+		m_pBodyCache -> GetStats ( lpStats );
+	else
+		lpStats -> cbBudget = m_cbBodyCache;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cReadBody ( )
+|
+|	Parameters:	[IN] hMsgID == The message to read.
+|
+|				[OUT] psText == Receives the note text.
+|
+|	Purpose:	Gets the text of a message without marking it read, from the
+|				body cache when it is there and otherwise with MAPI_PEEK and
+|				MAPI_SUPPRESS_ATTACH, caching and indexing what was read.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cReadBody ( MSGIDHANDLE hMsgID, std::string *psText )
+{
+	HRESULT hRes = SUCCESS_SUCCESS;
+	CBodyCache *pCache = cBodyCache ( );
+	lpMapiMessage lpMessage = NULL;
+
+	if ( pCache && pCache -> Get ( hMsgID, psText ) )
+		return SUCCESS_SUCCESS;
+
+	if ( SUCCESS_SUCCESS != ( hRes = cReadMessage ( hMsgID, MAPI_PEEK | MAPI_SUPPRESS_ATTACH, &lpMessage ) ) )
+		return hRes;
+
+	psText -> assign ( lpMessage -> lpszNoteText ? lpMessage -> lpszNoteText : "" );
+	if ( pCache )
+		pCache -> Put ( hMsgID, lpMessage -> lpszNoteText );
+	cIndexMessage ( hMsgID, lpMessage );
+	cFreeBuffer ( lpMessage );
+
+	return hRes;
+}
@@ -0,0 +1,68 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		BodyCache.h
+|
+|   Purpose:	Declares CBodyCache, an in-memory cache of message text
+|				keyed by message ID handle. It holds at most a budget of
+|				bytes, counting each entry's stored text and overhead,
+|				and evicts the least recently used entries to stay
+|				within it. Text of BODYCACHE_COMPRESS_MIN bytes or more
+|				is stored LZ-compressed (LZBlock.h) when that makes it
+|				smaller.
+|
+|				A CBodyCache may be used from any thread.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _BODYCACHE_H
+#define _BODYCACHE_H
+
+#include "swap.h"
+
+#define BODYCACHE_COMPRESS_MIN	1024		// Shorter text is stored as it is
+#define BODYCACHE_NIL			0xFFFFFFFF	// No entry, at either end of the LRU list
+
+class CBodyCache
+{
+private:
+	// One cached text, on the LRU list by entry index.
+	typedef struct _BODYENTRY
+	{
+		MSGIDHANDLE	hMsgID;			// MSGID_NONE when the slot is free
+		LPBYTE		pbData;
+		ULONG		cbStored;		// Bytes at pbData
+		ULONG		cchText;		// Length of the text, without terminator
+		BOOL		fCompressed;
+		ULONG		iPrev;			// Toward the most recently used; BODYCACHE_NIL at the head
+		ULONG		iNext;
+	} BODYENTRY;
+
+	CRITICAL_SECTION		m_csLock;
+	ULONGLONG				m_cbBudget;
+	std::vector<BODYENTRY>	m_rgEntries;
+	std::vector<ULONG>		m_rgiEntries;	// By MSGIDHANDLE; entry index + 1, 0 == none
+	std::vector<ULONG>		m_rgiFree;		// Free entry slots
+	ULONG					m_iHead;		// Most recently used
+	ULONG					m_iTail;		// Least recently used
+	std::vector<BYTE>		m_rgbScratch;	// Compression output
+	BODYCACHESTATS			m_Stats;
+
+	void	Unlink ( ULONG iEntry );
+	void	LinkHead ( ULONG iEntry );
+	void	Drop ( ULONG iEntry );
+	void	Trim ( ULONGLONG cbBudget );
+
+public:
+	CBodyCache ( ULONGLONG cbBudget );
+	~CBodyCache ( );
+
+	BOOL	Get ( MSGIDHANDLE hMsgID, std::string *psText );
+	void	Put ( MSGIDHANDLE hMsgID, LPCSTR lpszText );
+	void	Remove ( MSGIDHANDLE hMsgID );
+	void	SetBudget ( ULONGLONG cbBudget );
+	void	GetStats ( LPBODYCACHESTATS lpStats );
+};
+
+#endif
@@ -0,0 +1,678 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		BulkSend.cpp
+|
+|   Purpose:	Sending one message to many recipients. A pool of
+|				workers, each logged on to a session of its own, claims
+|				recipients one at a time and sends each a copy with
+|				MAPISendMail, so as many sends are in flight as there
+|				are workers. Every send is timed, and cBulkSend reports
+|				throughput and the spread of the send latencies.
+|
+|				When the template has no mail merge fields every copy
+|				is the same, so the recipients are sorted by address,
+|				duplicates dropped, and packed as blind copies into
+|				messages of up to m_cRecipLimit recipients, which the
+|				workers claim instead. A message the provider refuses
+|				with MAPI_E_TOO_MANY_RECIPIENTS is split and the limit
+|				lowered for the rest of the send; one refused for a bad
+|				recipient is halved until the bad address is found, so
+|				the others still get their copy.
+|
++---------------------------------------------------------------------
+*/
+
+#include "bulksend.h"
+#include "workpool.h"
+#include "mailmerge.h"
+#include <algorithm>
+
+#define BULK_FAILURES_SHOWN		20		// Failed recipients cBulkSendMessages lists
+
+// Recipients sent one packed message: rgiPacked[iFirst] on.
+typedef struct _BULKPACK
+{
+	ULONG		iFirst;
+	ULONG		cRecips;
+} BULKPACK;
+
+// State shared by the workers of one cBulkSend.
+typedef struct _BULKCONTEXT
+{
+	CApp								*pApp;
+	const CMailMerge					*pMerge;
+	const std::vector<BULKRECIPIENT>	*prgRecips;
+	volatile LONG						iNext;			// Next recipient or pack to claim
+	volatile LONG						cSessions;
+	volatile LONG						cCalls;
+	std::vector<HRESULT>				rghRes;			// By recipient
+	std::vector<double>					rgdMs;			// By recipient or pack; send latency
+	std::vector<ULONG>					rgiPacked;		// Recipients by address, without duplicates
+	std::vector<BULKPACK>				rgPacks;		// Empty if each recipient is sent a copy
+	volatile LONG						cRecipLimit;	// Recipients per packed message
+} BULKCONTEXT;
+
+// Orders recipients, by index, by address and then by index.
+struct BulkAddressLess
+{
+	const std::vector<BULKRECIPIENT>	*prgRecips;
+
+	bool operator ( ) ( ULONG iLeft, ULONG iRight ) const
+	{
+		int nCompare = _stricmp ( ( *prgRecips )[iLeft].sAddress.c_str ( ), ( *prgRecips )[iRight].sAddress.c_str ( ) );
+
+		return nCompare < 0 || ( 0 == nCompare && iLeft < iRight );
+	}
+};
+
+// Reads a whole file into psBytes. FALSE if it cannot be opened.
+static BOOL BulkReadFile ( LPCSTR lpszFile, std::string *psBytes )
+{
+	FILE *pFile = fopen ( lpszFile, "rb" );
+	char rgchBuffer[4096];
+	size_t cbRead = 0;
+
+	psBytes -> clear ( );
+
+	if ( NULL == pFile )
+		return FALSE;
+
+	while ( 0 != ( cbRead = fread ( rgchBuffer, 1, sizeof ( rgchBuffer ), pFile ) ) )
+		psBytes -> append ( rgchBuffer, cbRead );
+	fclose ( pFile );
+
+	return TRUE;
+}
+
+// Removes white space from both ends of psText.
+static void BulkTrim ( std::string *psText )
+{
+	size_t ichFirst = psText -> find_first_not_of ( " \t\r\n" );
+
+	if ( std::string::npos == ichFirst )
+	{
+		psText -> clear ( );
+		return;
+	}
+	psText -> erase ( psText -> find_last_not_of ( " \t\r\n" ) + 1 );
+	psText -> erase ( 0, ichFirst );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BulkLoadRecipients()
+|
+|	Purpose:	Reads a recipient file (BulkSend.h) into prgRecips.
+|				Returns MAPI_E_NOT_FOUND if the file cannot be opened.
+|
++---------------------------------------------------------------------
+*/
+HRESULT BulkLoadRecipients ( LPCSTR lpszFile, std::vector<BULKRECIPIENT> *prgRecips )
+{
+	std::string sBytes;
+	size_t ichLine = 0;
+
+	prgRecips -> clear ( );
+
+	if ( !BulkReadFile ( lpszFile, &sBytes ) )
+		return MAPI_E_NOT_FOUND;
+
+	while ( ichLine < sBytes.size ( ) )
+	{
+		size_t ichEnd = sBytes.find ( '\n', ichLine );
+		std::string sLine;
+		BULKRECIPIENT Recip;
+		size_t ichOpen = 0;
+		size_t ichTab = 0;
+
+		if ( std::string::npos == ichEnd )
+			ichEnd = sBytes.size ( );
+		sLine.assign ( sBytes, ichLine, ichEnd - ichLine );
+		ichLine = ichEnd + 1;
+
+		// Columns for the mail merge follow the address.
+		if ( std::string::npos != ( ichTab = sLine.find ( '\t' ) ) )
+		{
+			size_t ichColumn = ichTab + 1;
+
+			for ( ;; )
+			{
+				size_t ichNext = sLine.find ( '\t', ichColumn );
+				std::string sColumn;
+
+				if ( std::string::npos == ichNext )
+					ichNext = sLine.size ( );
+				sColumn.assign ( sLine, ichColumn, ichNext - ichColumn );
+				BulkTrim ( &sColumn );
+				Recip.rgColumns.push_back ( sColumn );
+				if ( ichNext == sLine.size ( ) )
+					break;
+				ichColumn = ichNext + 1;
+			}
+			sLine.erase ( ichTab );
+		}
+
+		BulkTrim ( &sLine );
+		if ( sLine.empty ( ) || '#' == sLine[0] )
+			continue;
+
+		// "Name <address>" or a bare address.
+		if ( '>' == sLine[sLine.size ( ) - 1] && std::string::npos != ( ichOpen = sLine.rfind ( '<' ) ) )
+		{
+			Recip.sAddress.assign ( sLine, ichOpen + 1, sLine.size ( ) - ichOpen - 2 );
+			Recip.sName.assign ( sLine, 0, ichOpen );
+			BulkTrim ( &Recip.sAddress );
+			BulkTrim ( &Recip.sName );
+		}
+		else
+			Recip.sAddress = sLine;
+
+		if ( Recip.sAddress.empty ( ) )
+			continue;
+		if ( Recip.sName.empty ( ) )
+			Recip.sName = Recip.sAddress;
+		if ( std::string::npos == Recip.sAddress.find ( ':' ) )
+			Recip.sAddress.insert ( 0, "SMTP:" );
+
+		prgRecips -> push_back ( Recip );
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BulkLoadTemplate()
+|
+|	Purpose:	Reads a template file (BulkSend.h) into pTemplate.
+|				Returns MAPI_E_NOT_FOUND if the file cannot be opened.
+|
++---------------------------------------------------------------------
+*/
+HRESULT BulkLoadTemplate ( LPCSTR lpszFile, BULKTEMPLATE *pTemplate )
+{
+	std::string sBytes;
+	size_t ichText = 0;
+
+	pTemplate -> sSubject.clear ( );
+	pTemplate -> sNoteText.clear ( );
+
+	if ( !BulkReadFile ( lpszFile, &sBytes ) )
+		return MAPI_E_NOT_FOUND;
+
+	if ( 0 == _strnicmp ( sBytes.c_str ( ), "Subject:", 8 ) )
+	{
+		size_t ichEnd = sBytes.find ( '\n' );
+
+		if ( std::string::npos == ichEnd )
+			ichEnd = sBytes.size ( );
+		pTemplate -> sSubject.assign ( sBytes, 8, ichEnd - 8 );
+		BulkTrim ( &pTemplate -> sSubject );
+
+		ichText = ichEnd < sBytes.size ( ) ? ichEnd + 1 : ichEnd;
+		if ( 0 == sBytes.compare ( ichText, 2, "\r\n" ) )
+			ichText += 2;
+		else if ( 0 == sBytes.compare ( ichText, 1, "\n" ) )
+			ichText += 1;
+	}
+
+	pTemplate -> sNoteText.assign ( sBytes, ichText, std::string::npos );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BulkSendWorker()
+|
+|	Purpose:	Logs on to a session of its own, then claims recipients
+|				and sends each the template, merged into buffers the
+|				worker reuses, until none are left. A worker that
+|				cannot log on leaves the recipients to the others.
+|
++---------------------------------------------------------------------
+*/
+static DWORD BulkSendWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	BULKCONTEXT *pCtx = (BULKCONTEXT *) lpvContext;
+	LONG cRecips = (LONG) pCtx -> prgRecips -> size ( );
+	CApp Session;
+	MapiMessage Message;
+	MapiRecipDesc Recip;
+	MERGEBUFFERS Buffers;
+	LARGE_INTEGER liFreq, liStart, liEnd;
+	HRESULT hRes = S_OK;
+	LONG i = 0;
+
+	if ( SUCCESS_SUCCESS != ( hRes = pCtx -> pApp -> cCloneSession ( &Session ) ) )
+		return hRes;
+	InterlockedIncrement ( &pCtx -> cSessions );
+
+	QueryPerformanceFrequency ( &liFreq );
+
+	// Only the recipient and the merged text change from one send to the
+	// next.
+	ZeroMemory ( &Message, sizeof ( MapiMessage ) );
+	ZeroMemory ( &Recip, sizeof ( MapiRecipDesc ) );
+	Message.nRecipCount = 1L;
+	Message.lpRecips = &Recip;
+	Recip.ulRecipClass = MAPI_TO;
+
+	while ( ( i = InterlockedIncrement ( &pCtx -> iNext ) - 1 ) < cRecips )
+	{
+		const BULKRECIPIENT &Target = ( *pCtx -> prgRecips )[i];
+
+		Recip.lpszName = (LPSTR) Target.sName.c_str ( );
+		Recip.lpszAddress = (LPSTR) Target.sAddress.c_str ( );
+		pCtx -> pMerge -> Render ( Target, &Buffers, &Message );
+
+		QueryPerformanceCounter ( &liStart );
+		InterlockedIncrement ( &pCtx -> cCalls );
+		pCtx -> rghRes[i] = Session.cSendMail ( &Message, 0L );
+		QueryPerformanceCounter ( &liEnd );
+
+		pCtx -> rgdMs[i] = (double) ( liEnd.QuadPart - liStart.QuadPart ) * 1000.0 / (double) liFreq.QuadPart;
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+// TRUE for the MAPISendMail failures caused by one of the recipients.
+static BOOL BulkIsRecipientError ( HRESULT hRes )
+{
+	return MAPI_E_UNKNOWN_RECIPIENT == hRes || MAPI_E_AMBIGUOUS_RECIPIENT == hRes ||
+		   MAPI_E_INVALID_RECIPS == hRes || MAPI_E_BAD_RECIPTYPE == hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BulkSendPack()
+|
+|	Parameters:	[IN] pDescs == Descriptors of the cRecips recipients
+|				from rgiPacked[iFirst] on.
+|
+|	Purpose:	Sends lpMessage to the recipients in one message, or in
+|				several if there are more than the limit. If the
+|				provider refuses the message for having too many
+|				recipients the limit is lowered to half of them and the
+|				message split; if it refuses it for a bad recipient the
+|				message is halved until the recipient is found. The
+|				outcome is stored for each recipient.
+|
++---------------------------------------------------------------------
+*/
+static void BulkSendPack ( BULKCONTEXT *pCtx, CApp *pSession, lpMapiMessage lpMessage,
+						   lpMapiRecipDesc pDescs, ULONG iFirst, ULONG cRecips )
+{
+	ULONG cLimit = (ULONG) pCtx -> cRecipLimit;
+	HRESULT hRes = S_OK;
+
+	// The limit may have come down since the pack was made.
+	if ( cRecips > cLimit )
+	{
+		for ( ULONG i = 0; i < cRecips; i += cLimit )
+			BulkSendPack ( pCtx, pSession, lpMessage, pDescs + i, iFirst + i, min ( cLimit, cRecips - i ) );
+		return;
+	}
+
+	lpMessage -> nRecipCount = cRecips;
+	lpMessage -> lpRecips = pDescs;
+	InterlockedIncrement ( &pCtx -> cCalls );
+	hRes = pSession -> cSendMail ( lpMessage, 0L );
+
+	if ( cRecips > 1 && MAPI_E_TOO_MANY_RECIPIENTS == hRes )
+	{
+		LONG cOld = pCtx -> cRecipLimit;
+
+		// Another worker may have lowered it further meanwhile.
+		while ( cOld > (LONG) ( cRecips / 2 ) &&
+				cOld != InterlockedCompareExchange ( &pCtx -> cRecipLimit, (LONG) ( cRecips / 2 ), cOld ) )
+			cOld = pCtx -> cRecipLimit;
+
+		BulkSendPack ( pCtx, pSession, lpMessage, pDescs, iFirst, cRecips );
+		return;
+	}
+
+	if ( cRecips > 1 && BulkIsRecipientError ( hRes ) )
+	{
+		BulkSendPack ( pCtx, pSession, lpMessage, pDescs, iFirst, cRecips / 2 );
+		BulkSendPack ( pCtx, pSession, lpMessage, pDescs + cRecips / 2, iFirst + cRecips / 2, cRecips - cRecips / 2 );
+		return;
+	}
+
+	for ( ULONG i = 0; i < cRecips; i++ )
+		pCtx -> rghRes[pCtx -> rgiPacked[iFirst + i]] = hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	BulkPackWorker()
+|
+|	Purpose:	Logs on to a session of its own, then claims packs and
+|				sends each as one message with every recipient a blind
+|				copy, until none are left.
+|
++---------------------------------------------------------------------
+*/
+static DWORD BulkPackWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	BULKCONTEXT *pCtx = (BULKCONTEXT *) lpvContext;
+	LONG cPacks = (LONG) pCtx -> rgPacks.size ( );
+	CApp Session;
+	MapiMessage Message;
+	std::vector<MapiRecipDesc> rgDescs;
+	MERGEBUFFERS Buffers;
+	LARGE_INTEGER liFreq, liStart, liEnd;
+	HRESULT hRes = S_OK;
+	LONG i = 0;
+
+	if ( SUCCESS_SUCCESS != ( hRes = pCtx -> pApp -> cCloneSession ( &Session ) ) )
+		return hRes;
+	InterlockedIncrement ( &pCtx -> cSessions );
+
+	QueryPerformanceFrequency ( &liFreq );
+
+	// Without fields the text is the same for everyone.
+	ZeroMemory ( &Message, sizeof ( MapiMessage ) );
+	pCtx -> pMerge -> Render ( ( *pCtx -> prgRecips )[0], &Buffers, &Message );
+
+	while ( ( i = InterlockedIncrement ( &pCtx -> iNext ) - 1 ) < cPacks )
+	{
+		const BULKPACK &Pack = pCtx -> rgPacks[i];
+
+		rgDescs.resize ( Pack.cRecips );
+		for ( ULONG j = 0; j < Pack.cRecips; j++ )
+		{
+			const BULKRECIPIENT &Target = ( *pCtx -> prgRecips )[pCtx -> rgiPacked[Pack.iFirst + j]];
+
+			ZeroMemory ( &rgDescs[j], sizeof ( MapiRecipDesc ) );
+			rgDescs[j].ulRecipClass = MAPI_BCC;
+			rgDescs[j].lpszName = (LPSTR) Target.sName.c_str ( );
+			rgDescs[j].lpszAddress = (LPSTR) Target.sAddress.c_str ( );
+		}
+
+		QueryPerformanceCounter ( &liStart );
+		BulkSendPack ( pCtx, &Session, &Message, &rgDescs[0], Pack.iFirst, Pack.cRecips );
+		QueryPerformanceCounter ( &liEnd );
+
+		pCtx -> rgdMs[i] = (double) ( liEnd.QuadPart - liStart.QuadPart ) * 1000.0 / (double) liFreq.QuadPart;
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cBulkSend ( )
+|
+|	Parameters:	[IN] cWorkers == Number of sessions sending at once.
+|
+|				[IN] Template == Subject and text of the message, with
+|				mail merge fields (MailMerge.h).
+|
+|				[IN] rgRecips == The recipients. Each gets a copy of its
+|				own, or, if the template has no fields, a blind copy of a
+|				message packed with others.
+|
+|				[OUT] prghRes == Receives the outcome of each send, by
+|				recipient. May be NULL.
+|
+|				[OUT] lpStats == Receives counts and timings. May be NULL.
+|
+|	Purpose:	Sends the template to every recipient on cWorkers sessions
+|				of this object's provider. Failed sends are counted, not
+|				retried. Returns MAPI_E_LOGIN_FAILURE, with nothing sent,
+|				if no worker session could be opened, and E_INVALIDARG if
+|				the template has a field with an unknown name. A limit
+|				lowered because the provider refused a pack is kept for
+|				later sends.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cBulkSend ( ULONG cWorkers, const BULKTEMPLATE &Template, const std::vector<BULKRECIPIENT> &rgRecips,
+							   std::vector<HRESULT> *prghRes, LPBULKSENDSTATS lpStats )
+{
+	CWorkerThreads Workers;
+	CMailMerge Merge;
+	BULKCONTEXT Ctx;
+	BulkAddressLess AddressLess;
+	LARGE_INTEGER liFreq, liStart, liEnd;
+	std::vector<double> rgdMs;
+	std::vector<ULONG> rgiOrder;
+	std::vector<ULONG> rgiSentAs;
+	double dMsTotal = 0.0;
+	ULONG cSent = 0L;
+	ULONG cDuplicates = 0L;
+
+	if ( prghRes )
+		prghRes -> clear ( );
+	if ( lpStats )
+		ZeroMemory ( lpStats, sizeof ( BULKSENDSTATS ) );
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( rgRecips.empty ( ) )
+		return SUCCESS_SUCCESS;
+	if ( FAILED ( Merge.Compile ( Template, NULL ) ) )
+		return E_INVALIDARG;
+
+	Ctx.pApp = this;
+	Ctx.pMerge = &Merge;
+	Ctx.prgRecips = &rgRecips;
+	Ctx.iNext = 0;
+	Ctx.cSessions = 0;
+	Ctx.cCalls = 0;
+	Ctx.cRecipLimit = (LONG) max ( m_cRecipLimit, 1L );
+	Ctx.rghRes.assign ( rgRecips.size ( ), MAPI_E_LOGIN_FAILURE );
+
+	if ( m_cRecipLimit > 1 && 0 == Merge.FieldCount ( ) )
+	{
+		// Sort by address so duplicates are next to each other. The first
+		// of each is sent; the others share its outcome.
+		rgiOrder.resize ( rgRecips.size ( ) );
+		for ( ULONG i = 0; i < rgRecips.size ( ); i++ )
+			rgiOrder[i] = i;
+		AddressLess.prgRecips = &rgRecips;
+		std::sort ( rgiOrder.begin ( ), rgiOrder.end ( ), AddressLess );
+
+		rgiSentAs.resize ( rgRecips.size ( ) );
+		for ( size_t i = 0; i < rgiOrder.size ( ); i++ )
+		{
+			ULONG iRecip = rgiOrder[i];
+
+			if ( !Ctx.rgiPacked.empty ( ) &&
+				 0 == _stricmp ( rgRecips[iRecip].sAddress.c_str ( ), rgRecips[Ctx.rgiPacked.back ( )].sAddress.c_str ( ) ) )
+			{
+				rgiSentAs[iRecip] = Ctx.rgiPacked.back ( );
+				cDuplicates++;
+				continue;
+			}
+			rgiSentAs[iRecip] = iRecip;
+			Ctx.rgiPacked.push_back ( iRecip );
+		}
+
+		for ( ULONG i = 0; i < Ctx.rgiPacked.size ( ); i += m_cRecipLimit )
+		{
+			BULKPACK Pack;
+
+			Pack.iFirst = i;
+			Pack.cRecips = min ( m_cRecipLimit, (ULONG) Ctx.rgiPacked.size ( ) - i );
+			Ctx.rgPacks.push_back ( Pack );
+		}
+	}
+
+	if ( 0 == cWorkers )
+		cWorkers = 1;
+	if ( Ctx.rgPacks.empty ( ) && cWorkers > rgRecips.size ( ) )
+		cWorkers = (ULONG) rgRecips.size ( );
+	if ( !Ctx.rgPacks.empty ( ) && cWorkers > Ctx.rgPacks.size ( ) )
+		cWorkers = (ULONG) Ctx.rgPacks.size ( );
+	Ctx.rgdMs.assign ( Ctx.rgPacks.empty ( ) ? rgRecips.size ( ) : Ctx.rgPacks.size ( ), 0.0 );
+
+	QueryPerformanceFrequency ( &liFreq );
+	QueryPerformanceCounter ( &liStart );
+	if ( FAILED ( Workers.Start ( cWorkers, Ctx.rgPacks.empty ( ) ? BulkSendWorker : BulkPackWorker, &Ctx ) ) )
+	{
+		Workers.Join ( );
+		return MAPI_E_FAILURE;
+	}
+	Workers.Join ( );
+	QueryPerformanceCounter ( &liEnd );
+
+	if ( 0 == Ctx.cSessions )
+		return MAPI_E_LOGIN_FAILURE;
+
+	if ( !Ctx.rgPacks.empty ( ) )
+	{
+		for ( size_t i = 0; i < rgiSentAs.size ( ); i++ )
+			Ctx.rghRes[i] = Ctx.rghRes[rgiSentAs[i]];
+		m_cRecipLimit = (ULONG) Ctx.cRecipLimit;
+	}
+
+	for ( size_t i = 0; i < rgRecips.size ( ); i++ )
+	{
+		if ( SUCCESS_SUCCESS == Ctx.rghRes[i] )
+			cSent++;
+	}
+
+	if ( lpStats )
+	{
+		rgdMs.swap ( Ctx.rgdMs );
+		for ( size_t i = 0; i < rgdMs.size ( ); i++ )
+			dMsTotal += rgdMs[i];
+
+		lpStats -> cSent = cSent;
+		lpStats -> cFailed = (ULONG) rgRecips.size ( ) - cSent;
+		lpStats -> cSessions = (ULONG) Ctx.cSessions;
+		lpStats -> cDuplicates = cDuplicates;
+		lpStats -> cCalls = (ULONG) Ctx.cCalls;
+		lpStats -> cRecipLimit = Ctx.rgPacks.empty ( ) ? 1L : (ULONG) Ctx.cRecipLimit;
+		lpStats -> dMsElapsed = (double) ( liEnd.QuadPart - liStart.QuadPart ) * 1000.0 / (double) liFreq.QuadPart;
+		lpStats -> dPerSecond = cSent * 1000.0 / ( lpStats -> dMsElapsed > 0.0 ? lpStats -> dMsElapsed : 1.0 );
+		lpStats -> dMsMean = dMsTotal / rgdMs.size ( );
+
+		// Each percentile is found with nth_element on a range that narrows
+		// as they rise, which is cheaper than sorting every latency.
+		std::nth_element ( rgdMs.begin ( ), rgdMs.begin ( ) + rgdMs.size ( ) / 2, rgdMs.end ( ) );
+		lpStats -> dMsMedian = rgdMs[rgdMs.size ( ) / 2];
+		std::nth_element ( rgdMs.begin ( ) + rgdMs.size ( ) / 2, rgdMs.begin ( ) + rgdMs.size ( ) * 95 / 100, rgdMs.end ( ) );
+		lpStats -> dMsP95 = rgdMs[rgdMs.size ( ) * 95 / 100];
+		std::nth_element ( rgdMs.begin ( ) + rgdMs.size ( ) * 95 / 100, rgdMs.begin ( ) + rgdMs.size ( ) * 99 / 100, rgdMs.end ( ) );
+		lpStats -> dMsP99 = rgdMs[rgdMs.size ( ) * 99 / 100];
+		lpStats -> dMsMax = *std::max_element ( rgdMs.begin ( ) + rgdMs.size ( ) * 99 / 100, rgdMs.end ( ) );
+	}
+
+	if ( prghRes )
+		prghRes -> swap ( Ctx.rghRes );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSetRecipientLimit ( )
+|
+|	Parameters:	[IN] cMaxRecips == Recipients cBulkSend may pack into one
+|				message, or 1 to send each recipient a copy of its own.
+|
+|	Purpose:	Sets the most recipients the provider is expected to
+|				accept in one message. cBulkSend lowers it by itself if
+|				the provider refuses a message for having too many.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSetRecipientLimit ( ULONG cMaxRecips )
+{
+	m_cRecipLimit = max ( cMaxRecips, 1L );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cBulkSendMessages ( )
+|
+|	Purpose:	Asks for a recipient file, a template file and a number of
+|				sessions, sends the template to every recipient with
+|				cBulkSend and prints the throughput, the send latencies and
+|				the first recipients that could not be sent to.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cBulkSendMessages ( )
+{
+	HRESULT hRes = S_OK;
+	LPSTR lpszRecipFile = NULL,
+		  lpszTemplateFile = NULL,
+		  lpszWorkers = NULL;
+	std::vector<BULKRECIPIENT> rgRecips;
+	std::vector<HRESULT> rghRes;
+	BULKTEMPLATE Template;
+	BULKSENDSTATS Stats;
+	CMailMerge Merge;
+	std::string sBadField;
+	ULONG cWorkers = 0L;
+	ULONG cShown = 0L;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	if ( SUCCEEDED ( hRes = cCaptureText ( "Recipient file: ", &lpszRecipFile ) ) &&
+		 SUCCEEDED ( hRes = cCaptureText ( "Template file: ", &lpszTemplateFile ) ) &&
+		 SUCCEEDED ( hRes = cCaptureText ( "Sessions to send on (0 for the default): ", &lpszWorkers ) ) )
+	{
+		if ( 0 == ( cWorkers = strtoul ( lpszWorkers, NULL, 10 ) ) )
+			cWorkers = BULK_WORKERS;
+
+		if ( SUCCESS_SUCCESS != ( hRes = BulkLoadRecipients ( lpszRecipFile, &rgRecips ) ) )
+			printf ( "Could not read %s.\r\n", lpszRecipFile );
+		else if ( SUCCESS_SUCCESS != ( hRes = BulkLoadTemplate ( lpszTemplateFile, &Template ) ) )
+			printf ( "Could not read %s.\r\n", lpszTemplateFile );
+		else if ( FAILED ( hRes = Merge.Compile ( Template, &sBadField ) ) )
+			printf ( "The template has an unknown field %s.\r\n", sBadField.c_str ( ) );
+		else
+		{
+			printf ( "Sending \"%s\" to %lu recipients on %lu sessions.\r\n",
+					 Template.sSubject.c_str ( ), (ULONG) rgRecips.size ( ), cWorkers );
+
+			if ( SUCCESS_SUCCESS != ( hRes = cBulkSend ( cWorkers, Template, rgRecips, &rghRes, &Stats ) ) )
+				printf ( "Bulk send failed due to error code %d.\r\n", hRes );
+			else if ( !rgRecips.empty ( ) )
+			{
+				printf ( "%lu sent, %lu failed in %.0f ms on %lu sessions, %.1f messages/s.\r\n",
+						 Stats.cSent, Stats.cFailed, Stats.dMsElapsed, Stats.cSessions, Stats.dPerSecond );
+				printf ( "Send latency: mean %.1f ms, median %.1f ms, 95th %.1f ms, 99th %.1f ms, max %.1f ms.\r\n",
+						 Stats.dMsMean, Stats.dMsMedian, Stats.dMsP95, Stats.dMsP99, Stats.dMsMax );
+				if ( Stats.cRecipLimit > 1 )
+					printf ( "Packed up to %lu recipients per message in %lu MAPISendMail calls; %lu duplicates skipped.\r\n",
+							 Stats.cRecipLimit, Stats.cCalls, Stats.cDuplicates );
+
+				for ( size_t i = 0; i < rghRes.size ( ) && cShown < BULK_FAILURES_SHOWN; i++ )
+				{
+					if ( SUCCESS_SUCCESS != rghRes[i] )
+					{
+						printf ( "  %s: error code %d\r\n", rgRecips[i].sAddress.c_str ( ), rghRes[i] );
+						cShown++;
+					}
+				}
+				if ( Stats.cFailed > cShown )
+					printf ( "  and %lu more.\r\n", Stats.cFailed - cShown );
+			}
+		}
+	}
+
+	cFreeBuffer ( lpszRecipFile );
+	cFreeBuffer ( lpszTemplateFile );
+	cFreeBuffer ( lpszWorkers );
+
+	return hRes;
+}
@@ -0,0 +1,41 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		BulkSend.h
+|
+|   Purpose:	Declares the file formats read by cBulkSend's menu
+|				command.
+|
+|				A recipient file has one recipient per line, either a
+|				bare address or a display name followed by the address
+|				in angle brackets:
+|
+|					alice@example.com
+|					Bob Brown <bob@example.com>
+|
+|				Blank lines and lines starting with # are skipped. An
+|				address without a type is given SMTP:, so MAPISendMail
+|				uses it as it is instead of resolving the name. Columns
+|				separated by tabs may follow the address; the mail
+|				merge fills them in for {{1}}, {{2}} and so on.
+|
+|				A template file is the message text. If its first line
+|				starts with "Subject:", the rest of that line is the
+|				subject and the text starts after it, past one blank
+|				line if there is one. Both may hold mail merge fields
+|				(MailMerge.h).
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _BULKSEND_H
+#define _BULKSEND_H
+
+#include "swap.h"
+
+#define BULK_WORKERS			8		// Sessions sending in parallel by default
+
+HRESULT	BulkLoadRecipients ( LPCSTR lpszFile, std::vector<BULKRECIPIENT> *prgRecips );
+HRESULT	BulkLoadTemplate ( LPCSTR lpszFile, BULKTEMPLATE *pTemplate );
+
+#endif
@@ -0,0 +1,496 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		ConvTree.cpp
+|
+|   Purpose:	Implementation of CConversationTree, and of the CApp
+|				methods behind the threaded Inbox listing.
+|
++---------------------------------------------------------------------
+*/
+
+#include "convtree.h"
+#include "output.h"
+#include <algorithm>
+
+// Orders nodes by date received, then by the order they were added.
+class CConvDateLess
+{
+private:
+	const std::vector<LPCSTR>	&m_rglpszDates;
+
+public:
+	CConvDateLess ( const std::vector<LPCSTR> &rglpszDates ) : m_rglpszDates ( rglpszDates ) { }
+
+	bool operator ( ) ( ULONG i1, ULONG i2 ) const
+	{
+		int nCompare = strcmp ( m_rglpszDates[i1], m_rglpszDates[i2] );
+
+		return nCompare < 0 || ( 0 == nCompare && i1 < i2 );
+	}
+};
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	ConvIndexFromHex()
+|
+|	Purpose:	Decodes a conversation index given in hex, as in the
+|				lpszConversationID of a Simple MAPI message. Returns
+|				FALSE, leaving *psIndex empty, for anything that is not
+|				a header and whole blocks in hex.
+|
++---------------------------------------------------------------------
+*/
+BOOL ConvIndexFromHex ( LPCSTR lpszHex, std::string *psIndex )
+{
+	size_t cch = lpszHex ? strlen ( lpszHex ) : 0;
+
+	psIndex -> clear ( );
+
+	if ( cch % 2 || cch / 2 < CONV_ROOT_SIZE || ( cch / 2 - CONV_ROOT_SIZE ) % CONV_BLOCK_SIZE )
+		return FALSE;
+
+	psIndex -> reserve ( cch / 2 );
+	for ( size_t i = 0; i < cch; i += 2 )
+	{
+		int nHigh = 0;
+		int nLow = 0;
+
+		if ( !isxdigit ( (BYTE) lpszHex[i] ) || !isxdigit ( (BYTE) lpszHex[i + 1] ) )
+		{
+			psIndex -> clear ( );
+			return FALSE;
+		}
+		nHigh = isdigit ( (BYTE) lpszHex[i] ) ? lpszHex[i] - '0' : ( lpszHex[i] | 0x20 ) - 'a' + 10;
+		nLow = isdigit ( (BYTE) lpszHex[i + 1] ) ? lpszHex[i + 1] - '0' : ( lpszHex[i + 1] | 0x20 ) - 'a' + 10;
+		*psIndex += (char) ( ( nHigh << 4 ) | nLow );
+	}
+
+	return TRUE;
+}
+
+CConversationTree::CConversationTree ( )
+{
+	m_cMessages = 0L;
+}
+
+void CConversationTree::Clear ( void )
+{
+	m_rgNodes.clear ( );
+	m_rgConversations.clear ( );
+	m_rgiNodes.clear ( );
+	m_Indexes.clear ( );
+	m_Roots.clear ( );
+	m_Subjects.clear ( );
+	m_cMessages = 0L;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	NormalizeSubject()
+|
+|	Purpose:	Lower-cases a subject and removes the reply and
+|				forward prefixes in front of it, such as "RE: ",
+|				"Fwd: " or "RE[2]: ", and the white space around them.
+|
++---------------------------------------------------------------------
+*/
+void CConversationTree::NormalizeSubject ( LPCSTR lpszSubject, std::string *psKey )
+{
+	static LPCSTR rglpszPrefixes[] = { "re", "fwd", "fw", "aw", "wg", "sv" };
+	LPCSTR lpsz = lpszSubject;
+	BOOL fPrefix = TRUE;
+
+	psKey -> clear ( );
+
+	while ( fPrefix )
+	{
+		fPrefix = FALSE;
+		while ( ' ' == *lpsz || '\t' == *lpsz )
+			lpsz++;
+
+		for ( size_t i = 0; i < _countof ( rglpszPrefixes ) && !fPrefix; i++ )
+		{
+			size_t cch = strlen ( rglpszPrefixes[i] );
+			LPCSTR lpszAfter = lpsz + cch;
+
+			if ( _strnicmp ( lpsz, rglpszPrefixes[i], cch ) )
+				continue;
+
+			if ( '[' == *lpszAfter )
+			{
+				while ( isdigit ( (BYTE) *++lpszAfter ) )
+					;
+				if ( ']' != *lpszAfter++ )
+					continue;
+			}
+			if ( ':' == *lpszAfter )
+			{
+				lpsz = lpszAfter + 1;
+				fPrefix = TRUE;
+			}
+		}
+	}
+
+	for ( ; *lpsz; lpsz++ )
+		*psKey += (char) ( ( *lpsz >= 'A' && *lpsz <= 'Z' ) ? *lpsz - 'A' + 'a' : *lpsz );
+	while ( !psKey -> empty ( ) && ( ' ' == psKey -> back ( ) || '\t' == psKey -> back ( ) ) )
+		psKey -> erase ( psKey -> size ( ) - 1 );
+}
+
+ULONG CConversationTree::NewConversation ( const std::string &sSubjectKey )
+{
+	ULONG iConversation = (ULONG) m_rgConversations.size ( );
+
+	m_rgConversations.push_back ( CONVERSATION ( ) );
+	m_rgConversations.back ( ).cMessages = 0L;
+	m_rgConversations.back ( ).fIndexed = FALSE;
+	if ( !sSubjectKey.empty ( ) )
+		m_Subjects.insert ( std::make_pair ( sSubjectKey, iConversation ) );
+
+	return iConversation;
+}
+
+void CConversationTree::Link ( ULONG iNode, ULONG iParent )
+{
+	m_rgNodes[iNode].iParent = iParent;
+	if ( CONV_NONE == iParent )
+		m_rgConversations[m_rgNodes[iNode].iConversation].rgiTop.push_back ( iNode );
+	else
+		m_rgNodes[iParent].rgiChildren.push_back ( iNode );
+}
+
+void CConversationTree::Unlink ( ULONG iNode )
+{
+	ULONG iParent = m_rgNodes[iNode].iParent;
+	std::vector<ULONG> &rgiSiblings = CONV_NONE == iParent ?
+									  m_rgConversations[m_rgNodes[iNode].iConversation].rgiTop :
+									  m_rgNodes[iParent].rgiChildren;
+
+	rgiSiblings.erase ( std::find ( rgiSiblings.begin ( ), rgiSiblings.end ( ), iNode ) );
+	m_rgNodes[iNode].iParent = CONV_NONE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Add()
+|
+|	Purpose:	Places a message in its conversation. A message that
+|				is already in the tree has its header updated, such as
+|				its read flag, and stays where it is.
+|
++---------------------------------------------------------------------
+*/
+void CConversationTree::Add ( const MSGHEADER &Header )
+{
+	const std::string &sIndex = Header.sConversationIndex;
+	ULONG iNode = (ULONG) m_rgNodes.size ( );
+	ULONG iParent = CONV_NONE;
+	BOOL fIndex = sIndex.size ( ) >= CONV_ROOT_SIZE && 0 == ( sIndex.size ( ) - CONV_ROOT_SIZE ) % CONV_BLOCK_SIZE;
+	std::string sSubjectKey;
+	std::map<std::string, ULONG>::iterator it;
+
+	if ( MSGID_NONE == Header.hMsgID )
+		return;
+
+	if ( Contains ( Header.hMsgID ) )
+	{
+		m_rgNodes[m_rgiNodes[Header.hMsgID] - 1].Header = Header;
+		return;
+	}
+
+	m_rgNodes.push_back ( CONVNODE ( ) );
+	m_rgNodes[iNode].Header = Header;
+	m_rgNodes[iNode].iParent = CONV_NONE;
+	if ( Header.hMsgID >= m_rgiNodes.size ( ) )
+		m_rgiNodes.resize ( max ( (size_t) Header.hMsgID + 1, 2 * m_rgiNodes.size ( ) ), 0 );
+	m_rgiNodes[Header.hMsgID] = iNode + 1;
+
+	NormalizeSubject ( Header.sSubject.c_str ( ), &sSubjectKey );
+
+	if ( fIndex )
+	{
+		std::string sRoot ( sIndex, 0, CONV_ROOT_SIZE );
+
+		if ( m_Roots.end ( ) == ( it = m_Roots.find ( sRoot ) ) )
+		{
+			ULONG iConversation = CONV_NONE;
+
+			if ( !sSubjectKey.empty ( ) && m_Subjects.end ( ) != ( it = m_Subjects.find ( sSubjectKey ) ) &&
+				 !m_rgConversations[it -> second].fIndexed )
+				iConversation = it -> second;
+			else
+				iConversation = NewConversation ( sSubjectKey );
+			m_rgConversations[iConversation].fIndexed = TRUE;
+			it = m_Roots.insert ( std::make_pair ( sRoot, iConversation ) ).first;
+		}
+		m_rgNodes[iNode].iConversation = it -> second;
+
+		if ( m_Indexes.end ( ) != ( it = m_Indexes.find ( sIndex ) ) )
+		{
+			// A second message with the same index, such as a copy, goes
+			// under the first, and moves with it.
+			iParent = it -> second;
+		}
+		else
+		{
+			for ( size_t cb = sIndex.size ( ); cb > CONV_ROOT_SIZE && CONV_NONE == iParent; )
+			{
+				cb -= CONV_BLOCK_SIZE;
+				if ( m_Indexes.end ( ) != ( it = m_Indexes.find ( sIndex.substr ( 0, cb ) ) ) )
+					iParent = it -> second;
+			}
+
+			// Replies that arrived first hang from this message's nearest
+			// ancestor, or from nothing; they move under this message.
+			it = m_Indexes.insert ( std::make_pair ( sIndex, iNode ) ).first;
+			for ( ++it; it != m_Indexes.end ( ) && 0 == it -> first.compare ( 0, sIndex.size ( ), sIndex ); ++it )
+			{
+				if ( m_rgNodes[it -> second].iParent == iParent )
+				{
+					Unlink ( it -> second );
+					Link ( it -> second, iNode );
+				}
+			}
+		}
+	}
+	else if ( !sSubjectKey.empty ( ) && m_Subjects.end ( ) != ( it = m_Subjects.find ( sSubjectKey ) ) )
+	{
+		CONVERSATION &Conversation = m_rgConversations[it -> second];
+
+		m_rgNodes[iNode].iConversation = it -> second;
+		if ( !Conversation.rgiTop.empty ( ) )
+			iParent = Conversation.rgiTop[0];
+	}
+	else
+		m_rgNodes[iNode].iConversation = NewConversation ( sSubjectKey );
+
+	// Messages grouped by subject before the conversation had a message
+	// with an index answer the first that has one.
+	if ( CONV_NONE == iParent && fIndex )
+	{
+		std::vector<ULONG> rgiTop = m_rgConversations[m_rgNodes[iNode].iConversation].rgiTop;
+
+		for ( size_t i = 0; i < rgiTop.size ( ); i++ )
+		{
+			if ( !m_Indexes.count ( m_rgNodes[rgiTop[i]].Header.sConversationIndex ) )
+			{
+				Unlink ( rgiTop[i] );
+				Link ( rgiTop[i], iNode );
+			}
+		}
+	}
+
+	Link ( iNode, iParent );
+	m_rgConversations[m_rgNodes[iNode].iConversation].cMessages++;
+	m_cMessages++;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Remove()
+|
+|	Purpose:	Takes a message out of the views. Its node stays, so
+|				its replies keep their place under it.
+|
++---------------------------------------------------------------------
+*/
+void CConversationTree::Remove ( MSGIDHANDLE hMsgID )
+{
+	ULONG iNode = 0;
+
+	if ( !Contains ( hMsgID ) )
+		return;
+
+	iNode = m_rgiNodes[hMsgID] - 1;
+	m_rgiNodes[hMsgID] = 0;
+	m_rgNodes[iNode].Header.hMsgID = MSGID_NONE;
+	m_rgConversations[m_rgNodes[iNode].iConversation].cMessages--;
+	m_cMessages--;
+}
+
+// Adds the rows of a node and its replies, oldest reply first. A removed
+// message is shown only when some of its replies are.
+void CConversationTree::Emit ( ULONG iNode, ULONG ulDepth, std::vector<CONVROW> *pRows )
+{
+	CONVNODE &Node = m_rgNodes[iNode];
+	size_t iRow = pRows -> size ( );
+	CONVROW Row;
+
+	Row.pHeader = MSGID_NONE == Node.Header.hMsgID ? NULL : &Node.Header;
+	Row.ulDepth = ulDepth;
+	Row.iConversation = Node.iConversation;
+	Row.cMessages = m_rgConversations[Node.iConversation].cMessages;
+	pRows -> push_back ( Row );
+
+	for ( size_t i = 0; i < Node.rgiChildren.size ( ); i++ )
+		Emit ( Node.rgiChildren[i], ulDepth + 1, pRows );
+
+	if ( NULL == Row.pHeader && pRows -> size ( ) == iRow + 1 )
+		pRows -> pop_back ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	GetView()
+|
+|	Purpose:	Lists the conversations, the one with the newest
+|				message first, each as its messages in tree order with
+|				replies under the message they answer. The rows point
+|				into the tree and are valid until it next changes.
+|
++---------------------------------------------------------------------
+*/
+void CConversationTree::GetView ( std::vector<CONVROW> *pRows )
+{
+	std::vector<LPCSTR> rglpszDates ( m_rgNodes.size ( ) );
+	std::vector<LPCSTR> rglpszLatest ( m_rgConversations.size ( ), "" );
+	std::vector<ULONG> rgiOrder;
+	CConvDateLess DateLess ( rglpszDates );
+
+	pRows -> clear ( );
+	pRows -> reserve ( m_cMessages );
+
+	for ( ULONG iNode = 0; iNode < m_rgNodes.size ( ); iNode++ )
+	{
+		const CONVNODE &Node = m_rgNodes[iNode];
+
+		rglpszDates[iNode] = Node.Header.szDateReceived;
+		if ( MSGID_NONE != Node.Header.hMsgID && strcmp ( Node.Header.szDateReceived, rglpszLatest[Node.iConversation] ) > 0 )
+			rglpszLatest[Node.iConversation] = Node.Header.szDateReceived;
+	}
+
+	for ( ULONG iNode = 0; iNode < m_rgNodes.size ( ); iNode++ )
+	{
+		std::vector<ULONG> &rgiChildren = m_rgNodes[iNode].rgiChildren;
+
+		if ( rgiChildren.size ( ) > 1 )
+			std::sort ( rgiChildren.begin ( ), rgiChildren.end ( ), DateLess );
+	}
+
+	for ( ULONG iConversation = 0; iConversation < m_rgConversations.size ( ); iConversation++ )
+	{
+		if ( m_rgConversations[iConversation].cMessages )
+			rgiOrder.push_back ( iConversation );
+	}
+
+	// Newest first: sort oldest first by the latest date and walk backward.
+	std::sort ( rgiOrder.begin ( ), rgiOrder.end ( ), CConvDateLess ( rglpszLatest ) );
+
+	for ( size_t i = rgiOrder.size ( ); i-- > 0; )
+	{
+		CONVERSATION &Conversation = m_rgConversations[rgiOrder[i]];
+
+		std::sort ( Conversation.rgiTop.begin ( ), Conversation.rgiTop.end ( ), DateLess );
+		for ( size_t iTop = 0; iTop < Conversation.rgiTop.size ( ); iTop++ )
+			Emit ( Conversation.rgiTop[iTop], 0, pRows );
+	}
+
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cUpdateConversations ( )
+|
+|	Parameters:	[OUT] pcNew == Receives the number of messages that arrived
+|				since the last update. May be NULL.
+|
+|	Purpose:	Brings the conversation tree up to date with the Inbox using
+|				cFetchNewInboxHeaders, so only new mail is threaded. Known
+|				messages have their headers refreshed in place. The tree is
+|				rebuilt when the whole Inbox was read again or messages
+|				have left the header cache.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cUpdateConversations ( ULONG *pcNew )
+{
+	HRESULT hRes = S_OK;
+	MSGHEADERLIST View;
+	ULONG cNew = 0L;
+
+	if ( pcNew )
+		*pcNew = 0L;
+
+	if ( SUCCESS_SUCCESS != ( hRes = cFetchNewInboxHeaders ( szCURSORFILE, &View, &cNew ) ) )
+		return hRes;
+
+	if ( NULL == m_pConversations )
+		m_pConversations = new CConversationTree;
+
+	if ( cNew == View.size ( ) || m_pConversations -> MessageCount ( ) != View.size ( ) - cNew )
+		m_pConversations -> Clear ( );
+
+	for ( size_t i = 0; i < View.size ( ); i++ )
+		m_pConversations -> Add ( View[i] );
+
+	if ( pcNew )
+		*pcNew = cNew;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cListInboxConversations ( )
+|
+|	Purpose:	Prints the Inbox as conversations, the most recently active
+|				first, with each reply indented under the message it
+|				answers.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cListInboxConversations ( )
+{
+	HRESULT hRes = S_OK;
+	std::vector<CONVROW> rgRows;
+	ULONG cNew = 0L;
+	ULONG cConversations = 0L;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	if ( SUCCESS_SUCCESS != ( hRes = cUpdateConversations ( &cNew ) ) )
+	{
+		printf ( "Threaded listing failed due to error code %d.\r\n", hRes );
+		return hRes;
+	}
+
+	m_pConversations -> GetView ( &rgRows );
+
+	for ( size_t i = 0; i < rgRows.size ( ); i++ )
+	{
+		const CONVROW &Row = rgRows[i];
+
+		// A conversation is named after its first message still in the Inbox.
+		if ( 0 == i || Row.iConversation != rgRows[i - 1].iConversation )
+		{
+			size_t iNamed = i;
+
+			while ( NULL == rgRows[iNamed].pHeader )
+				iNamed++;
+			g_StdOut.Printf ( "== %s (%lu messages)\r\n", rgRows[iNamed].pHeader -> sSubject.c_str ( ), Row.cMessages );
+			cConversations++;
+		}
+
+		if ( Row.pHeader )
+			g_StdOut.Printf ( "%-16s  %-24.24s  %*s%s\r\n", Row.pHeader -> szDateReceived,
+							  Row.pHeader -> sOriginator.c_str ( ), (int) ( 2 * Row.ulDepth ), "",
+							  Row.pHeader -> sSubject.c_str ( ) );
+		else
+			g_StdOut.Printf ( "%-16s  %-24.24s  %*s(deleted)\r\n", "", "", (int) ( 2 * Row.ulDepth ), "" );
+	}
+	g_StdOut.Printf ( "%lu conversations, %lu messages, %lu new.\r\n",
+					  cConversations, m_pConversations -> MessageCount ( ), cNew );
+	g_StdOut.Flush ( );
+
+	return SUCCESS_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		ConvTree.h
+|
+|   Purpose:	Declares CConversationTree, which groups Inbox headers
+|				into conversations for the threaded listing.
+|
+|				A conversation index (PR_CONVERSATION_INDEX) is a
+|				22-byte header, the same for every message of a
+|				conversation, followed by one 5-byte block per reply.
+|				A message's parent is the message whose index is its
+|				own less the last block. The indexes are kept in a
+|				sorted map, so a message's parent, or its nearest
+|				ancestor in the Inbox when the parent is not there, is
+|				found in O(log n), and a message that arrives after its
+|				replies adopts them from the range of keys that start
+|				with its own. Building the tree is O(n log n), and
+|				adding a new message costs O(log n) plus the replies it
+|				adopts.
+|
+|				Messages without an index join the conversation of the
+|				first message with the same subject once prefixes such
+|				as RE: and FW: are removed, as a reply to its first
+|				message, or start one of their own. When the first
+|				message with an index arrives for a conversation that
+|				so far was grouped only by subject, it takes that
+|				conversation over and the messages at its top become
+|				replies to it. Two conversations with indexes are never
+|				merged because their subjects match.
+|
+|				A CConversationTree is not thread safe.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _CONVTREE_H
+#define _CONVTREE_H
+
+#include "swap.h"
+#include <map>
+
+#define CONV_ROOT_SIZE		22			// Header of a conversation index
+#define CONV_BLOCK_SIZE		5			// Each reply adds one block
+#define CONV_NONE			0xFFFFFFFF
+
+// One line of a threaded view.
+typedef struct _CONVROW
+{
+	const MSGHEADER	*pHeader;			// NULL for a removed message with replies still in the Inbox
+	ULONG			ulDepth;			// 0 for the messages that start the conversation
+	ULONG			iConversation;		// Rows of a conversation are adjacent
+	ULONG			cMessages;			// Messages in the conversation
+} CONVROW;
+
+class CConversationTree
+{
+private:
+	typedef struct _CONVNODE
+	{
+		MSGHEADER				Header;			// hMsgID is MSGID_NONE once removed
+		ULONG					iParent;		// CONV_NONE at the top of a conversation
+		ULONG					iConversation;
+		std::vector<ULONG>		rgiChildren;
+	} CONVNODE;
+
+	typedef struct _CONVERSATION
+	{
+		std::vector<ULONG>		rgiTop;			// Nodes without a parent
+		ULONG					cMessages;
+		BOOL					fIndexed;		// Has a message with a conversation index
+	} CONVERSATION;
+
+	std::vector<CONVNODE>				m_rgNodes;
+	std::vector<CONVERSATION>			m_rgConversations;
+	std::vector<ULONG>					m_rgiNodes;			// By MSGIDHANDLE; node + 1, 0 == none
+	std::map<std::string, ULONG>		m_Indexes;			// Conversation index to node
+	std::map<std::string, ULONG>		m_Roots;			// Index header to conversation
+	std::map<std::string, ULONG>		m_Subjects;			// Normalized subject to conversation
+	ULONG								m_cMessages;
+
+	ULONG	NewConversation ( const std::string &sSubjectKey );
+	void	Link ( ULONG iNode, ULONG iParent );
+	void	Unlink ( ULONG iNode );
+	void	Emit ( ULONG iNode, ULONG ulDepth, std::vector<CONVROW> *pRows );
+
+public:
+	CConversationTree ( );
+
+	void	Add ( const MSGHEADER &Header );
+	void	Remove ( MSGIDHANDLE hMsgID );
+	BOOL	Contains ( MSGIDHANDLE hMsgID ) { return hMsgID < m_rgiNodes.size ( ) && m_rgiNodes[hMsgID]; }
+	void	GetView ( std::vector<CONVROW> *pRows );
+	void	Clear ( void );
+	ULONG	MessageCount ( void ) { return m_cMessages; }
+
+	static void	NormalizeSubject ( LPCSTR lpszSubject, std::string *psKey );
+};
+
+BOOL	ConvIndexFromHex ( LPCSTR lpszHex, std::string *psIndex );
+
+#endif
@@ -0,0 +1,69 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Crc32.cpp
+|
+|   Purpose:	Implementation of Crc32.
+|
++---------------------------------------------------------------------
+*/
+
+#include "crc32.h"
+
+// Eight tables let the CRC take eight bytes a step; the crc32 instruction
+// of SSE 4.2 computes CRC-32C and cannot be used.
+static struct CRCTABLES
+{
+	UINT32	rg[8][256];
+
+	CRCTABLES ( )
+	{
+		for ( UINT32 i = 0; i < 256; i++ )
+		{
+			UINT32 ul = i;
+
+			for ( int iBit = 0; iBit < 8; iBit++ )
+				ul = ( ul & 1 ) ? ( ul >> 1 ) ^ 0xEDB88320 : ( ul >> 1 );
+			rg[0][i] = ul;
+		}
+		for ( UINT32 i = 0; i < 256; i++ )
+			for ( int iTable = 1; iTable < 8; iTable++ )
+				rg[iTable][i] = ( rg[iTable - 1][i] >> 8 ) ^ rg[0][rg[iTable - 1][i] & 0xFF];
+	}
+} g_Crc;
+
+static inline UINT32 CrcReadLE32 ( const BYTE *pb )
+{
+	return (UINT32) pb[0] | ( (UINT32) pb[1] << 8 ) | ( (UINT32) pb[2] << 16 ) | ( (UINT32) pb[3] << 24 );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Crc32()
+|
+|	Purpose:	Continues the CRC ulCrc over cb more bytes. Start at 0.
+|
++---------------------------------------------------------------------
+*/
+ULONG Crc32 ( ULONG ulCrc, const BYTE *pb, size_t cb )
+{
+	UINT32 ul = (UINT32) ulCrc;
+
+	while ( cb >= 8 )
+	{
+		UINT32 ulLow = ul ^ CrcReadLE32 ( pb );
+		UINT32 ulHigh = CrcReadLE32 ( pb + 4 );
+
+		ul = g_Crc.rg[7][ulLow & 0xFF] ^ g_Crc.rg[6][( ulLow >> 8 ) & 0xFF] ^
+			 g_Crc.rg[5][( ulLow >> 16 ) & 0xFF] ^ g_Crc.rg[4][ulLow >> 24] ^
+			 g_Crc.rg[3][ulHigh & 0xFF] ^ g_Crc.rg[2][( ulHigh >> 8 ) & 0xFF] ^
+			 g_Crc.rg[1][( ulHigh >> 16 ) & 0xFF] ^ g_Crc.rg[0][ulHigh >> 24];
+		pb += 8;
+		cb -= 8;
+	}
+	while ( cb-- )
+		ul = g_Crc.rg[0][( ul ^ *pb++ ) & 0xFF] ^ ( ul >> 8 );
+
+	return ul;
+}
@@ -0,0 +1,21 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Crc32.h
+|
+|   Purpose:	Declares the CRC-32 shared by the compressed RTF codec
+|				and the outbox journal. It is the CRC-32 of
+|				[MS-OXRTFCP] (polynomial 0xEDB88320), started at 0 and
+|				not inverted at the end.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+#include "swap.h"
+
+ULONG	Crc32 ( ULONG ulCrc, const BYTE *pb, size_t cb );
+
+#endif
@@ -0,0 +1,475 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Cursor.cpp
+|
+|   Purpose:	Incremental Inbox listing. The headers seen so far are
+|				kept in the header cache (HdrCache.h) and the ID of the
+|				last message listed in a cursor file. A later listing
+|				continues MAPIFindNext from that ID, so only mail
+|				delivered since then is read.
+|
+|				Cursor file layout, all integers little-endian ULONGs:
+|
+|					"SMCR" version
+|					profile name			(length, bytes)
+|					seed message ID			(length, bytes)
+|					header cache ID			(two ULONGs)
+|					digest of the above		(two ULONGs, FNV-1a 64)
+|
++---------------------------------------------------------------------
+*/
+
+#include "swap.h"
+#include "hdrcache.h"
+#include "output.h"
+
+#define CURSOR_MAGIC		0x52434D53		// "SMCR"
+#define CURSOR_VERSION		2
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	CursorDigest()
+|
+|	Purpose:	FNV-1a 64 bit hash of a block of bytes. Detects a cursor
+|				file that was truncated or damaged.
+|
++---------------------------------------------------------------------
+*/
+static ULONGLONG CursorDigest ( const std::string &sBytes )
+{
+	ULONGLONG ullHash = 14695981039346656037ULL;
+
+	for ( size_t i = 0; i < sBytes.size ( ); i++ )
+	{
+		ullHash ^= (BYTE) sBytes[i];
+		ullHash *= 1099511628211ULL;
+	}
+
+	return ullHash;
+}
+
+static void CursorPutULong ( std::string &sOut, ULONG ul )
+{
+	BYTE rgb[4] = { (BYTE) ul, (BYTE) ( ul >> 8 ), (BYTE) ( ul >> 16 ), (BYTE) ( ul >> 24 ) };
+
+	sOut.append ( (const char *) rgb, sizeof ( rgb ) );
+}
+
+static void CursorPutString ( std::string &sOut, const std::string &s )
+{
+	CursorPutULong ( sOut, (ULONG) s.size ( ) );
+	sOut.append ( s );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Class:		CCursorReader
+|
+|	Purpose:	Reads the fields written by the CursorPut functions from
+|				a block of bytes. Any read past the end of the block
+|				sets m_fFailed and returns an empty value.
+|
++---------------------------------------------------------------------
+*/
+class CCursorReader
+{
+private:
+	const std::string	&m_sBytes;
+	size_t				m_ib;
+
+public:
+	BOOL				m_fFailed;
+
+	CCursorReader ( const std::string &sBytes, size_t ibStart ) : m_sBytes ( sBytes )
+	{
+		m_ib = ibStart;
+		m_fFailed = FALSE;
+	}
+
+	size_t Offset ( void ) { return m_ib; }
+
+	ULONG GetULong ( void )
+	{
+		const BYTE *pb = (const BYTE *) m_sBytes.data ( ) + m_ib;
+
+		if ( m_fFailed || m_sBytes.size ( ) - m_ib < 4 )
+		{
+			m_fFailed = TRUE;
+			return 0L;
+		}
+		m_ib += 4;
+
+		return pb[0] | ( pb[1] << 8 ) | ( pb[2] << 16 ) | ( (ULONG) pb[3] << 24 );
+	}
+
+	std::string GetString ( void )
+	{
+		ULONG cb = GetULong ( );
+
+		if ( m_fFailed || m_sBytes.size ( ) - m_ib < cb )
+		{
+			m_fFailed = TRUE;
+			return std::string ( );
+		}
+		m_ib += cb;
+
+		return m_sBytes.substr ( m_ib - cb, cb );
+	}
+};
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	LoadInboxCursor()
+|
+|	Parameters:	[IN] lpszCursorFile == Cursor file to read.
+|				[IN] lpszProfileName == Profile the cursor must belong to.
+|				[IN] ullCacheID == ID of the open header cache.
+|				[OUT] lpszSeedMsgID == MAX_MSGID buffer for the seed ID.
+|
+|	Purpose:	Loads a cursor written by SaveInboxCursor. Returns FALSE,
+|				with an empty seed, if the file is missing, damaged, from
+|				another version, for another profile or was written
+|				against different header cache contents.
+|
++---------------------------------------------------------------------
+*/
+static BOOL LoadInboxCursor ( LPCSTR lpszCursorFile, LPCSTR lpszProfileName,
+							  ULONGLONG ullCacheID, LPSTR lpszSeedMsgID )
+{
+	FILE *pFile = fopen ( lpszCursorFile, "rb" );
+	std::string sBytes;
+	char rgchBuffer[4096];
+	size_t cbRead = 0;
+
+	lpszSeedMsgID[0] = '\0';
+
+	if ( NULL == pFile )
+		return FALSE;
+
+	while ( 0 != ( cbRead = fread ( rgchBuffer, 1, sizeof ( rgchBuffer ), pFile ) ) )
+		sBytes.append ( rgchBuffer, cbRead );
+	fclose ( pFile );
+
+	CCursorReader Reader ( sBytes, 0 );
+
+	if ( CURSOR_MAGIC == Reader.GetULong ( ) && CURSOR_VERSION == Reader.GetULong ( ) )
+	{
+		std::string sProfile = Reader.GetString ( );
+		std::string sSeed = Reader.GetString ( );
+		ULONGLONG ullCursorCacheID = Reader.GetULong ( );
+		size_t cbDigested = 0;
+		ULONGLONG ullDigest = 0;
+
+		ullCursorCacheID |= (ULONGLONG) Reader.GetULong ( ) << 32;
+		cbDigested = Reader.Offset ( );
+		ullDigest = Reader.GetULong ( );
+		ullDigest |= (ULONGLONG) Reader.GetULong ( ) << 32;
+
+		if ( !Reader.m_fFailed &&
+			 sProfile == lpszProfileName &&
+			 sSeed.size ( ) < MAX_MSGID &&
+			 ullCursorCacheID == ullCacheID &&
+			 ullDigest == CursorDigest ( sBytes.substr ( 0, cbDigested ) ) )
+		{
+			strcpy ( lpszSeedMsgID, sSeed.c_str ( ) );
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	SaveInboxCursor()
+|
+|	Purpose:	Writes the cursor to a temporary file and then moves it
+|				over lpszCursorFile, so a failure part way through leaves
+|				the previous cursor intact.
+|
++---------------------------------------------------------------------
+*/
+static HRESULT SaveInboxCursor ( LPCSTR lpszCursorFile, LPCSTR lpszProfileName,
+								 LPCSTR lpszSeedMsgID, ULONGLONG ullCacheID )
+{
+	std::string sBytes;
+	std::string sTempFile = std::string ( lpszCursorFile ) + ".tmp";
+	ULONGLONG ullDigest = 0;
+	FILE *pFile = NULL;
+	BOOL fWritten = FALSE;
+
+	CursorPutULong ( sBytes, CURSOR_MAGIC );
+	CursorPutULong ( sBytes, CURSOR_VERSION );
+	CursorPutString ( sBytes, lpszProfileName );
+	CursorPutString ( sBytes, lpszSeedMsgID );
+	CursorPutULong ( sBytes, (ULONG) ullCacheID );
+	CursorPutULong ( sBytes, (ULONG) ( ullCacheID >> 32 ) );
+	ullDigest = CursorDigest ( sBytes );
+	CursorPutULong ( sBytes, (ULONG) ullDigest );
+	CursorPutULong ( sBytes, (ULONG) ( ullDigest >> 32 ) );
+
+	if ( NULL == ( pFile = fopen ( sTempFile.c_str ( ), "wb" ) ) )
+		return MAPI_E_FAILURE;
+
+	fWritten = sBytes.size ( ) == fwrite ( sBytes.data ( ), 1, sBytes.size ( ), pFile );
+	fWritten = ( 0 == fclose ( pFile ) ) && fWritten;
+
+	if ( !fWritten ||
+		 !MoveFileEx ( sTempFile.c_str ( ), lpszCursorFile, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+	{
+		DeleteFile ( sTempFile.c_str ( ) );
+		return MAPI_E_FAILURE;
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cOpenHeaderCache ( )
+|
+|	Parameters:	[IN] lpszCacheFile == Header cache file, created if missing.
+|
+|	Purpose:	Opens the header cache used by the incremental listings in
+|				place of any cache this object already has open. They open
+|				szHEADERCACHEFILE themselves if this has not been called.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cOpenHeaderCache ( LPCSTR lpszCacheFile )
+{
+	HRESULT hRes = S_OK;
+
+	if ( NULL == m_pHeaderCache )
+		m_pHeaderCache = new CHeaderCache;
+
+	if ( FAILED ( hRes = m_pHeaderCache -> Open ( lpszCacheFile, m_pMsgIDs ) ) )
+	{
+		delete m_pHeaderCache;
+		m_pHeaderCache = NULL;
+		return MAPI_E_FAILURE;
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cLoadCachedInboxHeaders ( )
+|
+|	Parameters:	[IN] lpszCursorFile == Cursor the cache must match.
+|
+|				[OUT] pView == Receives the cached Inbox headers.
+|
+|	Purpose:	Returns the Inbox as of the last listing straight from the
+|				header cache, without calling MAPI. Returns
+|				MAPI_E_NO_MESSAGES if there is no cache that matches the
+|				cursor, so the caller has nothing to show before the store
+|				has been read.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cLoadCachedInboxHeaders ( LPCSTR lpszCursorFile, MSGHEADERLIST *pView )
+{
+	char szSeedMsgID[MAX_MSGID] = {0};
+
+	if ( NULL == m_pHeaderCache && SUCCESS_SUCCESS != cOpenHeaderCache ( szHEADERCACHEFILE ) )
+		return MAPI_E_FAILURE;
+
+	if ( !LoadInboxCursor ( lpszCursorFile, m_szProfileName, m_pHeaderCache -> CacheID ( ), szSeedMsgID ) ||
+		 0 == m_pHeaderCache -> Count ( ) )
+		return MAPI_E_NO_MESSAGES;
+
+	m_pHeaderCache -> GetAll ( pView );
+
+	return SUCCESS_SUCCESS;
+}
+
+// cEnumInboxHeaders callback that collects the headers of a full Inbox walk.
+static BOOL CursorAppendHeader ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	( (MSGHEADERLIST *) lpvContext ) -> push_back ( *pHeader );
+
+	return TRUE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cFetchNewInboxHeaders ( )
+|
+|	Parameters:	[IN] lpszCursorFile == Cursor file to continue from and update.
+|
+|				[OUT] pView == Receives every known Inbox header: the cached
+|				ones followed by the new ones.
+|
+|				[OUT] pcNew == Number of headers at the end of pView that
+|				arrived since the cursor was written.
+|
+|	Purpose:	Reads only the messages delivered after the cursor and adds
+|				them to the header cache. If there is no usable cursor, or
+|				the message it points at has been deleted, the cache is reset
+|				and the whole Inbox is read again with cEnumInboxHeaders;
+|				every header then counts as new. The cursor file is rewritten
+|				when new mail was found.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cFetchNewInboxHeaders ( LPCSTR lpszCursorFile, MSGHEADERLIST *pView, ULONG *pcNew )
+{
+	HRESULT hRes = S_OK;
+	char szSeedMsgID[MAX_MSGID] = {0};
+	size_t cCached = 0;
+
+	*pcNew = 0L;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( NULL == m_pHeaderCache && SUCCESS_SUCCESS != ( hRes = cOpenHeaderCache ( szHEADERCACHEFILE ) ) )
+		return hRes;
+
+	if ( LoadInboxCursor ( lpszCursorFile, m_szProfileName, m_pHeaderCache -> CacheID ( ), szSeedMsgID ) )
+	{
+		m_pHeaderCache -> GetAll ( pView );
+		cCached = pView -> size ( );
+
+		while ( SUCCESS_SUCCESS == ( hRes = cFetchInboxHeaders ( szSeedMsgID, HEADER_BATCH_SIZE, pView ) ) )
+			;
+
+		// The message the cursor points at is gone, so there is no position to
+		// continue from. Start again from the beginning of the Inbox.
+		if ( MAPI_E_INVALID_MESSAGE == hRes )
+		{
+			pView -> clear ( );
+			cCached = 0;
+			szSeedMsgID[0] = '\0';
+		}
+	}
+
+	if ( '\0' == szSeedMsgID[0] )
+	{
+		m_pHeaderCache -> Reset ( );
+
+		if ( SUCCESS_SUCCESS == ( hRes = cEnumInboxHeaders ( NULL, CursorAppendHeader, pView ) ) )
+			hRes = MAPI_E_NO_MESSAGES;
+	}
+
+	if ( MAPI_E_NO_MESSAGES == hRes )
+	{
+		*pcNew = (ULONG) ( pView -> size ( ) - cCached );
+		hRes = SUCCESS_SUCCESS;
+
+		for ( size_t i = cCached; i < pView -> size ( ) && SUCCEEDED ( hRes ); i++ )
+			hRes = m_pHeaderCache -> Put ( ( *pView )[i] );
+
+		// The cache must be on disk before a cursor that refers to it.
+		if ( SUCCEEDED ( hRes ) && *pcNew )
+			hRes = m_pHeaderCache -> Flush ( );
+
+		if ( SUCCEEDED ( hRes ) && *pcNew )
+			hRes = SaveInboxCursor ( lpszCursorFile, m_szProfileName,
+									 cMsgIDText ( pView -> back ( ).hMsgID ), m_pHeaderCache -> CacheID ( ) );
+		else if ( FAILED ( hRes ) )
+			hRes = MAPI_E_FAILURE;
+	}
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cRevalidateHeaderCache ( )
+|
+|	Parameters:	[IN] cHeaders == Most cached headers to check.
+|
+|	Purpose:	Rereads the envelopes of up to cHeaders cached messages and
+|				brings the cache up to date: deleted messages are removed
+|				and changed flags or subjects are replaced. Each call
+|				continues where the last one, in this or an earlier
+|				process, stopped, so the whole cache is checked over a
+|				number of listings without any one listing paying for it.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cRevalidateHeaderCache ( ULONG cHeaders )
+{
+	HRESULT hRes = SUCCESS_SUCCESS;
+	ULONG cEntries = 0L;
+	ULONG iEntry = 0L;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( NULL == m_pHeaderCache || 0 == ( cEntries = m_pHeaderCache -> EntryCount ( ) ) )
+		return SUCCESS_SUCCESS;
+
+	iEntry = m_pHeaderCache -> RevalidatePosition ( );
+	if ( iEntry >= cEntries )
+		iEntry = 0L;
+
+	for ( ULONG c = 0; c < cHeaders && c < cEntries; c++ )
+	{
+		MSGHEADER Cached, Current;
+
+		if ( m_pHeaderCache -> GetEntry ( iEntry, &Cached ) )
+		{
+			hRes = cReadHeader ( (LPSTR) cMsgIDText ( Cached.hMsgID ), &Current );
+
+			if ( MAPI_E_INVALID_MESSAGE == hRes )
+				m_pHeaderCache -> Remove ( Cached.hMsgID );
+			else if ( SUCCESS_SUCCESS != hRes )
+				break;
+			else if ( Current.flFlags != Cached.flFlags || Current.sSubject != Cached.sSubject )
+				m_pHeaderCache -> Put ( Current );
+			hRes = SUCCESS_SUCCESS;
+		}
+
+		iEntry = ( iEntry + 1 ) % cEntries;
+	}
+
+	m_pHeaderCache -> SetRevalidatePosition ( iEntry );
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cListNewInboxMessages ( )
+|
+|	Purpose:	Prints the subjects of the messages delivered since the last
+|				time this function ran, using the cursor in szCURSORFILE.
+|
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cListNewInboxMessages ( )
+{
+	HRESULT hRes = S_OK;
+	MSGHEADERLIST View;
+	ULONG cNew = 0L;
+
+	if ( m_lhSession )
+	{
+		if ( SUCCESS_SUCCESS == ( hRes = cFetchNewInboxHeaders ( szCURSORFILE, &View, &cNew ) ) )
+		{
+			for ( size_t i = View.size ( ) - cNew; i < View.size ( ); i++ )
+				g_StdOut.Puts ( View[i].sSubject.c_str ( ) );
+			g_StdOut.Printf ( "%lu new messages, %lu in Inbox.\r\n", cNew, (ULONG) View.size ( ) );
+			g_StdOut.Flush ( );
+		}
+		else
+		{
+			printf ( "Incremental listing failed due to error code %d.\r\n", hRes );
+		}
+	}
+	else
+	{
+		hRes = MAPI_E_INVALID_SESSION;
+		printf ( "Not logged on to messaging system.\r\n" );
+	}
+
+	return hRes;
+}
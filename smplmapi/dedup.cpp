@@ -0,0 +1,580 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Dedup.cpp
+|
+|   Purpose:	Fingerprinting of messages, and the CApp methods that
+|				find duplicate messages in the Inbox and delete them.
+|
++---------------------------------------------------------------------
+*/
+
+#include "dedup.h"
+#include "hdrcache.h"
+#include "msgidtbl.h"
+#include "bodycache.h"
+#include "srchidx.h"
+#include "convtree.h"
+#include "workpool.h"
+#include "output.h"
+#include <algorithm>
+
+static inline ULONGLONG Rotl64 ( ULONGLONG ull, int nBits )
+{
+	return ( ull << nBits ) | ( ull >> ( 64 - nBits ) );
+}
+
+static inline ULONGLONG Mix64 ( ULONGLONG ull )
+{
+	ull ^= ull >> 33;
+	ull *= 0xFF51AFD7ED558CCDULL;
+	ull ^= ull >> 33;
+	ull *= 0xC4CEB9FE1A85EC53ULL;
+	ull ^= ull >> 33;
+
+	return ull;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	DedupHash()
+|
+|	Purpose:	MurmurHash3, the x64 128-bit variant, of cb bytes.
+|
++---------------------------------------------------------------------
+*/
+void DedupHash ( const BYTE *pb, size_t cb, ULONG ulSeed, ULONGLONG rgullHash[2] )
+{
+	const ULONGLONG c1 = 0x87C37B91114253D5ULL;
+	const ULONGLONG c2 = 0x4CF5AD432745937FULL;
+	ULONGLONG h1 = ulSeed;
+	ULONGLONG h2 = ulSeed;
+	ULONGLONG k1 = 0;
+	ULONGLONG k2 = 0;
+	size_t cbBlocks = cb & ~(size_t) 15;
+
+	for ( size_t ib = 0; ib < cbBlocks; ib += 16 )
+	{
+		memcpy ( &k1, pb + ib, sizeof ( k1 ) );
+		memcpy ( &k2, pb + ib + 8, sizeof ( k2 ) );
+
+		k1 *= c1; k1 = Rotl64 ( k1, 31 ); k1 *= c2; h1 ^= k1;
+		h1 = Rotl64 ( h1, 27 ); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+		k2 *= c2; k2 = Rotl64 ( k2, 33 ); k2 *= c1; h2 ^= k2;
+		h2 = Rotl64 ( h2, 31 ); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+	}
+
+	// The last 1 to 15 bytes, little-endian.
+	k1 = 0;
+	k2 = 0;
+	for ( size_t ib = cb; ib-- > cbBlocks; )
+	{
+		if ( ib - cbBlocks >= 8 )
+			k2 = ( k2 << 8 ) | pb[ib];
+		else
+			k1 = ( k1 << 8 ) | pb[ib];
+	}
+	if ( cb - cbBlocks > 8 )
+	{
+		k2 *= c2; k2 = Rotl64 ( k2, 33 ); k2 *= c1; h2 ^= k2;
+	}
+	if ( cb - cbBlocks > 0 )
+	{
+		k1 *= c1; k1 = Rotl64 ( k1, 31 ); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= cb;
+	h2 ^= cb;
+	h1 += h2;
+	h2 += h1;
+	h1 = Mix64 ( h1 );
+	h2 = Mix64 ( h2 );
+	h1 += h2;
+	h2 += h1;
+
+	rgullHash[0] = h1;
+	rgullHash[1] = h2;
+}
+
+void DedupPrintSearchKey ( const std::string &sSearchKey, DEDUPPRINT *pPrint )
+{
+	DedupHash ( (const BYTE *) sSearchKey.data ( ), sSearchKey.size ( ), DEDUP_SEED, pPrint -> rgullHash );
+	pPrint -> rgullHash[0] |= DEDUP_SEARCH_KEY;
+}
+
+// Appends lpszText and a NUL separator, with runs of white space made one
+// space and removed at the ends, and upper-case ASCII letters lowered when
+// fLower is set.
+static void AppendNormalized ( std::string *ps, LPCSTR lpszText, BOOL fLower )
+{
+	BOOL fSpace = FALSE;
+
+	for ( LPCSTR lpsz = lpszText ? lpszText : ""; *lpsz; lpsz++ )
+	{
+		char ch = *lpsz;
+
+		if ( ' ' == ch || '\t' == ch || '\r' == ch || '\n' == ch )
+		{
+			fSpace = TRUE;
+			continue;
+		}
+		if ( fSpace && !ps -> empty ( ) && '\0' != ps -> back ( ) )
+			*ps += ' ';
+		fSpace = FALSE;
+		*ps += ( fLower && ch >= 'A' && ch <= 'Z' ) ? (char) ( ch - 'A' + 'a' ) : ch;
+	}
+	*ps += '\0';
+}
+
+// Appends the text of a message with CRLF made LF, and the white space at
+// the end of each line and blank lines at the end removed, as copies saved
+// through different clients differ in those.
+static void AppendBody ( std::string *ps, LPCSTR lpszText )
+{
+	size_t cchStart = ps -> size ( );
+	size_t cchLine = cchStart;
+
+	for ( LPCSTR lpsz = lpszText ? lpszText : ""; *lpsz; lpsz++ )
+	{
+		if ( '\n' == *lpsz )
+		{
+			ps -> resize ( cchLine );
+			*ps += '\n';
+			cchLine = ps -> size ( );
+		}
+		else
+		{
+			*ps += *lpsz;
+			if ( ' ' != *lpsz && '\t' != *lpsz && '\r' != *lpsz )
+				cchLine = ps -> size ( );
+		}
+	}
+	ps -> resize ( cchLine );
+	while ( ps -> size ( ) > cchStart && '\n' == ps -> back ( ) )
+		ps -> erase ( ps -> size ( ) - 1 );
+	*ps += '\0';
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	DedupPrintMessage()
+|
+|	Parameters:	[IN] lpMessage == The message, read with its text.
+|				[IN/OUT] psScratch == Buffer the normalized message
+|				is built in, kept by the caller between messages.
+|				[OUT] pPrint == Receives the content hash.
+|
+|	Purpose:	Hashes the parts of a message that copies of it share.
+|				Addresses and subjects are compared without regard to
+|				case and runs of white space; the sender's display
+|				name is left out, as it depends on the address book
+|				of whoever saved the copy.
+|
++---------------------------------------------------------------------
+*/
+void DedupPrintMessage ( lpMapiMessage lpMessage, std::string *psScratch, DEDUPPRINT *pPrint )
+{
+	psScratch -> clear ( );
+
+	AppendNormalized ( psScratch, lpMessage -> lpszSubject, TRUE );
+	if ( lpMessage -> lpOriginator )
+		AppendNormalized ( psScratch, lpMessage -> lpOriginator -> lpszAddress ? lpMessage -> lpOriginator -> lpszAddress
+																			  : lpMessage -> lpOriginator -> lpszName, TRUE );
+	else
+		*psScratch += '\0';
+	AppendNormalized ( psScratch, lpMessage -> lpszDateReceived, FALSE );
+
+	for ( ULONG i = 0; i < lpMessage -> nRecipCount; i++ )
+	{
+		const MapiRecipDesc &Recip = lpMessage -> lpRecips[i];
+
+		*psScratch += (char) ( '0' + Recip.ulRecipClass );
+		AppendNormalized ( psScratch, Recip.lpszAddress ? Recip.lpszAddress : Recip.lpszName, TRUE );
+	}
+	*psScratch += '\0';
+
+	for ( ULONG i = 0; i < lpMessage -> nFileCount; i++ )
+		AppendNormalized ( psScratch, lpMessage -> lpFiles[i].lpszFileName, TRUE );
+	*psScratch += '\0';
+
+	AppendBody ( psScratch, lpMessage -> lpszNoteText );
+
+	DedupHash ( (const BYTE *) psScratch -> data ( ), psScratch -> size ( ), DEDUP_SEED, pPrint -> rgullHash );
+	pPrint -> rgullHash[0] &= ~(ULONGLONG) DEDUP_SEARCH_KEY;
+}
+
+// Orders fingerprints so copies are adjacent, oldest first.
+static bool PrintLess ( const DEDUPPRINT &Print1, const DEDUPPRINT &Print2 )
+{
+	if ( Print1.rgullHash[0] != Print2.rgullHash[0] )
+		return Print1.rgullHash[0] < Print2.rgullHash[0];
+	if ( Print1.rgullHash[1] != Print2.rgullHash[1] )
+		return Print1.rgullHash[1] < Print2.rgullHash[1];
+
+	return Print1.ulOrder < Print2.ulOrder;
+}
+
+static bool DuplicateLess ( const MSGDUPLICATE &Dup1, const MSGDUPLICATE &Dup2 )
+{
+	return Dup1.hDuplicate < Dup2.hDuplicate;
+}
+
+// State shared by the enumeration callback and the workers of cFindDuplicates.
+typedef struct _DEDUPCONTEXT
+{
+	CApp					*pApp;
+	std::vector<DEDUPPRINT>	rgPrints;		// In Inbox order
+	ULONG					cBySearchKey;
+	volatile LONG			iNext;			// First of the next batch to claim
+	std::vector<HRESULT>	rghRes;			// By worker; first error
+} DEDUPCONTEXT;
+
+// cEnumInboxHeaders callback that records a fingerprint for each message,
+// from its search key when the contents table gave one.
+static BOOL DedupAppendHeader ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	DEDUPCONTEXT *pCtx = (DEDUPCONTEXT *) lpvContext;
+	DEDUPPRINT Print;
+
+	Print.rgullHash[0] = 0;
+	Print.rgullHash[1] = 0;
+	Print.hMsgID = pHeader -> hMsgID;
+	Print.ulOrder = (ULONG) pCtx -> rgPrints.size ( );
+
+	if ( MSGID_NONE == Print.hMsgID )
+		return TRUE;
+
+	if ( !pHeader -> sSearchKey.empty ( ) )
+	{
+		DedupPrintSearchKey ( pHeader -> sSearchKey, &Print );
+		pCtx -> cBySearchKey++;
+	}
+	pCtx -> rgPrints.push_back ( Print );
+
+	return TRUE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	DedupWorker()
+|
+|	Purpose:	Claims DEDUP_BATCH fingerprints at a time and hashes
+|				the content of the messages that have no search key,
+|				reading them on a session of the worker's own, logged
+|				on at the first such read. A message that cannot be
+|				read is dropped from the comparison.
+|
++---------------------------------------------------------------------
+*/
+static DWORD DedupWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	DEDUPCONTEXT *pCtx = (DEDUPCONTEXT *) lpvContext;
+	LONG cPrints = (LONG) pCtx -> rgPrints.size ( );
+	CApp Session;
+	BOOL fLoggedOn = FALSE;
+	std::string sScratch;
+	LONG iFirst = 0;
+
+	while ( ( iFirst = InterlockedExchangeAdd ( &pCtx -> iNext, DEDUP_BATCH ) ) < cPrints )
+	{
+		for ( LONG i = iFirst; i < iFirst + DEDUP_BATCH && i < cPrints; i++ )
+		{
+			DEDUPPRINT &Print = pCtx -> rgPrints[i];
+			lpMapiMessage lpMessage = NULL;
+			HRESULT hRes = SUCCESS_SUCCESS;
+
+			if ( Print.rgullHash[0] & DEDUP_SEARCH_KEY )
+				continue;
+
+			if ( !fLoggedOn )
+			{
+				if ( SUCCESS_SUCCESS != ( hRes = pCtx -> pApp -> cCloneSession ( &Session ) ) )
+				{
+					pCtx -> rghRes[iWorker] = hRes;
+					return hRes;
+				}
+				fLoggedOn = TRUE;
+			}
+
+			hRes = Session.cReadMessage ( Print.hMsgID, MAPI_PEEK | MAPI_SUPPRESS_ATTACH, &lpMessage );
+			if ( SUCCESS_SUCCESS != hRes )
+			{
+				if ( MAPI_E_INVALID_MESSAGE != hRes && SUCCESS_SUCCESS == pCtx -> rghRes[iWorker] )
+					pCtx -> rghRes[iWorker] = hRes;
+				Print.hMsgID = MSGID_NONE;
+				continue;
+			}
+
+			DedupPrintMessage ( lpMessage, &sScratch, &Print );
+			Session.cFreeBuffer ( lpMessage );
+		}
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cFindDuplicates ( )
+|
+|	Parameters:	[IN] cWorkers == Number of threads reading messages.
+|
+|				[OUT] pDuplicates == Receives one entry for each message
+|				that duplicates an earlier one, grouped by original.
+|
+|				[OUT] lpStats == Receives the counts of the scan. May be
+|				NULL.
+|
+|	Purpose:	Fingerprints every message in the Inbox (Dedup.h) and
+|				reports the messages whose fingerprint an earlier message
+|				in the Inbox already has. The earliest copy of each is
+|				the one to keep. Nothing is deleted. The Inbox is walked
+|				on a session of cCloneScanSession, so of all the IDs it
+|				reads only those of the duplicates and their originals
+|				are interned in this object's table.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cFindDuplicates ( ULONG cWorkers, std::vector<MSGDUPLICATE> *pDuplicates, LPDEDUPSTATS lpStats )
+{
+	HRESULT hRes = S_OK;
+	CWorkerThreads Workers;
+	CApp Scan;
+	DEDUPCONTEXT Ctx;
+	MSGIDSTATS IDStats;
+	ULONG cToRead = 0L;
+	ULONG cUnreadable = 0L;
+	size_t cLive = 0;
+
+	pDuplicates -> clear ( );
+	if ( lpStats )
+		ZeroMemory ( lpStats, sizeof ( DEDUPSTATS ) );
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( SUCCESS_SUCCESS != ( hRes = cCloneScanSession ( &Scan ) ) )
+		return hRes;
+
+	Ctx.pApp = &Scan;
+	Ctx.cBySearchKey = 0L;
+	Ctx.iNext = 0;
+
+	if ( SUCCESS_SUCCESS != ( hRes = Scan.cEnumInboxHeaders ( NULL, DedupAppendHeader, &Ctx ) ) )
+		return hRes;
+	cToRead = (ULONG) Ctx.rgPrints.size ( ) - Ctx.cBySearchKey;
+
+	if ( cToRead )
+	{
+		if ( 0 == cWorkers )
+			cWorkers = 1;
+		if ( cWorkers > ( cToRead + DEDUP_BATCH - 1 ) / DEDUP_BATCH )
+			cWorkers = ( cToRead + DEDUP_BATCH - 1 ) / DEDUP_BATCH;
+
+		Ctx.rghRes.assign ( cWorkers, SUCCESS_SUCCESS );
+		if ( FAILED ( Workers.Start ( cWorkers, DedupWorker, &Ctx ) ) )
+		{
+			Workers.Join ( );
+			return MAPI_E_FAILURE;
+		}
+		Workers.Join ( );
+
+		for ( ULONG i = 0; i < cWorkers; i++ )
+		{
+			if ( SUCCESS_SUCCESS != Ctx.rghRes[i] )
+				return Ctx.rghRes[i];
+		}
+	}
+
+	if ( lpStats )
+	{
+		Scan.cMsgIDTable ( ) -> GetStats ( &IDStats );
+		lpStats -> cbFingerprints = Ctx.rgPrints.capacity ( ) * sizeof ( DEDUPPRINT );
+		lpStats -> cbMsgIDs = IDStats.cbArena + IDStats.cbDirectory + IDStats.cbIndex;
+	}
+
+	// Drop the messages deleted since the Inbox was walked.
+	for ( size_t i = 0; i < Ctx.rgPrints.size ( ); i++ )
+	{
+		if ( MSGID_NONE != Ctx.rgPrints[i].hMsgID )
+			Ctx.rgPrints[cLive++] = Ctx.rgPrints[i];
+	}
+	cUnreadable = (ULONG) ( Ctx.rgPrints.size ( ) - cLive );
+	Ctx.rgPrints.resize ( cLive );
+
+	std::sort ( Ctx.rgPrints.begin ( ), Ctx.rgPrints.end ( ), PrintLess );
+
+	for ( size_t iFirst = 0, i = 1; i < Ctx.rgPrints.size ( ); i++ )
+	{
+		const DEDUPPRINT &First = Ctx.rgPrints[iFirst];
+		const DEDUPPRINT &Print = Ctx.rgPrints[i];
+
+		if ( Print.rgullHash[0] == First.rgullHash[0] && Print.rgullHash[1] == First.rgullHash[1] )
+		{
+			MSGDUPLICATE Duplicate = { m_pMsgIDs -> Intern ( Scan.cMsgIDText ( First.hMsgID ) ),
+									   m_pMsgIDs -> Intern ( Scan.cMsgIDText ( Print.hMsgID ) ),
+									   0 != ( Print.rgullHash[0] & DEDUP_SEARCH_KEY ) };
+
+			if ( MSGID_NONE != Duplicate.hOriginal && MSGID_NONE != Duplicate.hDuplicate )
+				pDuplicates -> push_back ( Duplicate );
+		}
+		else
+			iFirst = i;
+	}
+
+	if ( lpStats )
+	{
+		lpStats -> cMessages = (ULONG) ( cLive + cUnreadable );
+		lpStats -> cBySearchKey = Ctx.cBySearchKey;
+		lpStats -> cByContent = cToRead - cUnreadable;
+		lpStats -> cUnreadable = cUnreadable;
+		lpStats -> cDuplicates = (ULONG) pDuplicates -> size ( );
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cDeleteMessages ( )
+|
+|	Parameters:	[IN] rghMsgIDs == The messages to delete.
+|
+|				[OUT] pcDeleted == Receives the number deleted. May be
+|				NULL.
+|
+|	Purpose:	Deletes the messages with MAPIDeleteMail. After every
+|				DEDUP_DELETE_BATCH of them the header cache, body cache,
+|				search index and conversation tree drop them together, so
+|				the search index writes one remove record per batch.
+|				Stops at the first message that cannot be deleted. That
+|				includes MAPI_E_INVALID_MESSAGE: the message may be gone,
+|				but it may as well be one whose ID the provider does not
+|				accept, so it is neither counted nor dropped. Returns
+|				MAPI_E_NOT_SUPPORTED if the provider does not export
+|				MAPIDeleteMail.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cDeleteMessages ( const std::vector<MSGIDHANDLE> &rghMsgIDs, ULONG *pcDeleted )
+{
+	HRESULT hRes = SUCCESS_SUCCESS;
+	std::vector<MSGIDHANDLE> rghBatch;
+	ULONG cDeleted = 0L;
+
+	if ( pcDeleted )
+		*pcDeleted = 0L;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( NULL == m_MAPIDeleteMail )
+		return MAPI_E_NOT_SUPPORTED;
+
+	for ( size_t iFirst = 0; iFirst < rghMsgIDs.size ( ) && SUCCESS_SUCCESS == hRes; iFirst += DEDUP_DELETE_BATCH )
+	{
+		rghBatch.clear ( );
+
+		for ( size_t i = iFirst; i < iFirst + DEDUP_DELETE_BATCH && i < rghMsgIDs.size ( ); i++ )
+		{
+			hRes = m_MAPIDeleteMail ( m_lhSession, 0L, (LPSTR) cMsgIDText ( rghMsgIDs[i] ), 0L, 0L );
+
+			if ( SUCCESS_SUCCESS != hRes )
+				break;
+			rghBatch.push_back ( rghMsgIDs[i] );
+		}
+
+		for ( size_t i = 0; i < rghBatch.size ( ); i++ )
+		{
+			if ( m_pHeaderCache )
+				m_pHeaderCache -> Remove ( rghBatch[i] );
+			if ( m_pBodyCache )
+				m_pBodyCache -> Remove ( rghBatch[i] );
+			if ( m_pConversations )
+				m_pConversations -> Remove ( rghBatch[i] );
+		}
+		if ( m_pSearchIndex && !rghBatch.empty ( ) )
+			m_pSearchIndex -> Remove ( rghBatch );
+
+		cDeleted += (ULONG) rghBatch.size ( );
+	}
+
+	if ( m_pHeaderCache )
+		m_pHeaderCache -> Flush ( );
+
+	if ( pcDeleted )
+		*pcDeleted = cDeleted;
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cFindDuplicateMessages ( )
+|
+|	Purpose:	Prints the date, sender and subject of each duplicate
+|				message in the Inbox, then offers to delete them.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cFindDuplicateMessages ( )
+{
+	HRESULT hRes = S_OK;
+	std::vector<MSGDUPLICATE> Duplicates;
+	std::vector<MSGIDHANDLE> rghDelete;
+	DEDUPSTATS Stats;
+	LPSTR lpszAnswer = NULL;
+	ULONG cDeleted = 0L;
+	DWORD dwStart = 0;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	dwStart = GetTickCount ( );
+	if ( SUCCESS_SUCCESS != ( hRes = cFindDuplicates ( CWorkerThreads::ProcessorCount ( ), &Duplicates, &Stats ) ) )
+	{
+		printf ( "Duplicate scan failed due to error code %d.\r\n", hRes );
+		return hRes;
+	}
+
+	std::sort ( Duplicates.begin ( ), Duplicates.end ( ), DuplicateLess );
+	for ( size_t i = 0; i < Duplicates.size ( ); i++ )
+	{
+		MSGHEADER Header;
+
+		if ( SUCCESS_SUCCESS == cReadHeader ( (LPSTR) cMsgIDText ( Duplicates[i].hDuplicate ), &Header ) )
+			g_StdOut.Printf ( "%s  %-24.24s  %s%s\r\n", Header.szDateReceived, Header.sOriginator.c_str ( ),
+							  Header.sSubject.c_str ( ), Duplicates[i].fSearchKey ? "  [search key]" : "" );
+		rghDelete.push_back ( Duplicates[i].hDuplicate );
+	}
+	g_StdOut.Flush ( );
+
+	printf ( "%lu duplicates among %lu messages (%lu by search key, %lu read) in %lu ms.\r\n",
+			 Stats.cDuplicates, Stats.cMessages, Stats.cBySearchKey, Stats.cByContent, GetTickCount ( ) - dwStart );
+
+	if ( rghDelete.empty ( ) )
+		return SUCCESS_SUCCESS;
+
+	if ( FAILED ( hRes = cCaptureText ( "Delete the duplicates (y/n): ", &lpszAnswer ) ) )
+		return hRes;
+
+	if ( 'y' == lpszAnswer[0] || 'Y' == lpszAnswer[0] )
+	{
+		hRes = cDeleteMessages ( rghDelete, &cDeleted );
+
+		if ( SUCCESS_SUCCESS == hRes )
+			printf ( "%lu messages deleted.\r\n", cDeleted );
+		else if ( MAPI_E_NOT_SUPPORTED == hRes )
+			printf ( "The messaging system does not support MAPIDeleteMail.\r\n" );
+		else
+			printf ( "Deleted %lu messages, then failed due to error code %d.\r\n", cDeleted, hRes );
+	}
+
+	cFreeBuffer ( lpszAnswer );
+
+	return hRes;
+}
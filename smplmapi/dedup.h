@@ -0,0 +1,52 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Dedup.h
+|
+|   Purpose:	Declares the fingerprints cFindDuplicates compares to
+|				find copies of the same message in the Inbox.
+|
+|				A message the contents table gives a PR_SEARCH_KEY for
+|				is fingerprinted from that key, which the store keeps
+|				the same on every copy of a message, without reading
+|				it. Any other message is read once and fingerprinted by
+|				a 128-bit MurmurHash3 of its subject, sender, date,
+|				recipients, attachment names and text, with white space
+|				and letter case normalized where copies may differ. The
+|				low bit of a fingerprint tells the two kinds apart, so
+|				a key never matches a content hash.
+|
+|				A fingerprint is a fixed 24 bytes, with a handle to the
+|				message's ID so it can be read. The IDs are interned on
+|				a session of the scan's own, and are freed with it once
+|				the duplicates are found: only the IDs of duplicates
+|				and their originals outlive the scan. While it runs, a
+|				million messages take 24 MB of fingerprints plus their
+|				IDs, some 150 bytes each for the hex entry IDs of most
+|				stores.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _DEDUP_H
+#define _DEDUP_H
+
+#include "swap.h"
+
+#define DEDUP_BATCH				64				// Messages a worker claims at a time
+#define DEDUP_DELETE_BATCH		64				// Deletes between cache and index updates
+#define DEDUP_SEARCH_KEY		1				// Low bit of rgullHash[0] for PR_SEARCH_KEY prints
+#define DEDUP_SEED				0x5344504DUL	// "MPDS"
+
+typedef struct _DEDUPPRINT
+{
+	ULONGLONG	rgullHash[2];					// 0 until the message is hashed
+	MSGIDHANDLE	hMsgID;							// MSGID_NONE if the message could not be read
+	ULONG		ulOrder;						// Position in the Inbox; the lowest of a group is kept
+} DEDUPPRINT;
+
+void	DedupHash ( const BYTE *pb, size_t cb, ULONG ulSeed, ULONGLONG rgullHash[2] );
+void	DedupPrintSearchKey ( const std::string &sSearchKey, DEDUPPRINT *pPrint );
+void	DedupPrintMessage ( lpMapiMessage lpMessage, std::string *psScratch, DEDUPPRINT *pPrint );
+
+#endif
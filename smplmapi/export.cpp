@@ -0,0 +1,341 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Export.cpp
+|
+|   Purpose:	Implementation of CRecordWriter and the Inbox export.
+|
++---------------------------------------------------------------------
+*/
+
+#include "export.h"
+
+// Characters JsonString cannot copy as they are: 1 for the ASCII ones
+// with a short escape or none, 2 for bytes above 0x7F.
+static BYTE		g_rgbJsonClass[256];
+static WCHAR	g_rgwcAnsi[128];		// Bytes 0x80 - 0xFF in the ANSI code page
+static BOOL		g_fJsonTables = FALSE;
+
+static void BuildJsonTables ( void )
+{
+	for ( int i = 0; i < 256; i++ )
+		g_rgbJsonClass[i] = i < 0x20 || '"' == i || '\\' == i ? 1 : i >= 0x80 ? 2 : 0;
+
+	// Lead bytes of a double-byte code page do not convert on their own
+	// and come out as U+FFFD.
+	for ( int i = 0; i < 128; i++ )
+	{
+		char ch = (char) ( 0x80 + i );
+
+		if ( 1 != MultiByteToWideChar ( CP_ACP, MB_ERR_INVALID_CHARS, &ch, 1, &g_rgwcAnsi[i], 1 ) )
+			g_rgwcAnsi[i] = 0xFFFD;
+	}
+
+	g_fJsonTables = TRUE;
+}
+
+CRecordWriter::CRecordWriter ( COutput *pOut, ULONG ulFormat, BOOL fBodies )
+{
+	m_pOut = pOut;
+	m_ulFormat = ulFormat;
+	m_fBodies = fBodies;
+
+	if ( !g_fJsonTables )
+		BuildJsonTables ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	JsonString()
+|
+|	Purpose:	Writes lpsz as a quoted JSON string. Runs of characters
+|				that need no escape are written with one call; only the
+|				characters between them are looked at twice.
+|
++---------------------------------------------------------------------
+*/
+void CRecordWriter::JsonString ( LPCSTR lpsz )
+{
+	static const char szHex[] = "0123456789abcdef";
+	const BYTE *pbRun = (const BYTE *) lpsz;
+	const BYTE *pb = pbRun;
+
+	m_pOut -> Write ( "\"", 1 );
+
+	for ( ; *pb; pb++ )
+	{
+		char szEscape[6] = { '\\', 'u', '0', '0', 0, 0 };
+		LPCSTR lpszEscape = szEscape;
+		size_t cchEscape = 6;
+
+		if ( 0 == g_rgbJsonClass[*pb] )
+			continue;
+
+		if ( pb > pbRun )
+			m_pOut -> Write ( (LPCSTR) pbRun, pb - pbRun );
+		pbRun = pb + 1;
+
+		switch ( *pb )
+		{
+		case '"':	lpszEscape = "\\\"";	cchEscape = 2;	break;
+		case '\\':	lpszEscape = "\\\\";	cchEscape = 2;	break;
+		case '\n':	lpszEscape = "\\n";		cchEscape = 2;	break;
+		case '\r':	lpszEscape = "\\r";		cchEscape = 2;	break;
+		case '\t':	lpszEscape = "\\t";		cchEscape = 2;	break;
+		default:
+			{
+				WCHAR wc = *pb < 0x80 ? *pb : g_rgwcAnsi[*pb - 0x80];
+
+				szEscape[2] = szHex[( wc >> 12 ) & 0x0F];
+				szEscape[3] = szHex[( wc >> 8 ) & 0x0F];
+				szEscape[4] = szHex[( wc >> 4 ) & 0x0F];
+				szEscape[5] = szHex[wc & 0x0F];
+			}
+			break;
+		}
+		m_pOut -> Write ( lpszEscape, cchEscape );
+	}
+
+	if ( pb > pbRun )
+		m_pOut -> Write ( (LPCSTR) pbRun, pb - pbRun );
+	m_pOut -> Write ( "\"", 1 );
+}
+
+// Writes lpsz as a quoted CSV field, doubling the quotes in it.
+void CRecordWriter::CsvString ( LPCSTR lpsz )
+{
+	LPCSTR lpszQuote = NULL;
+
+	m_pOut -> Write ( "\"", 1 );
+
+	while ( NULL != ( lpszQuote = strchr ( lpsz, '"' ) ) )
+	{
+		// Write through the quote, then double it.
+		m_pOut -> Write ( lpsz, lpszQuote - lpsz + 1 );
+		m_pOut -> Write ( "\"", 1 );
+		lpsz = lpszQuote + 1;
+	}
+
+	m_pOut -> Write ( lpsz, strlen ( lpsz ) );
+	m_pOut -> Write ( "\"", 1 );
+}
+
+void CRecordWriter::Field ( LPCSTR lpszName, LPCSTR lpszValue, BOOL fFirst )
+{
+	if ( EXPORT_JSONL == m_ulFormat )
+	{
+		m_pOut -> Write ( fFirst ? "{\"" : ",\"", 2 );
+		m_pOut -> Write ( lpszName, strlen ( lpszName ) );
+		m_pOut -> Write ( "\":", 2 );
+		JsonString ( lpszValue );
+	}
+	else
+	{
+		if ( !fFirst )
+			m_pOut -> Write ( ",", 1 );
+		CsvString ( lpszValue );
+	}
+}
+
+// Writes what comes before the first record: the CSV header row.
+void CRecordWriter::Begin ( void )
+{
+	if ( EXPORT_CSV == m_ulFormat )
+		m_pOut -> Puts ( m_fBodies ? "id,date,from,subject,unread,body" : "id,date,from,subject,unread" );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Record()
+|
+|	Parameters:	[IN] lpszMsgID == The message ID.
+|				[IN] pHeader == The envelope of the message.
+|				[IN] lpszBody == The message text; ignored unless the
+|				writer exports bodies, and NULL for an empty body.
+|
+|	Purpose:	Writes one record.
+|
++---------------------------------------------------------------------
+*/
+void CRecordWriter::Record ( LPCSTR lpszMsgID, const MSGHEADER *pHeader, LPCSTR lpszBody )
+{
+	BOOL fUnread = 0 != ( pHeader -> flFlags & MAPI_UNREAD );
+
+	Field ( "id", lpszMsgID, TRUE );
+	Field ( "date", pHeader -> szDateReceived, FALSE );
+	Field ( "from", pHeader -> sOriginator.c_str ( ), FALSE );
+	Field ( "subject", pHeader -> sSubject.c_str ( ), FALSE );
+
+	if ( EXPORT_JSONL == m_ulFormat )
+		m_pOut -> Write ( fUnread ? ",\"unread\":true" : ",\"unread\":false", fUnread ? 14 : 15 );
+	else
+		m_pOut -> Write ( fUnread ? ",1" : ",0", 2 );
+
+	if ( m_fBodies )
+		Field ( "body", lpszBody ? lpszBody : "", FALSE );
+
+	if ( EXPORT_JSONL == m_ulFormat )
+		m_pOut -> Write ( "}\n", 2 );
+	else
+		m_pOut -> Write ( "\r\n", 2 );
+}
+
+// State for the cExportInbox callback.
+typedef struct _EXPORTCONTEXT
+{
+	CApp			*pApp;
+	CRecordWriter	*pWriter;
+	BOOL			fBodies;
+	ULONG			cRecords;
+	HRESULT			hRes;			// First body read failure
+	std::string		sBody;			// Text of the current message
+} EXPORTCONTEXT;
+
+static BOOL ExportHeader ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	EXPORTCONTEXT *pCtx = (EXPORTCONTEXT *) lpvContext;
+	LPCSTR lpszMsgID = pCtx -> pApp -> cMsgIDText ( pHeader -> hMsgID );
+
+	if ( pCtx -> fBodies )
+	{
+		HRESULT hRes = pCtx -> pApp -> cReadBody ( pHeader -> hMsgID, &pCtx -> sBody );
+
+		// A message deleted since it was listed is left out.
+		if ( MAPI_E_INVALID_MESSAGE == hRes )
+			return TRUE;
+		if ( SUCCESS_SUCCESS != hRes )
+		{
+			pCtx -> hRes = hRes;
+			return FALSE;
+		}
+	}
+
+	pCtx -> pWriter -> Record ( lpszMsgID, pHeader, pCtx -> fBodies ? pCtx -> sBody.c_str ( ) : NULL );
+	pCtx -> cRecords++;
+
+	return TRUE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cExportInbox ( )
+|
+|	Parameters:	[IN] pOut == Where the records are written.
+|
+|				[IN] ulFormat == EXPORT_JSONL or EXPORT_CSV.
+|
+|				[IN] fBodies == TRUE to read and export each message's text
+|				as well as its envelope.
+|
+|				[OUT] pcRecords == Number of records written. Can be NULL.
+|
+|	Purpose:	Streams one record per Inbox message, in delivery order, as
+|				cEnumInboxHeaders delivers the headers. Bodies come from
+|				cReadBody, so exporting does not mark mail read. pOut is
+|				flushed before returning.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cExportInbox ( COutput *pOut, ULONG ulFormat, BOOL fBodies, ULONG *pcRecords )
+{
+	HRESULT hRes = S_OK;
+	CRecordWriter Writer ( pOut, ulFormat, fBodies );
+	EXPORTCONTEXT Ctx;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( EXPORT_JSONL != ulFormat && EXPORT_CSV != ulFormat )
+		return MAPI_E_INVALID_PARAMETER;
+
+	Ctx.pApp = this;
+	Ctx.pWriter = &Writer;
+	Ctx.fBodies = fBodies;
+	Ctx.cRecords = 0L;
+	Ctx.hRes = SUCCESS_SUCCESS;
+
+	Writer.Begin ( );
+	hRes = cEnumInboxHeaders ( NULL, ExportHeader, &Ctx );
+	if ( MAPI_USER_ABORT == hRes )
+		hRes = Ctx.hRes;
+	if ( FAILED ( pOut -> Flush ( ) ) && SUCCESS_SUCCESS == hRes )
+		hRes = MAPI_E_FAILURE;
+
+	if ( pcRecords )
+		*pcRecords = Ctx.cRecords;
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cExportInboxMessages ( )
+|
+|	Purpose:	Asks the user for a format, whether to include bodies and a
+|				file, then exports the Inbox with cExportInbox. Entering *
+|				for the file writes the records to standard output.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cExportInboxMessages ( )
+{
+	HRESULT hRes = S_OK;
+	LPSTR lpszFormat = NULL;
+	LPSTR lpszBodies = NULL;
+	LPSTR lpszFile = NULL;
+	ULONG ulFormat = 0L;
+	ULONG cRecords = 0L;
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	if ( SUCCEEDED ( hRes = cCaptureText ( "Format (json/csv): ", &lpszFormat ) ) &&
+		 SUCCEEDED ( hRes = cCaptureText ( "Include message bodies (y/n): ", &lpszBodies ) ) &&
+		 SUCCEEDED ( hRes = cCaptureText ( "Export file (* for standard output): ", &lpszFile ) ) )
+	{
+		if ( 0 == _stricmp ( lpszFormat, "json" ) || 0 == _stricmp ( lpszFormat, "jsonl" ) )
+			ulFormat = EXPORT_JSONL;
+		else if ( 0 == _stricmp ( lpszFormat, "csv" ) )
+			ulFormat = EXPORT_CSV;
+
+		if ( 0 == ulFormat )
+		{
+			printf ( "Unknown format %s.\r\n", lpszFormat );
+			hRes = MAPI_E_INVALID_PARAMETER;
+		}
+		else if ( 0 == strcmp ( lpszFile, "*" ) )
+		{
+			hRes = cExportInbox ( &g_StdOut, ulFormat, 'y' == lpszBodies[0] || 'Y' == lpszBodies[0], &cRecords );
+		}
+		else if ( INVALID_HANDLE_VALUE == ( hFile = CreateFile ( lpszFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+																  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL ) ) )
+		{
+			printf ( "Could not create %s.\r\n", lpszFile );
+			hRes = MAPI_E_FAILURE;
+		}
+		else
+		{
+			COutput Out ( hFile );
+
+			hRes = cExportInbox ( &Out, ulFormat, 'y' == lpszBodies[0] || 'Y' == lpszBodies[0], &cRecords );
+			Out.Close ( );
+			CloseHandle ( hFile );
+		}
+
+		if ( SUCCESS_SUCCESS == hRes )
+			printf ( "%lu messages exported.\r\n", cRecords );
+		else if ( ulFormat )
+			printf ( "Export failed due to error code %d after %lu messages.\r\n", hRes, cRecords );
+	}
+
+	cFreeBuffer ( lpszFormat );
+	cFreeBuffer ( lpszBodies );
+	cFreeBuffer ( lpszFile );
+
+	return hRes;
+}
@@ -0,0 +1,52 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Export.h
+|
+|   Purpose:	Declares CRecordWriter, which streams Inbox headers
+|				and message bodies as JSON Lines or RFC 4180 CSV for
+|				scripts. Each record is escaped and written straight
+|				into a COutput buffer as it is produced; nothing is
+|				copied into an intermediate string.
+|
+|				JSON Lines: one object per line with the members id,
+|				date, from, subject, unread and, when bodies are
+|				exported, body. Text from the provider is in the ANSI
+|				code page and is written as \u escapes above 0x7F.
+|
+|				CSV: a header row, then one row per message with the
+|				same columns. Text fields are always quoted, with
+|				quotes doubled, so they may span lines, and are left in
+|				the ANSI code page. Rows end in CRLF.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _EXPORT_H
+#define _EXPORT_H
+
+#include "swap.h"
+#include "output.h"
+
+#define EXPORT_JSONL			1
+#define EXPORT_CSV				2
+
+class CRecordWriter
+{
+private:
+	COutput		*m_pOut;
+	ULONG		m_ulFormat;
+	BOOL		m_fBodies;
+
+	void	JsonString ( LPCSTR lpsz );
+	void	CsvString ( LPCSTR lpsz );
+	void	Field ( LPCSTR lpszName, LPCSTR lpszValue, BOOL fFirst );
+
+public:
+	CRecordWriter ( COutput *pOut, ULONG ulFormat, BOOL fBodies );
+
+	void	Begin ( void );
+	void	Record ( LPCSTR lpszMsgID, const MSGHEADER *pHeader, LPCSTR lpszBody );
+};
+
+#endif
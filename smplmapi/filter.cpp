@@ -0,0 +1,472 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Filter.cpp
+|
+|   Purpose:	Filtered Inbox listing: compiling a MSGFILTER into an
+|				SRestriction and evaluating restrictions locally.
+|
++---------------------------------------------------------------------
+*/
+
+#include "filter.h"
+#include "inboxtbl.h"
+#include "output.h"
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	DateToFileTime()
+|
+|	Parameters:	[IN] lpszDate == Local time as YYYY/MM/DD HH:MM, the
+|				form of MapiMessage.lpszDateReceived, or YYYY/MM/DD
+|				for midnight.
+|				[OUT] pft == Receives the time in UTC.
+|
+|	Purpose:	Converts a Simple MAPI date to the UTC FILETIME that
+|				PR_MESSAGE_DELIVERY_TIME holds. Returns FALSE if the
+|				date cannot be parsed.
+|
++---------------------------------------------------------------------
+*/
+BOOL DateToFileTime ( LPCSTR lpszDate, FILETIME *pft )
+{
+	SYSTEMTIME stLocal = {0};
+	FILETIME ftLocal;
+	int nYear = 0, nMonth = 0, nDay = 0, nHour = 0, nMinute = 0;
+	int cFields = sscanf ( lpszDate, "%d/%d/%d %d:%d", &nYear, &nMonth, &nDay, &nHour, &nMinute );
+
+	if ( 3 != cFields && 5 != cFields )
+		return FALSE;
+
+	stLocal.wYear = (WORD) nYear;
+	stLocal.wMonth = (WORD) nMonth;
+	stLocal.wDay = (WORD) nDay;
+	stLocal.wHour = (WORD) nHour;
+	stLocal.wMinute = (WORD) nMinute;
+
+	return SystemTimeToFileTime ( &stLocal, &ftLocal ) && LocalFileTimeToFileTime ( &ftLocal, pft );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	HeaderProp()
+|
+|	Purpose:	Returns in *pProp the value a contents table row would
+|				hold for ulPropTag, derived from a MSGHEADER, so a
+|				restriction can be evaluated without the store. A
+|				MSGHEADER keeps one originator string, so it answers
+|				for both the sender name and the sender address.
+|				Returns FALSE if the header has no such property.
+|
++---------------------------------------------------------------------
+*/
+static BOOL HeaderProp ( ULONG ulPropTag, const MSGHEADER *pHeader, SPropValue *pProp )
+{
+	pProp -> ulPropTag = ulPropTag;
+
+	switch ( ulPropTag )
+	{
+	case PR_SUBJECT_A:
+		pProp -> Value.lpszA = (LPSTR) pHeader -> sSubject.c_str ( );
+		return TRUE;
+	case PR_SENDER_NAME_A:
+	case PR_SENDER_EMAIL_ADDRESS_A:
+		pProp -> Value.lpszA = (LPSTR) pHeader -> sOriginator.c_str ( );
+		return TRUE;
+	case PR_MESSAGE_DELIVERY_TIME:
+		return DateToFileTime ( pHeader -> szDateReceived, &pProp -> Value.ft );
+	case PR_MESSAGE_FLAGS:
+		pProp -> Value.l = 0;
+		if ( !( pHeader -> flFlags & MAPI_UNREAD ) )
+			pProp -> Value.l |= MSGFLAG_READ;
+		if ( pHeader -> flFlags & MAPI_RECEIPT_REQUESTED )
+			pProp -> Value.l |= MSGFLAG_RN_PENDING;
+		if ( !( pHeader -> flFlags & MAPI_SENT ) )
+			pProp -> Value.l |= MSGFLAG_UNSENT;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+// Case-insensitive comparisons use the C locale, like FL_IGNORECASE on
+// ASCII text.
+static int CompareText ( LPCSTR lpsz1, LPCSTR lpsz2, BOOL fIgnoreCase, size_t cchMax )
+{
+	return fIgnoreCase ? _strnicmp ( lpsz1, lpsz2, cchMax ) : strncmp ( lpsz1, lpsz2, cchMax );
+}
+
+static BOOL EvalContent ( const SContentRestriction *lpContent, const MSGHEADER *pHeader )
+{
+	SPropValue Prop;
+	BOOL fIgnoreCase = 0 != ( lpContent -> ulFuzzyLevel & FL_IGNORECASE );
+	LPCSTR lpszValue = NULL;
+	LPCSTR lpszPattern = lpContent -> lpProp -> Value.lpszA;
+	size_t cchPattern = strlen ( lpszPattern );
+
+	if ( PT_STRING8 != PROP_TYPE ( lpContent -> ulPropTag ) ||
+		 !HeaderProp ( lpContent -> ulPropTag, pHeader, &Prop ) )
+		return FALSE;
+	lpszValue = Prop.Value.lpszA;
+
+	switch ( lpContent -> ulFuzzyLevel & 0xFFFF )
+	{
+	case FL_SUBSTRING:
+		for ( ; *lpszValue; lpszValue++ )
+		{
+			if ( 0 == CompareText ( lpszValue, lpszPattern, fIgnoreCase, cchPattern ) )
+				return TRUE;
+		}
+		return 0 == cchPattern;
+	case FL_PREFIX:
+		return 0 == CompareText ( lpszValue, lpszPattern, fIgnoreCase, cchPattern );
+	default:
+		return 0 == CompareText ( lpszValue, lpszPattern, fIgnoreCase, (size_t) -1 );
+	}
+}
+
+static BOOL EvalProperty ( const SPropertyRestriction *lpProperty, const MSGHEADER *pHeader )
+{
+	SPropValue Prop;
+	int nCompare = 0;
+
+	if ( !HeaderProp ( lpProperty -> ulPropTag, pHeader, &Prop ) )
+		return FALSE;
+
+	switch ( PROP_TYPE ( lpProperty -> ulPropTag ) )
+	{
+	case PT_SYSTIME:
+		nCompare = CompareFileTime ( &Prop.Value.ft, &lpProperty -> lpProp -> Value.ft );
+		break;
+	case PT_LONG:
+		nCompare = Prop.Value.l < lpProperty -> lpProp -> Value.l ? -1 :
+				   Prop.Value.l > lpProperty -> lpProp -> Value.l ? 1 : 0;
+		break;
+	case PT_STRING8:
+		nCompare = _stricmp ( Prop.Value.lpszA, lpProperty -> lpProp -> Value.lpszA );
+		break;
+	default:
+		return FALSE;
+	}
+
+	switch ( lpProperty -> relop )
+	{
+	case RELOP_LT:	return nCompare < 0;
+	case RELOP_LE:	return nCompare <= 0;
+	case RELOP_GT:	return nCompare > 0;
+	case RELOP_GE:	return nCompare >= 0;
+	case RELOP_EQ:	return 0 == nCompare;
+	case RELOP_NE:	return 0 != nCompare;
+	default:		return FALSE;
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	EvalRestriction()
+|
+|	Purpose:	Evaluates a restriction against one header with the
+|				semantics IMAPITable::Restrict gives it. Supports AND,
+|				OR, NOT, content, property, bitmask and exist
+|				restrictions on the properties HeaderProp knows;
+|				anything else does not match.
+|
++---------------------------------------------------------------------
+*/
+BOOL EvalRestriction ( const SRestriction *lpRes, const MSGHEADER *pHeader )
+{
+	SPropValue Prop;
+
+	switch ( lpRes -> rt )
+	{
+	case RES_AND:
+		for ( ULONG i = 0; i < lpRes -> res.resAnd.cRes; i++ )
+		{
+			if ( !EvalRestriction ( &lpRes -> res.resAnd.lpRes[i], pHeader ) )
+				return FALSE;
+		}
+		return TRUE;
+	case RES_OR:
+		for ( ULONG i = 0; i < lpRes -> res.resOr.cRes; i++ )
+		{
+			if ( EvalRestriction ( &lpRes -> res.resOr.lpRes[i], pHeader ) )
+				return TRUE;
+		}
+		return FALSE;
+	case RES_NOT:
+		return !EvalRestriction ( lpRes -> res.resNot.lpRes, pHeader );
+	case RES_CONTENT:
+		return EvalContent ( &lpRes -> res.resContent, pHeader );
+	case RES_PROPERTY:
+		return EvalProperty ( &lpRes -> res.resProperty, pHeader );
+	case RES_BITMASK:
+		if ( PT_LONG != PROP_TYPE ( lpRes -> res.resBitMask.ulPropTag ) ||
+			 !HeaderProp ( lpRes -> res.resBitMask.ulPropTag, pHeader, &Prop ) )
+			return FALSE;
+		return ( BMR_EQZ == lpRes -> res.resBitMask.relBMR ) ==
+			   ( 0 == ( Prop.Value.l & lpRes -> res.resBitMask.ulMask ) );
+	case RES_EXIST:
+		return HeaderProp ( lpRes -> res.resExist.ulPropTag, pHeader, &Prop );
+	default:
+		return FALSE;
+	}
+}
+
+CFilterRestriction::CFilterRestriction ( )
+{
+	ZeroMemory ( &m_resRoot, sizeof ( m_resRoot ) );
+	ZeroMemory ( m_rgresTerms, sizeof ( m_rgresTerms ) );
+	ZeroMemory ( m_rgresSender, sizeof ( m_rgresSender ) );
+	ZeroMemory ( m_rgProps, sizeof ( m_rgProps ) );
+	m_fEmpty = TRUE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Compile()
+|
+|	Purpose:	Builds an AND of one term per predicate set in the
+|				filter:
+|
+|					unread		PR_MESSAGE_FLAGS & MSGFLAG_READ == 0
+|					sender		name or address contains sSender
+|					subject		PR_SUBJECT contains sSubject
+|					since		PR_MESSAGE_DELIVERY_TIME >= sSince
+|					before		PR_MESSAGE_DELIVERY_TIME < sBefore
+|
+|				Text matches ignore case. The tree points into this
+|				object, which must outlive any use of Get. Returns
+|				MAPI_E_INVALID_PARAMETER for a date that cannot be
+|				parsed.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CFilterRestriction::Compile ( const MSGFILTER *pFilter )
+{
+	ULONG cTerms = 0L;
+	ULONG cProps = 0L;
+
+	m_sSender = pFilter -> sSender;
+	m_sSubject = pFilter -> sSubject;
+
+	if ( pFilter -> fUnreadOnly )
+	{
+		SRestriction &Res = m_rgresTerms[cTerms++];
+
+		Res.rt = RES_BITMASK;
+		Res.res.resBitMask.relBMR = BMR_EQZ;
+		Res.res.resBitMask.ulPropTag = PR_MESSAGE_FLAGS;
+		Res.res.resBitMask.ulMask = MSGFLAG_READ;
+	}
+
+	if ( !m_sSender.empty ( ) )
+	{
+		SRestriction &Res = m_rgresTerms[cTerms++];
+		SPropValue &Prop = m_rgProps[cProps++];
+
+		Prop.ulPropTag = PR_SENDER_NAME_A;
+		Prop.Value.lpszA = (LPSTR) m_sSender.c_str ( );
+
+		m_rgresSender[0].rt = RES_CONTENT;
+		m_rgresSender[0].res.resContent.ulFuzzyLevel = FL_SUBSTRING | FL_IGNORECASE;
+		m_rgresSender[0].res.resContent.ulPropTag = PR_SENDER_NAME_A;
+		m_rgresSender[0].res.resContent.lpProp = &Prop;
+		m_rgresSender[1] = m_rgresSender[0];
+		m_rgresSender[1].res.resContent.ulPropTag = PR_SENDER_EMAIL_ADDRESS_A;
+
+		Res.rt = RES_OR;
+		Res.res.resOr.cRes = 2;
+		Res.res.resOr.lpRes = m_rgresSender;
+	}
+
+	if ( !m_sSubject.empty ( ) )
+	{
+		SRestriction &Res = m_rgresTerms[cTerms++];
+		SPropValue &Prop = m_rgProps[cProps++];
+
+		Prop.ulPropTag = PR_SUBJECT_A;
+		Prop.Value.lpszA = (LPSTR) m_sSubject.c_str ( );
+
+		Res.rt = RES_CONTENT;
+		Res.res.resContent.ulFuzzyLevel = FL_SUBSTRING | FL_IGNORECASE;
+		Res.res.resContent.ulPropTag = PR_SUBJECT_A;
+		Res.res.resContent.lpProp = &Prop;
+	}
+
+	if ( !pFilter -> sSince.empty ( ) || !pFilter -> sBefore.empty ( ) )
+	{
+		const std::string *rgsDate[2] = { &pFilter -> sSince, &pFilter -> sBefore };
+		ULONG rgRelop[2] = { RELOP_GE, RELOP_LT };
+
+		for ( ULONG i = 0; i < 2; i++ )
+		{
+			SRestriction *lpRes = NULL;
+			SPropValue *lpProp = NULL;
+
+			if ( rgsDate[i] -> empty ( ) )
+				continue;
+
+			lpRes = &m_rgresTerms[cTerms++];
+			lpProp = &m_rgProps[cProps++];
+
+			lpProp -> ulPropTag = PR_MESSAGE_DELIVERY_TIME;
+			if ( !DateToFileTime ( rgsDate[i] -> c_str ( ), &lpProp -> Value.ft ) )
+				return MAPI_E_INVALID_PARAMETER;
+
+			lpRes -> rt = RES_PROPERTY;
+			lpRes -> res.resProperty.relop = rgRelop[i];
+			lpRes -> res.resProperty.ulPropTag = PR_MESSAGE_DELIVERY_TIME;
+			lpRes -> res.resProperty.lpProp = lpProp;
+		}
+	}
+
+	m_resRoot.rt = RES_AND;
+	m_resRoot.res.resAnd.cRes = cTerms;
+	m_resRoot.res.resAnd.lpRes = m_rgresTerms;
+	m_fEmpty = 0 == cTerms;
+
+	return SUCCESS_SUCCESS;
+}
+
+BOOL CFilterRestriction::Matches ( const MSGHEADER *pHeader )
+{
+	return m_fEmpty || EvalRestriction ( &m_resRoot, pHeader );
+}
+
+// Passes the headers that match the filter on to the caller's callback.
+typedef struct _FILTERCONTEXT
+{
+	CFilterRestriction	*pFilter;
+	LPHEADERCALLBACK	lpfnCallback;
+	LPVOID				lpvContext;
+} FILTERCONTEXT;
+
+static BOOL FilterHeader ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	FILTERCONTEXT *pCtx = (FILTERCONTEXT *) lpvContext;
+
+	if ( !pCtx -> pFilter -> Matches ( pHeader ) )
+		return TRUE;
+
+	return pCtx -> lpfnCallback ( pHeader, pCtx -> lpvContext );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cEnumFilteredInboxHeaders ( )
+|
+|	Parameters:	[IN] pFilter == Predicates a header must match.
+|
+|				[IN] lpfnCallback == Called with each matching header in
+|				delivery order. Returns FALSE to stop the enumeration.
+|
+|				[IN] lpvContext == Passed through to lpfnCallback.
+|
+|	Purpose:	Like cEnumInboxHeaders, but only for messages that match the
+|				filter. With the Extended MAPI contents table the filter is
+|				applied by the store with IMAPITable::Restrict, so rows that
+|				do not match are never sent. On the Simple MAPI paths every
+|				envelope is read and the same restriction is evaluated here.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cEnumFilteredInboxHeaders ( const MSGFILTER *pFilter, LPHEADERCALLBACK lpfnCallback, LPVOID lpvContext )
+{
+	HRESULT hRes = S_OK;
+	CFilterRestriction Filter;
+	FILTERCONTEXT Ctx = { &Filter, lpfnCallback, lpvContext };
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	if ( SUCCESS_SUCCESS != ( hRes = Filter.Compile ( pFilter ) ) )
+		return hRes;
+
+	if ( SUCCESS_SUCCESS == cOpenInboxTable ( ) )
+	{
+		ULONG cRows = 0L;
+
+		hRes = m_pInboxTable -> Enum ( Filter.Get ( ), lpfnCallback, lpvContext, &cRows );
+		if ( SUCCESS_SUCCESS == hRes || MAPI_USER_ABORT == hRes || cRows )
+			return hRes;
+	}
+
+	return cEnumInboxHeaders ( NULL, FilterHeader, &Ctx );
+}
+
+// cEnumFilteredInboxHeaders callback for cListFilteredInboxMessages.
+static BOOL PrintFilteredHeader ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	g_StdOut.Printf ( "%s  %-24.24s  %s\r\n", pHeader -> szDateReceived, pHeader -> sOriginator.c_str ( ),
+			 pHeader -> sSubject.c_str ( ) );
+	( *(ULONG *) lpvContext )++;
+
+	return TRUE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cListFilteredInboxMessages ( )
+|
+|	Purpose:	Asks the user for a filter and prints the date, sender and
+|				subject of each Inbox message that matches it. Entering *
+|				leaves a predicate unset.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cListFilteredInboxMessages ( )
+{
+	HRESULT hRes = S_OK;
+	MSGFILTER Filter;
+	LPSTR rglpszAnswer[5] = {0};
+	LPCSTR rglpszPrompt[5] =
+	{
+		"Unread messages only (y/n): ",
+		"Sender contains (* for any): ",
+		"Subject contains (* for any): ",
+		"Received since YYYY/MM/DD [HH:MM] (* for any): ",
+		"Received before YYYY/MM/DD [HH:MM] (* for any): "
+	};
+	ULONG cMatches = 0L;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	for ( ULONG i = 0; i < _countof ( rglpszPrompt ) && SUCCEEDED ( hRes ); i++ )
+		hRes = cCaptureText ( rglpszPrompt[i], &rglpszAnswer[i] );
+
+	if ( SUCCEEDED ( hRes ) )
+	{
+		Filter.fUnreadOnly = 'y' == rglpszAnswer[0][0] || 'Y' == rglpszAnswer[0][0];
+		if ( strcmp ( rglpszAnswer[1], "*" ) )
+			Filter.sSender = rglpszAnswer[1];
+		if ( strcmp ( rglpszAnswer[2], "*" ) )
+			Filter.sSubject = rglpszAnswer[2];
+		if ( strcmp ( rglpszAnswer[3], "*" ) )
+			Filter.sSince = rglpszAnswer[3];
+		if ( strcmp ( rglpszAnswer[4], "*" ) )
+			Filter.sBefore = rglpszAnswer[4];
+
+		hRes = cEnumFilteredInboxHeaders ( &Filter, PrintFilteredHeader, &cMatches );
+		g_StdOut.Flush ( );
+
+		if ( SUCCESS_SUCCESS == hRes )
+			printf ( "%lu matching messages.\r\n", cMatches );
+		else if ( MAPI_E_INVALID_PARAMETER == hRes )
+			printf ( "Dates must be entered as YYYY/MM/DD or YYYY/MM/DD HH:MM.\r\n" );
+		else
+			printf ( "Filtered listing failed due to error code %d.\r\n", hRes );
+	}
+
+	for ( ULONG i = 0; i < _countof ( rglpszAnswer ); i++ )
+		cFreeBuffer ( rglpszAnswer[i] );
+
+	return hRes;
+}
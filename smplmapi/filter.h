@@ -0,0 +1,47 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Filter.h
+|
+|   Purpose:	Declares CFilterRestriction, which compiles a MSGFILTER
+|				into an SRestriction tree. The Extended MAPI listing
+|				hands the tree to IMAPITable::Restrict so the store
+|				only returns matching rows; the Simple MAPI listing
+|				evaluates the same tree against each header with
+|				Matches.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include "swap.h"
+#include <mapidefs.h>
+#include <mapitags.h>
+
+#define FILTER_MAX_TERMS		5		// Unread, sender, subject, since, before
+
+class CFilterRestriction
+{
+private:
+	SRestriction	m_resRoot;
+	SRestriction	m_rgresTerms[FILTER_MAX_TERMS];	// Children of the root AND
+	SRestriction	m_rgresSender[2];				// Children of the sender OR
+	SPropValue		m_rgProps[FILTER_MAX_TERMS + 1];
+	std::string		m_sSender;
+	std::string		m_sSubject;
+	BOOL			m_fEmpty;
+
+public:
+	CFilterRestriction ( );
+
+	HRESULT			Compile ( const MSGFILTER *pFilter );
+	LPSRestriction	Get ( void ) { return m_fEmpty ? NULL : &m_resRoot; }
+	BOOL			Matches ( const MSGHEADER *pHeader );
+};
+
+BOOL EvalRestriction ( const SRestriction *lpRes, const MSGHEADER *pHeader );
+BOOL DateToFileTime ( LPCSTR lpszDate, FILETIME *pft );
+
+#endif
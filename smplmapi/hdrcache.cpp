@@ -0,0 +1,601 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		HdrCache.cpp
+|
+|   Purpose:	Implementation of CHeaderCache.
+|
++---------------------------------------------------------------------
+*/
+
+#include "hdrcache.h"
+#include "msgidtbl.h"
+
+#define CACHE_ALIGN(cb)		( ( (cb) + 7 ) & ~( (ULONGLONG) 7 ) )
+
+static ULONG CacheCheck ( const BYTE *pb, size_t cb )
+{
+	ULONG ulHash = 2166136261UL;
+
+	for ( size_t i = 0; i < cb; i++ )
+	{
+		ulHash ^= pb[i];
+		ulHash *= 16777619UL;
+	}
+
+	return ulHash;
+}
+
+CHeaderCache::CHeaderCache ( )
+{
+	m_pMsgIDs = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+	m_pbView = NULL;
+	m_cbMapped = 0;
+	m_cbLive = 0;
+	m_cLive = 0L;
+}
+
+CHeaderCache::~CHeaderCache ( )
+{
+	Close ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Map()
+|
+|	Purpose:	Maps the first cbSize bytes of the file read/write,
+|				growing the file if it is shorter.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Map ( ULONGLONG cbSize )
+{
+	Unmap ( );
+
+	m_hMapping = CreateFileMapping ( m_hFile, NULL, PAGE_READWRITE,
+									 (DWORD) ( cbSize >> 32 ), (DWORD) cbSize, NULL );
+	if ( NULL == m_hMapping )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	m_pbView = (LPBYTE) MapViewOfFile ( m_hMapping, FILE_MAP_WRITE, 0, 0, (SIZE_T) cbSize );
+	if ( NULL == m_pbView )
+	{
+		HRESULT hRes = HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+		CloseHandle ( m_hMapping );
+		m_hMapping = NULL;
+		return hRes;
+	}
+	m_cbMapped = cbSize;
+
+	return S_OK;
+}
+
+void CHeaderCache::Unmap ( void )
+{
+	if ( m_pbView )
+	{
+		FlushViewOfFile ( m_pbView, 0 );
+		UnmapViewOfFile ( m_pbView );
+		m_pbView = NULL;
+	}
+	if ( m_hMapping )
+	{
+		CloseHandle ( m_hMapping );
+		m_hMapping = NULL;
+	}
+	m_cbMapped = 0;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Open()
+|
+|	Parameters:	[IN] lpszFile == Cache file; created if it does not exist.
+|				[IN] pMsgIDs == Table the cached message IDs are interned
+|				in. Headers read from the cache carry its handles.
+|
+|	Purpose:	Maps the cache and rebuilds the index from its records.
+|				A file that is not a cache of this version is reset. A
+|				damaged record ends the cache at that point, so a write
+|				cut short by a crash loses only that record.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Open ( LPCSTR lpszFile, CMsgIDTable *pMsgIDs )
+{
+	HRESULT hRes = S_OK;
+	LARGE_INTEGER liSize;
+
+	Close ( );
+
+	m_pMsgIDs = pMsgIDs;
+	m_sFile = lpszFile;
+	m_hFile = CreateFile ( lpszFile, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+						   OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( INVALID_HANDLE_VALUE == m_hFile )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	if ( !GetFileSizeEx ( m_hFile, &liSize ) )
+	{
+		hRes = HRESULT_FROM_WIN32 ( GetLastError ( ) );
+		Close ( );
+		return hRes;
+	}
+
+	if ( FAILED ( hRes = Map ( max ( (ULONGLONG) liSize.QuadPart, (ULONGLONG) CACHE_INITIAL_SIZE ) ) ) )
+	{
+		Close ( );
+		return hRes;
+	}
+
+	if ( CACHE_MAGIC != Header ( ) -> ulMagic ||
+		 CACHE_VERSION != Header ( ) -> ulVersion ||
+		 Header ( ) -> cbUsed < sizeof ( CACHEFILEHEADER ) ||
+		 Header ( ) -> cbUsed > m_cbMapped )
+		hRes = Reset ( );
+	else
+		hRes = Load ( );
+
+	// Compact once superseded records outweigh live ones.
+	if ( SUCCEEDED ( hRes ) &&
+		 Header ( ) -> cbUsed > CACHE_INITIAL_SIZE &&
+		 Header ( ) -> cbUsed - sizeof ( CACHEFILEHEADER ) > 2 * m_cbLive )
+		hRes = Compact ( );
+
+	if ( FAILED ( hRes ) )
+		Close ( );
+
+	return hRes;
+}
+
+void CHeaderCache::Close ( void )
+{
+	Unmap ( );
+	if ( INVALID_HANDLE_VALUE != m_hFile )
+	{
+		CloseHandle ( m_hFile );
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	m_rgEntries.clear ( );
+	m_rgiEntries.clear ( );
+	m_cbLive = 0;
+	m_cLive = 0L;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Flush()
+|
+|	Purpose:	Writes the records appended so far through to the disk.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Flush ( void )
+{
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	if ( !FlushViewOfFile ( m_pbView, (SIZE_T) Header ( ) -> cbUsed ) ||
+		 !FlushFileBuffers ( m_hFile ) )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Reset()
+|
+|	Purpose:	Empties the cache and gives it a new cache ID, so cursors
+|				written against the old contents no longer match.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Reset ( void )
+{
+	FILETIME ftNow;
+
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	GetSystemTimeAsFileTime ( &ftNow );
+
+	ZeroMemory ( m_pbView, sizeof ( CACHEFILEHEADER ) );
+	Header ( ) -> ulMagic = CACHE_MAGIC;
+	Header ( ) -> ulVersion = CACHE_VERSION;
+	Header ( ) -> cbUsed = sizeof ( CACHEFILEHEADER );
+	Header ( ) -> ullCacheID = ( (ULONGLONG) ftNow.dwHighDateTime << 32 ) | ftNow.dwLowDateTime;
+
+	m_rgEntries.clear ( );
+	m_rgiEntries.clear ( );
+	m_cbLive = 0;
+	m_cLive = 0L;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Load()
+|
+|	Purpose:	Rebuilds the entry list and index by walking the
+|				records in the mapping, interning each message ID.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Load ( void )
+{
+	ULONGLONG ib = sizeof ( CACHEFILEHEADER );
+	ULONGLONG cbUsed = Header ( ) -> cbUsed;
+
+	m_rgEntries.clear ( );
+	m_rgiEntries.clear ( );
+	m_cbLive = 0;
+	m_cLive = 0L;
+
+	while ( ib + sizeof ( CACHERECORD ) <= cbUsed )
+	{
+		CACHERECORD *pRecord = Record ( ib );
+		MSGIDHANDLE hMsgID = MSGID_NONE;
+		LONG iEntry = -1;
+
+		if ( pRecord -> cbRecord < sizeof ( CACHERECORD ) ||
+			 pRecord -> cbRecord > cbUsed - ib ||
+			 pRecord -> ulCheck != CacheCheck ( (LPBYTE) &pRecord -> ulKind,
+												pRecord -> cbRecord - 2 * sizeof ( ULONG ) ) )
+			break;
+
+		if ( MSGID_NONE == ( hMsgID = m_pMsgIDs -> Intern ( (LPCSTR) ( pRecord + 1 ) ) ) )
+			return E_OUTOFMEMORY;
+		iEntry = Lookup ( hMsgID );
+
+		if ( iEntry >= 0 && m_rgEntries[iEntry].fLive )
+		{
+			m_cbLive -= Record ( m_rgEntries[iEntry].ibRecord ) -> cbRecord;
+			m_cLive--;
+		}
+
+		if ( CACHE_RECORD_PUT == pRecord -> ulKind )
+		{
+			if ( iEntry < 0 )
+			{
+				CACHEENTRY Entry = { ib, hMsgID, TRUE };
+
+				Insert ( Entry );
+			}
+			else
+			{
+				m_rgEntries[iEntry].ibRecord = ib;
+				m_rgEntries[iEntry].fLive = TRUE;
+			}
+			m_cbLive += pRecord -> cbRecord;
+			m_cLive++;
+		}
+		else if ( iEntry >= 0 )
+		{
+			m_rgEntries[iEntry].fLive = FALSE;
+		}
+
+		ib += pRecord -> cbRecord;
+	}
+
+	Header ( ) -> cbUsed = ib;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Lookup()
+|
+|	Purpose:	Returns the entry index for a message ID, or -1.
+|
++---------------------------------------------------------------------
+*/
+LONG CHeaderCache::Lookup ( MSGIDHANDLE hMsgID )
+{
+	if ( hMsgID >= m_rgiEntries.size ( ) )
+		return -1;
+
+	return (LONG) m_rgiEntries[hMsgID] - 1;
+}
+
+void CHeaderCache::Insert ( const CACHEENTRY &Entry )
+{
+	m_rgEntries.push_back ( Entry );
+
+	if ( Entry.hMsgID >= m_rgiEntries.size ( ) )
+		m_rgiEntries.resize ( max ( (size_t) Entry.hMsgID + 1, 2 * m_rgiEntries.size ( ) ), 0 );
+	m_rgiEntries[Entry.hMsgID] = (ULONG) m_rgEntries.size ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Append()
+|
+|	Purpose:	Appends a record for Header, doubling the mapping when it
+|				is full. The used size in the file header is advanced
+|				only after the record is complete.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Append ( ULONG ulKind, const MSGHEADER &Header, ULONGLONG *pibRecord )
+{
+	HRESULT hRes = S_OK;
+	ULONG cchMsgID = m_pMsgIDs -> Length ( Header.hMsgID );
+	ULONG cchDate = (ULONG) strlen ( Header.szDateReceived );
+	ULONGLONG cbRecord = CACHE_ALIGN ( sizeof ( CACHERECORD ) +
+									   cchMsgID + 1 +
+									   Header.sSubject.size ( ) + 1 +
+									   Header.sOriginator.size ( ) + 1 +
+									   cchDate + 1 +
+									   Header.sConversationIndex.size ( ) );
+	ULONGLONG ib = this -> Header ( ) -> cbUsed;
+	CACHERECORD *pRecord = NULL;
+	LPSTR lpszNext = NULL;
+
+	if ( ib + cbRecord > m_cbMapped )
+	{
+		if ( FAILED ( hRes = Map ( max ( 2 * m_cbMapped, ib + cbRecord ) ) ) )
+			return hRes;
+	}
+
+	pRecord = Record ( ib );
+	ZeroMemory ( pRecord, (size_t) cbRecord );
+	pRecord -> cbRecord = (ULONG) cbRecord;
+	pRecord -> ulKind = ulKind;
+	pRecord -> flFlags = Header.flFlags;
+	pRecord -> cchMsgID = cchMsgID;
+	pRecord -> cchSubject = (ULONG) Header.sSubject.size ( );
+	pRecord -> cchOriginator = (ULONG) Header.sOriginator.size ( );
+	pRecord -> cchDate = cchDate;
+	pRecord -> cbConversationIndex = (ULONG) Header.sConversationIndex.size ( );
+
+	lpszNext = (LPSTR) ( pRecord + 1 );
+	memcpy ( lpszNext, m_pMsgIDs -> Get ( Header.hMsgID ), cchMsgID + 1 );
+	lpszNext += pRecord -> cchMsgID + 1;
+	memcpy ( lpszNext, Header.sSubject.c_str ( ), pRecord -> cchSubject + 1 );
+	lpszNext += pRecord -> cchSubject + 1;
+	memcpy ( lpszNext, Header.sOriginator.c_str ( ), pRecord -> cchOriginator + 1 );
+	lpszNext += pRecord -> cchOriginator + 1;
+	memcpy ( lpszNext, Header.szDateReceived, cchDate + 1 );
+	lpszNext += cchDate + 1;
+	memcpy ( lpszNext, Header.sConversationIndex.data ( ), pRecord -> cbConversationIndex );
+
+	pRecord -> ulCheck = CacheCheck ( (LPBYTE) &pRecord -> ulKind, (size_t) cbRecord - 2 * sizeof ( ULONG ) );
+	this -> Header ( ) -> cbUsed = ib + cbRecord;
+
+	*pibRecord = ib;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Put()
+|
+|	Purpose:	Adds a header, or replaces the cached header with the same
+|				message ID. A replaced header keeps its place in GetAll.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Put ( const MSGHEADER &Header )
+{
+	HRESULT hRes = S_OK;
+	LONG iEntry = -1;
+	ULONGLONG ibRecord = 0;
+
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	iEntry = Lookup ( Header.hMsgID );
+
+	if ( FAILED ( hRes = Append ( CACHE_RECORD_PUT, Header, &ibRecord ) ) )
+		return hRes;
+
+	if ( iEntry < 0 )
+	{
+		CACHEENTRY Entry = { ibRecord, Header.hMsgID, TRUE };
+
+		Insert ( Entry );
+	}
+	else
+	{
+		if ( m_rgEntries[iEntry].fLive )
+		{
+			m_cbLive -= Record ( m_rgEntries[iEntry].ibRecord ) -> cbRecord;
+			m_cLive--;
+		}
+		m_rgEntries[iEntry].ibRecord = ibRecord;
+		m_rgEntries[iEntry].fLive = TRUE;
+	}
+	m_cbLive += Record ( ibRecord ) -> cbRecord;
+	m_cLive++;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Remove()
+|
+|	Purpose:	Drops a message from the cache by appending a REMOVE
+|				record. The entry keeps its place so the message returns
+|				to it if it is put again.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Remove ( MSGIDHANDLE hMsgID )
+{
+	HRESULT hRes = S_OK;
+	LONG iEntry = -1;
+	MSGHEADER Header;
+	ULONGLONG ibRecord = 0;
+
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	iEntry = Lookup ( hMsgID );
+	if ( iEntry < 0 || !m_rgEntries[iEntry].fLive )
+		return S_FALSE;
+
+	Header.hMsgID = hMsgID;
+	Header.szDateReceived[0] = '\0';
+	Header.flFlags = 0L;
+
+	if ( FAILED ( hRes = Append ( CACHE_RECORD_REMOVE, Header, &ibRecord ) ) )
+		return hRes;
+
+	m_cbLive -= Record ( m_rgEntries[iEntry].ibRecord ) -> cbRecord;
+	m_cLive--;
+	m_rgEntries[iEntry].fLive = FALSE;
+
+	return S_OK;
+}
+
+void CHeaderCache::Decode ( const CACHEENTRY &Entry, MSGHEADER *pHeader )
+{
+	CACHERECORD *pRecord = Record ( Entry.ibRecord );
+	LPCSTR lpszNext = (LPCSTR) ( pRecord + 1 );
+
+	pHeader -> hMsgID = Entry.hMsgID;
+	lpszNext += pRecord -> cchMsgID + 1;
+	pHeader -> sSubject.assign ( lpszNext, pRecord -> cchSubject );
+	lpszNext += pRecord -> cchSubject + 1;
+	pHeader -> sOriginator.assign ( lpszNext, pRecord -> cchOriginator );
+	lpszNext += pRecord -> cchOriginator + 1;
+	strncpy ( pHeader -> szDateReceived, lpszNext, MAX_DATE_LENGTH - 1 );
+	pHeader -> szDateReceived[MAX_DATE_LENGTH - 1] = '\0';
+	lpszNext += pRecord -> cchDate + 1;
+	pHeader -> sConversationIndex.assign ( lpszNext, pRecord -> cbConversationIndex );
+	pHeader -> flFlags = pRecord -> flFlags;
+}
+
+BOOL CHeaderCache::Find ( MSGIDHANDLE hMsgID, MSGHEADER *pHeader )
+{
+	LONG iEntry = -1;
+
+	if ( NULL == m_pbView )
+		return FALSE;
+
+	iEntry = Lookup ( hMsgID );
+	if ( iEntry < 0 || !m_rgEntries[iEntry].fLive )
+		return FALSE;
+
+	Decode ( m_rgEntries[iEntry], pHeader );
+
+	return TRUE;
+}
+
+BOOL CHeaderCache::GetEntry ( ULONG iEntry, MSGHEADER *pHeader )
+{
+	if ( NULL == m_pbView )
+		return FALSE;
+	if ( iEntry >= m_rgEntries.size ( ) || !m_rgEntries[iEntry].fLive )
+		return FALSE;
+
+	Decode ( m_rgEntries[iEntry], pHeader );
+
+	return TRUE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	GetAll()
+|
+|	Purpose:	Appends every live header to pView in the order the
+|				messages were first added.
+|
++---------------------------------------------------------------------
+*/
+void CHeaderCache::GetAll ( MSGHEADERLIST *pView )
+{
+	MSGHEADER Header;
+
+	if ( NULL == m_pbView )
+		return;
+
+	pView -> reserve ( pView -> size ( ) + m_cLive );
+	for ( size_t i = 0; i < m_rgEntries.size ( ); i++ )
+	{
+		if ( m_rgEntries[i].fLive )
+		{
+			Decode ( m_rgEntries[i], &Header );
+			pView -> push_back ( Header );
+		}
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Compact()
+|
+|	Purpose:	Rewrites the cache with only its live records, in order,
+|				to a temporary file that then replaces the cache file.
+|				The cache ID and revalidation position are kept.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CHeaderCache::Compact ( void )
+{
+	HRESULT hRes = S_OK;
+	std::string sTempFile = m_sFile + ".tmp";
+	std::string sFile = m_sFile;
+	CACHEFILEHEADER FileHeader = *Header ( );
+	ULONG iRevalidate = 0L;
+	MSGHEADERLIST View;
+	CHeaderCache Compacted;
+
+	// The revalidation position counts entries, removed ones included.
+	for ( ULONG i = 0; i < FileHeader.iRevalidate && i < m_rgEntries.size ( ); i++ )
+	{
+		if ( m_rgEntries[i].fLive )
+			iRevalidate++;
+	}
+
+	GetAll ( &View );
+
+	DeleteFile ( sTempFile.c_str ( ) );
+	if ( FAILED ( hRes = Compacted.Open ( sTempFile.c_str ( ), m_pMsgIDs ) ) )
+		return hRes;
+
+	for ( size_t i = 0; i < View.size ( ) && SUCCEEDED ( hRes ); i++ )
+		hRes = Compacted.Put ( View[i] );
+
+	if ( SUCCEEDED ( hRes ) )
+	{
+		Compacted.Header ( ) -> ullCacheID = FileHeader.ullCacheID;
+		Compacted.Header ( ) -> iRevalidate = iRevalidate;
+	}
+	Compacted.Close ( );
+
+	if ( FAILED ( hRes ) )
+	{
+		DeleteFile ( sTempFile.c_str ( ) );
+		return hRes;
+	}
+
+	Close ( );
+	if ( !MoveFileEx ( sTempFile.c_str ( ), sFile.c_str ( ), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+	{
+		DeleteFile ( sTempFile.c_str ( ) );
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+	}
+
+	return Open ( sFile.c_str ( ), m_pMsgIDs );
+}
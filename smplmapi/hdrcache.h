@@ -0,0 +1,114 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		HdrCache.h
+|
+|   Purpose:	Declares CHeaderCache, the persistent Inbox header cache.
+|				Headers are appended to a memory-mapped file and found
+|				through an in-memory index keyed by message ID handle,
+|				which is rebuilt from the mapping when the cache is
+|				opened. A changed or removed header is recorded by
+|				appending a new record; the file is compacted on open
+|				once most of it is superseded records.
+|
+|				A CHeaderCache is not thread safe.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _HDRCACHE_H
+#define _HDRCACHE_H
+
+#include "swap.h"
+
+#define CACHE_MAGIC				0x43484D53		// "SMHC"
+#define CACHE_VERSION			2
+#define CACHE_INITIAL_SIZE		( 1024 * 1024 )
+#define CACHE_RECORD_PUT		1
+#define CACHE_RECORD_REMOVE		2
+
+// First 64 bytes of the cache file.
+typedef struct _CACHEFILEHEADER
+{
+	ULONG		ulMagic;
+	ULONG		ulVersion;
+	ULONGLONG	cbUsed;			// Bytes in use, this header included
+	ULONGLONG	ullCacheID;		// Changes whenever the cache is reset
+	ULONG		iRevalidate;	// Next entry cRevalidateHeaderCache checks
+	BYTE		rgbReserved[36];
+} CACHEFILEHEADER;
+
+// Every record starts with this header and is followed by the message ID,
+// subject, originator and date, each NUL-terminated, and then the
+// cbConversationIndex bytes of the conversation index. Records are padded
+// to a multiple of 8 bytes.
+typedef struct _CACHERECORD
+{
+	ULONG		cbRecord;		// Whole record, padding included
+	ULONG		ulCheck;		// FNV-1a 32 of the bytes after this field
+	ULONG		ulKind;			// CACHE_RECORD_PUT or CACHE_RECORD_REMOVE
+	ULONG		flFlags;
+	ULONG		cchMsgID;		// Lengths exclude the terminators
+	ULONG		cchSubject;
+	ULONG		cchOriginator;
+	ULONG		cchDate;
+	ULONG		cbConversationIndex;
+} CACHERECORD;
+
+class CHeaderCache
+{
+private:
+	// A message ID known to the cache, in the order it was first added.
+	typedef struct _CACHEENTRY
+	{
+		ULONGLONG	ibRecord;		// Latest PUT record for the message
+		MSGIDHANDLE	hMsgID;
+		BOOL		fLive;			// FALSE once removed
+	} CACHEENTRY;
+
+	CMsgIDTable				*m_pMsgIDs;
+	std::string				m_sFile;
+	HANDLE					m_hFile;
+	HANDLE					m_hMapping;
+	LPBYTE					m_pbView;
+	ULONGLONG				m_cbMapped;
+	ULONGLONG				m_cbLive;		// Bytes of live PUT records
+	std::vector<CACHEENTRY>	m_rgEntries;
+	std::vector<ULONG>		m_rgiEntries;	// By MSGIDHANDLE; entry index + 1, 0 == none
+	ULONG					m_cLive;
+
+	CACHEFILEHEADER *Header ( void ) { return (CACHEFILEHEADER *) m_pbView; }
+	CACHERECORD *Record ( ULONGLONG ib ) { return (CACHERECORD *) ( m_pbView + ib ); }
+
+	HRESULT	Map ( ULONGLONG cbSize );
+	void	Unmap ( void );
+	HRESULT	Append ( ULONG ulKind, const MSGHEADER &Header, ULONGLONG *pibRecord );
+	LONG	Lookup ( MSGIDHANDLE hMsgID );
+	void	Insert ( const CACHEENTRY &Entry );
+	HRESULT	Load ( void );
+	HRESULT	Compact ( void );
+	void	Decode ( const CACHEENTRY &Entry, MSGHEADER *pHeader );
+
+public:
+	CHeaderCache ( );
+	~CHeaderCache ( );
+
+	HRESULT		Open ( LPCSTR lpszFile, CMsgIDTable *pMsgIDs );
+	void		Close ( void );
+	HRESULT		Flush ( void );
+	HRESULT		Reset ( void );
+	HRESULT		Put ( const MSGHEADER &Header );
+	HRESULT		Remove ( MSGIDHANDLE hMsgID );
+	BOOL		Find ( MSGIDHANDLE hMsgID, MSGHEADER *pHeader );
+	void		GetAll ( MSGHEADERLIST *pView );
+	ULONG		Count ( void ) { return m_cLive; }
+	ULONGLONG	CacheID ( void ) { return m_pbView ? Header ( ) -> ullCacheID : 0; }
+
+	// Revalidation walks the live entries round-robin across restarts.
+	ULONG		EntryCount ( void ) { return (ULONG) m_rgEntries.size ( ); }
+	BOOL		GetEntry ( ULONG iEntry, MSGHEADER *pHeader );
+	ULONG		RevalidatePosition ( void ) { return m_pbView ? Header ( ) -> iRevalidate : 0; }
+	void		SetRevalidatePosition ( ULONG iEntry ) { if ( m_pbView ) Header ( ) -> iRevalidate = iEntry; }
+};
+
+#endif
@@ -0,0 +1,725 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		InboxTbl.cpp
+|
+|   Purpose:	Implementation of CInboxTable.
+|
++---------------------------------------------------------------------
+*/
+
+#include "inboxtbl.h"
+#include "msgidtbl.h"
+#include "rtfcomp.h"
+#include <mapiutil.h>
+
+// Columns requested from the contents table, in this order.
+enum { iENTRYID, iSUBJECT, iSENDER_NAME, iSENDER_ADDRESS, iDELIVERY_TIME, iMESSAGE_FLAGS, iCONVERSATION_INDEX, iSEARCH_KEY, cCOLUMNS };
+
+static SizedSPropTagArray ( cCOLUMNS, sptHeaderColumns ) =
+{
+	cCOLUMNS,
+	{
+		PR_ENTRYID,
+		PR_SUBJECT_A,
+		PR_SENDER_NAME_A,
+		PR_SENDER_EMAIL_ADDRESS_A,
+		PR_MESSAGE_DELIVERY_TIME,
+		PR_MESSAGE_FLAGS,
+		PR_CONVERSATION_INDEX,
+		PR_SEARCH_KEY
+	}
+};
+
+// Oldest first, the order MAPI_GUARANTEE_FIFO gives in Simple MAPI.
+static SizedSSortOrderSet ( 1, sosDeliveryTime ) =
+{
+	1, 0, 0,
+	{
+		{ PR_MESSAGE_DELIVERY_TIME, TABLE_SORT_ASCEND }
+	}
+};
+
+CInboxTable::CInboxTable ( )
+{
+	m_pMsgIDs = NULL;
+	m_lpfnUninitialize = NULL;
+	m_lpSession = NULL;
+	m_lpMDB = NULL;
+	m_lpInbox = NULL;
+	m_lpTable = NULL;
+	m_cBatch = TABLE_BATCH_START;
+}
+
+CInboxTable::~CInboxTable ( )
+{
+	Close ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Open()
+|
+|	Parameters:	[IN] lpfnInitialize, lpfnUninitialize, lpfnLogonEx ==
+|				Extended MAPI entry points loaded by cInitApp.
+|				[IN] lpszProfileName == Profile to log on to, or NULL or
+|				an empty string for the default profile.
+|				[IN] pMsgIDs == Table the message IDs of the rows are
+|				interned in.
+|
+|	Purpose:	Logs on to Extended MAPI without UI and opens the
+|				contents table of the Inbox, with its columns set and
+|				sorted by delivery time.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CInboxTable::Open ( LPMAPIINITIALIZE lpfnInitialize, LPMAPIUNINITIALIZE lpfnUninitialize,
+							LPMAPILOGONEX lpfnLogonEx, LPCSTR lpszProfileName, CMsgIDTable *pMsgIDs )
+{
+	HRESULT hRes = S_OK;
+	ULONG cbInboxEID = 0L;
+	LPENTRYID lpInboxEID = NULL;
+	ULONG ulObjType = 0L;
+	BOOL fDefault = NULL == lpszProfileName || '\0' == lpszProfileName[0];
+
+	Close ( );
+
+	m_pMsgIDs = pMsgIDs;
+
+	if ( NULL == lpfnInitialize || NULL == lpfnUninitialize || NULL == lpfnLogonEx )
+		return MAPI_E_NOT_FOUND;
+
+	if ( FAILED ( hRes = lpfnInitialize ( NULL ) ) )
+		return hRes;
+	m_lpfnUninitialize = lpfnUninitialize;
+
+	hRes = lpfnLogonEx ( 0,
+						 fDefault ? NULL : (LPTSTR) lpszProfileName,
+						 NULL,
+						 MAPI_EXTENDED | MAPI_NEW_SESSION | MAPI_NO_MAIL | ( fDefault ? MAPI_USE_DEFAULT : 0 ),
+						 &m_lpSession );
+
+	if ( SUCCEEDED ( hRes ) )
+		hRes = OpenDefaultStore ( );
+
+	if ( SUCCEEDED ( hRes ) )
+		hRes = m_lpMDB -> GetReceiveFolder ( NULL, 0L, &cbInboxEID, &lpInboxEID, NULL );
+
+	if ( SUCCEEDED ( hRes ) )
+		hRes = m_lpMDB -> OpenEntry ( cbInboxEID, lpInboxEID, NULL, 0L, &ulObjType, (LPUNKNOWN *) &m_lpInbox );
+	MAPIFreeBuffer ( lpInboxEID );
+
+	if ( SUCCEEDED ( hRes ) )
+		hRes = m_lpInbox -> GetContentsTable ( 0L, &m_lpTable );
+
+	if ( SUCCEEDED ( hRes ) )
+		hRes = m_lpTable -> SetColumns ( (LPSPropTagArray) &sptHeaderColumns, TBL_BATCH );
+
+	if ( SUCCEEDED ( hRes ) )
+		hRes = m_lpTable -> SortTable ( (LPSSortOrderSet) &sosDeliveryTime, TBL_BATCH );
+
+	if ( FAILED ( hRes ) )
+		Close ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	OpenDefaultStore()
+|
+|	Purpose:	Finds the store marked PR_DEFAULT_STORE in the session's
+|				message store table and opens it.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CInboxTable::OpenDefaultStore ( void )
+{
+	HRESULT hRes = S_OK;
+	LPMAPITABLE lpStores = NULL;
+	LPSRowSet lpRows = NULL;
+	SizedSPropTagArray ( 2, sptStoreColumns ) = { 2, { PR_ENTRYID, PR_DEFAULT_STORE } };
+
+	if ( FAILED ( hRes = m_lpSession -> GetMsgStoresTable ( 0L, &lpStores ) ) )
+		return hRes;
+
+	if ( SUCCEEDED ( hRes = lpStores -> SetColumns ( (LPSPropTagArray) &sptStoreColumns, 0L ) ) )
+	{
+		hRes = MAPI_E_NOT_FOUND;
+
+		while ( NULL == m_lpMDB &&
+				SUCCEEDED ( lpStores -> QueryRows ( TABLE_BATCH_MIN, 0L, &lpRows ) ) &&
+				lpRows -> cRows )
+		{
+			for ( ULONG i = 0; i < lpRows -> cRows && NULL == m_lpMDB; i++ )
+			{
+				LPSPropValue lpProps = lpRows -> aRow[i].lpProps;
+
+				if ( PR_DEFAULT_STORE == lpProps[1].ulPropTag && lpProps[1].Value.b &&
+					 PR_ENTRYID == lpProps[0].ulPropTag )
+				{
+					hRes = m_lpSession -> OpenMsgStore ( 0,
+														 lpProps[0].Value.bin.cb,
+														 (LPENTRYID) lpProps[0].Value.bin.lpb,
+														 NULL,
+														 MDB_NO_MAIL,
+														 &m_lpMDB );
+				}
+			}
+			FreeProws ( lpRows );
+			lpRows = NULL;
+		}
+		FreeProws ( lpRows );
+	}
+
+	lpStores -> Release ( );
+
+	return hRes;
+}
+
+void CInboxTable::Close ( void )
+{
+	m_sFetchSeed.clear ( );
+	if ( m_lpTable )
+	{
+		m_lpTable -> Release ( );
+		m_lpTable = NULL;
+	}
+	if ( m_lpInbox )
+	{
+		m_lpInbox -> Release ( );
+		m_lpInbox = NULL;
+	}
+	if ( m_lpMDB )
+	{
+		m_lpMDB -> Release ( );
+		m_lpMDB = NULL;
+	}
+	if ( m_lpSession )
+	{
+		m_lpSession -> Logoff ( 0, 0L, 0L );
+		m_lpSession -> Release ( );
+		m_lpSession = NULL;
+	}
+	if ( m_lpfnUninitialize )
+	{
+		m_lpfnUninitialize ( );
+		m_lpfnUninitialize = NULL;
+	}
+}
+
+// Sets m_sHexID to the message ID of an entry ID.
+void CInboxTable::HexID ( const SBinary &Bin )
+{
+	static const char szHex[] = "0123456789ABCDEF";
+
+	m_sHexID.clear ( );
+	for ( ULONG i = 0; i < Bin.cb; i++ )
+	{
+		m_sHexID += szHex[Bin.lpb[i] >> 4];
+		m_sHexID += szHex[Bin.lpb[i] & 0x0F];
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	RowToHeader()
+|
+|	Purpose:	Fills a MSGHEADER from one contents table row the way
+|				cReadHeader fills it from a MapiMessage. Columns the
+|				store has no value for come back as PT_ERROR and are
+|				left empty.
+|
++---------------------------------------------------------------------
+*/
+void CInboxTable::RowToHeader ( const SRow *pRow, MSGHEADER *pHeader )
+{
+	LPSPropValue lpProps = pRow -> lpProps;
+	FILETIME ftLocal;
+	SYSTEMTIME stLocal;
+
+	pHeader -> hMsgID = MSGID_NONE;
+	pHeader -> sSubject.clear ( );
+	pHeader -> sOriginator.clear ( );
+	pHeader -> szDateReceived[0] = '\0';
+	pHeader -> flFlags = 0L;
+	pHeader -> sConversationIndex.clear ( );
+	pHeader -> sSearchKey.clear ( );
+
+	if ( PR_ENTRYID == lpProps[iENTRYID].ulPropTag )
+	{
+		HexID ( lpProps[iENTRYID].Value.bin );
+		pHeader -> hMsgID = m_pMsgIDs -> Intern ( m_sHexID.c_str ( ) );
+	}
+
+	if ( PR_SUBJECT_A == lpProps[iSUBJECT].ulPropTag )
+		pHeader -> sSubject = lpProps[iSUBJECT].Value.lpszA;
+
+	if ( PR_SENDER_NAME_A == lpProps[iSENDER_NAME].ulPropTag && lpProps[iSENDER_NAME].Value.lpszA[0] )
+		pHeader -> sOriginator = lpProps[iSENDER_NAME].Value.lpszA;
+	else if ( PR_SENDER_EMAIL_ADDRESS_A == lpProps[iSENDER_ADDRESS].ulPropTag )
+		pHeader -> sOriginator = lpProps[iSENDER_ADDRESS].Value.lpszA;
+
+	// Simple MAPI reports the local time as YYYY/MM/DD HH:MM.
+	if ( PR_MESSAGE_DELIVERY_TIME == lpProps[iDELIVERY_TIME].ulPropTag &&
+		 FileTimeToLocalFileTime ( &lpProps[iDELIVERY_TIME].Value.ft, &ftLocal ) &&
+		 FileTimeToSystemTime ( &ftLocal, &stLocal ) )
+	{
+		_snprintf ( pHeader -> szDateReceived, MAX_DATE_LENGTH, "%04u/%02u/%02u %02u:%02u",
+					stLocal.wYear, stLocal.wMonth, stLocal.wDay, stLocal.wHour, stLocal.wMinute );
+		pHeader -> szDateReceived[MAX_DATE_LENGTH - 1] = '\0';
+	}
+
+	if ( PR_MESSAGE_FLAGS == lpProps[iMESSAGE_FLAGS].ulPropTag )
+	{
+		LONG lFlags = lpProps[iMESSAGE_FLAGS].Value.l;
+
+		if ( !( lFlags & MSGFLAG_READ ) )
+			pHeader -> flFlags |= MAPI_UNREAD;
+		if ( lFlags & MSGFLAG_RN_PENDING )
+			pHeader -> flFlags |= MAPI_RECEIPT_REQUESTED;
+		if ( !( lFlags & MSGFLAG_UNSENT ) )
+			pHeader -> flFlags |= MAPI_SENT;
+	}
+
+	if ( PR_CONVERSATION_INDEX == lpProps[iCONVERSATION_INDEX].ulPropTag )
+	{
+		const SBinary &Bin = lpProps[iCONVERSATION_INDEX].Value.bin;
+
+		pHeader -> sConversationIndex.assign ( (LPCSTR) Bin.lpb, Bin.cb );
+	}
+
+	if ( PR_SEARCH_KEY == lpProps[iSEARCH_KEY].ulPropTag )
+	{
+		const SBinary &Bin = lpProps[iSEARCH_KEY].Value.bin;
+
+		pHeader -> sSearchKey.assign ( (LPCSTR) Bin.lpb, Bin.cb );
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Enum()
+|
+|	Parameters:	[IN] lpRes == Restriction the store applies before
+|				returning rows, or NULL for every message.
+|				[IN] lpfnCallback == Called with each header, oldest
+|				first. Returns FALSE to stop the enumeration.
+|				[IN] lpvContext == Passed through to lpfnCallback.
+|				[OUT] pcRows == Number of headers handed to lpfnCallback.
+|
+|	Purpose:	Reads the table from the top in QueryRows batches. A
+|				full batch that took under TABLE_BATCH_FAST_MS doubles
+|				the next one; one that took over TABLE_BATCH_SLOW_MS
+|				halves it, so round trips stay few without any single
+|				call holding up the caller. The size carries over to the
+|				next Enum. Returns MAPI_USER_ABORT if the callback
+|				stopped the enumeration.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CInboxTable::Enum ( LPSRestriction lpRes, LPHEADERCALLBACK lpfnCallback, LPVOID lpvContext, ULONG *pcRows )
+{
+	HRESULT hRes = S_OK;
+	LPSRowSet lpRows = NULL;
+	MSGHEADER Header;
+
+	*pcRows = 0L;
+	m_sFetchSeed.clear ( );
+
+	if ( NULL == m_lpTable )
+		return MAPI_E_INVALID_SESSION;
+
+	// The restriction stays on the table until the next Enum replaces it;
+	// a NULL restriction removes it.
+	if ( FAILED ( hRes = m_lpTable -> Restrict ( lpRes, TBL_BATCH ) ) ||
+		 FAILED ( hRes = m_lpTable -> SeekRow ( BOOKMARK_BEGINNING, 0, NULL ) ) )
+		return hRes;
+
+	for ( ;; )
+	{
+		DWORD dwStart = GetTickCount ( );
+		DWORD dwElapsed = 0;
+		BOOL fFull = FALSE;
+
+		if ( FAILED ( hRes = m_lpTable -> QueryRows ( (LONG) m_cBatch, 0L, &lpRows ) ) )
+			break;
+
+		dwElapsed = GetTickCount ( ) - dwStart;
+		fFull = lpRows -> cRows == m_cBatch;
+
+		if ( 0 == lpRows -> cRows )
+		{
+			FreeProws ( lpRows );
+			hRes = SUCCESS_SUCCESS;
+			break;
+		}
+
+		if ( fFull && dwElapsed < TABLE_BATCH_FAST_MS && m_cBatch < TABLE_BATCH_MAX )
+			m_cBatch *= 2;
+		else if ( dwElapsed > TABLE_BATCH_SLOW_MS && m_cBatch > TABLE_BATCH_MIN )
+			m_cBatch /= 2;
+
+		for ( ULONG i = 0; i < lpRows -> cRows && SUCCESS_SUCCESS == hRes; i++ )
+		{
+			RowToHeader ( &lpRows -> aRow[i], &Header );
+			( *pcRows )++;
+			if ( !lpfnCallback ( &Header, lpvContext ) )
+				hRes = MAPI_USER_ABORT;
+		}
+		FreeProws ( lpRows );
+
+		if ( MAPI_USER_ABORT == hRes )
+			break;
+	}
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Fetch()
+|
+|	Parameters:	[IN/OUT] lpszSeedMsgID == Buffer of MAX_MSGID characters
+|				as for cFetchInboxHeaders. An empty string starts at the
+|				top of the Inbox; otherwise it must be the ID the last
+|				Fetch left in it. Receives the ID of the last row read.
+|				[IN] cMaxHeaders == Rows to ask for.
+|				[OUT] pHeaders == List the headers are appended to.
+|
+|	Purpose:	Reads the next cMaxHeaders rows in one QueryRows. The
+|				table keeps its position between calls, so a listing
+|				fetched in batches costs one call per batch. Returns
+|				MAPI_E_NOT_FOUND, having read nothing, for a seed the
+|				table is not positioned after; the caller then goes
+|				through Simple MAPI. Returns MAPI_E_NO_MESSAGES once
+|				the table is exhausted.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CInboxTable::Fetch ( LPSTR lpszSeedMsgID, ULONG cMaxHeaders, MSGHEADERLIST *pHeaders )
+{
+	HRESULT hRes = S_OK;
+	LPSRowSet lpRows = NULL;
+	MSGHEADER Header;
+
+	if ( NULL == m_lpTable )
+		return MAPI_E_INVALID_SESSION;
+
+	if ( '\0' == lpszSeedMsgID[0] )
+	{
+		m_sFetchSeed.clear ( );
+		if ( FAILED ( hRes = m_lpTable -> Restrict ( NULL, TBL_BATCH ) ) ||
+			 FAILED ( hRes = m_lpTable -> SeekRow ( BOOKMARK_BEGINNING, 0, NULL ) ) )
+			return hRes;
+	}
+	else if ( m_sFetchSeed != lpszSeedMsgID )
+		return MAPI_E_NOT_FOUND;
+
+	// A row without an entry ID cannot be read or continued from, so a
+	// batch of nothing else is followed by the next one.
+	do
+	{
+		if ( FAILED ( hRes = m_lpTable -> QueryRows ( (LONG) cMaxHeaders, 0L, &lpRows ) ) )
+		{
+			m_sFetchSeed.clear ( );
+			return hRes;
+		}
+
+		hRes = lpRows -> cRows ? MAPI_E_NOT_FOUND : MAPI_E_NO_MESSAGES;
+		pHeaders -> reserve ( pHeaders -> size ( ) + lpRows -> cRows );
+
+		for ( ULONG i = 0; i < lpRows -> cRows; i++ )
+		{
+			RowToHeader ( &lpRows -> aRow[i], &Header );
+			if ( MSGID_NONE == Header.hMsgID )
+				continue;
+
+			pHeaders -> push_back ( Header );
+			strncpy ( lpszSeedMsgID, m_sHexID.c_str ( ), MAX_MSGID - 1 );
+			lpszSeedMsgID[MAX_MSGID - 1] = '\0';
+			hRes = S_OK;
+		}
+		FreeProws ( lpRows );
+	}
+	while ( MAPI_E_NOT_FOUND == hRes );
+
+	m_sFetchSeed = lpszSeedMsgID;
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	FirstID()
+|
+|	Parameters:	[OUT] psHexID == Receives the message ID of the oldest
+|				message in the Inbox.
+|
+|	Purpose:	Reads the first row of the table with no restriction.
+|				Returns MAPI_E_NOT_FOUND if the Inbox is empty.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CInboxTable::FirstID ( std::string *psHexID )
+{
+	HRESULT hRes = S_OK;
+	LPSRowSet lpRows = NULL;
+
+	psHexID -> clear ( );
+	m_sFetchSeed.clear ( );
+
+	if ( NULL == m_lpTable )
+		return MAPI_E_INVALID_SESSION;
+
+	if ( FAILED ( hRes = m_lpTable -> Restrict ( NULL, TBL_BATCH ) ) ||
+		 FAILED ( hRes = m_lpTable -> SeekRow ( BOOKMARK_BEGINNING, 0, NULL ) ) ||
+		 FAILED ( hRes = m_lpTable -> QueryRows ( 1, 0L, &lpRows ) ) )
+		return hRes;
+
+	hRes = MAPI_E_NOT_FOUND;
+	if ( lpRows -> cRows && PR_ENTRYID == lpRows -> aRow[0].lpProps[iENTRYID].ulPropTag )
+	{
+		HexID ( lpRows -> aRow[0].lpProps[iENTRYID].Value.bin );
+		*psHexID = m_sHexID;
+		hRes = S_OK;
+	}
+	FreeProws ( lpRows );
+
+	return hRes;
+}
+
+// Appends the entry ID a message ID stands for to prgbEID. FALSE if the
+// ID is not hex or is empty.
+static BOOL EntryIDFromHex ( LPCSTR lpszHexID, std::vector<BYTE> *prgbEID )
+{
+	size_t cbStart = prgbEID -> size ( );
+
+	for ( LPCSTR lpsz = lpszHexID; lpsz[0] && lpsz[1]; lpsz += 2 )
+	{
+		BYTE b = 0;
+
+		for ( int i = 0; i < 2; i++ )
+		{
+			char ch = lpsz[i];
+
+			b <<= 4;
+			if ( ch >= '0' && ch <= '9' )
+				b |= ch - '0';
+			else if ( ch >= 'A' && ch <= 'F' )
+				b |= ch - 'A' + 10;
+			else if ( ch >= 'a' && ch <= 'f' )
+				b |= ch - 'a' + 10;
+			else
+			{
+				prgbEID -> resize ( cbStart );
+				return FALSE;
+			}
+		}
+		prgbEID -> push_back ( b );
+	}
+
+	return prgbEID -> size ( ) > cbStart;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	ReadRtf()
+|
+|	Parameters:	[IN] lpszHexID == Message ID, the entry ID in hex.
+|				[OUT] psRtf == Receives the RTF body.
+|
+|	Purpose:	Opens the message in the store and decompresses its
+|				PR_RTF_COMPRESSED as the property stream is read
+|				(RtfComp.h). Returns MAPI_E_NOT_FOUND if the message
+|				has no RTF body.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CInboxTable::ReadRtf ( LPCSTR lpszHexID, std::string *psRtf )
+{
+	HRESULT hRes = S_OK;
+	std::vector<BYTE> rgbEID;
+	LPMESSAGE lpMessage = NULL;
+	LPSTREAM lpStream = NULL;
+	ULONG ulObjType = 0L;
+
+	psRtf -> clear ( );
+
+	if ( NULL == m_lpMDB )
+		return MAPI_E_INVALID_SESSION;
+
+	if ( !EntryIDFromHex ( lpszHexID, &rgbEID ) )
+		return MAPI_E_INVALID_ENTRYID;
+
+	if ( FAILED ( hRes = m_lpMDB -> OpenEntry ( (ULONG) rgbEID.size ( ), (LPENTRYID) &rgbEID[0], NULL, 0L,
+												&ulObjType, (LPUNKNOWN *) &lpMessage ) ) )
+		return hRes;
+
+	if ( SUCCEEDED ( hRes = lpMessage -> OpenProperty ( PR_RTF_COMPRESSED, &IID_IStream, STGM_READ, 0L,
+														(LPUNKNOWN *) &lpStream ) ) )
+	{
+		hRes = RtfDecompressStream ( lpStream, psRtf );
+		lpStream -> Release ( );
+	}
+
+	lpMessage -> Release ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	MarkRead()
+|
+|	Parameters:	[IN] rghMsgIDs == Messages to mark read.
+|				[OUT] prghSkipped == Receives the IDs that are not
+|				entry IDs, which are left out.
+|
+|	Purpose:	Marks the messages read with one SetReadFlags call on
+|				the Inbox. Returns MAPI_W_PARTIAL_COMPLETION if some
+|				messages could not be marked, for example because they
+|				were deleted, and MAPI_E_INVALID_ENTRYID if every ID
+|				was left out.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CInboxTable::MarkRead ( const std::vector<MSGIDHANDLE> &rghMsgIDs, std::vector<MSGIDHANDLE> *prghSkipped )
+{
+	std::vector<BYTE> rgbEIDs;
+	std::vector<size_t> rgibEIDs;
+	std::vector<SBinary> rgEntries;
+	ENTRYLIST List;
+
+	prghSkipped -> clear ( );
+
+	if ( NULL == m_lpInbox )
+		return MAPI_E_INVALID_SESSION;
+
+	// The entry IDs go in one buffer, which may move while it grows, so
+	// the SBinary array is filled in only once it is complete.
+	for ( size_t i = 0; i < rghMsgIDs.size ( ); i++ )
+	{
+		size_t ibStart = rgbEIDs.size ( );
+
+		if ( EntryIDFromHex ( m_pMsgIDs -> Get ( rghMsgIDs[i] ), &rgbEIDs ) )
+			rgibEIDs.push_back ( ibStart );
+		else
+			prghSkipped -> push_back ( rghMsgIDs[i] );
+	}
+	if ( rgibEIDs.empty ( ) )
+		return MAPI_E_INVALID_ENTRYID;
+	rgibEIDs.push_back ( rgbEIDs.size ( ) );
+
+	rgEntries.resize ( rgibEIDs.size ( ) - 1 );
+	for ( size_t i = 0; i < rgEntries.size ( ); i++ )
+	{
+		rgEntries[i].cb = (ULONG) ( rgibEIDs[i + 1] - rgibEIDs[i] );
+		rgEntries[i].lpb = &rgbEIDs[rgibEIDs[i]];
+	}
+
+	List.cValues = (ULONG) rgEntries.size ( );
+	List.lpbin = &rgEntries[0];
+
+	return m_lpInbox -> SetReadFlags ( &List, 0L, NULL, 0L );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cOpenInboxTable ( )
+|
+|	Purpose:	Opens the Extended MAPI contents table of the Inbox for
+|				cEnumInboxHeaders, on the profile given to cLogon. Fails
+|				if the provider does not export Extended MAPI, the table
+|				cannot be opened or MAPIFindNext rejects the ID of the
+|				oldest message in it as a seed, which means the table's
+|				message IDs are not this provider's. A failure is
+|				remembered so later listings go straight to Simple MAPI.
+|				While the Inbox is empty nothing can be checked, so the
+|				table is kept but not used until a later call.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cOpenInboxTable ( )
+{
+	HRESULT hRes = S_OK;
+	std::string sHexID;
+	char szMsgID[MAX_MSGID];
+
+	if ( m_pInboxTable && m_fInboxIDsChecked )
+		return SUCCESS_SUCCESS;
+	if ( m_fNoInboxTable || NULL == m_MAPILogonEx || !m_lhSession )
+		return MAPI_E_NOT_SUPPORTED;
+
+	if ( NULL == m_pInboxTable )
+	{
+		m_pInboxTable = new CInboxTable;
+
+		if ( FAILED ( m_pInboxTable -> Open ( m_MAPIInitialize, m_MAPIUninitialize, m_MAPILogonEx,
+											 m_szProfileName, m_pMsgIDs ) ) )
+		{
+			delete m_pInboxTable;
+			m_pInboxTable = NULL;
+			m_fNoInboxTable = TRUE;
+			return MAPI_E_NOT_SUPPORTED;
+		}
+	}
+
+	if ( m_fInboxIDsChecked )
+		return SUCCESS_SUCCESS;
+
+	if ( MAPI_E_NOT_FOUND == ( hRes = m_pInboxTable -> FirstID ( &sHexID ) ) )
+		return MAPI_E_NOT_SUPPORTED;
+
+	if ( SUCCEEDED ( hRes ) )
+		hRes = m_MAPIFindNext ( m_lhSession, 0L, NULL, (LPSTR) sHexID.c_str ( ),
+								MAPI_GUARANTEE_FIFO | MAPI_LONG_MSGID, 0L, szMsgID );
+
+	if ( SUCCESS_SUCCESS != hRes && MAPI_E_NO_MESSAGES != hRes )
+	{
+		delete m_pInboxTable;
+		m_pInboxTable = NULL;
+		m_fNoInboxTable = TRUE;
+		return MAPI_E_NOT_SUPPORTED;
+	}
+
+	m_fInboxIDsChecked = TRUE;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cReadRtfBody ( )
+|
+|	Parameters:	[IN] hMsgID == The message to read.
+|
+|				[OUT] psRtf == Receives the RTF body.
+|
+|	Purpose:	Gets the formatted body of a message, which Simple MAPI
+|				cannot return, by decompressing PR_RTF_COMPRESSED through
+|				the Extended MAPI session of cOpenInboxTable. The message
+|				is not marked read. cReadMail shows it for messages that
+|				have no plain text.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cReadRtfBody ( MSGIDHANDLE hMsgID, std::string *psRtf )
+{
+	HRESULT hRes = SUCCESS_SUCCESS;
+
+	psRtf -> clear ( );
+
+	if ( SUCCESS_SUCCESS != ( hRes = cOpenInboxTable ( ) ) )
+		return hRes;
+
+	return m_pInboxTable -> ReadRtf ( cMsgIDText ( hMsgID ), psRtf );
+}
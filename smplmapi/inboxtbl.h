@@ -0,0 +1,73 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		InboxTbl.h
+|
+|   Purpose:	Declares CInboxTable, the Extended MAPI listing engine.
+|				It opens the contents table of the default store's
+|				receive folder, asks only for the columns a MSGHEADER
+|				needs and reads rows in batches whose size adapts to
+|				how long each QueryRows call takes. One call returns
+|				many headers, where Simple MAPI needs a MAPIFindNext
+|				and a MAPIReadMail for each one.
+|
+|				Message IDs are the entry IDs in upper case hex. Most
+|				Simple MAPI providers use the same IDs, but not all, so
+|				cOpenInboxTable first checks that MAPIFindNext accepts
+|				the ID of a message in the table as a seed. Until one
+|				has been accepted the table is not used.
+|
+|				Extended MAPI must be initialized on the thread that
+|				uses the table, so a CInboxTable belongs to the thread
+|				that opened it.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _INBOXTBL_H
+#define _INBOXTBL_H
+
+#include "swap.h"
+#include <mapidefs.h>
+#include <mapitags.h>
+
+#define TABLE_BATCH_MIN			16		// Rows per QueryRows, lower bound
+#define TABLE_BATCH_START		64		// Rows in the first QueryRows
+#define TABLE_BATCH_MAX			1024	// Rows per QueryRows, upper bound
+#define TABLE_BATCH_FAST_MS		50		// Batches quicker than this grow
+#define TABLE_BATCH_SLOW_MS		250		// Batches slower than this shrink
+
+class CInboxTable
+{
+private:
+	CMsgIDTable			*m_pMsgIDs;
+	LPMAPIUNINITIALIZE	m_lpfnUninitialize;
+	LPMAPISESSION		m_lpSession;
+	LPMDB				m_lpMDB;
+	LPMAPIFOLDER		m_lpInbox;
+	LPMAPITABLE			m_lpTable;
+	ULONG				m_cBatch;		// Current QueryRows batch size
+	std::string			m_sHexID;		// Scratch for RowToHeader
+	std::string			m_sFetchSeed;	// Last ID Fetch returned; the table is past it
+
+	HRESULT	OpenDefaultStore ( void );
+	void	HexID ( const SBinary &Bin );
+	void	RowToHeader ( const SRow *pRow, MSGHEADER *pHeader );
+
+public:
+	CInboxTable ( );
+	~CInboxTable ( );
+
+	HRESULT		Open ( LPMAPIINITIALIZE lpfnInitialize, LPMAPIUNINITIALIZE lpfnUninitialize,
+					   LPMAPILOGONEX lpfnLogonEx, LPCSTR lpszProfileName, CMsgIDTable *pMsgIDs );
+	void		Close ( void );
+	HRESULT		Enum ( LPSRestriction lpRes, LPHEADERCALLBACK lpfnCallback, LPVOID lpvContext,
+						   ULONG *pcRows );
+	HRESULT		Fetch ( LPSTR lpszSeedMsgID, ULONG cMaxHeaders, MSGHEADERLIST *pHeaders );
+	HRESULT		FirstID ( std::string *psHexID );
+	HRESULT		ReadRtf ( LPCSTR lpszHexID, std::string *psRtf );
+	HRESULT		MarkRead ( const std::vector<MSGIDHANDLE> &rghMsgIDs, std::vector<MSGIDHANDLE> *prghSkipped );
+	ULONG		BatchSize ( void ) { return m_cBatch; }
+};
+
+#endif
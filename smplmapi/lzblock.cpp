@@ -0,0 +1,192 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		LZBlock.cpp
+|
+|   Purpose:	Implementation of the LZ block compressor.
+|
++---------------------------------------------------------------------
+*/
+
+#include "lzblock.h"
+
+static inline UINT32 LZRead32 ( const BYTE *pb )
+{
+	UINT32 ul;
+
+	memcpy ( &ul, pb, sizeof ( ul ) );
+	return ul;
+}
+
+static inline UINT32 LZHash ( UINT32 ul )
+{
+	return ( ul * 2654435761U ) >> ( 32 - LZ_HASH_BITS );
+}
+
+// Writes the part of a length that does not fit its nibble.
+static inline LPBYTE LZPutLength ( LPBYTE pbOut, size_t cb )
+{
+	for ( ; cb >= 255; cb -= 255 )
+		*pbOut++ = 255;
+	*pbOut++ = (BYTE) cb;
+
+	return pbOut;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	LZCompress()
+|
+|	Purpose:	Compresses cbIn bytes into pbOut. Returns the size of
+|				the block, or 0 if it would not fit in cbOutMax bytes,
+|				in which case the input is best kept as it is.
+|
++---------------------------------------------------------------------
+*/
+size_t LZCompress ( const BYTE *pbIn, size_t cbIn, LPBYTE pbOut, size_t cbOutMax )
+{
+	UINT32 rgiTable[1 << LZ_HASH_BITS];
+	const BYTE *pbEnd = pbIn + cbIn;
+	const BYTE *pbLimit = cbIn > 12 ? pbEnd - 12 : pbIn;	// Last place a match may start
+	const BYTE *pbAnchor = pbIn;
+	const BYTE *pb = pbIn;
+	LPBYTE pbDst = pbOut;
+	LPBYTE pbDstEnd = pbOut + cbOutMax;
+
+	memset ( rgiTable, 0xFF, sizeof ( rgiTable ) );
+
+	while ( pb < pbLimit )
+	{
+		UINT32 ulHash = LZHash ( LZRead32 ( pb ) );
+		UINT32 iCandidate = rgiTable[ulHash];
+		const BYTE *pbMatch = NULL;
+		size_t cbLiterals = 0;
+		size_t cbMatch = LZ_MIN_MATCH;
+		LPBYTE pbToken = NULL;
+
+		rgiTable[ulHash] = (UINT32) ( pb - pbIn );
+
+		if ( 0xFFFFFFFF == iCandidate || (size_t) ( pb - pbIn ) - iCandidate > LZ_MAX_OFFSET ||
+			 LZRead32 ( pbIn + iCandidate ) != LZRead32 ( pb ) )
+		{
+			pb++;
+			continue;
+		}
+		pbMatch = pbIn + iCandidate;
+
+		// Matches stop short of the last 5 bytes, which are always literals.
+		while ( pb + cbMatch < pbEnd - 5 && pbMatch[cbMatch] == pb[cbMatch] )
+			cbMatch++;
+
+		cbLiterals = pb - pbAnchor;
+		if ( pbDst + 1 + cbLiterals + cbLiterals / 255 + 2 + 2 + ( cbMatch - LZ_MIN_MATCH ) / 255 + 1 > pbDstEnd )
+			return 0;
+
+		pbToken = pbDst++;
+		*pbToken = (BYTE) ( ( cbLiterals >= 15 ? 15 : cbLiterals ) << 4 );
+		if ( cbLiterals >= 15 )
+			pbDst = LZPutLength ( pbDst, cbLiterals - 15 );
+		memcpy ( pbDst, pbAnchor, cbLiterals );
+		pbDst += cbLiterals;
+
+		*pbDst++ = (BYTE) ( ( pb - pbMatch ) & 0xFF );
+		*pbDst++ = (BYTE) ( ( pb - pbMatch ) >> 8 );
+		if ( cbMatch - LZ_MIN_MATCH >= 15 )
+		{
+			*pbToken |= 15;
+			pbDst = LZPutLength ( pbDst, cbMatch - LZ_MIN_MATCH - 15 );
+		}
+		else
+			*pbToken |= (BYTE) ( cbMatch - LZ_MIN_MATCH );
+
+		pb += cbMatch;
+		pbAnchor = pb;
+	}
+
+	// The rest goes out as literals.
+	size_t cbLiterals = pbEnd - pbAnchor;
+
+	if ( pbDst + 1 + cbLiterals + cbLiterals / 255 + 1 > pbDstEnd )
+		return 0;
+
+	*pbDst = (BYTE) ( ( cbLiterals >= 15 ? 15 : cbLiterals ) << 4 );
+	pbDst++;
+	if ( cbLiterals >= 15 )
+		pbDst = LZPutLength ( pbDst, cbLiterals - 15 );
+	memcpy ( pbDst, pbAnchor, cbLiterals );
+	pbDst += cbLiterals;
+
+	return pbDst - pbOut;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	LZDecompress()
+|
+|	Purpose:	Expands a block made by LZCompress into exactly cbOut
+|				bytes. Returns FALSE if the block is malformed or does
+|				not expand to that size; nothing outside pbOut is
+|				touched either way.
+|
++---------------------------------------------------------------------
+*/
+BOOL LZDecompress ( const BYTE *pbIn, size_t cbIn, LPBYTE pbOut, size_t cbOut )
+{
+	const BYTE *pbEnd = pbIn + cbIn;
+	LPBYTE pbDst = pbOut;
+	LPBYTE pbDstEnd = pbOut + cbOut;
+
+	while ( pbIn < pbEnd )
+	{
+		BYTE bToken = *pbIn++;
+		size_t cbLiterals = bToken >> 4;
+		size_t cbMatch = bToken & 15;
+		size_t ibOffset = 0;
+
+		if ( 15 == cbLiterals )
+		{
+			BYTE b = 255;
+
+			while ( 255 == b && pbIn < pbEnd )
+				cbLiterals += ( b = *pbIn++ );
+		}
+		if ( cbLiterals > (size_t) ( pbEnd - pbIn ) || cbLiterals > (size_t) ( pbDstEnd - pbDst ) )
+			return FALSE;
+		memcpy ( pbDst, pbIn, cbLiterals );
+		pbDst += cbLiterals;
+		pbIn += cbLiterals;
+
+		// The last sequence has no match.
+		if ( pbIn == pbEnd )
+			break;
+
+		if ( pbEnd - pbIn < 2 )
+			return FALSE;
+		ibOffset = pbIn[0] | ( pbIn[1] << 8 );
+		pbIn += 2;
+		if ( 0 == ibOffset || ibOffset > (size_t) ( pbDst - pbOut ) )
+			return FALSE;
+
+		if ( 15 == cbMatch )
+		{
+			BYTE b = 255;
+
+			while ( 255 == b && pbIn < pbEnd )
+				cbMatch += ( b = *pbIn++ );
+		}
+		cbMatch += LZ_MIN_MATCH;
+		if ( cbMatch > (size_t) ( pbDstEnd - pbDst ) )
+			return FALSE;
+
+		// Byte by byte: the match may overlap what it is copying.
+		const BYTE *pbMatch = pbDst - ibOffset;
+
+		for ( size_t i = 0; i < cbMatch; i++ )
+			pbDst[i] = pbMatch[i];
+		pbDst += cbMatch;
+	}
+
+	return pbDst == pbDstEnd;
+}
@@ -0,0 +1,34 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		LZBlock.h
+|
+|   Purpose:	Declares a fast LZ77 block compressor for cached message
+|				text. The format is that of an LZ4 block: a token byte
+|				holds the literal count in its high nibble and the match
+|				length less LZ_MIN_MATCH in its low one, a nibble of 15
+|				is continued in bytes of 255, and each match is a
+|				two-byte little-endian offset back into the output. The
+|				last sequence is literals only. Matches are found
+|				greedily through a single hash table, trading ratio for
+|				speed; decompression only copies.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _LZBLOCK_H
+#define _LZBLOCK_H
+
+#include "swap.h"
+
+#define LZ_MIN_MATCH			4
+#define LZ_HASH_BITS			12
+#define LZ_MAX_OFFSET			65535
+
+// Bytes LZCompress may need for cbIn bytes of input that do not compress.
+#define LZ_COMPRESS_BOUND(cbIn)	( (cbIn) + (cbIn) / 255 + 16 )
+
+size_t	LZCompress ( const BYTE *pbIn, size_t cbIn, LPBYTE pbOut, size_t cbOutMax );
+BOOL	LZDecompress ( const BYTE *pbIn, size_t cbIn, LPBYTE pbOut, size_t cbOut );
+
+#endif
@@ -0,0 +1,192 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		MailMerge.cpp
+|
+|   Purpose:	Implementation of CMergeTemplate and CMailMerge.
+|
++---------------------------------------------------------------------
+*/
+
+#include "mailmerge.h"
+
+CMergeTemplate::CMergeTemplate ( )
+{
+	m_cFields = 0L;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Compile()
+|
+|	Parameters:	[IN] sTemplate == Subject or text with fields
+|				(MailMerge.h).
+|
+|				[OUT] psBadField == Receives the first field with an
+|				unknown name. May be NULL.
+|
+|	Purpose:	Parses the template into operations. Plain text next to
+|				plain text is one operation. Returns E_INVALIDARG if a
+|				field has an unknown name; the template is then empty.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CMergeTemplate::Compile ( const std::string &sTemplate, std::string *psBadField )
+{
+	size_t ich = 0;
+
+	m_rgOps.clear ( );
+	m_sText.clear ( );
+	m_cFields = 0L;
+	if ( psBadField )
+		psBadField -> clear ( );
+
+	while ( ich < sTemplate.size ( ) )
+	{
+		size_t ichOpen = sTemplate.find ( "{{", ich );
+		size_t ichClose = std::string::npos;
+		MERGEOP Op;
+
+		if ( std::string::npos != ichOpen )
+			ichClose = sTemplate.find ( "}}", ichOpen + 2 );
+		if ( std::string::npos == ichClose )
+			ichOpen = ichClose = sTemplate.size ( );
+
+		// The plain text before the field.
+		if ( ichOpen > ich )
+		{
+			if ( !m_rgOps.empty ( ) && MERGE_TEXT == m_rgOps.back ( ).ulField )
+				m_rgOps.back ( ).cchText += (ULONG) ( ichOpen - ich );
+			else
+			{
+				Op.ulField = MERGE_TEXT;
+				Op.ichText = (ULONG) m_sText.size ( );
+				Op.cchText = (ULONG) ( ichOpen - ich );
+				m_rgOps.push_back ( Op );
+			}
+			m_sText.append ( sTemplate, ich, ichOpen - ich );
+		}
+		if ( ichOpen == sTemplate.size ( ) )
+			break;
+
+		std::string sName ( sTemplate, ichOpen + 2, ichClose - ichOpen - 2 );
+		ULONG ulColumn = 0L;
+
+		Op.ulField = MERGE_TEXT;
+		Op.ichText = 0L;
+		Op.cchText = 0L;
+		if ( 0 == _stricmp ( sName.c_str ( ), "Name" ) )
+			Op.ulField = MERGE_NAME;
+		else if ( 0 == _stricmp ( sName.c_str ( ), "FirstName" ) )
+			Op.ulField = MERGE_FIRST_NAME;
+		else if ( 0 == _stricmp ( sName.c_str ( ), "Address" ) )
+			Op.ulField = MERGE_ADDRESS;
+		else if ( !sName.empty ( ) && sName.size ( ) <= 2 &&
+				  std::string::npos == sName.find_first_not_of ( "0123456789" ) &&
+				  ( ulColumn = strtoul ( sName.c_str ( ), NULL, 10 ) ) >= 1 )
+			Op.ulField = MERGE_COLUMN + ulColumn - 1;
+
+		if ( MERGE_TEXT == Op.ulField )
+		{
+			if ( psBadField )
+				psBadField -> assign ( sTemplate, ichOpen, ichClose + 2 - ichOpen );
+			m_rgOps.clear ( );
+			m_sText.clear ( );
+			m_cFields = 0L;
+			return E_INVALIDARG;
+		}
+
+		m_rgOps.push_back ( Op );
+		m_cFields++;
+		ich = ichClose + 2;
+	}
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Render()
+|
+|	Purpose:	Replaces psOut with the template filled in for Recip.
+|				psOut keeps its capacity, so a buffer reused for every
+|				recipient stops allocating once it fits the longest
+|				message.
+|
++---------------------------------------------------------------------
+*/
+void CMergeTemplate::Render ( const BULKRECIPIENT &Recip, std::string *psOut ) const
+{
+	psOut -> clear ( );
+
+	for ( size_t i = 0; i < m_rgOps.size ( ); i++ )
+	{
+		const MERGEOP &Op = m_rgOps[i];
+		size_t ich = 0;
+
+		switch ( Op.ulField )
+		{
+		case MERGE_TEXT:
+			psOut -> append ( m_sText, Op.ichText, Op.cchText );
+			break;
+		case MERGE_NAME:
+			psOut -> append ( Recip.sName );
+			break;
+		case MERGE_FIRST_NAME:
+			psOut -> append ( Recip.sName, 0, Recip.sName.find ( ' ' ) );
+			break;
+		case MERGE_ADDRESS:
+			ich = Recip.sAddress.find ( ':' );
+			psOut -> append ( Recip.sAddress, std::string::npos == ich ? 0 : ich + 1, std::string::npos );
+			break;
+		default:
+			ich = Op.ulField - MERGE_COLUMN;
+			if ( ich < Recip.rgColumns.size ( ) )
+				psOut -> append ( Recip.rgColumns[ich] );
+			break;
+		}
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Compile()
+|
+|	Purpose:	Compiles the subject and the text of Template. Returns
+|				E_INVALIDARG, with the field in psBadField, if either
+|				has a field with an unknown name.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CMailMerge::Compile ( const BULKTEMPLATE &Template, std::string *psBadField )
+{
+	HRESULT hRes = S_OK;
+
+	if ( FAILED ( hRes = m_Subject.Compile ( Template.sSubject, psBadField ) ) )
+		return hRes;
+
+	return m_NoteText.Compile ( Template.sNoteText, psBadField );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Render()
+|
+|	Purpose:	Fills in the subject and text for Recip and points the
+|				subject and text of lpMessage at them. They stay valid
+|				until pBuffers is rendered into again.
+|
++---------------------------------------------------------------------
+*/
+void CMailMerge::Render ( const BULKRECIPIENT &Recip, MERGEBUFFERS *pBuffers, lpMapiMessage lpMessage ) const
+{
+	m_Subject.Render ( Recip, &pBuffers -> sSubject );
+	m_NoteText.Render ( Recip, &pBuffers -> sNoteText );
+
+	lpMessage -> lpszSubject = (LPSTR) pBuffers -> sSubject.c_str ( );
+	lpMessage -> lpszNoteText = (LPSTR) pBuffers -> sNoteText.c_str ( );
+}
@@ -0,0 +1,85 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		MailMerge.h
+|
+|   Purpose:	Declares the mail merge used by cBulkSend to give each
+|				recipient a message of their own. A template subject or
+|				text may contain fields, which are replaced with values
+|				of the recipient:
+|
+|					{{Name}}		Display name
+|					{{FirstName}}	Display name up to the first space
+|					{{Address}}		Address without its type, e.g.
+|									bob@example.com
+|					{{1}}, {{2}}...	Columns after the address in the
+|									recipient file (BulkSend.h)
+|
+|				Field names are not case sensitive. A "{{" with no "}}"
+|				after it is plain text; a field with any other name is
+|				an error.
+|
+|				A template is compiled once into a list of operations,
+|				each either a span of a single string holding all the
+|				plain text or a field. Rendering runs the list, appending
+|				to buffers the caller keeps from one message to the
+|				next, so once the buffers have grown to fit no message
+|				allocates memory.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _MAILMERGE_H
+#define _MAILMERGE_H
+
+#include "swap.h"
+
+#define MERGE_TEXT				0		// Operation appends plain text
+#define MERGE_NAME				1
+#define MERGE_FIRST_NAME		2
+#define MERGE_ADDRESS			3
+#define MERGE_COLUMN			16		// MERGE_COLUMN + n is column n + 1
+#define MERGE_MAX_COLUMNS		99
+
+typedef struct _MERGEOP
+{
+	ULONG		ulField;				// MERGE_TEXT or the field
+	ULONG		ichText;				// MERGE_TEXT: span of the plain text
+	ULONG		cchText;
+} MERGEOP;
+
+class CMergeTemplate
+{
+private:
+	std::vector<MERGEOP>	m_rgOps;
+	std::string				m_sText;	// Plain text of every MERGE_TEXT operation
+	ULONG					m_cFields;
+
+public:
+	CMergeTemplate ( );
+
+	HRESULT	Compile ( const std::string &sTemplate, std::string *psBadField );
+	void	Render ( const BULKRECIPIENT &Recip, std::string *psOut ) const;
+	ULONG	FieldCount ( void ) const { return m_cFields; }
+};
+
+// Buffers a merge renders into; keep one per thread and reuse it.
+typedef struct _MERGEBUFFERS
+{
+	std::string	sSubject;
+	std::string	sNoteText;
+} MERGEBUFFERS;
+
+class CMailMerge
+{
+private:
+	CMergeTemplate	m_Subject;
+	CMergeTemplate	m_NoteText;
+
+public:
+	HRESULT	Compile ( const BULKTEMPLATE &Template, std::string *psBadField );
+	ULONG	FieldCount ( void ) const { return m_Subject.FieldCount ( ) + m_NoteText.FieldCount ( ); }
+	void	Render ( const BULKRECIPIENT &Recip, MERGEBUFFERS *pBuffers, lpMapiMessage lpMessage ) const;
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Message.cpp
+|
+|   Purpose:	Implementation of CLazyMessage.
+|
++---------------------------------------------------------------------
+*/
+
+#include "message.h"
+#include "bodycache.h"
+
+CLazyMessage::CLazyMessage ( CApp *pApp )
+{
+	m_pApp = pApp;
+	m_hMsgID = MSGID_NONE;
+	m_lpMessage = NULL;
+	m_ulLevel = LAZY_NONE;
+	m_fMarkRead = FALSE;
+}
+
+CLazyMessage::~CLazyMessage ( )
+{
+	Close ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Open()
+|
+|	Purpose:	Points the object at a message without reading it.
+|				With fMarkRead the first read marks the message read.
+|
++---------------------------------------------------------------------
+*/
+void CLazyMessage::Open ( MSGIDHANDLE hMsgID, BOOL fMarkRead )
+{
+	Close ( );
+	m_hMsgID = hMsgID;
+	m_fMarkRead = fMarkRead;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Adopt()
+|
+|	Purpose:	Takes ownership of a copy of the open message that was
+|				read to ulLevel elsewhere, such as by the read-ahead.
+|				Text that was read goes to the body cache and the
+|				search index.
+|
++---------------------------------------------------------------------
+*/
+void CLazyMessage::Adopt ( lpMapiMessage lpMessage, ULONG ulLevel )
+{
+	CBodyCache *pCache = m_pApp -> cBodyCache ( );
+
+	if ( m_lpMessage )
+		m_pApp -> cFreeBuffer ( m_lpMessage );
+	m_lpMessage = lpMessage;
+	m_ulLevel = lpMessage ? ulLevel : LAZY_NONE;
+
+	if ( m_ulLevel >= LAZY_TEXT )
+	{
+		if ( pCache )
+			pCache -> Put ( m_hMsgID, m_lpMessage -> lpszNoteText );
+		m_pApp -> cIndexMessage ( m_hMsgID, m_lpMessage );
+	}
+}
+
+void CLazyMessage::Close ( void )
+{
+	if ( m_lpMessage )
+		m_pApp -> cFreeBuffer ( m_lpMessage );
+	m_lpMessage = NULL;
+	m_ulLevel = LAZY_NONE;
+	m_hMsgID = MSGID_NONE;
+	m_fMarkRead = FALSE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Load()
+|
+|	Purpose:	Returns the message read to at least ulLevel, reading
+|				it again only if it has not been read that far. The
+|				returned message stays owned by this object and is
+|				valid until the next read or Close.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CLazyMessage::Load ( ULONG ulLevel, lpMapiMessage *lppMessage )
+{
+	HRESULT hRes = SUCCESS_SUCCESS;
+	lpMapiMessage lpMessage = NULL;
+	FLAGS flFlags = m_fMarkRead ? 0L : MAPI_PEEK;
+	CBodyCache *pCache = m_pApp -> cBodyCache ( );
+
+	*lppMessage = NULL;
+
+	// Cached text is attached to the envelope; the text pointer of a
+	// message is not used to free it.
+	if ( LAZY_TEXT == ulLevel && m_ulLevel < LAZY_TEXT && pCache && pCache -> Get ( m_hMsgID, &m_sText ) )
+	{
+		if ( SUCCESS_SUCCESS != ( hRes = Load ( LAZY_ENVELOPE, &lpMessage ) ) )
+			return hRes;
+		lpMessage -> lpszNoteText = (LPSTR) m_sText.c_str ( );
+		m_ulLevel = LAZY_TEXT;
+	}
+
+	if ( m_ulLevel < ulLevel )
+	{
+		if ( LAZY_ENVELOPE == ulLevel )
+			flFlags |= MAPI_ENVELOPE_ONLY;
+		else if ( LAZY_TEXT == ulLevel )
+			flFlags |= MAPI_SUPPRESS_ATTACH;
+
+		if ( SUCCESS_SUCCESS != ( hRes = m_pApp -> cReadMessage ( m_hMsgID, flFlags, &lpMessage ) ) )
+			return hRes;
+
+		Adopt ( lpMessage, ulLevel );
+		m_fMarkRead = FALSE;
+	}
+
+	*lppMessage = m_lpMessage;
+
+	return hRes;
+}
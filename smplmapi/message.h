@@ -0,0 +1,61 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Message.h
+|
+|   Purpose:	Declares CLazyMessage, which reads a message only as far
+|				as it is used. The envelope is read with
+|				MAPI_ENVELOPE_ONLY, the text with MAPI_SUPPRESS_ATTACH
+|				on first access, and attachments are written to
+|				temporary files only when they are asked for. A read
+|				that goes further replaces the one before, and every
+|				level is served from the furthest read so far.
+|
+|				When the message is opened to be marked read, the first
+|				read it makes is without MAPI_PEEK, which marks it.
+|
+|				Text goes through the session's body cache
+|				(BodyCache.h): text found there needs only the envelope
+|				to be read, and text read is added to it.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _MESSAGE_H
+#define _MESSAGE_H
+
+#include "swap.h"
+
+// How far a message has been read, in increasing order.
+#define LAZY_NONE				0
+#define LAZY_ENVELOPE			1		// Envelope and recipients
+#define LAZY_TEXT				2		// Plus the note text
+#define LAZY_ATTACHMENTS		3		// Plus attachments in temporary files
+
+class CLazyMessage
+{
+private:
+	CApp			*m_pApp;
+	MSGIDHANDLE		m_hMsgID;
+	lpMapiMessage	m_lpMessage;
+	ULONG			m_ulLevel;		// LAZY_ constant m_lpMessage was read to
+	BOOL			m_fMarkRead;	// Next read is made without MAPI_PEEK
+	std::string		m_sText;		// Text from the body cache, if it came from there
+
+	HRESULT	Load ( ULONG ulLevel, lpMapiMessage *lppMessage );
+
+public:
+	CLazyMessage ( CApp *pApp );
+	~CLazyMessage ( );
+
+	void		Open ( MSGIDHANDLE hMsgID, BOOL fMarkRead );
+	void		Adopt ( lpMapiMessage lpMessage, ULONG ulLevel );
+	void		Close ( void );
+	MSGIDHANDLE	MsgID ( void ) { return m_hMsgID; }
+
+	HRESULT	Envelope ( lpMapiMessage *lppMessage ) { return Load ( LAZY_ENVELOPE, lppMessage ); }
+	HRESULT	Text ( lpMapiMessage *lppMessage ) { return Load ( LAZY_TEXT, lppMessage ); }
+	HRESULT	Attachments ( lpMapiMessage *lppMessage ) { return Load ( LAZY_ATTACHMENTS, lppMessage ); }
+};
+
+#endif
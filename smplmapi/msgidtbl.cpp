@@ -0,0 +1,215 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		MsgIDTbl.cpp
+|
+|   Purpose:	Implementation of CMsgIDTable.
+|
++---------------------------------------------------------------------
+*/
+
+#include "msgidtbl.h"
+
+#define MSGID_ALIGN(cb)		( ( (cb) + 7 ) & ~( (size_t) 7 ) )
+
+static ULONG MsgIDHash ( LPCSTR lpszMsgID, size_t cch )
+{
+	ULONG ulHash = 2166136261UL;
+
+	for ( size_t i = 0; i < cch; i++ )
+	{
+		ulHash ^= (BYTE) lpszMsgID[i];
+		ulHash *= 16777619UL;
+	}
+
+	return ulHash;
+}
+
+CMsgIDTable::CMsgIDTable ( )
+{
+	InitializeCriticalSection ( &m_csLock );
+	m_pbNext = NULL;
+	m_cbFree = 0;
+	ZeroMemory ( m_rgpPages, sizeof ( m_rgpPages ) );
+	m_cIDs = 0L;
+	m_rgSlots.assign ( 1024, MSGID_NONE );
+	m_cbText = 0;
+	m_cbArena = 0;
+}
+
+CMsgIDTable::~CMsgIDTable ( )
+{
+	for ( size_t i = 0; i < m_rgpBlocks.size ( ); i++ )
+		free ( m_rgpBlocks[i] );
+	for ( ULONG i = 0; i < MSGID_MAX_PAGES && m_rgpPages[i]; i++ )
+		free ( m_rgpPages[i] );
+
+	DeleteCriticalSection ( &m_csLock );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Allocate()
+|
+|	Purpose:	Carves cb bytes, a multiple of 8, out of the arena,
+|				starting a new block when the current one is full.
+|				Called with the lock held.
+|
++---------------------------------------------------------------------
+*/
+LPBYTE CMsgIDTable::Allocate ( size_t cb )
+{
+	LPBYTE pb = NULL;
+
+	if ( cb > m_cbFree )
+	{
+		size_t cbBlock = max ( cb, (size_t) MSGID_BLOCK_SIZE );
+
+		if ( NULL == ( pb = (LPBYTE) malloc ( cbBlock ) ) )
+			return NULL;
+		m_rgpBlocks.push_back ( pb );
+		m_cbArena += cbBlock;
+		m_pbNext = pb;
+		m_cbFree = cbBlock;
+	}
+
+	pb = m_pbNext;
+	m_pbNext += cb;
+	m_cbFree -= cb;
+
+	return pb;
+}
+
+MSGIDHANDLE CMsgIDTable::Lookup ( LPCSTR lpszMsgID, size_t cch, ULONG ulHash )
+{
+	size_t iMask = m_rgSlots.size ( ) - 1;
+
+	for ( size_t iSlot = ulHash & iMask; m_rgSlots[iSlot]; iSlot = ( iSlot + 1 ) & iMask )
+	{
+		const MSGIDRECORD *pRecord = Record ( m_rgSlots[iSlot] );
+
+		if ( pRecord -> ulHash == ulHash && pRecord -> cch == cch &&
+			 0 == memcmp ( pRecord + 1, lpszMsgID, cch ) )
+			return m_rgSlots[iSlot];
+	}
+
+	return MSGID_NONE;
+}
+
+void CMsgIDTable::Rehash ( size_t cSlots )
+{
+	size_t iMask = cSlots - 1;
+
+	m_rgSlots.assign ( cSlots, MSGID_NONE );
+	for ( MSGIDHANDLE h = 1; h <= m_cIDs; h++ )
+	{
+		size_t iSlot = Record ( h ) -> ulHash & iMask;
+
+		while ( m_rgSlots[iSlot] )
+			iSlot = ( iSlot + 1 ) & iMask;
+		m_rgSlots[iSlot] = h;
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Intern()
+|
+|	Purpose:	Returns the handle for lpszMsgID, copying the ID into
+|				the arena the first time it is seen. Returns MSGID_NONE
+|				if memory runs out or the table is full.
+|
++---------------------------------------------------------------------
+*/
+MSGIDHANDLE CMsgIDTable::Intern ( LPCSTR lpszMsgID )
+{
+	size_t cch = strlen ( lpszMsgID );
+	ULONG ulHash = MsgIDHash ( lpszMsgID, cch );
+	MSGIDHANDLE hMsgID = MSGID_NONE;
+	MSGIDRECORD *pRecord = NULL;
+	ULONG iPage = 0L;
+
+	EnterCriticalSection ( &m_csLock );
+
+	if ( MSGID_NONE != ( hMsgID = Lookup ( lpszMsgID, cch, ulHash ) ) )
+		goto Exit;
+
+	iPage = m_cIDs >> MSGID_PAGE_SHIFT;
+	if ( iPage >= MSGID_MAX_PAGES )
+		goto Exit;
+	if ( NULL == m_rgpPages[iPage] &&
+		 NULL == ( m_rgpPages[iPage] = (MSGIDRECORD **) malloc ( MSGID_PAGE_SIZE * sizeof ( MSGIDRECORD * ) ) ) )
+		goto Exit;
+	if ( NULL == ( pRecord = (MSGIDRECORD *) Allocate ( MSGID_ALIGN ( sizeof ( MSGIDRECORD ) + cch + 1 ) ) ) )
+		goto Exit;
+
+	pRecord -> ulHash = ulHash;
+	pRecord -> cch = (ULONG) cch;
+	memcpy ( pRecord + 1, lpszMsgID, cch + 1 );
+	m_cbText += MSGID_ALIGN ( sizeof ( MSGIDRECORD ) + cch + 1 );
+
+	m_rgpPages[iPage][m_cIDs & ( MSGID_PAGE_SIZE - 1 )] = pRecord;
+	hMsgID = ++m_cIDs;
+
+	// Keep the index at most half full.
+	if ( 2 * m_cIDs > m_rgSlots.size ( ) )
+	{
+		Rehash ( 2 * m_rgSlots.size ( ) );
+	}
+	else
+	{
+		size_t iMask = m_rgSlots.size ( ) - 1;
+		size_t iSlot = ulHash & iMask;
+
+		while ( m_rgSlots[iSlot] )
+			iSlot = ( iSlot + 1 ) & iMask;
+		m_rgSlots[iSlot] = hMsgID;
+	}
+
+Exit:
+	LeaveCriticalSection ( &m_csLock );
+
+	return hMsgID;
+}
+
+// Returns the handle of an ID already interned, or MSGID_NONE.
+MSGIDHANDLE CMsgIDTable::Find ( LPCSTR lpszMsgID )
+{
+	size_t cch = strlen ( lpszMsgID );
+	ULONG ulHash = MsgIDHash ( lpszMsgID, cch );
+	MSGIDHANDLE hMsgID = MSGID_NONE;
+
+	EnterCriticalSection ( &m_csLock );
+	hMsgID = Lookup ( lpszMsgID, cch, ulHash );
+	LeaveCriticalSection ( &m_csLock );
+
+	return hMsgID;
+}
+
+// Returns the text of a handle, or an empty string for MSGID_NONE.
+LPCSTR CMsgIDTable::Get ( MSGIDHANDLE hMsgID ) const
+{
+	return MSGID_NONE == hMsgID ? "" : (LPCSTR) ( Record ( hMsgID ) + 1 );
+}
+
+ULONG CMsgIDTable::Length ( MSGIDHANDLE hMsgID ) const
+{
+	return MSGID_NONE == hMsgID ? 0L : Record ( hMsgID ) -> cch;
+}
+
+void CMsgIDTable::GetStats ( LPMSGIDSTATS lpStats )
+{
+	EnterCriticalSection ( &m_csLock );
+
+	lpStats -> cIDs = m_cIDs;
+	lpStats -> cbText = m_cbText;
+	lpStats -> cbArena = m_cbArena;
+	lpStats -> cbDirectory = sizeof ( m_rgpPages ) +
+							 (ULONGLONG) ( ( m_cIDs + MSGID_PAGE_SIZE - 1 ) >> MSGID_PAGE_SHIFT ) *
+							 MSGID_PAGE_SIZE * sizeof ( MSGIDRECORD * );
+	lpStats -> cbIndex = m_rgSlots.size ( ) * sizeof ( MSGIDHANDLE );
+
+	LeaveCriticalSection ( &m_csLock );
+}
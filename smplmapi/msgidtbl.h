@@ -0,0 +1,80 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		MsgIDTbl.h
+|
+|   Purpose:	Declares CMsgIDTable, which interns message IDs. Each
+|				distinct ID is copied once into an arena of large
+|				blocks and from then on is referred to by a
+|				MSGIDHANDLE, so headers carry four bytes instead of a
+|				string and two IDs are equal exactly when their
+|				handles are. Handles are dense, starting at 1, and
+|				stay valid until the table is destroyed.
+|
+|				Intern and Find may be called from any thread. Get
+|				takes no lock: the text of a handle never moves once
+|				Intern has returned it.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _MSGIDTBL_H
+#define _MSGIDTBL_H
+
+#include "swap.h"
+
+#define MSGID_BLOCK_SIZE		( 64 * 1024 )	// Arena block; longer IDs get a block of their own
+#define MSGID_PAGE_SHIFT		12				// 4096 handles per directory page
+#define MSGID_PAGE_SIZE			( 1 << MSGID_PAGE_SHIFT )
+#define MSGID_MAX_PAGES			4096			// Up to 16M distinct IDs
+
+// Memory held by a CMsgIDTable.
+typedef struct _MSGIDSTATS
+{
+	ULONG		cIDs;			// Distinct IDs interned
+	ULONGLONG	cbText;			// Bytes of ID records in the arena
+	ULONGLONG	cbArena;		// Bytes of arena blocks allocated
+	ULONGLONG	cbDirectory;	// Bytes of handle directory pages
+	ULONGLONG	cbIndex;		// Bytes of the hash index
+} MSGIDSTATS, *LPMSGIDSTATS;
+
+class CMsgIDTable
+{
+private:
+	// Arena copy of one ID. The text follows, NUL-terminated.
+	typedef struct _MSGIDRECORD
+	{
+		ULONG	ulHash;
+		ULONG	cch;
+	} MSGIDRECORD;
+
+	CRITICAL_SECTION		m_csLock;		// Guards everything but the published records
+	std::vector<LPBYTE>		m_rgpBlocks;
+	LPBYTE					m_pbNext;		// Free space in the newest block
+	size_t					m_cbFree;
+	MSGIDRECORD				**m_rgpPages[MSGID_MAX_PAGES];	// Handle - 1 -> record
+	ULONG					m_cIDs;
+	std::vector<MSGIDHANDLE>	m_rgSlots;	// Open addressing; MSGID_NONE == empty
+	ULONGLONG				m_cbText;
+	ULONGLONG				m_cbArena;
+
+	MSGIDRECORD *Record ( MSGIDHANDLE hMsgID ) const
+		{ return m_rgpPages[( hMsgID - 1 ) >> MSGID_PAGE_SHIFT][( hMsgID - 1 ) & ( MSGID_PAGE_SIZE - 1 )]; }
+
+	MSGIDHANDLE	Lookup ( LPCSTR lpszMsgID, size_t cch, ULONG ulHash );
+	LPBYTE		Allocate ( size_t cb );
+	void		Rehash ( size_t cSlots );
+
+public:
+	CMsgIDTable ( );
+	~CMsgIDTable ( );
+
+	MSGIDHANDLE	Intern ( LPCSTR lpszMsgID );
+	MSGIDHANDLE	Find ( LPCSTR lpszMsgID );
+	LPCSTR		Get ( MSGIDHANDLE hMsgID ) const;
+	ULONG		Length ( MSGIDHANDLE hMsgID ) const;
+	ULONG		Count ( void ) const { return m_cIDs; }
+	void		GetStats ( LPMSGIDSTATS lpStats );
+};
+
+#endif
@@ -0,0 +1,911 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Outbox.cpp
+|
+|   Purpose:	Implementation of COutbox and the CApp methods that use
+|				it.
+|
++---------------------------------------------------------------------
+*/
+
+#include "outbox.h"
+#include "crc32.h"
+
+#define OUTBOX_HEADER_SIZE		8		// Magic and version
+
+static void OutboxPutULong ( std::string &sOut, ULONG ul )
+{
+	BYTE rgb[4] = { (BYTE) ul, (BYTE) ( ul >> 8 ), (BYTE) ( ul >> 16 ), (BYTE) ( ul >> 24 ) };
+
+	sOut.append ( (const char *) rgb, sizeof ( rgb ) );
+}
+
+static void OutboxPutString ( std::string &sOut, const std::string &s )
+{
+	OutboxPutULong ( sOut, (ULONG) s.size ( ) );
+	sOut.append ( s );
+}
+
+static ULONG OutboxGetULong ( const std::string &sBytes, size_t *pib, BOOL *pfFailed )
+{
+	const BYTE *pb = (const BYTE *) sBytes.data ( ) + *pib;
+
+	if ( *pfFailed || sBytes.size ( ) - *pib < 4 )
+	{
+		*pfFailed = TRUE;
+		return 0L;
+	}
+	*pib += 4;
+
+	return pb[0] | ( pb[1] << 8 ) | ( pb[2] << 16 ) | ( (ULONG) pb[3] << 24 );
+}
+
+static std::string OutboxGetString ( const std::string &sBytes, size_t *pib, BOOL *pfFailed )
+{
+	ULONG cb = OutboxGetULong ( sBytes, pib, pfFailed );
+
+	if ( *pfFailed || sBytes.size ( ) - *pib < cb )
+	{
+		*pfFailed = TRUE;
+		return std::string ( );
+	}
+	*pib += cb;
+
+	return sBytes.substr ( *pib - cb, cb );
+}
+
+// Data of a submit record.
+static void OutboxPutItem ( std::string &sOut, const OUTBOXITEM &Item )
+{
+	OutboxPutULong ( sOut, Item.flFlags );
+	OutboxPutString ( sOut, Item.sSubject );
+	OutboxPutString ( sOut, Item.sNoteText );
+	OutboxPutULong ( sOut, (ULONG) Item.rgRecips.size ( ) );
+	for ( size_t i = 0; i < Item.rgRecips.size ( ); i++ )
+	{
+		OutboxPutULong ( sOut, Item.rgRecips[i].ulRecipClass );
+		OutboxPutString ( sOut, Item.rgRecips[i].sName );
+		OutboxPutString ( sOut, Item.rgRecips[i].sAddress );
+		OutboxPutString ( sOut, Item.rgRecips[i].sEntryID );
+	}
+}
+
+static BOOL OutboxGetItem ( const std::string &sBytes, size_t ib, OUTBOXITEM *pItem )
+{
+	BOOL fFailed = FALSE;
+	ULONG cRecips = 0L;
+
+	pItem -> flFlags = OutboxGetULong ( sBytes, &ib, &fFailed );
+	pItem -> sSubject = OutboxGetString ( sBytes, &ib, &fFailed );
+	pItem -> sNoteText = OutboxGetString ( sBytes, &ib, &fFailed );
+	cRecips = OutboxGetULong ( sBytes, &ib, &fFailed );
+	pItem -> rgRecips.clear ( );
+	for ( ULONG i = 0; i < cRecips && !fFailed; i++ )
+	{
+		OUTBOXRECIP Recip;
+
+		Recip.ulRecipClass = OutboxGetULong ( sBytes, &ib, &fFailed );
+		Recip.sName = OutboxGetString ( sBytes, &ib, &fFailed );
+		Recip.sAddress = OutboxGetString ( sBytes, &ib, &fFailed );
+		Recip.sEntryID = OutboxGetString ( sBytes, &ib, &fFailed );
+		pItem -> rgRecips.push_back ( Recip );
+	}
+	pItem -> cAttempts = 0L;
+	pItem -> dwNextTry = GetTickCount ( );
+	pItem -> hResLast = SUCCESS_SUCCESS;
+
+	return !fFailed;
+}
+
+// TRUE for the MAPISendMail failures that may not recur, such as a lost
+// connection. Anything wrong with the message itself fails at once.
+static BOOL OutboxIsRetryable ( HRESULT hRes )
+{
+	switch ( hRes )
+	{
+	case MAPI_E_FAILURE:
+	case MAPI_E_LOGIN_FAILURE:
+	case MAPI_E_DISK_FULL:
+	case MAPI_E_INSUFFICIENT_MEMORY:
+	case MAPI_E_TOO_MANY_SESSIONS:
+	case MAPI_E_INVALID_SESSION:
+	case MAPI_E_MESSAGE_IN_USE:
+	case MAPI_E_NETWORK_FAILURE:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+COutbox::COutbox ( CApp *pApp )
+{
+	m_pApp = pApp;
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_cbFile = 0;
+	m_ulNextSeq = 1L;
+	InitializeCriticalSection ( &m_csLock );
+	InitializeConditionVariable ( &m_cvChanged );
+	m_fSending = FALSE;
+	m_fStop = FALSE;
+	ZeroMemory ( &m_Stats, sizeof ( OUTBOXSTATS ) );
+}
+
+COutbox::~COutbox ( )
+{
+	Close ( );
+	DeleteCriticalSection ( &m_csLock );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Open()
+|
+|	Parameters:	[IN] lpszFile == The journal, created if it does not
+|				exist.
+|
+|	Purpose:	Queues the messages the journal holds that were never
+|				sent or failed, rewrites the journal with only those and
+|				starts the sender. Returns once the sender has logged
+|				on, with its logon failure if it could not.
+|
++---------------------------------------------------------------------
+*/
+HRESULT COutbox::Open ( LPCSTR lpszFile )
+{
+	HRESULT hRes = S_OK;
+	std::vector<OUTBOXITEM> rgPending;
+
+	Close ( );
+
+	m_sFile = lpszFile;
+	m_hFile = CreateFile ( lpszFile, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+						   OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( INVALID_HANDLE_VALUE == m_hFile )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	if ( FAILED ( hRes = Load ( &rgPending ) ) ||
+		 FAILED ( hRes = Rewrite ( rgPending ) ) )
+	{
+		Close ( );
+		return hRes;
+	}
+
+	m_Queue.assign ( rgPending.begin ( ), rgPending.end ( ) );
+	m_Stats.cRecovered = (ULONG) rgPending.size ( );
+	m_fStop = FALSE;
+	m_Stats.hResLogon = MAPI_E_LOGIN_FAILURE;
+	m_fSending = TRUE;
+
+	if ( FAILED ( hRes = m_Sender.Start ( 1, SenderProc, this ) ) )
+	{
+		Close ( );
+		return hRes;
+	}
+
+	// The sender clears m_fSending once it has tried to log on.
+	EnterCriticalSection ( &m_csLock );
+	while ( m_fSending )
+		SleepConditionVariableCS ( &m_cvChanged, &m_csLock, INFINITE );
+	hRes = m_Stats.hResLogon;
+	LeaveCriticalSection ( &m_csLock );
+
+	if ( SUCCESS_SUCCESS != hRes )
+		Close ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Close()
+|
+|	Purpose:	Stops the sender once the send in progress, if any, has
+|				finished and closes the journal. Messages not yet sent
+|				stay in the journal for the next Open.
+|
++---------------------------------------------------------------------
+*/
+void COutbox::Close ( void )
+{
+	EnterCriticalSection ( &m_csLock );
+	m_fStop = TRUE;
+	LeaveCriticalSection ( &m_csLock );
+	WakeAllConditionVariable ( &m_cvChanged );
+
+	m_Sender.Join ( );
+
+	if ( INVALID_HANDLE_VALUE != m_hFile )
+	{
+		CloseHandle ( m_hFile );
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	m_Queue.clear ( );
+	m_cbFile = 0;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Load()
+|
+|	Purpose:	Reads the journal and returns the messages that have a
+|				submit record but no sent or failed record, in order.
+|				Reading stops at the first damaged or partly written
+|				record. An empty file is a new journal. Returns
+|				MAPI_E_CORRUPT_DATA for a file that is not a journal and
+|				MAPI_E_VERSION for a journal of another version, which
+|				Open then leaves as it is.
+|
++---------------------------------------------------------------------
+*/
+HRESULT COutbox::Load ( std::vector<OUTBOXITEM> *pPending )
+{
+	std::string sBytes;
+	char rgchBuffer[65536];
+	DWORD cbRead = 0;
+	size_t ib = 0;
+	BOOL fFailed = FALSE;
+
+	pPending -> clear ( );
+	m_ulNextSeq = 1L;
+
+	for ( ;; )
+	{
+		if ( !ReadFile ( m_hFile, rgchBuffer, sizeof ( rgchBuffer ), &cbRead, NULL ) )
+			return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+		if ( 0 == cbRead )
+			break;
+		sBytes.append ( rgchBuffer, cbRead );
+	}
+
+	if ( sBytes.empty ( ) )
+		return S_OK;
+	if ( OUTBOX_MAGIC != OutboxGetULong ( sBytes, &ib, &fFailed ) )
+		return MAPI_E_CORRUPT_DATA;
+	if ( OUTBOX_VERSION != OutboxGetULong ( sBytes, &ib, &fFailed ) )
+		return MAPI_E_VERSION;
+
+	while ( ib < sBytes.size ( ) )
+	{
+		ULONG cbBody = OutboxGetULong ( sBytes, &ib, &fFailed );
+		ULONG ulCrc = OutboxGetULong ( sBytes, &ib, &fFailed );
+		size_t ibBody = ib;
+		ULONG ulType = 0L;
+		ULONG ulSeq = 0L;
+
+		if ( fFailed || sBytes.size ( ) - ib < cbBody ||
+			 ulCrc != Crc32 ( 0, (const BYTE *) sBytes.data ( ) + ib, cbBody ) )
+			break;
+		ib += cbBody;
+
+		std::string sBody = sBytes.substr ( ibBody, cbBody );
+		size_t ibData = 0;
+
+		ulType = OutboxGetULong ( sBody, &ibData, &fFailed );
+		ulSeq = OutboxGetULong ( sBody, &ibData, &fFailed );
+		if ( fFailed )
+			break;
+		if ( ulSeq >= m_ulNextSeq )
+			m_ulNextSeq = ulSeq + 1;
+
+		if ( OUTBOX_RECORD_SUBMIT == ulType )
+		{
+			OUTBOXITEM Item;
+
+			if ( !OutboxGetItem ( sBody, ibData, &Item ) )
+				break;
+			Item.ulSeq = ulSeq;
+			pPending -> push_back ( Item );
+		}
+		else
+		{
+			// Sent or failed for good; either way it is no longer queued.
+			for ( size_t i = 0; i < pPending -> size ( ); i++ )
+			{
+				if ( ( *pPending )[i].ulSeq == ulSeq )
+				{
+					pPending -> erase ( pPending -> begin ( ) + i );
+					break;
+				}
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Rewrite()
+|
+|	Purpose:	Replaces the journal with one holding only the submit
+|				records of rgPending. The new journal is written to a
+|				temporary file and flushed before it is moved over the
+|				old one, so a crash leaves one or the other.
+|
++---------------------------------------------------------------------
+*/
+HRESULT COutbox::Rewrite ( const std::vector<OUTBOXITEM> &rgPending )
+{
+	HRESULT hRes = S_OK;
+	std::string sTempFile = m_sFile + ".tmp";
+	std::string sBytes;
+	HANDLE hTemp = INVALID_HANDLE_VALUE;
+	DWORD cbWritten = 0;
+	LARGE_INTEGER liEnd;
+
+	OutboxPutULong ( sBytes, OUTBOX_MAGIC );
+	OutboxPutULong ( sBytes, OUTBOX_VERSION );
+	for ( size_t i = 0; i < rgPending.size ( ); i++ )
+	{
+		std::string sBody;
+
+		OutboxPutULong ( sBody, OUTBOX_RECORD_SUBMIT );
+		OutboxPutULong ( sBody, rgPending[i].ulSeq );
+		OutboxPutItem ( sBody, rgPending[i] );
+		OutboxPutULong ( sBytes, (ULONG) sBody.size ( ) );
+		OutboxPutULong ( sBytes, Crc32 ( 0, (const BYTE *) sBody.data ( ), sBody.size ( ) ) );
+		sBytes.append ( sBody );
+	}
+
+	hTemp = CreateFile ( sTempFile.c_str ( ), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( INVALID_HANDLE_VALUE == hTemp )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+	if ( !WriteFile ( hTemp, sBytes.data ( ), (DWORD) sBytes.size ( ), &cbWritten, NULL ) ||
+		 cbWritten != sBytes.size ( ) ||
+		 !FlushFileBuffers ( hTemp ) )
+		hRes = HRESULT_FROM_WIN32 ( GetLastError ( ) );
+	CloseHandle ( hTemp );
+
+	// The journal must be closed before it can be replaced.
+	CloseHandle ( m_hFile );
+	m_hFile = INVALID_HANDLE_VALUE;
+
+	if ( SUCCEEDED ( hRes ) &&
+		 !MoveFileEx ( sTempFile.c_str ( ), m_sFile.c_str ( ), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+		hRes = HRESULT_FROM_WIN32 ( GetLastError ( ) );
+	if ( FAILED ( hRes ) )
+	{
+		DeleteFile ( sTempFile.c_str ( ) );
+		return hRes;
+	}
+
+	m_hFile = CreateFile ( m_sFile.c_str ( ), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+						   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( INVALID_HANDLE_VALUE == m_hFile )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	liEnd.QuadPart = (LONGLONG) sBytes.size ( );
+	if ( !SetFilePointerEx ( m_hFile, liEnd, NULL, FILE_BEGIN ) )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+	m_cbFile = sBytes.size ( );
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Append()
+|
+|	Purpose:	Appends a record to the journal and flushes it to disk.
+|				If the write fails the journal is cut back to where it
+|				was, so a partial record cannot hide later ones. Called
+|				with the lock held.
+|
++---------------------------------------------------------------------
+*/
+HRESULT COutbox::Append ( ULONG ulType, ULONG ulSeq, const std::string &sData )
+{
+	std::string sBody;
+	std::string sRecord;
+	DWORD cbWritten = 0;
+	LARGE_INTEGER liEnd;
+
+	if ( INVALID_HANDLE_VALUE == m_hFile )
+		return E_UNEXPECTED;
+
+	OutboxPutULong ( sBody, ulType );
+	OutboxPutULong ( sBody, ulSeq );
+	sBody.append ( sData );
+	OutboxPutULong ( sRecord, (ULONG) sBody.size ( ) );
+	OutboxPutULong ( sRecord, Crc32 ( 0, (const BYTE *) sBody.data ( ), sBody.size ( ) ) );
+	sRecord.append ( sBody );
+
+	if ( !WriteFile ( m_hFile, sRecord.data ( ), (DWORD) sRecord.size ( ), &cbWritten, NULL ) ||
+		 cbWritten != sRecord.size ( ) ||
+		 !FlushFileBuffers ( m_hFile ) )
+	{
+		HRESULT hRes = HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+		liEnd.QuadPart = (LONGLONG) m_cbFile;
+		SetFilePointerEx ( m_hFile, liEnd, NULL, FILE_BEGIN );
+		SetEndOfFile ( m_hFile );
+
+		return FAILED ( hRes ) ? hRes : E_FAIL;
+	}
+	m_cbFile += sRecord.size ( );
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Submit()
+|
+|	Parameters:	[IN] lpMessage == The message to send. Copied; the
+|				caller may free it on return.
+|
+|				[OUT] pulSeq == Receives the message number. May be NULL.
+|
+|	Purpose:	Journals the message and queues it for the sender.
+|				Returns once the journal is on disk.
+|
++---------------------------------------------------------------------
+*/
+HRESULT COutbox::Submit ( lpMapiMessage lpMessage, ULONG *pulSeq )
+{
+	HRESULT hRes = S_OK;
+	OUTBOXITEM Item;
+	std::string sData;
+
+	if ( lpMessage -> nFileCount )
+		return MAPI_E_NOT_SUPPORTED;
+	if ( 0 == lpMessage -> nRecipCount || NULL == lpMessage -> lpRecips )
+		return MAPI_E_INVALID_RECIPS;
+
+	Item.flFlags = lpMessage -> flFlags;
+	if ( lpMessage -> lpszSubject )
+		Item.sSubject = lpMessage -> lpszSubject;
+	if ( lpMessage -> lpszNoteText )
+		Item.sNoteText = lpMessage -> lpszNoteText;
+	for ( ULONG i = 0; i < lpMessage -> nRecipCount; i++ )
+	{
+		const MapiRecipDesc &Desc = lpMessage -> lpRecips[i];
+		OUTBOXRECIP Recip;
+
+		Recip.ulRecipClass = Desc.ulRecipClass;
+		if ( Desc.lpszName )
+			Recip.sName = Desc.lpszName;
+		if ( Desc.lpszAddress )
+			Recip.sAddress = Desc.lpszAddress;
+		if ( Desc.lpEntryID && Desc.ulEIDSize )
+			Recip.sEntryID.assign ( (const char *) Desc.lpEntryID, Desc.ulEIDSize );
+		Item.rgRecips.push_back ( Recip );
+	}
+	Item.cAttempts = 0L;
+	Item.dwNextTry = GetTickCount ( );
+	Item.hResLast = SUCCESS_SUCCESS;
+	OutboxPutItem ( sData, Item );
+
+	EnterCriticalSection ( &m_csLock );
+	Item.ulSeq = m_ulNextSeq;
+	if ( SUCCEEDED ( hRes = Append ( OUTBOX_RECORD_SUBMIT, Item.ulSeq, sData ) ) )
+	{
+		m_ulNextSeq++;
+		m_Queue.push_back ( Item );
+	}
+	LeaveCriticalSection ( &m_csLock );
+	WakeAllConditionVariable ( &m_cvChanged );
+
+	if ( FAILED ( hRes ) )
+		return hRes;
+	if ( pulSeq )
+		*pulSeq = Item.ulSeq;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	WaitIdle()
+|
+|	Purpose:	Waits up to dwTimeout ms for every queued message to be
+|				sent or to fail for good. Returns TRUE if none is left.
+|
++---------------------------------------------------------------------
+*/
+BOOL COutbox::WaitIdle ( DWORD dwTimeout )
+{
+	DWORD dwStart = GetTickCount ( );
+	BOOL fIdle = FALSE;
+
+	EnterCriticalSection ( &m_csLock );
+	while ( !m_Queue.empty ( ) && !m_fStop )
+	{
+		DWORD dwWaited = GetTickCount ( ) - dwStart;
+
+		if ( INFINITE != dwTimeout && dwWaited >= dwTimeout )
+			break;
+		SleepConditionVariableCS ( &m_cvChanged, &m_csLock, INFINITE == dwTimeout ? INFINITE : dwTimeout - dwWaited );
+	}
+	fIdle = m_Queue.empty ( );
+	LeaveCriticalSection ( &m_csLock );
+
+	return fIdle;
+}
+
+void COutbox::GetStats ( LPOUTBOXSTATS lpStats )
+{
+	EnterCriticalSection ( &m_csLock );
+	*lpStats = m_Stats;
+	lpStats -> cQueued = (ULONG) m_Queue.size ( );
+	LeaveCriticalSection ( &m_csLock );
+}
+
+DWORD COutbox::SenderProc ( ULONG iWorker, LPVOID lpvContext )
+{
+	( (COutbox *) lpvContext ) -> Send ( );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Send()
+|
+|	Purpose:	The sender. Logs on, then sends the first message whose
+|				retry time has come, until Close is called. The outcome
+|				is journaled; a retryable failure only delays the
+|				message. If the session is lost a new one is opened from
+|				it, so the owner is not touched after the first logon.
+|				While no new one can be opened, nothing is sent and the
+|				logon is tried again when a message is due, after a wait
+|				that doubles up to OUTBOX_LOGON_MAX_MS.
+|
++---------------------------------------------------------------------
+*/
+void COutbox::Send ( void )
+{
+	CApp *pSession = new CApp;
+	HRESULT hRes = m_pApp -> cCloneSession ( pSession );
+	BOOL fLoggedOn = SUCCESS_SUCCESS == hRes;
+	DWORD dwNextLogon = 0;
+	ULONG ulLogonWait = OUTBOX_RETRY_MS;
+
+	EnterCriticalSection ( &m_csLock );
+	m_Stats.hResLogon = hRes;
+	m_fSending = FALSE;
+	LeaveCriticalSection ( &m_csLock );
+	WakeAllConditionVariable ( &m_cvChanged );
+
+	if ( SUCCESS_SUCCESS != hRes )
+	{
+		delete pSession;
+		return;
+	}
+
+	for ( ;; )
+	{
+		OUTBOXITEM Item;
+		size_t iItem = 0;
+		std::vector<MapiRecipDesc> rgDescs;
+		MapiMessage Message;
+		std::string sData;
+
+		EnterCriticalSection ( &m_csLock );
+		for ( ;; )
+		{
+			DWORD dwNow = GetTickCount ( );
+			DWORD dwWait = INFINITE;
+
+			if ( m_fStop )
+				break;
+			for ( iItem = 0; iItem < m_Queue.size ( ); iItem++ )
+			{
+				LONG lDue = (LONG) ( m_Queue[iItem].dwNextTry - dwNow );
+
+				if ( lDue <= 0 )
+					break;
+				if ( (DWORD) lDue < dwWait )
+					dwWait = (DWORD) lDue;
+			}
+			if ( iItem < m_Queue.size ( ) )
+			{
+				LONG lLogonDue = (LONG) ( dwNextLogon - dwNow );
+
+				// Without a session nothing is sent until the next logon.
+				if ( fLoggedOn || lLogonDue <= 0 )
+					break;
+				dwWait = (DWORD) lLogonDue;
+			}
+			SleepConditionVariableCS ( &m_cvChanged, &m_csLock, dwWait );
+		}
+		if ( m_fStop )
+		{
+			LeaveCriticalSection ( &m_csLock );
+			break;
+		}
+		Item = m_Queue[iItem];
+		m_fSending = TRUE;
+		LeaveCriticalSection ( &m_csLock );
+
+		ZeroMemory ( &Message, sizeof ( MapiMessage ) );
+		rgDescs.resize ( Item.rgRecips.size ( ) );
+		for ( size_t i = 0; i < Item.rgRecips.size ( ); i++ )
+		{
+			OUTBOXRECIP &Recip = Item.rgRecips[i];
+
+			ZeroMemory ( &rgDescs[i], sizeof ( MapiRecipDesc ) );
+			rgDescs[i].ulRecipClass = Recip.ulRecipClass;
+			rgDescs[i].lpszName = Recip.sName.empty ( ) ? NULL : (LPSTR) Recip.sName.c_str ( );
+			rgDescs[i].lpszAddress = Recip.sAddress.empty ( ) ? NULL : (LPSTR) Recip.sAddress.c_str ( );
+			rgDescs[i].ulEIDSize = (ULONG) Recip.sEntryID.size ( );
+			rgDescs[i].lpEntryID = Recip.sEntryID.empty ( ) ? NULL : (LPVOID) Recip.sEntryID.data ( );
+		}
+		Message.flFlags = Item.flFlags;
+		Message.lpszSubject = (LPSTR) Item.sSubject.c_str ( );
+		Message.lpszNoteText = (LPSTR) Item.sNoteText.c_str ( );
+		Message.nRecipCount = (ULONG) rgDescs.size ( );
+		Message.lpRecips = rgDescs.empty ( ) ? NULL : &rgDescs[0];
+
+		hRes = MAPI_E_INVALID_SESSION;
+		if ( fLoggedOn )
+			hRes = pSession -> cSendMail ( &Message, 0L );
+		if ( MAPI_E_INVALID_SESSION == hRes )
+		{
+			CApp *pNew = new CApp;
+			HRESULT hResLogon = SUCCESS_SUCCESS;
+
+			// Log on again with the lost session's profile. The lost
+			// session is kept until then; it is what the profile is
+			// cloned from.
+			if ( SUCCESS_SUCCESS == ( hResLogon = pSession -> cCloneSession ( pNew ) ) )
+			{
+				delete pSession;
+				pSession = pNew;
+				hRes = pSession -> cSendMail ( &Message, 0L );
+			}
+			else
+				delete pNew;
+
+			EnterCriticalSection ( &m_csLock );
+			m_Stats.hResLogon = hResLogon;
+			LeaveCriticalSection ( &m_csLock );
+		}
+		fLoggedOn = MAPI_E_INVALID_SESSION != hRes;
+
+		// Only this thread removes items, so iItem still points at it.
+		EnterCriticalSection ( &m_csLock );
+		m_fSending = FALSE;
+		OUTBOXITEM &Queued = m_Queue[iItem];
+
+		Queued.hResLast = hRes;
+		if ( fLoggedOn )
+		{
+			Queued.cAttempts++;
+			ulLogonWait = OUTBOX_RETRY_MS;
+		}
+
+		if ( !fLoggedOn )
+		{
+			// The message was not tried, so it keeps its attempts.
+			dwNextLogon = GetTickCount ( ) + ulLogonWait;
+			ulLogonWait = min ( ulLogonWait * 2, (ULONG) OUTBOX_LOGON_MAX_MS );
+		}
+		else if ( SUCCESS_SUCCESS == hRes )
+		{
+			Append ( OUTBOX_RECORD_SENT, Queued.ulSeq, sData );
+			m_Queue.erase ( m_Queue.begin ( ) + iItem );
+			m_Stats.cSent++;
+		}
+		else if ( !OutboxIsRetryable ( hRes ) || Queued.cAttempts >= OUTBOX_MAX_ATTEMPTS )
+		{
+			OutboxPutULong ( sData, (ULONG) hRes );
+			Append ( OUTBOX_RECORD_FAILED, Queued.ulSeq, sData );
+			m_Queue.erase ( m_Queue.begin ( ) + iItem );
+			m_Stats.cFailed++;
+			m_Stats.hResLastFailure = hRes;
+		}
+		else
+		{
+			Queued.dwNextTry = GetTickCount ( ) + ( OUTBOX_RETRY_MS << ( Queued.cAttempts - 1 ) );
+			m_Stats.cRetries++;
+		}
+
+		// Once nothing is queued the journal holds nothing worth keeping.
+		if ( m_Queue.empty ( ) && m_cbFile >= OUTBOX_COMPACT_SIZE )
+		{
+			LARGE_INTEGER liEnd;
+
+			liEnd.QuadPart = OUTBOX_HEADER_SIZE;
+			if ( SetFilePointerEx ( m_hFile, liEnd, NULL, FILE_BEGIN ) &&
+				 SetEndOfFile ( m_hFile ) &&
+				 FlushFileBuffers ( m_hFile ) )
+				m_cbFile = OUTBOX_HEADER_SIZE;
+		}
+		LeaveCriticalSection ( &m_csLock );
+		WakeAllConditionVariable ( &m_cvChanged );
+	}
+
+	delete pSession;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cOpenOutbox ( )
+|
+|	Parameters:	[IN] lpszFile == The outbox journal (Outbox.h).
+|
+|	Purpose:	Opens the outbox and starts sending what it holds in the
+|				background, on a session of its own. cQueueMessage and
+|				cSubmitMail queue messages in it; cSendMessage always
+|				sends at once and reports the MAPISendMail result.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cOpenOutbox ( LPCSTR lpszFile )
+{
+	HRESULT hRes = S_OK;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	delete m_pOutbox;
+	m_pOutbox = new COutbox ( this );
+
+	if ( SUCCESS_SUCCESS != ( hRes = m_pOutbox -> Open ( lpszFile ) ) )
+	{
+		delete m_pOutbox;
+		m_pOutbox = NULL;
+	}
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSubmitMail ( )
+|
+|	Parameters:	[IN] lpMessage == The message to send.
+|
+|				[OUT] pulSeq == Receives its number in the outbox. May be
+|				NULL.
+|
+|	Purpose:	Queues the message in the outbox, opening szOUTBOXFILE if
+|				no outbox is open, and returns once it is journaled. The
+|				outcome is known only later, from cGetOutboxStats.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSubmitMail ( lpMapiMessage lpMessage, ULONG *pulSeq )
+{
+	HRESULT hRes = S_OK;
+
+	if ( NULL == m_pOutbox && SUCCESS_SUCCESS != ( hRes = cOpenOutbox ( szOUTBOXFILE ) ) )
+		return hRes;
+
+	return m_pOutbox -> Submit ( lpMessage, pulSeq );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cGetOutboxStats ( )
+|
+|	Parameters:	[OUT] lpStats == Receives the outbox counts.
+|
+|	Purpose:	Reports what the outbox has sent, what failed and what it
+|				still holds. Fails if no outbox is open.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cGetOutboxStats ( LPOUTBOXSTATS lpStats )
+{
+	ZeroMemory ( lpStats, sizeof ( OUTBOXSTATS ) );
+
+	if ( NULL == m_pOutbox )
+		return MAPI_E_FAILURE;
+
+	m_pOutbox -> GetStats ( lpStats );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cWaitOutbox ( )
+|
+|	Parameters:	[IN] dwTimeout == Milliseconds to wait, or INFINITE.
+|
+|	Purpose:	Waits for the outbox to send or give up on every message
+|				it holds. Returns MAPI_E_FAILURE if some are left.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cWaitOutbox ( DWORD dwTimeout )
+{
+	if ( NULL == m_pOutbox )
+		return SUCCESS_SUCCESS;
+
+	return m_pOutbox -> WaitIdle ( dwTimeout ) ? SUCCESS_SUCCESS : MAPI_E_FAILURE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cShowOutbox ( )
+|
+|	Purpose:	Prints the outbox counts, opening szOUTBOXFILE if no
+|				outbox is open.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cShowOutbox ( )
+{
+	HRESULT hRes = S_OK;
+	OUTBOXSTATS Stats;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	if ( NULL == m_pOutbox && SUCCESS_SUCCESS != ( hRes = cOpenOutbox ( szOUTBOXFILE ) ) )
+	{
+		printf ( "The outbox could not be opened due to error code %d.\r\n", hRes );
+		return hRes;
+	}
+
+	cGetOutboxStats ( &Stats );
+	printf ( "%lu waiting, %lu sent, %lu failed, %lu retries; %lu recovered from the journal.\r\n",
+			 Stats.cQueued, Stats.cSent, Stats.cFailed, Stats.cRetries, Stats.cRecovered );
+	if ( Stats.cFailed )
+		printf ( "The last failure was error code %d.\r\n", Stats.hResLastFailure );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cQueueMessage ( )
+|
+|	Purpose:	Asks for 1 recipient, as cSendMessage does without a
+|				dialog, and queues the same hard coded message in the
+|				outbox instead of sending it. Returns once the message is
+|				journaled; whether it was delivered is shown later by
+|				cShowOutbox.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cQueueMessage ( )
+{
+	HRESULT hRes = S_OK;
+	LPSTR lpszName = NULL;
+	lpMapiRecipDesc pRecips = NULL;
+	MapiMessage Message;
+	ULONG ulSeq = 0L;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	cCaptureText ( "\r\nEnter an e-mail address: ", &lpszName );
+	hRes = cResolveName ( lpszName, &pRecips );
+	m_MAPIFreeBuffer ( lpszName );
+	if ( SUCCESS_SUCCESS != hRes )
+		return hRes;
+
+	ZeroMemory ( &Message, sizeof ( MapiMessage ) );
+	Message.lpszSubject		= ( LPTSTR ) "Any subject";
+	Message.lpszNoteText	= ( LPTSTR ) "Any note text";
+	Message.nRecipCount		= 1L;
+	Message.lpRecips		= pRecips;
+
+	if ( SUCCESS_SUCCESS == ( hRes = cSubmitMail ( &Message, &ulSeq ) ) )
+		printf ( "Message %lu queued for sending. Its outcome is shown with the outbox.\r\n", ulSeq );
+	else
+		printf ( "Message was not queued due to error code %d.\r\n", hRes );
+
+	m_MAPIFreeBuffer ( pRecips );
+
+	return hRes;
+}
@@ -0,0 +1,117 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Outbox.h
+|
+|   Purpose:	Declares COutbox, which sends messages in the
+|				background. Submit appends the message to a journal
+|				file and flushes it to disk before it returns, so the
+|				caller waits for a local write instead of MAPISendMail.
+|				A worker with a session of its own sends the journaled
+|				messages in order and appends a record when each is
+|				sent or has failed for good. A send that fails for a
+|				reason that may pass, such as a lost connection, is
+|				retried after a delay that doubles with each attempt.
+|
+|				Journal layout, all integers little-endian ULONGs:
+|
+|					"SMOB" version
+|					records:	body size, CRC-32 of the body,
+|								body = type, message number, data
+|
+|				A submit record holds the message; a sent record holds
+|				nothing and a failed record the error. When the journal
+|				is opened, messages submitted without a sent or failed
+|				record are queued again, so a message whose send was
+|				cut short by a crash is sent again rather than lost. A
+|				damaged record ends the journal at that point, and the
+|				journal is rewritten with only the messages still to
+|				send. A file that is not a journal, or is a journal of
+|				another version, is left as it is and not opened.
+|
+|				If the sender loses its session it logs on again before
+|				the next due message, waiting longer after each logon
+|				that fails. Messages wait meanwhile without using up
+|				their attempts.
+|
+|				Only the subject, text, flags and recipients of a
+|				message are journaled. Messages with attachments are
+|				refused with MAPI_E_NOT_SUPPORTED.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _OUTBOX_H
+#define _OUTBOX_H
+
+#include "swap.h"
+#include "workpool.h"
+#include <deque>
+
+#define OUTBOX_MAGIC			0x424F4D53		// "SMOB"
+#define OUTBOX_VERSION			1
+#define OUTBOX_RECORD_SUBMIT	1
+#define OUTBOX_RECORD_SENT		2
+#define OUTBOX_RECORD_FAILED	3
+#define OUTBOX_MAX_ATTEMPTS		6				// Sends tried before a message fails for good
+#define OUTBOX_RETRY_MS			1000			// Delay before the first retry; doubles after each
+#define OUTBOX_LOGON_MAX_MS		( 60 * 1000 )	// Longest wait between logons without a session
+#define OUTBOX_COMPACT_SIZE		( 1024 * 1024 )	// Journal bytes at which an empty queue rewrites it
+
+typedef struct _OUTBOXRECIP
+{
+	ULONG		ulRecipClass;
+	std::string	sName;
+	std::string	sAddress;
+	std::string	sEntryID;						// Bytes of lpEntryID; empty if there was none
+} OUTBOXRECIP;
+
+// A journaled message waiting to be sent.
+typedef struct _OUTBOXITEM
+{
+	ULONG						ulSeq;			// Message number in the journal
+	FLAGS						flFlags;		// MapiMessage flags, such as MAPI_RECEIPT_REQUESTED
+	std::string					sSubject;
+	std::string					sNoteText;
+	std::vector<OUTBOXRECIP>	rgRecips;
+	ULONG						cAttempts;
+	DWORD						dwNextTry;		// GetTickCount before which it is not retried
+	HRESULT						hResLast;		// Outcome of the last attempt
+} OUTBOXITEM;
+
+class COutbox
+{
+private:
+	CApp					*m_pApp;
+	std::string				m_sFile;
+	HANDLE					m_hFile;
+	ULONGLONG				m_cbFile;			// Bytes of valid journal
+	ULONG					m_ulNextSeq;
+	CWorkerThreads			m_Sender;
+
+	CRITICAL_SECTION		m_csLock;			// Guards everything below and the journal
+	CONDITION_VARIABLE		m_cvChanged;
+	std::deque<OUTBOXITEM>	m_Queue;			// In message number order
+	BOOL					m_fSending;			// The sender is logging on or sending
+	BOOL					m_fStop;
+	OUTBOXSTATS				m_Stats;
+
+	HRESULT	Load ( std::vector<OUTBOXITEM> *pPending );
+	HRESULT	Rewrite ( const std::vector<OUTBOXITEM> &rgPending );
+	HRESULT	Append ( ULONG ulType, ULONG ulSeq, const std::string &sData );
+	void	Send ( void );
+
+	static DWORD SenderProc ( ULONG iWorker, LPVOID lpvContext );
+
+public:
+	COutbox ( CApp *pApp );
+	~COutbox ( );
+
+	HRESULT	Open ( LPCSTR lpszFile );
+	void	Close ( void );
+	HRESULT	Submit ( lpMapiMessage lpMessage, ULONG *pulSeq );
+	BOOL	WaitIdle ( DWORD dwTimeout );
+	void	GetStats ( LPOUTBOXSTATS lpStats );
+};
+
+#endif
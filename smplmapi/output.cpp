@@ -0,0 +1,297 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Output.cpp
+|
+|   Purpose:	Implementation of COutput.
+|
++---------------------------------------------------------------------
+*/
+
+#include "output.h"
+#include <stdarg.h>
+
+COutput g_StdOut ( GetStdHandle ( STD_OUTPUT_HANDLE ) );
+
+COutput::COutput ( HANDLE hOut )
+{
+	m_hOut = hOut;
+	m_fOpen = FALSE;
+	m_fBackground = FALSE;
+	m_fConsole = FALSE;
+	m_Current.pch = NULL;
+	m_Current.cch = 0;
+	m_fStarted = FALSE;
+	m_pFull = NULL;
+	m_pFree = NULL;
+	m_hResWrite = S_OK;
+}
+
+COutput::~COutput ( )
+{
+	Close ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Open()
+|
+|	Purpose:	Allocates the buffers on first use. A console shows
+|				text as it is written, so it is written on the calling
+|				thread at the end of each line; pipes and files get the
+|				background writer.
+|
++---------------------------------------------------------------------
+*/
+HRESULT COutput::Open ( void )
+{
+	ULONG cBuffers = 1;
+
+	if ( m_fOpen )
+		return S_OK;
+
+	m_fConsole = FILE_TYPE_CHAR == GetFileType ( m_hOut );
+	m_fBackground = !m_fConsole;
+	if ( m_fBackground )
+	{
+		m_pFull = new CBoundedQueue<OUTPUTBLOCK> ( OUTPUT_BUFFERS );
+		m_pFree = new CBoundedQueue<OUTPUTBLOCK> ( OUTPUT_BUFFERS );
+		cBuffers = OUTPUT_BUFFERS;
+	}
+
+	for ( ULONG i = 0; i < cBuffers; i++ )
+	{
+		OUTPUTBLOCK Block = { (LPSTR) malloc ( OUTPUT_BUFFER_SIZE ), 0 };
+
+		if ( NULL == Block.pch )
+		{
+			Close ( );
+			return E_OUTOFMEMORY;
+		}
+		m_rgpBuffers.push_back ( Block.pch );
+
+		if ( 0 == i )
+			m_Current = Block;
+		else
+			m_pFree -> Push ( Block );
+	}
+
+	if ( m_fBackground && FAILED ( m_Writer.Start ( 1, WriterProc, this ) ) )
+	{
+		// Fall back to writing on the calling thread with the first buffer.
+		delete m_pFull;
+		delete m_pFree;
+		m_pFull = NULL;
+		m_pFree = NULL;
+		m_fBackground = FALSE;
+	}
+
+	m_fOpen = TRUE;
+
+	return S_OK;
+}
+
+void COutput::Close ( void )
+{
+	Flush ( );
+
+	if ( m_fBackground )
+	{
+		m_pFull -> Close ( );
+		m_Writer.Join ( );
+		delete m_pFull;
+		delete m_pFree;
+		m_pFull = NULL;
+		m_pFree = NULL;
+		m_fBackground = FALSE;
+	}
+
+	for ( size_t i = 0; i < m_rgpBuffers.size ( ); i++ )
+		free ( m_rgpBuffers[i] );
+	m_rgpBuffers.clear ( );
+	m_Current.pch = NULL;
+	m_Current.cch = 0;
+	m_fOpen = FALSE;
+}
+
+HRESULT COutput::WriteBlock ( const OUTPUTBLOCK &Block )
+{
+	DWORD ib = 0;
+
+	while ( ib < Block.cch )
+	{
+		DWORD cbWritten = 0;
+
+		if ( !WriteFile ( m_hOut, Block.pch + ib, Block.cch - ib, &cbWritten, NULL ) || 0 == cbWritten )
+			return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+		ib += cbWritten;
+	}
+
+	return S_OK;
+}
+
+DWORD COutput::WriterProc ( ULONG iWorker, LPVOID lpvContext )
+{
+	COutput *pThis = (COutput *) lpvContext;
+	OUTPUTBLOCK Block;
+
+	while ( pThis -> m_pFull -> Pop ( &Block ) )
+	{
+		HRESULT hRes = S_OK;
+
+		// After a failure the rest is discarded; Flush reports it.
+		if ( SUCCEEDED ( pThis -> m_hResWrite ) && FAILED ( hRes = pThis -> WriteBlock ( Block ) ) )
+			pThis -> m_hResWrite = hRes;
+
+		Block.cch = 0;
+		pThis -> m_pFree -> Push ( Block );
+	}
+
+	return 0;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Submit()
+|
+|	Purpose:	Writes out the current buffer, or in background mode
+|				queues it for the writer thread and continues in a free
+|				buffer, waiting only if every buffer is in the queue.
+|
++---------------------------------------------------------------------
+*/
+void COutput::Submit ( void )
+{
+	if ( 0 == m_Current.cch )
+		return;
+
+	if ( m_fBackground )
+	{
+		m_pFull -> Push ( m_Current );
+		m_pFree -> Pop ( &m_Current );
+	}
+	else
+	{
+		HRESULT hRes = S_OK;
+
+		if ( SUCCEEDED ( m_hResWrite ) && FAILED ( hRes = WriteBlock ( m_Current ) ) )
+			m_hResWrite = hRes;
+		m_Current.cch = 0;
+	}
+}
+
+// On a console, writes out the buffer once it ends with a whole line.
+void COutput::EndLine ( void )
+{
+	if ( m_fConsole && m_Current.cch && '\n' == m_Current.pch[m_Current.cch - 1] )
+		Submit ( );
+}
+
+void COutput::Write ( LPCSTR pch, size_t cch )
+{
+	if ( FAILED ( Open ( ) ) )
+		return;
+
+	// Anything printf still holds goes out first.
+	if ( !m_fStarted )
+	{
+		fflush ( stdout );
+		m_fStarted = TRUE;
+	}
+
+	while ( cch )
+	{
+		size_t cchCopy = min ( cch, (size_t) ( OUTPUT_BUFFER_SIZE - m_Current.cch ) );
+
+		memcpy ( m_Current.pch + m_Current.cch, pch, cchCopy );
+		m_Current.cch += (DWORD) cchCopy;
+		pch += cchCopy;
+		cch -= cchCopy;
+
+		if ( OUTPUT_BUFFER_SIZE == m_Current.cch )
+			Submit ( );
+	}
+
+	EndLine ( );
+}
+
+// Writes a string followed by a line break.
+void COutput::Puts ( LPCSTR lpsz )
+{
+	Write ( lpsz, strlen ( lpsz ) );
+	Write ( "\r\n", 2 );
+}
+
+void COutput::Printf ( LPCSTR lpszFormat, ... )
+{
+	va_list vaArgs;
+	int cch = 0;
+
+	if ( FAILED ( Open ( ) ) )
+		return;
+
+	// Format straight into the buffer when the text fits.
+	va_start ( vaArgs, lpszFormat );
+	cch = vsnprintf ( m_Current.pch + m_Current.cch, OUTPUT_BUFFER_SIZE - m_Current.cch, lpszFormat, vaArgs );
+	va_end ( vaArgs );
+
+	if ( cch < 0 )
+		return;
+
+	if ( (size_t) cch < OUTPUT_BUFFER_SIZE - m_Current.cch )
+	{
+		if ( !m_fStarted )
+		{
+			fflush ( stdout );
+			m_fStarted = TRUE;
+		}
+		m_Current.cch += cch;
+		EndLine ( );
+		return;
+	}
+
+	// Too long for the space left: format into a buffer of its own.
+	std::vector<char> rgch ( cch + 1 );
+
+	va_start ( vaArgs, lpszFormat );
+	vsnprintf ( &rgch[0], rgch.size ( ), lpszFormat, vaArgs );
+	va_end ( vaArgs );
+
+	Write ( &rgch[0], cch );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Flush()
+|
+|	Purpose:	Writes out everything buffered so far and waits until
+|				it has been written. Returns the first write failure
+|				since the writer was opened.
+|
++---------------------------------------------------------------------
+*/
+HRESULT COutput::Flush ( void )
+{
+	if ( !m_fOpen )
+		return S_OK;
+
+	Submit ( );
+
+	if ( m_fBackground )
+	{
+		std::vector<OUTPUTBLOCK> rgBlocks ( OUTPUT_BUFFERS - 1 );
+
+		// Every other buffer comes back once the writer is done with it.
+		for ( size_t i = 0; i < rgBlocks.size ( ); i++ )
+			m_pFree -> Pop ( &rgBlocks[i] );
+		for ( size_t i = 0; i < rgBlocks.size ( ); i++ )
+			m_pFree -> Push ( rgBlocks[i] );
+	}
+
+	m_fStarted = FALSE;
+
+	return m_hResWrite;
+}
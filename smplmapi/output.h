@@ -0,0 +1,75 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Output.h
+|
+|   Purpose:	Declares COutput, the buffered writer the Inbox
+|				listings print through. Text collects in a large
+|				buffer that is written with one WriteFile call when it
+|				fills or is flushed, instead of one stdio call per
+|				line. When output goes to a pipe or a file, full
+|				buffers are handed to a background writer thread so
+|				listing continues while the previous buffer is being
+|				written. A console is written whenever a line is
+|				complete, so it shows a listing as it progresses.
+|
+|				g_StdOut writes to the standard output handle. Text
+|				written with printf and text written through g_StdOut
+|				stay in order as long as g_StdOut is flushed before
+|				printf is used again.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include "swap.h"
+#include "workpool.h"
+
+#define OUTPUT_BUFFER_SIZE		( 64 * 1024 )
+#define OUTPUT_BUFFERS			4		// Buffers cycled through in background mode
+
+class COutput
+{
+private:
+	// A buffer and the number of bytes in it.
+	typedef struct _OUTPUTBLOCK
+	{
+		LPSTR	pch;
+		DWORD	cch;
+	} OUTPUTBLOCK;
+
+	HANDLE						m_hOut;
+	BOOL						m_fOpen;
+	BOOL						m_fBackground;
+	BOOL						m_fConsole;		// Written a line at a time
+	std::vector<LPSTR>			m_rgpBuffers;	// Every buffer, for Close
+	OUTPUTBLOCK					m_Current;		// Buffer being filled
+	BOOL						m_fStarted;		// Text written since the last Flush
+	CBoundedQueue<OUTPUTBLOCK>	*m_pFull;		// Waiting for the writer thread
+	CBoundedQueue<OUTPUTBLOCK>	*m_pFree;		// Returned by the writer thread
+	CWorkerThreads				m_Writer;
+	volatile HRESULT			m_hResWrite;	// First write failure
+
+	HRESULT	Open ( void );
+	void	Submit ( void );
+	void	EndLine ( void );
+	HRESULT	WriteBlock ( const OUTPUTBLOCK &Block );
+
+	static DWORD WriterProc ( ULONG iWorker, LPVOID lpvContext );
+
+public:
+	COutput ( HANDLE hOut );
+	~COutput ( );
+
+	void	Write ( LPCSTR pch, size_t cch );
+	void	Puts ( LPCSTR lpsz );
+	void	Printf ( LPCSTR lpszFormat, ... );
+	HRESULT	Flush ( void );
+	void	Close ( void );
+};
+
+extern COutput g_StdOut;
+
+#endif
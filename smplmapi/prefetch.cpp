@@ -0,0 +1,352 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		Prefetch.cpp
+|
+|   Purpose:	Pipelined Inbox listing. The calling thread walks the
+|				Inbox with MAPIFindNext and hands each message ID to a
+|				pool of workers. Every worker reads envelopes on a
+|				session of its own, so many MAPIReadMail calls are in
+|				flight at once. The sessions are kept in the session
+|				pool (WorkPool.h) and reused by the next listing. A reorder buffer hands the headers to the
+|				caller's callback in the order MAPIFindNext returned them.
+|
++---------------------------------------------------------------------
+*/
+
+#include "swap.h"
+#include "workpool.h"
+#include "msgidtbl.h"
+#include <map>
+#include <algorithm>
+
+// Work item: a message ID and its position in the Inbox walk.
+typedef struct _PREFETCHITEM
+{
+	ULONG		ulSeq;
+	MSGIDHANDLE	hMsgID;
+} PREFETCHITEM;
+
+// Completed read waiting in the reorder buffer.
+typedef struct _PREFETCHRESULT
+{
+	HRESULT		hRes;
+	MSGHEADER	Header;
+} PREFETCHRESULT;
+
+// State shared between the calling thread and the workers.
+class CPrefetchContext
+{
+public:
+	CApp							*pApp;
+	CSessionPool					*pSessions;
+	CBoundedQueue<PREFETCHITEM>		Work;
+	LPHEADERCALLBACK				lpfnCallback;
+	LPVOID							lpvCallbackContext;
+	volatile BOOL					fStopped;			// Callback asked to stop
+
+	CRITICAL_SECTION				csLock;
+	CONDITION_VARIABLE				cvChanged;
+	ULONG							cLogonsPending;		// Workers still logging on
+	ULONG							cSessions;			// Workers that logged on
+	std::map<ULONG, PREFETCHRESULT>	Done;				// Reorder buffer keyed by ulSeq
+
+	CPrefetchContext ( CApp *pOwner, CSessionPool *pPool, ULONG cWorkers, LPHEADERCALLBACK lpfn, LPVOID lpvContext ) : Work ( PREFETCH_WINDOW )
+	{
+		pApp = pOwner;
+		pSessions = pPool;
+		lpfnCallback = lpfn;
+		lpvCallbackContext = lpvContext;
+		fStopped = FALSE;
+		InitializeCriticalSection ( &csLock );
+		InitializeConditionVariable ( &cvChanged );
+		cLogonsPending = cWorkers;
+		cSessions = 0L;
+	}
+
+	~CPrefetchContext ( )
+	{
+		DeleteCriticalSection ( &csLock );
+	}
+};
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	PrefetchWorker()
+|
+|	Purpose:	Takes a session from the pool, logging on to a new one
+|				if none is idle, reports the outcome, then reads
+|				envelopes until the work queue is closed and drained. A
+|				worker that cannot get a session exits and leaves the
+|				work to the others. The session goes back to the pool
+|				unless the provider reported it invalid.
+|
++---------------------------------------------------------------------
+*/
+static DWORD PrefetchWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	CPrefetchContext *pCtx = (CPrefetchContext *) lpvContext;
+	CApp *pSession = NULL;
+	HRESULT hResLogon = pCtx -> pSessions -> Get ( pCtx -> pApp, &pSession );
+	BOOL fKeep = TRUE;
+	PREFETCHITEM Item;
+
+	EnterCriticalSection ( &pCtx -> csLock );
+	pCtx -> cLogonsPending--;
+	if ( SUCCESS_SUCCESS == hResLogon )
+		pCtx -> cSessions++;
+	LeaveCriticalSection ( &pCtx -> csLock );
+	WakeAllConditionVariable ( &pCtx -> cvChanged );
+
+	if ( SUCCESS_SUCCESS != hResLogon )
+		return hResLogon;
+
+	while ( pCtx -> Work.Pop ( &Item ) )
+	{
+		PREFETCHRESULT Result;
+
+		// Once the enumeration is stopped the remaining items are only
+		// accounted for, not read.
+		if ( pCtx -> fStopped )
+			Result.hRes = MAPI_USER_ABORT;
+		else
+			Result.hRes = pSession -> cReadHeader ( (LPSTR) pSession -> cMsgIDText ( Item.hMsgID ), &Result.Header );
+
+		if ( MAPI_E_INVALID_SESSION == Result.hRes )
+			fKeep = FALSE;
+
+		EnterCriticalSection ( &pCtx -> csLock );
+		pCtx -> Done[Item.ulSeq] = Result;
+		LeaveCriticalSection ( &pCtx -> csLock );
+		WakeAllConditionVariable ( &pCtx -> cvChanged );
+	}
+
+	pCtx -> pSessions -> Put ( pSession, fKeep );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	PrefetchDrain()
+|
+|	Purpose:	Hands completed reads that are next in sequence from the
+|				reorder buffer to the callback. With fWait, first waits
+|				until the next read in sequence has completed. Messages
+|				deleted before they could be read are skipped; the first
+|				other error is kept in *phResRead. The callback runs
+|				outside the lock so it does not hold up the workers. Once
+|				it returns FALSE, fStopped is set and later results are
+|				discarded.
+|
++---------------------------------------------------------------------
+*/
+static void PrefetchDrain ( CPrefetchContext *pCtx, ULONG *pulNextSeq, BOOL fWait, HRESULT *phResRead )
+{
+	std::map<ULONG, PREFETCHRESULT>::iterator it;
+
+	EnterCriticalSection ( &pCtx -> csLock );
+
+	if ( fWait )
+	{
+		while ( pCtx -> Done.end ( ) == pCtx -> Done.find ( *pulNextSeq ) )
+			SleepConditionVariableCS ( &pCtx -> cvChanged, &pCtx -> csLock, INFINITE );
+	}
+
+	while ( pCtx -> Done.end ( ) != ( it = pCtx -> Done.find ( *pulNextSeq ) ) )
+	{
+		PREFETCHRESULT Result = it -> second;
+
+		pCtx -> Done.erase ( it );
+		( *pulNextSeq )++;
+
+		if ( pCtx -> fStopped )
+			continue;
+
+		if ( SUCCESS_SUCCESS == Result.hRes )
+		{
+			LeaveCriticalSection ( &pCtx -> csLock );
+			if ( !pCtx -> lpfnCallback ( &Result.Header, pCtx -> lpvCallbackContext ) )
+				pCtx -> fStopped = TRUE;
+			EnterCriticalSection ( &pCtx -> csLock );
+		}
+		else if ( MAPI_E_INVALID_MESSAGE != Result.hRes && SUCCESS_SUCCESS == *phResRead )
+			*phResRead = Result.hRes;
+	}
+
+	LeaveCriticalSection ( &pCtx -> csLock );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cEnumInboxHeadersParallel ( )
+|
+|	Parameters:	[IN] cWorkers == Number of sessions reading envelopes.
+|
+|				[IN] lpszSeedMsgID == Message to continue after, or NULL or
+|				an empty string to start at the first message in the Inbox.
+|
+|				[IN] lpfnCallback == Called with each header, in
+|				MAPI_GUARANTEE_FIFO order, on the calling thread. Returns
+|				FALSE to stop the enumeration.
+|
+|				[IN] lpvContext == Passed through to lpfnCallback.
+|
+|	Purpose:	Enumerates the Inbox with up to cWorkers envelope reads in
+|				flight. At most PREFETCH_WINDOW reads run ahead of the oldest
+|				header not yet handed to the callback, which bounds the
+|				reorder buffer. If the message the walk would continue
+|				after is deleted meanwhile, it starts again from the top
+|				of the Inbox without reading any message twice. Returns
+|				SUCCESS_SUCCESS once every message has been enumerated,
+|				MAPI_USER_ABORT if the callback stopped it, or
+|				MAPI_E_LOGIN_FAILURE, before any header is read, if no
+|				worker session could be opened.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cEnumInboxHeadersParallel ( ULONG cWorkers, LPCSTR lpszSeedMsgID,
+											   LPHEADERCALLBACK lpfnCallback, LPVOID lpvContext )
+{
+	HRESULT hRes = S_OK;
+	HRESULT hResRead = SUCCESS_SUCCESS;
+	ULONG ulSeq = 0L;
+	ULONG ulNextSeq = 0L;
+	char szMsgID[MAX_MSGID] = {0};
+	char szSeedMsgID[MAX_MSGID] = {0};
+	std::vector<MSGIDHANDLE> rghIssued;
+	size_t cSorted = 0;
+	std::string sRestartSeed;
+	CWorkerThreads Workers;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( 0 == cWorkers )
+		cWorkers = 1;
+	if ( lpszSeedMsgID )
+	{
+		strncpy ( szSeedMsgID, lpszSeedMsgID, MAX_MSGID - 1 );
+		szSeedMsgID[MAX_MSGID - 1] = '\0';
+	}
+
+	// Created here, before any worker runs, so the workers only share it.
+	if ( NULL == m_pSessionPool )
+		m_pSessionPool = new CSessionPool;
+
+	CPrefetchContext Ctx ( this, m_pSessionPool, cWorkers, lpfnCallback, lpvContext );
+
+	if ( FAILED ( hRes = Workers.Start ( cWorkers, PrefetchWorker, &Ctx ) ) )
+	{
+		Ctx.Work.Close ( );
+		Workers.Join ( );
+		return hRes;
+	}
+
+	// Wait until every worker has tried to log on.
+	EnterCriticalSection ( &Ctx.csLock );
+	while ( Ctx.cLogonsPending )
+		SleepConditionVariableCS ( &Ctx.cvChanged, &Ctx.csLock, INFINITE );
+	LeaveCriticalSection ( &Ctx.csLock );
+
+	if ( 0 == Ctx.cSessions )
+	{
+		Ctx.Work.Close ( );
+		Workers.Join ( );
+		return MAPI_E_LOGIN_FAILURE;
+	}
+
+	while ( !Ctx.fStopped )
+	{
+		PREFETCHITEM Item;
+
+		hRes = m_MAPIFindNext ( m_lhSession,
+								0L,
+								NULL,
+								szSeedMsgID[0] ? szSeedMsgID : NULL,
+								MAPI_GUARANTEE_FIFO | MAPI_LONG_MSGID,
+								0L,
+								szMsgID );
+
+		// The seed has been deleted, so there is no position to continue
+		// from. Start again from the top of the Inbox, passing over the
+		// messages already read. The same seed failing twice is not a
+		// deletion, so that ends the walk.
+		if ( MAPI_E_INVALID_MESSAGE == hRes && szSeedMsgID[0] && sRestartSeed != szSeedMsgID )
+		{
+			sRestartSeed = szSeedMsgID;
+			szSeedMsgID[0] = '\0';
+			std::sort ( rghIssued.begin ( ), rghIssued.end ( ) );
+			cSorted = rghIssued.size ( );
+			continue;
+		}
+		if ( SUCCESS_SUCCESS != hRes )
+			break;
+
+		if ( MSGID_NONE == ( Item.hMsgID = m_pMsgIDs -> Intern ( szMsgID ) ) )
+		{
+			hRes = MAPI_E_INSUFFICIENT_MEMORY;
+			break;
+		}
+
+		strcpy ( szSeedMsgID, szMsgID );
+		if ( cSorted && std::binary_search ( rghIssued.begin ( ), rghIssued.begin ( ) + cSorted, Item.hMsgID ) )
+			continue;
+		rghIssued.push_back ( Item.hMsgID );
+
+		// Keep the window of outstanding reads bounded.
+		if ( ulSeq - ulNextSeq >= PREFETCH_WINDOW )
+			PrefetchDrain ( &Ctx, &ulNextSeq, TRUE, &hResRead );
+
+		Item.ulSeq = ulSeq++;
+		Ctx.Work.Push ( Item );
+
+		PrefetchDrain ( &Ctx, &ulNextSeq, FALSE, &hResRead );
+	}
+
+	Ctx.Work.Close ( );
+	while ( ulNextSeq < ulSeq )
+		PrefetchDrain ( &Ctx, &ulNextSeq, TRUE, &hResRead );
+	Workers.Join ( );
+
+	if ( Ctx.fStopped )
+		hRes = MAPI_USER_ABORT;
+	else if ( MAPI_E_NO_MESSAGES == hRes )
+		hRes = hResRead;
+
+	return hRes;
+}
+
+static BOOL AppendHeader ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	( (MSGHEADERLIST *) lpvContext ) -> push_back ( *pHeader );
+
+	return TRUE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cFetchInboxHeadersParallel ( )
+|
+|	Parameters:	[IN] cWorkers == Number of sessions reading envelopes.
+|
+|				[OUT] pHeaders == List every Inbox header is appended to, in
+|				MAPI_GUARANTEE_FIFO order.
+|
+|	Purpose:	Lists the whole Inbox through cEnumInboxHeadersParallel.
+|				Returns MAPI_E_NO_MESSAGES if the Inbox is empty.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cFetchInboxHeadersParallel ( ULONG cWorkers, MSGHEADERLIST *pHeaders )
+{
+	HRESULT hRes = S_OK;
+	size_t cHeaders = pHeaders -> size ( );
+
+	hRes = cEnumInboxHeadersParallel ( cWorkers, NULL, AppendHeader, pHeaders );
+	if ( SUCCESS_SUCCESS == hRes && cHeaders == pHeaders -> size ( ) )
+		hRes = MAPI_E_NO_MESSAGES;
+
+	return hRes;
+}
@@ -0,0 +1,394 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		ReadAhead.cpp
+|
+|   Purpose:	Implementation of CReadAhead and of cReadMail's use of it.
+|
++---------------------------------------------------------------------
+*/
+
+#include "readahead.h"
+#include "msgidtbl.h"
+#include "message.h"
+
+CReadAhead::CReadAhead ( CApp *pApp, ULONG cWindow, ULONG cMarkBatch, ULONG ulMarkInterval )
+{
+	m_pApp = pApp;
+	m_cWindow = cWindow ? cWindow : 1;
+	m_cMarkBatch = cMarkBatch ? cMarkBatch : 1;
+	m_ulMarkInterval = ulMarkInterval;
+	m_dwFirstMark = 0L;
+	InitializeCriticalSection ( &m_csLock );
+	InitializeConditionVariable ( &m_cvChanged );
+	m_fAtEnd = FALSE;
+	m_fStop = FALSE;
+	m_cLogons = 0;
+	m_hResLogon = SUCCESS_SUCCESS;
+}
+
+CReadAhead::~CReadAhead ( )
+{
+	Stop ( );
+	DeleteCriticalSection ( &m_csLock );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Start()
+|
+|	Purpose:	Starts the workers and waits until they have logged
+|				on. Returns the logon failure if either could not.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CReadAhead::Start ( void )
+{
+	HRESULT hRes = S_OK;
+
+	if ( FAILED ( hRes = m_Fetcher.Start ( 1, FetchProc, this ) ) )
+		return hRes;
+	if ( FAILED ( hRes = m_Marker.Start ( 1, MarkProc, this ) ) )
+	{
+		Stop ( );
+		return hRes;
+	}
+
+	EnterCriticalSection ( &m_csLock );
+	while ( m_cLogons < READAHEAD_SESSIONS )
+		SleepConditionVariableCS ( &m_cvChanged, &m_csLock, INFINITE );
+	hRes = m_hResLogon;
+	LeaveCriticalSection ( &m_csLock );
+
+	if ( SUCCESS_SUCCESS != hRes )
+		Stop ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Stop()
+|
+|	Purpose:	Stops the workers once every message already taken
+|				has been marked read, and frees the messages fetched but not
+|				taken.
+|
++---------------------------------------------------------------------
+*/
+void CReadAhead::Stop ( void )
+{
+	EnterCriticalSection ( &m_csLock );
+	m_fStop = TRUE;
+	LeaveCriticalSection ( &m_csLock );
+	WakeAllConditionVariable ( &m_cvChanged );
+
+	m_Fetcher.Join ( );
+	m_Marker.Join ( );
+
+	for ( size_t i = 0; i < m_Ready.size ( ); i++ )
+	{
+		if ( m_Ready[i].lpMessage )
+			m_pApp -> cFreeBuffer ( m_Ready[i].lpMessage );
+	}
+	m_Ready.clear ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Next()
+|
+|	Purpose:	Takes the next unread message, waiting for the worker
+|				if it has not been fetched yet. If the walk had already
+|				reached the end, the worker looks once more so mail
+|				delivered since is found. pItem -> hRes is
+|				MAPI_E_NO_MESSAGES when there is no unread mail.
+|
++---------------------------------------------------------------------
+*/
+void CReadAhead::Next ( READAHEADITEM *pItem )
+{
+	EnterCriticalSection ( &m_csLock );
+
+	if ( m_Ready.empty ( ) && m_fAtEnd )
+	{
+		m_fAtEnd = FALSE;
+		WakeAllConditionVariable ( &m_cvChanged );
+	}
+
+	while ( m_Ready.empty ( ) && !m_fAtEnd )
+		SleepConditionVariableCS ( &m_cvChanged, &m_csLock, INFINITE );
+
+	if ( m_Ready.empty ( ) )
+	{
+		pItem -> hRes = MAPI_E_NO_MESSAGES;
+		pItem -> hMsgID = MSGID_NONE;
+		pItem -> lpMessage = NULL;
+	}
+	else
+	{
+		*pItem = m_Ready.front ( );
+		m_Ready.pop_front ( );
+		if ( SUCCESS_SUCCESS == pItem -> hRes )
+		{
+			if ( m_ToMark.empty ( ) )
+				m_dwFirstMark = GetTickCount ( );
+			m_ToMark.push_back ( pItem -> hMsgID );
+		}
+	}
+
+	LeaveCriticalSection ( &m_csLock );
+	WakeAllConditionVariable ( &m_cvChanged );
+}
+
+// TRUE if the message was fetched already, whether or not it was taken.
+// Called with the lock held.
+BOOL CReadAhead::IsTaken ( MSGIDHANDLE hMsgID )
+{
+	for ( size_t i = 0; i < m_Ready.size ( ); i++ )
+	{
+		if ( m_Ready[i].hMsgID == hMsgID )
+			return TRUE;
+	}
+	for ( size_t i = 0; i < m_ToMark.size ( ); i++ )
+	{
+		if ( m_ToMark[i] == hMsgID )
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+DWORD CReadAhead::FetchProc ( ULONG iWorker, LPVOID lpvContext )
+{
+	return ( (CReadAhead *) lpvContext ) -> Work ( TRUE );
+}
+
+DWORD CReadAhead::MarkProc ( ULONG iWorker, LPVOID lpvContext )
+{
+	return ( (CReadAhead *) lpvContext ) -> Work ( FALSE );
+}
+
+DWORD CReadAhead::Work ( BOOL fFetch )
+{
+	CApp Session;
+	HRESULT hRes = m_pApp -> cCloneSession ( &Session );
+	BOOL fRun = FALSE;
+
+	// Both sessions must open, or neither worker runs.
+	EnterCriticalSection ( &m_csLock );
+	if ( SUCCESS_SUCCESS != hRes && SUCCESS_SUCCESS == m_hResLogon )
+		m_hResLogon = hRes;
+	m_cLogons++;
+	WakeAllConditionVariable ( &m_cvChanged );
+	while ( !m_fStop && m_cLogons < READAHEAD_SESSIONS )
+		SleepConditionVariableCS ( &m_cvChanged, &m_csLock, INFINITE );
+	fRun = !m_fStop && SUCCESS_SUCCESS == m_hResLogon;
+	LeaveCriticalSection ( &m_csLock );
+
+	if ( fRun )
+	{
+		if ( fFetch )
+			Fetch ( &Session );
+		else
+			MarkRead ( &Session );
+	}
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	MarkRead()
+|
+|	Purpose:	Marks taken messages read with cMarkReadBatch once a
+|				batch of them is waiting or the oldest has waited the
+|				interval, until Stop is called and none are left.
+|
++---------------------------------------------------------------------
+*/
+void CReadAhead::MarkRead ( CApp *pSession )
+{
+	std::vector<MSGIDHANDLE> rghBatch;
+
+	for ( ;; )
+	{
+		EnterCriticalSection ( &m_csLock );
+		while ( !m_fStop && m_ToMark.size ( ) < m_cMarkBatch )
+		{
+			DWORD dwWaited = GetTickCount ( ) - m_dwFirstMark;
+
+			if ( m_ToMark.empty ( ) )
+				SleepConditionVariableCS ( &m_cvChanged, &m_csLock, INFINITE );
+			else if ( dwWaited < m_ulMarkInterval )
+				SleepConditionVariableCS ( &m_cvChanged, &m_csLock, m_ulMarkInterval - dwWaited );
+			else
+				break;
+		}
+		if ( m_ToMark.empty ( ) )
+		{
+			LeaveCriticalSection ( &m_csLock );
+			break;
+		}
+		rghBatch.assign ( m_ToMark.begin ( ), m_ToMark.end ( ) );
+		LeaveCriticalSection ( &m_csLock );
+
+		pSession -> cMarkReadBatch ( rghBatch );
+
+		// Popped only now, so until they are read the fetch still skips them.
+		EnterCriticalSection ( &m_csLock );
+		m_ToMark.erase ( m_ToMark.begin ( ), m_ToMark.begin ( ) + rghBatch.size ( ) );
+		if ( !m_ToMark.empty ( ) )
+			m_dwFirstMark = GetTickCount ( );
+		LeaveCriticalSection ( &m_csLock );
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Fetch()
+|
+|	Purpose:	While the window has room and the walk has not reached
+|				the end, finds the next unread message with the clone's
+|				cFindNextUnread and reads its text with MAPI_PEEK.
+|				Attachments are left for CLazyMessage. Messages
+|				already fetched are skipped when the walk comes back to
+|				them from the top.
+|
++---------------------------------------------------------------------
+*/
+void CReadAhead::Fetch ( CApp *pSession )
+{
+	for ( ;; )
+	{
+		READAHEADITEM Item = { SUCCESS_SUCCESS, MSGID_NONE, NULL };
+		BOOL fTaken = FALSE;
+
+		EnterCriticalSection ( &m_csLock );
+		while ( !m_fStop && ( m_fAtEnd || m_Ready.size ( ) >= m_cWindow ) )
+			SleepConditionVariableCS ( &m_cvChanged, &m_csLock, INFINITE );
+		if ( m_fStop )
+		{
+			LeaveCriticalSection ( &m_csLock );
+			break;
+		}
+		LeaveCriticalSection ( &m_csLock );
+
+		Item.hRes = pSession -> cFindNextUnread ( &Item.hMsgID );
+
+		if ( SUCCESS_SUCCESS == Item.hRes )
+		{
+			EnterCriticalSection ( &m_csLock );
+			fTaken = IsTaken ( Item.hMsgID );
+			LeaveCriticalSection ( &m_csLock );
+			if ( fTaken )
+				continue;
+
+			Item.hRes = pSession -> cReadMessage ( Item.hMsgID, MAPI_PEEK | MAPI_SUPPRESS_ATTACH, &Item.lpMessage );
+
+			// Deleted between MAPIFindNext and MAPIReadMail.
+			if ( MAPI_E_INVALID_MESSAGE == Item.hRes )
+				continue;
+		}
+
+		EnterCriticalSection ( &m_csLock );
+		if ( MAPI_E_NO_MESSAGES == Item.hRes )
+		{
+			m_fAtEnd = TRUE;
+		}
+		else
+		{
+			// A failure is handed to the reader, and the walk pauses until
+			// the reader asks again.
+			m_Ready.push_back ( Item );
+			if ( SUCCESS_SUCCESS != Item.hRes )
+				m_fAtEnd = TRUE;
+		}
+		LeaveCriticalSection ( &m_csLock );
+		WakeAllConditionVariable ( &m_cvChanged );
+	}
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSetReadAhead ( )
+|
+|	Parameters:	[IN] cWindow == Unread messages cReadMail may fetch ahead of
+|				the one it displays, or 0 to read each one on demand.
+|
+|	Purpose:	Changes the read-ahead window. Messages already fetched
+|				are discarded; the worker starts again on the next
+|				cReadMail.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSetReadAhead ( ULONG cWindow )
+{
+	delete m_pReadAhead;
+	m_pReadAhead = NULL;
+	m_cReadAhead = cWindow;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cReadNextUnread ( )
+|
+|	Parameters:	[OUT] pMessage == Opened on the message found.
+|
+|	Purpose:	Finds the first unread message in the Inbox for cReadMail
+|				and opens pMessage on it so it is marked read. With a
+|				read-ahead window the message comes from CReadAhead with
+|				its text already read, and is marked read in the
+|				background; otherwise, or if no read-ahead session can be
+|				opened, it is found with cFindNextUnread and read by
+|				pMessage as it is used, with MAPI_PEEK when read marks
+|				are batched (cBatchReadMarks).
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cReadNextUnread ( CLazyMessage *pMessage )
+{
+	HRESULT hRes = S_OK;
+	MSGIDHANDLE hMsgID = MSGID_NONE;
+
+	pMessage -> Close ( );
+
+	if ( m_cReadAhead && NULL == m_pReadAhead )
+	{
+		m_pReadAhead = new CReadAhead ( this, m_cReadAhead, m_cReadMarkBatch, m_ulReadMarkInterval );
+		if ( SUCCESS_SUCCESS != m_pReadAhead -> Start ( ) )
+		{
+			delete m_pReadAhead;
+			m_pReadAhead = NULL;
+			m_cReadAhead = 0L;
+		}
+	}
+
+	if ( m_pReadAhead )
+	{
+		READAHEADITEM Item;
+
+		m_pReadAhead -> Next ( &Item );
+		if ( MAPI_E_NO_MESSAGES == Item.hRes )
+			printf ( "No messages to print.\r\n" );
+
+		pMessage -> Open ( Item.hMsgID, FALSE );
+		pMessage -> Adopt ( Item.lpMessage, LAZY_TEXT );
+
+		return Item.hRes;
+	}
+
+	if ( MAPI_E_NO_MESSAGES == ( hRes = cFindNextUnread ( &hMsgID ) ) )
+		printf ( "No messages to print.\r\n" );
+
+	pMessage -> Open ( hMsgID, !cBatchReadMarks ( ) );
+
+	return hRes;
+}
@@ -0,0 +1,76 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		ReadAhead.h
+|
+|   Purpose:	Declares CReadAhead, which serves "read next unread"
+|				from memory. A worker thread with a session of its own
+|				walks the unread messages in delivery order and reads
+|				up to a window of them ahead with MAPI_PEEK, so while
+|				one message is displayed the next ones are already
+|				fetched. Taking a message from the read-ahead queues it
+|				to be marked read, which a second worker does on a
+|				session of its own so marking never holds up fetching.
+|				It marks a batch of messages at a time, or fewer once
+|				the oldest has waited the interval (ReadMark.cpp).
+|
+|				A message read or deleted elsewhere after it was
+|				fetched is still served once from memory.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _READAHEAD_H
+#define _READAHEAD_H
+
+#include "swap.h"
+#include "workpool.h"
+#include <deque>
+
+#define READAHEAD_SESSIONS		2		// One session fetches, one marks read
+
+// A fetched message, or the failure that ended the walk.
+typedef struct _READAHEADITEM
+{
+	HRESULT			hRes;
+	MSGIDHANDLE		hMsgID;
+	lpMapiMessage	lpMessage;		// Free with MAPIFreeBuffer
+} READAHEADITEM;
+
+class CReadAhead
+{
+private:
+	CApp						*m_pApp;
+	ULONG						m_cWindow;
+	ULONG						m_cMarkBatch;
+	ULONG						m_ulMarkInterval;
+	CWorkerThreads				m_Fetcher;
+	CWorkerThreads				m_Marker;
+
+	CRITICAL_SECTION			m_csLock;
+	CONDITION_VARIABLE			m_cvChanged;
+	std::deque<READAHEADITEM>	m_Ready;		// Fetched, in delivery order
+	std::deque<MSGIDHANDLE>		m_ToMark;		// Taken, not yet marked read
+	DWORD						m_dwFirstMark;	// GetTickCount when the oldest was taken
+	BOOL						m_fAtEnd;		// The walk found no more unread mail
+	BOOL						m_fStop;
+	ULONG						m_cLogons;		// Workers that have tried to log on
+	HRESULT						m_hResLogon;
+
+	static DWORD FetchProc ( ULONG iWorker, LPVOID lpvContext );
+	static DWORD MarkProc ( ULONG iWorker, LPVOID lpvContext );
+	DWORD	Work ( BOOL fFetch );
+	void	Fetch ( CApp *pSession );
+	void	MarkRead ( CApp *pSession );
+	BOOL	IsTaken ( MSGIDHANDLE hMsgID );
+
+public:
+	CReadAhead ( CApp *pApp, ULONG cWindow, ULONG cMarkBatch, ULONG ulMarkInterval );
+	~CReadAhead ( );
+
+	HRESULT	Start ( void );
+	void	Next ( READAHEADITEM *pItem );
+	void	Stop ( void );
+};
+
+#endif
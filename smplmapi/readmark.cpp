@@ -0,0 +1,172 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		ReadMark.cpp
+|
+|   Purpose:	Batched read marks. cReadMail reads with MAPI_PEEK and
+|				queues the message to be marked read instead of marking
+|				it as it is read. The queue is flushed with one
+|				IMAPIFolder::SetReadFlags call on the Extended MAPI
+|				session of cOpenInboxTable once it holds a batch of
+|				messages, when a mark is queued after the oldest has
+|				waited the interval, and at logoff. That session
+|				belongs to the main thread, so no timer can flush the
+|				queue while the client is idle; instead the client
+|				flushes it before it waits for the next command.
+|
+|				Simple MAPI can only mark a message read by reading it
+|				without MAPI_PEEK, so without Extended MAPI cReadMail
+|				goes on marking each message as it reads it, which
+|				costs no extra call. The read-ahead, which peeks anyway,
+|				still marks its messages in batches.
+|
+|				The header cache is updated as each message is read, so
+|				listings from it show the message read at once.
+|				cFindNextUnread skips queued messages, which the store
+|				still has unread.
+|
++---------------------------------------------------------------------
+*/
+
+#include "swap.h"
+#include "inboxtbl.h"
+#include <algorithm>
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSetReadMarkBatch ( )
+|
+|	Parameters:	[IN] cBatch == Read marks cReadMail queues before they are
+|				written, or 0 to mark each message as it is read.
+|
+|				[IN] ulInterval == Milliseconds the oldest queued mark may
+|				wait before the queue is written anyway.
+|
+|	Purpose:	Changes how read marks are batched. Marks already queued
+|				are written first. The read-ahead picks up the new values
+|				the next time it starts.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSetReadMarkBatch ( ULONG cBatch, ULONG ulInterval )
+{
+	HRESULT hRes = cFlushReadMarks ( );
+
+	m_cReadMarkBatch = cBatch;
+	m_ulReadMarkInterval = ulInterval;
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cQueueMarkRead ( )
+|
+|	Parameters:	[IN] hMsgID == A message read with MAPI_PEEK.
+|
+|	Purpose:	Queues the message to be marked read, and writes the queue
+|				if it is full or its oldest mark has waited the interval.
+|				Without batching the message is marked read now.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cQueueMarkRead ( MSGIDHANDLE hMsgID )
+{
+	if ( 0 == m_cReadMarkBatch )
+		return cMarkRead ( hMsgID );
+
+	if ( cIsReadMarkQueued ( hMsgID ) )
+		return SUCCESS_SUCCESS;
+
+	if ( m_rghReadMarks.empty ( ) )
+		m_dwReadMarkFirst = GetTickCount ( );
+	m_rghReadMarks.push_back ( hMsgID );
+
+	if ( m_rghReadMarks.size ( ) >= m_cReadMarkBatch ||
+		 GetTickCount ( ) - m_dwReadMarkFirst >= m_ulReadMarkInterval )
+		return cFlushReadMarks ( );
+
+	return SUCCESS_SUCCESS;
+}
+
+// TRUE if the message is queued to be marked read and the store still
+// has it unread.
+BOOL CApp::cIsReadMarkQueued ( MSGIDHANDLE hMsgID )
+{
+	return std::find ( m_rghReadMarks.begin ( ), m_rghReadMarks.end ( ), hMsgID ) != m_rghReadMarks.end ( );
+}
+
+// TRUE if cReadMail should read with MAPI_PEEK and queue the read mark:
+// batching is on and SetReadFlags is there to write the batch.
+BOOL CApp::cBatchReadMarks ( void )
+{
+	return m_cReadMarkBatch && SUCCESS_SUCCESS == cOpenInboxTable ( );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cFlushReadMarks ( )
+|
+|	Purpose:	Writes the queued read marks. The queue is emptied even if
+|				the write fails; the messages are then still unread in the
+|				store and cReadMail comes back to them.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cFlushReadMarks ( void )
+{
+	std::vector<MSGIDHANDLE> rghMsgIDs;
+
+	if ( m_rghReadMarks.empty ( ) )
+		return SUCCESS_SUCCESS;
+
+	rghMsgIDs.swap ( m_rghReadMarks );
+
+	return cMarkReadBatch ( rghMsgIDs );
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cMarkReadBatch ( )
+|
+|	Parameters:	[IN] rghMsgIDs == Messages to mark read.
+|
+|	Purpose:	Marks messages read, with one SetReadFlags call on the
+|				Inbox when the Extended MAPI table of cOpenInboxTable is
+|				available and with cMarkRead for each message otherwise.
+|				IDs SetReadFlags cannot take are marked with cMarkRead
+|				too. SetReadFlags does not say which messages it failed
+|				to mark, so after a partial completion every message is
+|				marked again with cMarkRead. A message deleted meanwhile
+|				is not an error.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cMarkReadBatch ( const std::vector<MSGIDHANDLE> &rghMsgIDs )
+{
+	HRESULT hRes = SUCCESS_SUCCESS;
+	std::vector<MSGIDHANDLE> rghSkipped;
+	const std::vector<MSGIDHANDLE> *prghEach = &rghMsgIDs;
+
+	if ( rghMsgIDs.empty ( ) )
+		return SUCCESS_SUCCESS;
+
+	if ( SUCCESS_SUCCESS == cOpenInboxTable ( ) &&
+		 S_OK == m_pInboxTable -> MarkRead ( rghMsgIDs, &rghSkipped ) )
+	{
+		if ( rghSkipped.empty ( ) )
+			return SUCCESS_SUCCESS;
+		prghEach = &rghSkipped;
+	}
+
+	for ( size_t i = 0; i < prghEach -> size ( ); i++ )
+	{
+		HRESULT hResMark = cMarkRead ( ( *prghEach )[i] );
+
+		if ( SUCCESS_SUCCESS != hResMark && MAPI_E_INVALID_MESSAGE != hResMark &&
+			 SUCCESS_SUCCESS == hRes )
+			hRes = hResMark;
+	}
+
+	return hRes;
+}
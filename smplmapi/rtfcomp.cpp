@@ -0,0 +1,576 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		RtfComp.cpp
+|
+|   Purpose:	Implementation of the compressed RTF codec.
+|
++---------------------------------------------------------------------
+*/
+
+#include "rtfcomp.h"
+#include "crc32.h"
+
+static inline UINT32 ReadLE32 ( const BYTE *pb )
+{
+	return (UINT32) pb[0] | ( (UINT32) pb[1] << 8 ) | ( (UINT32) pb[2] << 16 ) | ( (UINT32) pb[3] << 24 );
+}
+
+static inline void WriteLE32 ( LPBYTE pb, UINT32 ul )
+{
+	pb[0] = (BYTE) ul;
+	pb[1] = (BYTE) ( ul >> 8 );
+	pb[2] = (BYTE) ( ul >> 16 );
+	pb[3] = (BYTE) ( ul >> 24 );
+}
+
+CRtfDecoder::CRtfDecoder ( )
+{
+	m_iWrite = 0;
+	m_ulType = 0;
+	m_cbRaw = 0;
+	m_ulCrcExpected = 0;
+	m_ulCrc = 0;
+	m_cbLeft = 0;
+	m_cbOut = 0;
+	m_bControl = 0;
+	m_iBit = 8;
+	m_fHalf = FALSE;
+	m_bHigh = 0;
+	m_fEnd = FALSE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Begin()
+|
+|	Purpose:	Starts decoding the stream whose RTFCOMP_HEADER_SIZE
+|				byte header is at pbHeader. RawSize() is then the
+|				size of the buffer Decode() needs. A header claiming
+|				more RTF than its data could hold is corrupt.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CRtfDecoder::Begin ( const BYTE *pbHeader )
+{
+	UINT32 cbComp = ReadLE32 ( pbHeader );
+
+	m_cbRaw = ReadLE32 ( pbHeader + 4 );
+	m_ulType = ReadLE32 ( pbHeader + 8 );
+	m_ulCrcExpected = ReadLE32 ( pbHeader + 12 );
+
+	if ( cbComp < RTFCOMP_HEADER_SIZE - 4 || ( RTFCOMP_LZFU != m_ulType && RTFCOMP_MELA != m_ulType ) )
+		return MAPI_E_CORRUPT_DATA;
+
+	m_cbLeft = cbComp - ( RTFCOMP_HEADER_SIZE - 4 );
+	if ( m_cbRaw > (ULONGLONG) m_cbLeft * ( RTFCOMP_LZFU == m_ulType ? RTFCOMP_MAX_RATIO : 1 ) )
+		return MAPI_E_CORRUPT_DATA;
+
+	m_ulCrc = 0;
+	m_cbOut = 0;
+	m_iBit = 8;
+	m_fHalf = FALSE;
+	m_fEnd = FALSE;
+
+	memcpy ( m_rgbDict, RTFCOMP_PREFILL, RTFCOMP_PREFILL_SIZE );
+	ZeroMemory ( m_rgbDict + RTFCOMP_PREFILL_SIZE, RTFCOMP_DICT_SIZE - RTFCOMP_PREFILL_SIZE );
+	m_iWrite = RTFCOMP_PREFILL_SIZE;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Decode()
+|
+|	Purpose:	Decodes the next cbIn bytes of the stream into pbOut,
+|				which holds the whole RTF (cbOut == RawSize()). Bytes
+|				past the end of the stream are ignored.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CRtfDecoder::Decode ( const BYTE *pbIn, size_t cbIn, LPBYTE pbOut, size_t cbOut )
+{
+	const BYTE *pbEnd = NULL;
+	ULONG iWrite = m_iWrite;
+	size_t cbDone = m_cbOut;
+
+	if ( cbIn > m_cbLeft )
+		cbIn = m_cbLeft;
+	m_ulCrc = Crc32 ( m_ulCrc, pbIn, cbIn );
+	m_cbLeft -= (ULONG) cbIn;
+	pbEnd = pbIn + cbIn;
+
+	if ( RTFCOMP_MELA == m_ulType )
+	{
+		if ( cbIn > cbOut - cbDone )
+			return MAPI_E_CORRUPT_DATA;
+		memcpy ( pbOut + cbDone, pbIn, cbIn );
+		m_cbOut = cbDone + cbIn;
+		return S_OK;
+	}
+
+	while ( pbIn < pbEnd && !m_fEnd )
+	{
+		if ( 8 == m_iBit )
+		{
+			m_bControl = *pbIn++;
+			m_iBit = 0;
+		}
+		else if ( !( m_bControl & ( 1 << m_iBit ) ) )
+		{
+			if ( cbDone == cbOut )
+				return MAPI_E_CORRUPT_DATA;
+			pbOut[cbDone++] = m_rgbDict[iWrite] = *pbIn++;
+			iWrite = ( iWrite + 1 ) & ( RTFCOMP_DICT_SIZE - 1 );
+			m_iBit++;
+		}
+		else if ( !m_fHalf )
+		{
+			m_bHigh = *pbIn++;
+			m_fHalf = TRUE;
+		}
+		else
+		{
+			ULONG ulRef = ( (ULONG) m_bHigh << 8 ) | *pbIn++;
+			ULONG iRead = ulRef >> 4;
+			ULONG cb = ( ulRef & 0xF ) + 2;
+
+			m_fHalf = FALSE;
+			m_iBit++;
+
+			if ( iRead == iWrite )
+			{
+				m_fEnd = TRUE;
+				break;
+			}
+			if ( cb > cbOut - cbDone )
+				return MAPI_E_CORRUPT_DATA;
+
+			// Byte by byte: the copy may overlap what it writes.
+			while ( cb-- )
+			{
+				pbOut[cbDone++] = m_rgbDict[iWrite] = m_rgbDict[iRead];
+				iRead = ( iRead + 1 ) & ( RTFCOMP_DICT_SIZE - 1 );
+				iWrite = ( iWrite + 1 ) & ( RTFCOMP_DICT_SIZE - 1 );
+			}
+		}
+	}
+
+	m_iWrite = iWrite;
+	m_cbOut = cbDone;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	End()
+|
+|	Purpose:	Checks that the whole stream was decoded into exactly
+|				RawSize() bytes and, for LZFu, that the CRC matches.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CRtfDecoder::End ( void )
+{
+	if ( m_cbLeft || m_cbOut != m_cbRaw )
+		return MAPI_E_CORRUPT_DATA;
+	if ( RTFCOMP_LZFU == m_ulType && ( !m_fEnd || m_ulCrc != m_ulCrcExpected ) )
+		return MAPI_E_CORRUPT_DATA;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	RtfDecompress()
+|
+|	Purpose:	Decompresses a whole PR_RTF_COMPRESSED value held in
+|				memory.
+|
++---------------------------------------------------------------------
+*/
+HRESULT RtfDecompress ( const BYTE *pbComp, size_t cbComp, std::string *psRtf )
+{
+	HRESULT hRes = S_OK;
+	CRtfDecoder *pDecoder = new CRtfDecoder;
+
+	psRtf -> clear ( );
+
+	if ( cbComp < RTFCOMP_HEADER_SIZE )
+		hRes = MAPI_E_CORRUPT_DATA;
+	else if ( SUCCEEDED ( hRes = pDecoder -> Begin ( pbComp ) ) &&
+			  pDecoder -> BytesLeft ( ) > cbComp - RTFCOMP_HEADER_SIZE )
+		hRes = MAPI_E_CORRUPT_DATA;
+	else if ( SUCCEEDED ( hRes ) )
+	{
+		psRtf -> resize ( pDecoder -> RawSize ( ) );
+		hRes = pDecoder -> Decode ( pbComp + RTFCOMP_HEADER_SIZE, cbComp - RTFCOMP_HEADER_SIZE,
+									(LPBYTE) &( *psRtf )[0], psRtf -> size ( ) );
+		if ( SUCCEEDED ( hRes ) )
+			hRes = pDecoder -> End ( );
+	}
+
+	delete pDecoder;
+	if ( FAILED ( hRes ) )
+		psRtf -> clear ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	RtfDecompressStream()
+|
+|	Purpose:	Decompresses PR_RTF_COMPRESSED as it is read from a
+|				property stream, RTFCOMP_READ_SIZE bytes at a time,
+|				without holding the compressed value in memory. The
+|				stream's length is not known up front, so the RTF only
+|				grows to what the data read so far could produce.
+|
++---------------------------------------------------------------------
+*/
+HRESULT RtfDecompressStream ( LPSTREAM lpStream, std::string *psRtf )
+{
+	HRESULT hRes = S_OK;
+	CRtfDecoder *pDecoder = new CRtfDecoder;
+	std::vector<BYTE> rgbRead ( RTFCOMP_READ_SIZE );
+	ULONG cbHave = 0;
+	ULONG cbRead = 0;
+	ULONGLONG cbFed = 0;
+
+	psRtf -> clear ( );
+
+	while ( cbHave < RTFCOMP_HEADER_SIZE )
+	{
+		if ( FAILED ( hRes = lpStream -> Read ( &rgbRead[cbHave], RTFCOMP_HEADER_SIZE - cbHave, &cbRead ) ) )
+			goto Quit;
+		if ( 0 == cbRead )
+		{
+			hRes = MAPI_E_CORRUPT_DATA;
+			goto Quit;
+		}
+		cbHave += cbRead;
+	}
+
+	if ( FAILED ( hRes = pDecoder -> Begin ( &rgbRead[0] ) ) )
+		goto Quit;
+
+	while ( pDecoder -> BytesLeft ( ) )
+	{
+		if ( FAILED ( hRes = lpStream -> Read ( &rgbRead[0], RTFCOMP_READ_SIZE, &cbRead ) ) )
+			goto Quit;
+		if ( 0 == cbRead )
+			break;
+		cbFed += cbRead;
+		psRtf -> resize ( (size_t) min ( (ULONGLONG) pDecoder -> RawSize ( ), cbFed * RTFCOMP_MAX_RATIO ) );
+		if ( FAILED ( hRes = pDecoder -> Decode ( &rgbRead[0], cbRead, (LPBYTE) &( *psRtf )[0], psRtf -> size ( ) ) ) )
+			goto Quit;
+	}
+
+	hRes = pDecoder -> End ( );
+
+Quit:
+	delete pDecoder;
+	if ( FAILED ( hRes ) )
+		psRtf -> clear ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	RtfCompress()
+|
+|	Purpose:	Compresses RTF to a PR_RTF_COMPRESSED value of type
+|				LZFu. Matches are found through hash chains of every
+|				three-byte sequence in the dictionary window, taking
+|				the longest, earliest found, at each position.
+|
++---------------------------------------------------------------------
+*/
+HRESULT RtfCompress ( const BYTE *pbRtf, size_t cbRtf, std::vector<BYTE> *prgbComp )
+{
+	const ULONG ulHashSize = 1 << 12;
+	const ULONG ulMaxChain = 64;
+	std::vector<BYTE> rgbAll;		// The prefill followed by the RTF, as the decoder sees it
+	std::vector<ULONG> rgiHead ( ulHashSize, 0 );			// Position + 1 of the latest sequence per hash
+	std::vector<ULONG> rgiPrev ( RTFCOMP_DICT_SIZE, 0 );	// Position + 1 of the one before, by position in the window
+	size_t iPos = RTFCOMP_PREFILL_SIZE;
+	size_t iControl = 0;
+	ULONG iBit = 8;
+
+	// The sizes in the header are 32 bits.
+	if ( cbRtf > 0x7FFFFFFF )
+		return MAPI_E_TOO_BIG;
+
+	rgbAll.reserve ( RTFCOMP_PREFILL_SIZE + cbRtf );
+	rgbAll.insert ( rgbAll.end ( ), (const BYTE *) RTFCOMP_PREFILL, (const BYTE *) RTFCOMP_PREFILL + RTFCOMP_PREFILL_SIZE );
+	rgbAll.insert ( rgbAll.end ( ), pbRtf, pbRtf + cbRtf );
+
+	prgbComp -> assign ( RTFCOMP_HEADER_SIZE, 0 );
+	prgbComp -> reserve ( RTFCOMP_HEADER_SIZE + cbRtf + cbRtf / 8 + 4 );
+
+	#define HASH3(p)	( ( ( (ULONG) (p)[0] << 8 ) ^ ( (ULONG) (p)[1] << 4 ) ^ (p)[2] ) & ( ulHashSize - 1 ) )
+	#define INSERT(i)	{ ULONG ulHash = HASH3 ( &rgbAll[i] ); \
+						  rgiPrev[( i ) & ( RTFCOMP_DICT_SIZE - 1 )] = rgiHead[ulHash]; \
+						  rgiHead[ulHash] = (ULONG) ( i ) + 1; }
+
+	for ( size_t i = 0; i + 3 <= RTFCOMP_PREFILL_SIZE; i++ )
+		INSERT ( i );
+
+	for ( ;; )
+	{
+		size_t cbMatch = 0;
+		size_t iMatch = 0;
+		size_t cbAvail = rgbAll.size ( ) - iPos;
+
+		if ( 8 == iBit )
+		{
+			iControl = prgbComp -> size ( );
+			prgbComp -> push_back ( 0 );
+			iBit = 0;
+		}
+
+		if ( 0 == cbAvail )
+			break;
+
+		if ( cbAvail >= 3 )
+		{
+			size_t cbMax = cbAvail < RTFCOMP_MAX_MATCH ? cbAvail : RTFCOMP_MAX_MATCH;
+			ULONG iCandidate = rgiHead[HASH3 ( &rgbAll[iPos] )];
+			ULONG cChain = ulMaxChain;
+
+			// Positions a whole window back have been overwritten.
+			while ( iCandidate && cChain-- && iCandidate - 1 + RTFCOMP_DICT_SIZE > iPos )
+			{
+				size_t iFrom = iCandidate - 1;
+				size_t cb = 0;
+
+				while ( cb < cbMax && rgbAll[iFrom + cb] == rgbAll[iPos + cb] )
+					cb++;
+				if ( cb > cbMatch )
+				{
+					cbMatch = cb;
+					iMatch = iFrom;
+					if ( cbMax == cb )
+						break;
+				}
+				iCandidate = rgiPrev[iFrom & ( RTFCOMP_DICT_SIZE - 1 )];
+			}
+		}
+
+		if ( cbMatch >= 3 )
+		{
+			ULONG ulRef = (ULONG) ( ( ( iMatch & ( RTFCOMP_DICT_SIZE - 1 ) ) << 4 ) | ( cbMatch - 2 ) );
+
+			( *prgbComp )[iControl] |= (BYTE) ( 1 << iBit );
+			prgbComp -> push_back ( (BYTE) ( ulRef >> 8 ) );
+			prgbComp -> push_back ( (BYTE) ulRef );
+		}
+		else
+		{
+			cbMatch = 1;
+			prgbComp -> push_back ( rgbAll[iPos] );
+		}
+		iBit++;
+
+		for ( size_t i = 0; i < cbMatch; i++, iPos++ )
+			if ( iPos + 3 <= rgbAll.size ( ) )
+				INSERT ( iPos );
+	}
+
+	#undef INSERT
+	#undef HASH3
+
+	// The end: a reference to the write position.
+	{
+		ULONG ulRef = (ULONG) ( ( iPos & ( RTFCOMP_DICT_SIZE - 1 ) ) << 4 );
+
+		( *prgbComp )[iControl] |= (BYTE) ( 1 << iBit );
+		prgbComp -> push_back ( (BYTE) ( ulRef >> 8 ) );
+		prgbComp -> push_back ( (BYTE) ulRef );
+	}
+
+	WriteLE32 ( &( *prgbComp )[0], (UINT32) ( prgbComp -> size ( ) - 4 ) );
+	WriteLE32 ( &( *prgbComp )[4], (UINT32) cbRtf );
+	WriteLE32 ( &( *prgbComp )[8], RTFCOMP_LZFU );
+	WriteLE32 ( &( *prgbComp )[12], (UINT32) Crc32 ( 0, &( *prgbComp )[RTFCOMP_HEADER_SIZE],
+														 prgbComp -> size ( ) - RTFCOMP_HEADER_SIZE ) );
+
+	return S_OK;
+}
+
+// The destinations whose text is not part of the body.
+static const char *g_rgszRtfSkip[] =
+{
+	"fonttbl", "colortbl", "stylesheet", "info", "pict", "object", "header", "footer",
+	"headerl", "headerr", "headerf", "footerl", "footerr", "footerf", "listtable",
+	"listoverridetable", "rsidtbl", "generator", "themedata", "colorschememapping",
+	"datastore", "latentstyles", "fldinst", "xmlnstbl", "mmathPr"
+};
+
+// What RtfToText keeps for each group it is in.
+typedef struct _RTFGROUP
+{
+	BOOL	fSkip;			// The group's text is not part of the body
+	BOOL	fHtmlRtf;		// Inside \htmlrtf, RTF that only stands in for HTML
+	ULONG	cchUnicodeAlt;	// \ucN: fallback characters after each \uN
+} RTFGROUP;
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	RtfToText()
+|
+|	Purpose:	Reduces RTF to the text a reader would see, for a
+|				console that cannot show formatting. Paragraph and
+|				line breaks become CR LF; tables, pictures, fields'
+|				instructions and other destinations are left out,
+|				as are the HTML tags of RTF that encapsulates HTML.
+|				Characters outside the ANSI code page are shown as
+|				'?'.
+|
++---------------------------------------------------------------------
+*/
+void RtfToText ( const std::string &sRtf, std::string *psText )
+{
+	std::vector<RTFGROUP> rgGroups;
+	RTFGROUP Group = { FALSE, FALSE, 1 };
+	ULONG cchAltLeft = 0;		// Fallback characters of a \uN still to drop
+	BOOL fGroupStart = FALSE;	// Nothing but '{' read in this group yet
+	size_t i = 0;
+	size_t cch = sRtf.size ( );
+
+	psText -> clear ( );
+
+	while ( i < cch )
+	{
+		char ch = sRtf[i++];
+		BOOL fWasGroupStart = fGroupStart;
+		char chOut = 0;
+
+		fGroupStart = FALSE;
+
+		if ( '{' == ch )
+		{
+			rgGroups.push_back ( Group );
+			fGroupStart = TRUE;
+			cchAltLeft = 0;
+			continue;
+		}
+		if ( '}' == ch )
+		{
+			if ( !rgGroups.empty ( ) )
+			{
+				Group = rgGroups.back ( );
+				rgGroups.pop_back ( );
+			}
+			cchAltLeft = 0;
+			continue;
+		}
+		if ( '\r' == ch || '\n' == ch )
+			continue;
+
+		if ( '\\' != ch )
+			chOut = ch;
+		else if ( i < cch && !isalpha ( (BYTE) sRtf[i] ) )
+		{
+			ch = sRtf[i++];
+			if ( '\\' == ch || '{' == ch || '}' == ch )
+				chOut = ch;
+			else if ( '~' == ch )
+				chOut = ' ';
+			else if ( '_' == ch )
+				chOut = '-';
+			else if ( '*' == ch && fWasGroupStart )
+				Group.fSkip = TRUE;
+			else if ( '\r' == ch || '\n' == ch )
+			{
+				if ( !Group.fSkip && !Group.fHtmlRtf )
+					*psText += "\r\n";
+				continue;
+			}
+			else if ( '\'' == ch && i + 2 <= cch && isxdigit ( (BYTE) sRtf[i] ) && isxdigit ( (BYTE) sRtf[i + 1] ) )
+			{
+				chOut = (char) strtoul ( sRtf.substr ( i, 2 ).c_str ( ), NULL, 16 );
+				i += 2;
+			}
+			if ( !chOut )
+				continue;
+		}
+		else
+		{
+			std::string sWord;
+			LONG lParam = 0;
+			BOOL fParam = FALSE;
+			BOOL fNegative = FALSE;
+
+			while ( i < cch && isalpha ( (BYTE) sRtf[i] ) )
+				sWord += sRtf[i++];
+			if ( i < cch && '-' == sRtf[i] )
+			{
+				fNegative = TRUE;
+				i++;
+			}
+			while ( i < cch && isdigit ( (BYTE) sRtf[i] ) )
+			{
+				lParam = lParam * 10 + ( sRtf[i++] - '0' );
+				fParam = TRUE;
+			}
+			if ( fNegative )
+				lParam = -lParam;
+			if ( i < cch && ' ' == sRtf[i] )
+				i++;
+
+			if ( fWasGroupStart )
+				for ( size_t j = 0; j < sizeof ( g_rgszRtfSkip ) / sizeof ( g_rgszRtfSkip[0] ); j++ )
+					if ( sWord == g_rgszRtfSkip[j] )
+						Group.fSkip = TRUE;
+
+			if ( "par" == sWord || "line" == sWord || "row" == sWord )
+				sWord = "\r\n";
+			else if ( "tab" == sWord || "cell" == sWord )
+				sWord = "\t";
+			else if ( "htmlrtf" == sWord )
+			{
+				Group.fHtmlRtf = !fParam || 0 != lParam;
+				continue;
+			}
+			else if ( "uc" == sWord && fParam )
+			{
+				Group.cchUnicodeAlt = (ULONG) max ( lParam, 0L );
+				continue;
+			}
+			else if ( "u" == sWord && fParam )
+			{
+				// Negative for code points past 32767, as RTF has signed 16-bit numbers.
+				if ( lParam < 0 )
+					lParam += 65536;
+				sWord = lParam < 128 ? std::string ( 1, (char) lParam ) : "?";
+				if ( !Group.fSkip && !Group.fHtmlRtf )
+					*psText += sWord;
+				cchAltLeft = Group.cchUnicodeAlt;
+				continue;
+			}
+			else
+				continue;
+
+			if ( !Group.fSkip && !Group.fHtmlRtf )
+				*psText += sWord;
+			continue;
+		}
+
+		if ( cchAltLeft )
+			cchAltLeft--;
+		else if ( !Group.fSkip && !Group.fHtmlRtf )
+			*psText += chOut;
+	}
+}
@@ -0,0 +1,82 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		RtfComp.h
+|
+|   Purpose:	Declares a portable codec for compressed RTF, the format
+|				of PR_RTF_COMPRESSED ([MS-OXRTFCP]), for hosts without
+|				WrapCompressedRTFStream.
+|
+|				A stream starts with a 16-byte header: the size of the
+|				rest of the stream plus 12, the size of the RTF, the
+|				type ("LZFu" compressed or "MELA" stored) and a CRC-32
+|				of the data after the header. LZFu data is groups of a
+|				control byte and up to eight items, least significant
+|				bit first: a 0 bit is a literal byte, a 1 bit a
+|				big-endian 16-bit reference of a 12-bit position in a
+|				4096-byte ring dictionary and a 4-bit length less 2. The
+|				dictionary starts out holding RTFCOMP_PREFILL, and a
+|				reference to the current write position ends the data.
+|
+|				CRtfDecoder takes the stream in pieces of any size, as
+|				they are read from a property stream, and writes the
+|				RTF straight into the caller's buffer. The sizes in the
+|				header are not trusted: the RTF is never sized past what
+|				the data actually read could produce.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _RTFCOMP_H
+#define _RTFCOMP_H
+
+#include "swap.h"
+
+#define RTFCOMP_HEADER_SIZE		16
+#define RTFCOMP_LZFU			0x75465A4C		// "LZFu"
+#define RTFCOMP_MELA			0x414C454D		// "MELA"
+#define RTFCOMP_DICT_SIZE		4096
+#define RTFCOMP_MAX_MATCH		17
+#define RTFCOMP_MAX_RATIO		8				// RTF bytes per LZFu byte, at most: 17 in, 8 * 17 out
+#define RTFCOMP_READ_SIZE		( 16 * 1024 )	// Bytes read from a stream at a time
+
+#define RTFCOMP_PREFILL			"{\\rtf1\\ansi\\mac\\deff0\\deftab720{\\fonttbl;}" \
+								"{\\f0\\fnil \\froman \\fswiss \\fmodern \\fscript " \
+								"\\fdecor MS Sans SerifSymbolArialTimes New RomanCourier" \
+								"{\\colortbl\\red0\\green0\\blue0\r\n\\par " \
+								"\\pard\\plain\\f0\\fs20\\b\\i\\u\\tab\\tx"
+#define RTFCOMP_PREFILL_SIZE	( sizeof ( RTFCOMP_PREFILL ) - 1 )
+
+class CRtfDecoder
+{
+private:
+	BYTE		m_rgbDict[RTFCOMP_DICT_SIZE];
+	ULONG		m_iWrite;		// Next dictionary position written
+	ULONG		m_ulType;
+	ULONG		m_cbRaw;
+	ULONG		m_ulCrcExpected;
+	ULONG		m_ulCrc;
+	ULONG		m_cbLeft;		// Bytes of the stream still to come
+	size_t		m_cbOut;		// Bytes of RTF written so far
+	BYTE		m_bControl;
+	ULONG		m_iBit;			// Next bit of m_bControl; 8 == read another
+	BOOL		m_fHalf;		// The first byte of a reference is in m_bHigh
+	BYTE		m_bHigh;
+	BOOL		m_fEnd;			// The end reference has been read
+
+public:
+	CRtfDecoder ( );
+
+	HRESULT	Begin ( const BYTE *pbHeader );
+	HRESULT	Decode ( const BYTE *pbIn, size_t cbIn, LPBYTE pbOut, size_t cbOut );
+	HRESULT	End ( void );
+	ULONG	RawSize ( void ) { return m_cbRaw; }
+	ULONG	BytesLeft ( void ) { return m_cbLeft; }
+};
+
+HRESULT	RtfDecompress ( const BYTE *pbComp, size_t cbComp, std::string *psRtf );
+HRESULT	RtfDecompressStream ( LPSTREAM lpStream, std::string *psRtf );
+HRESULT	RtfCompress ( const BYTE *pbRtf, size_t cbRtf, std::vector<BYTE> *prgbComp );
+void	RtfToText ( const std::string &sRtf, std::string *psText );
+
+#endif
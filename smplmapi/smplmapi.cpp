@@ -40,6 +40,10 @@ void main(int argc, char *argv[], char *envp[])
 		ULONG	cRecips = 0L;
 		lpMapiRecipDesc Recips = NULL;
 
+		// Nothing runs while waiting for a choice, so read marks still
+		// queued are written now instead of waiting for logoff.
+		pCApp->cFlushReadMarks();
+
 		printf("\r\nEnter your choice: ");
 		scanf("%d", &lpMenuChoice);
 
@@ -123,6 +127,42 @@ void main(int argc, char *argv[], char *envp[])
 		case REFRESH:
 			PrintMenuToConsole();
 			break;
+		case BENCHMARK:
+			RunBenchmarks();
+			break;
+		case LIST_NEW:
+			hRes = pCApp->cListNewInboxMessages();
+			break;
+		case LIST_FILTERED:
+			hRes = pCApp->cListFilteredInboxMessages();
+			break;
+		case EXPORT_INBOX:
+			hRes = pCApp->cExportInboxMessages();
+			break;
+		case SEARCH_INBOX:
+			hRes = pCApp->cSearchInboxMessages();
+			break;
+		case GREP_INBOX:
+			hRes = pCApp->cGrepInboxMessages();
+			break;
+		case LIST_THREADED:
+			hRes = pCApp->cListInboxConversations();
+			break;
+		case FIND_DUPLICATES:
+			hRes = pCApp->cFindDuplicateMessages();
+			break;
+		case BULK_SEND:
+			hRes = pCApp->cBulkSendMessages();
+			break;
+		case SHOW_OUTBOX:
+			hRes = pCApp->cShowOutbox();
+			break;
+		case QUEUE_SEND:
+			hRes = pCApp->cQueueMessage();
+			break;
+		case INDEX_INBOX:
+			hRes = pCApp->cIndexInboxMessages();
+			break;
 		default:
 			printf("Not a valid choice. Please try again.\r\n");
 			break;
@@ -166,6 +206,18 @@ void PrintMenuToConsole(void)
 	printf("[11] Logoff the message system.\r\n");
 	printf("[12] Exit Client.\r\n");
 	printf("[13] Refresh Menu.\r\n");
+	printf("[14] Run benchmarks against stand-in message store.\r\n");
+	printf("[15] List messages that arrived since the Inbox was last listed.\r\n");
+	printf("[16] List Inbox messages matching a filter.\r\n");
+	printf("[17] Export the Inbox as JSON Lines or CSV.\r\n");
+	printf("[18] Search the Inbox.\r\n");
+	printf("[19] Grep the Inbox for text, without the search index.\r\n");
+	printf("[20] List the Inbox as conversations.\r\n");
+	printf("[21] Find and delete duplicate messages.\r\n");
+	printf("[22] Send a message to every recipient in a file.\r\n");
+	printf("[23] Show the outbox of messages being sent.\r\n");
+	printf("[24] Queue Mail message to recipient in the outbox.\r\n");
+	printf("[25] Update the search index of the Inbox.\r\n");
 }
 
 // Run program: Ctrl + F5 or Debug > Start Without Debugging menu
@@ -4,6 +4,7 @@
 #define _SWPMAIN_
 
 #include "swap.h"
+#include "bench.h"
 #include <iostream>
 #include <string>
 
@@ -21,6 +22,18 @@
 #define LOGOFF					11
 #define EXIT				    12
 #define REFRESH					13
+#define BENCHMARK				14
+#define LIST_NEW				15
+#define LIST_FILTERED			16
+#define EXPORT_INBOX			17
+#define SEARCH_INBOX			18
+#define GREP_INBOX				19
+#define LIST_THREADED			20
+#define FIND_DUPLICATES			21
+#define BULK_SEND				22
+#define SHOW_OUTBOX				23
+#define QUEUE_SEND				24
+#define INDEX_INBOX				25
 
 void main(int argc, char *argv[], char *envp[]);
 void PrintMenuToConsole(void);
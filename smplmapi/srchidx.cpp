@@ -0,0 +1,1789 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		SrchIdx.cpp
+|
+|   Purpose:	Implementation of CIndexBuilder and CSearchIndex, and of
+|				the CApp methods that build and query the Inbox index.
+|
++---------------------------------------------------------------------
+*/
+
+#include "srchidx.h"
+#include "msgidtbl.h"
+#include "workpool.h"
+#include "output.h"
+#include <algorithm>
+#include <iterator>
+
+#define SEARCH_ALIGN(cb)	( ( (cb) + 7 ) & ~( (ULONGLONG) 7 ) )
+
+// Lower-cased byte for the bytes that make up words, 0 for the others.
+// Bytes above 0x7F are kept as they are, so words in other code pages are
+// indexed whole.
+static struct SEARCHWORDTABLE
+{
+	BYTE	rgb[256];
+
+	SEARCHWORDTABLE ( )
+	{
+		for ( int i = 0; i < 256; i++ )
+		{
+			if ( i >= 'A' && i <= 'Z' )
+				rgb[i] = (BYTE) ( i - 'A' + 'a' );
+			else if ( ( i >= 'a' && i <= 'z' ) || ( i >= '0' && i <= '9' ) || i >= 0x80 )
+				rgb[i] = (BYTE) i;
+			else
+				rgb[i] = 0;
+		}
+	}
+} g_SearchWord;
+
+static ULONG SearchCheck ( const BYTE *pb, size_t cb )
+{
+	ULONG ulHash = 2166136261UL;
+
+	for ( size_t i = 0; i < cb; i++ )
+	{
+		ulHash ^= pb[i];
+		ulHash *= 16777619UL;
+	}
+
+	return ulHash;
+}
+
+static inline void PutVarint ( std::vector<BYTE> *prgb, ULONG ul )
+{
+	while ( ul >= 0x80 )
+	{
+		prgb -> push_back ( (BYTE) ( ul | 0x80 ) );
+		ul >>= 7;
+	}
+	prgb -> push_back ( (BYTE) ul );
+}
+
+static inline ULONG GetVarint ( const BYTE **ppb, const BYTE *pbEnd )
+{
+	ULONG ul = 0;
+
+	for ( int iShift = 0; *ppb < pbEnd && iShift < 35; iShift += 7 )
+	{
+		BYTE b = *( *ppb )++;
+
+		ul |= (ULONG) ( b & 0x7F ) << iShift;
+		if ( !( b & 0x80 ) )
+			break;
+	}
+
+	return ul;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Tokenize()
+|
+|	Purpose:	Splits text into the words the index holds, the way
+|				messages are split when they are added.
+|
++---------------------------------------------------------------------
+*/
+void CIndexBuilder::Tokenize ( LPCSTR lpszText, std::vector<std::string> *prgsWords )
+{
+	const BYTE *pb = (const BYTE *) lpszText;
+	std::string sWord;
+
+	prgsWords -> clear ( );
+
+	for ( ;; pb++ )
+	{
+		BYTE b = g_SearchWord.rgb[*pb];
+
+		if ( b )
+		{
+			if ( sWord.size ( ) < SEARCH_MAX_TERM )
+				sWord += (char) b;
+		}
+		else if ( !sWord.empty ( ) )
+		{
+			prgsWords -> push_back ( sWord );
+			sWord.clear ( );
+		}
+
+		if ( '\0' == *pb )
+			break;
+	}
+}
+
+// Adds the words of one field of the message being added to m_DocTerms,
+// numbering them from *pulPosition on.
+void CIndexBuilder::AddField ( char chField, LPCSTR lpszText, ULONG *pulPosition )
+{
+	const BYTE *pb = (const BYTE *) lpszText;
+	std::string sKey ( 1, chField );
+
+	if ( NULL == lpszText )
+		return;
+
+	for ( ;; pb++ )
+	{
+		BYTE b = g_SearchWord.rgb[*pb];
+
+		if ( b )
+		{
+			if ( sKey.size ( ) < 1 + SEARCH_MAX_TERM )
+				sKey += (char) b;
+		}
+		else if ( sKey.size ( ) > 1 )
+		{
+			m_DocTerms[sKey].push_back ( ( *pulPosition )++ );
+			sKey.resize ( 1 );
+		}
+
+		if ( '\0' == *pb )
+			break;
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	AddMessage()
+|
+|	Purpose:	Adds a message as the next document. The sender's name
+|				and address are one field, one position apart, so a
+|				phrase does not match across them.
+|
++---------------------------------------------------------------------
+*/
+void CIndexBuilder::AddMessage ( LPCSTR lpszMsgID, LPCSTR lpszSubject, LPCSTR lpszSenderName,
+								 LPCSTR lpszSenderAddress, LPCSTR lpszBody )
+{
+	ULONG ulDoc = DocCount ( );
+	ULONG ulPosition = 0;
+
+	AddDocument ( lpszMsgID );
+
+	for ( auto it = m_DocTerms.begin ( ); it != m_DocTerms.end ( ); ++it )
+		it -> second.clear ( );
+
+	AddField ( SEARCH_FIELD_SUBJECT, lpszSubject, &ulPosition );
+	ulPosition = 0;
+	AddField ( SEARCH_FIELD_SENDER, lpszSenderName, &ulPosition );
+	ulPosition++;
+	AddField ( SEARCH_FIELD_SENDER, lpszSenderAddress, &ulPosition );
+	ulPosition = 0;
+	AddField ( SEARCH_FIELD_BODY, lpszBody, &ulPosition );
+
+	for ( auto it = m_DocTerms.begin ( ); it != m_DocTerms.end ( ); ++it )
+	{
+		if ( !it -> second.empty ( ) )
+			AddPostings ( it -> first, ulDoc, &it -> second[0], (ULONG) it -> second.size ( ) );
+	}
+
+	// Keys of words that are rare do not stay in the scratch map.
+	if ( m_DocTerms.size ( ) > 4096 )
+		m_DocTerms.clear ( );
+}
+
+void CIndexBuilder::AddDocument ( LPCSTR lpszMsgID )
+{
+	m_rgsMsgIDs.push_back ( lpszMsgID );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	AddPostings()
+|
+|	Purpose:	Records that the key occurs in document ulDoc at the
+|				given positions, which are in increasing order. Calls
+|				for a key must come in increasing document order.
+|
++---------------------------------------------------------------------
+*/
+void CIndexBuilder::AddPostings ( const std::string &sKey, ULONG ulDoc, const ULONG *pulPositions, ULONG cPositions )
+{
+	POSTINGS &Postings = m_Terms[sKey];
+	ULONG ulNext = 0;
+
+	PutVarint ( &Postings.rgbDocs, ulDoc - Postings.ulNextDoc );
+	PutVarint ( &Postings.rgbDocs, cPositions );
+	for ( ULONG i = 0; i < cPositions; i++ )
+	{
+		PutVarint ( &Postings.rgbPositions, pulPositions[i] - ulNext );
+		ulNext = pulPositions[i] + 1;
+	}
+
+	Postings.cDocs++;
+	Postings.ulNextDoc = ulDoc + 1;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Append()
+|
+|	Purpose:	Adds the documents of another builder after these.
+|				Only the first document gap of each key is rewritten;
+|				the rest of its postings are copied as they are.
+|
++---------------------------------------------------------------------
+*/
+void CIndexBuilder::Append ( const CIndexBuilder &Other )
+{
+	ULONG ulBase = DocCount ( );
+
+	for ( auto it = Other.m_Terms.begin ( ); it != Other.m_Terms.end ( ); ++it )
+	{
+		const POSTINGS &From = it -> second;
+		POSTINGS &To = m_Terms[it -> first];
+		const BYTE *pb = &From.rgbDocs[0];
+		const BYTE *pbEnd = pb + From.rgbDocs.size ( );
+		ULONG ulFirst = GetVarint ( &pb, pbEnd );
+
+		PutVarint ( &To.rgbDocs, ulBase + ulFirst - To.ulNextDoc );
+		To.rgbDocs.insert ( To.rgbDocs.end ( ), pb, pbEnd );
+		To.rgbPositions.insert ( To.rgbPositions.end ( ), From.rgbPositions.begin ( ), From.rgbPositions.end ( ) );
+		To.cDocs += From.cDocs;
+		To.ulNextDoc = ulBase + From.ulNextDoc;
+	}
+
+	m_rgsMsgIDs.insert ( m_rgsMsgIDs.end ( ), Other.m_rgsMsgIDs.begin ( ), Other.m_rgsMsgIDs.end ( ) );
+}
+
+const CIndexBuilder::POSTINGS *CIndexBuilder::Find ( const std::string &sKey ) const
+{
+	TERMMAP::const_iterator it = m_Terms.find ( sKey );
+
+	return m_Terms.end ( ) == it ? NULL : &it -> second;
+}
+
+void CIndexBuilder::Clear ( void )
+{
+	m_Terms.clear ( );
+	m_rgsMsgIDs.clear ( );
+	m_DocTerms.clear ( );
+}
+
+static bool KeyLess ( const CIndexBuilder::TERMMAP::value_type *p1, const CIndexBuilder::TERMMAP::value_type *p2 )
+{
+	return p1 -> first < p2 -> first;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Serialize()
+|
+|	Purpose:	Lays the documents out as a segment record, with the
+|				dictionary sorted by key.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CIndexBuilder::Serialize ( std::vector<BYTE> *prgbRecord ) const
+{
+	std::vector<const TERMMAP::value_type *> rgpTerms;
+	ULONGLONG cbDocs = 0;
+	ULONGLONG cbKeys = 0;
+	ULONGLONG cbPostings = 0;
+	ULONGLONG ibDict = 0;
+	ULONGLONG ibKeys = 0;
+	ULONGLONG ibPostings = 0;
+	ULONGLONG cbRecord = 0;
+	SEARCHRECORD *pRecord = NULL;
+	SEARCHTERM *pTerm = NULL;
+	LPBYTE pb = NULL;
+	ULONG ibKey = 0;
+	ULONG ibData = 0;
+
+	rgpTerms.reserve ( m_Terms.size ( ) );
+	for ( auto it = m_Terms.begin ( ); it != m_Terms.end ( ); ++it )
+	{
+		rgpTerms.push_back ( &*it );
+		cbKeys += it -> first.size ( );
+		cbPostings += it -> second.rgbDocs.size ( ) + it -> second.rgbPositions.size ( );
+	}
+	std::sort ( rgpTerms.begin ( ), rgpTerms.end ( ), KeyLess );
+
+	for ( size_t i = 0; i < m_rgsMsgIDs.size ( ); i++ )
+		cbDocs += m_rgsMsgIDs[i].size ( ) + 1;
+
+	ibDict = SEARCH_ALIGN ( sizeof ( SEARCHRECORD ) + cbDocs );
+	ibKeys = ibDict + rgpTerms.size ( ) * sizeof ( SEARCHTERM );
+	ibPostings = ibKeys + cbKeys;
+	cbRecord = SEARCH_ALIGN ( ibPostings + cbPostings );
+
+	// Offsets in the file are 32 bits.
+	if ( cbRecord > 0xFFFFFFFF )
+		return MAPI_E_TOO_BIG;
+
+	prgbRecord -> assign ( (size_t) cbRecord, 0 );
+	pRecord = (SEARCHRECORD *) &( *prgbRecord )[0];
+	pRecord -> cbRecord = (ULONG) cbRecord;
+	pRecord -> ulKind = SEARCH_RECORD_SEGMENT;
+	pRecord -> cDocs = DocCount ( );
+	pRecord -> cTerms = (ULONG) rgpTerms.size ( );
+	pRecord -> ibDocs = sizeof ( SEARCHRECORD );
+	pRecord -> ibDict = (ULONG) ibDict;
+	pRecord -> ibKeys = (ULONG) ibKeys;
+	pRecord -> ibPostings = (ULONG) ibPostings;
+
+	pb = &( *prgbRecord )[sizeof ( SEARCHRECORD )];
+	for ( size_t i = 0; i < m_rgsMsgIDs.size ( ); i++ )
+	{
+		memcpy ( pb, m_rgsMsgIDs[i].c_str ( ), m_rgsMsgIDs[i].size ( ) + 1 );
+		pb += m_rgsMsgIDs[i].size ( ) + 1;
+	}
+
+	pTerm = (SEARCHTERM *) &( *prgbRecord )[(size_t) ibDict];
+	for ( size_t i = 0; i < rgpTerms.size ( ); i++, pTerm++ )
+	{
+		const std::string &sKey = rgpTerms[i] -> first;
+		const POSTINGS &Postings = rgpTerms[i] -> second;
+
+		pTerm -> ibKey = ibKey;
+		pTerm -> cchKey = (ULONG) sKey.size ( );
+		pTerm -> cDocs = Postings.cDocs;
+		memcpy ( &( *prgbRecord )[(size_t) ( ibKeys + ibKey )], sKey.c_str ( ), sKey.size ( ) );
+		ibKey += (ULONG) sKey.size ( );
+
+		pTerm -> ibDocList = ibData;
+		pTerm -> cbDocList = (ULONG) Postings.rgbDocs.size ( );
+		memcpy ( &( *prgbRecord )[(size_t) ( ibPostings + ibData )], &Postings.rgbDocs[0], Postings.rgbDocs.size ( ) );
+		ibData += pTerm -> cbDocList;
+
+		pTerm -> ibPositions = ibData;
+		pTerm -> cbPositions = (ULONG) Postings.rgbPositions.size ( );
+		if ( pTerm -> cbPositions )
+			memcpy ( &( *prgbRecord )[(size_t) ( ibPostings + ibData )], &Postings.rgbPositions[0], pTerm -> cbPositions );
+		ibData += pTerm -> cbPositions;
+	}
+
+	pRecord -> ulCheck = SearchCheck ( (LPBYTE) &pRecord -> ulKind, (size_t) cbRecord - 2 * sizeof ( ULONG ) );
+
+	return S_OK;
+}
+
+// A postings list being walked by a query, from a segment or the pending
+// builder.
+typedef struct _SEARCHCURSOR
+{
+	const BYTE			*pbDocs;
+	const BYTE			*pbDocsEnd;
+	const BYTE			*pbPositions;
+	const BYTE			*pbPositionsEnd;
+	ULONG				ulNextDoc;
+	ULONG				ulDoc;
+	std::vector<ULONG>	rgulPositions;		// Of ulDoc, read only for phrases
+} SEARCHCURSOR;
+
+// Moves a cursor to its next document. Returns FALSE at the end.
+static BOOL CursorNext ( SEARCHCURSOR *pCursor, BOOL fPositions )
+{
+	ULONG cPositions = 0;
+
+	if ( pCursor -> pbDocs >= pCursor -> pbDocsEnd )
+		return FALSE;
+
+	pCursor -> ulDoc = pCursor -> ulNextDoc + GetVarint ( &pCursor -> pbDocs, pCursor -> pbDocsEnd );
+	pCursor -> ulNextDoc = pCursor -> ulDoc + 1;
+	cPositions = GetVarint ( &pCursor -> pbDocs, pCursor -> pbDocsEnd );
+
+	if ( fPositions )
+	{
+		ULONG ulNext = 0;
+
+		pCursor -> rgulPositions.resize ( cPositions );
+		for ( ULONG i = 0; i < cPositions; i++ )
+		{
+			pCursor -> rgulPositions[i] = ulNext + GetVarint ( &pCursor -> pbPositions, pCursor -> pbPositionsEnd );
+			ulNext = pCursor -> rgulPositions[i] + 1;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	MatchCursors()
+|
+|	Purpose:	Adds to prgulDocs the live documents, numbered from
+|				ulDocBase, in which the cursors' keys occur one after
+|				the other. With one cursor that is every document in
+|				its list, and positions are not read.
+|
++---------------------------------------------------------------------
+*/
+static void MatchCursors ( std::vector<SEARCHCURSOR> &rgCursors, ULONG ulDocBase,
+						   const std::vector<BYTE> &rgfLive, std::vector<ULONG> *prgulDocs )
+{
+	BOOL fPhrase = rgCursors.size ( ) > 1;
+
+	for ( size_t i = 0; i < rgCursors.size ( ); i++ )
+	{
+		if ( !CursorNext ( &rgCursors[i], fPhrase ) )
+			return;
+	}
+
+	if ( !fPhrase )
+	{
+		do
+		{
+			if ( rgfLive[ulDocBase + rgCursors[0].ulDoc] )
+				prgulDocs -> push_back ( ulDocBase + rgCursors[0].ulDoc );
+		}
+		while ( CursorNext ( &rgCursors[0], FALSE ) );
+		return;
+	}
+
+	for ( ;; )
+	{
+		ULONG ulDoc = rgCursors[0].ulDoc;
+		BOOL fSame = TRUE;
+
+		for ( size_t i = 1; i < rgCursors.size ( ); i++ )
+		{
+			if ( rgCursors[i].ulDoc > ulDoc )
+				ulDoc = rgCursors[i].ulDoc;
+		}
+		for ( size_t i = 0; i < rgCursors.size ( ); i++ )
+		{
+			while ( rgCursors[i].ulDoc < ulDoc )
+			{
+				if ( !CursorNext ( &rgCursors[i], TRUE ) )
+					return;
+			}
+			if ( rgCursors[i].ulDoc != ulDoc )
+				fSame = FALSE;
+		}
+		if ( !fSame )
+			continue;
+
+		if ( rgfLive[ulDocBase + ulDoc] )
+		{
+			const std::vector<ULONG> &rgulFirst = rgCursors[0].rgulPositions;
+			BOOL fMatch = FALSE;
+
+			for ( size_t iPos = 0; iPos < rgulFirst.size ( ) && !fMatch; iPos++ )
+			{
+				fMatch = TRUE;
+				for ( size_t i = 1; i < rgCursors.size ( ) && fMatch; i++ )
+					fMatch = std::binary_search ( rgCursors[i].rgulPositions.begin ( ), rgCursors[i].rgulPositions.end ( ),
+												  rgulFirst[iPos] + (ULONG) i );
+			}
+			if ( fMatch )
+				prgulDocs -> push_back ( ulDocBase + ulDoc );
+		}
+
+		if ( !CursorNext ( &rgCursors[0], TRUE ) )
+			return;
+	}
+}
+
+CSearchIndex::CSearchIndex ( )
+{
+	m_pMsgIDs = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+	m_pbView = NULL;
+	m_cbMapped = 0;
+	m_cLive = 0L;
+}
+
+CSearchIndex::~CSearchIndex ( )
+{
+	Close ( );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Map()
+|
+|	Purpose:	Maps the first cbSize bytes of the file read/write,
+|				growing the file if it is shorter.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Map ( ULONGLONG cbSize )
+{
+	Unmap ( );
+
+	m_hMapping = CreateFileMapping ( m_hFile, NULL, PAGE_READWRITE,
+									 (DWORD) ( cbSize >> 32 ), (DWORD) cbSize, NULL );
+	if ( NULL == m_hMapping )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	m_pbView = (LPBYTE) MapViewOfFile ( m_hMapping, FILE_MAP_WRITE, 0, 0, (SIZE_T) cbSize );
+	if ( NULL == m_pbView )
+	{
+		HRESULT hRes = HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+		CloseHandle ( m_hMapping );
+		m_hMapping = NULL;
+		return hRes;
+	}
+	m_cbMapped = cbSize;
+
+	return S_OK;
+}
+
+void CSearchIndex::Unmap ( void )
+{
+	if ( m_pbView )
+	{
+		FlushViewOfFile ( m_pbView, 0 );
+		UnmapViewOfFile ( m_pbView );
+		m_pbView = NULL;
+	}
+	if ( m_hMapping )
+	{
+		CloseHandle ( m_hMapping );
+		m_hMapping = NULL;
+	}
+	m_cbMapped = 0;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Open()
+|
+|	Parameters:	[IN] lpszFile == Index file; created if it does not exist.
+|				[IN] pMsgIDs == Table the indexed message IDs are
+|				interned in. Query results carry its handles.
+|
+|	Purpose:	Maps the index and reads its records. A file that is not
+|				an index of this version is reset. A damaged record ends
+|				the index at that point, so a write cut short by a crash
+|				loses only the messages of that record; they are indexed
+|				again by the next cBuildSearchIndex.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Open ( LPCSTR lpszFile, CMsgIDTable *pMsgIDs )
+{
+	HRESULT hRes = S_OK;
+	LARGE_INTEGER liSize;
+
+	Close ( );
+
+	m_pMsgIDs = pMsgIDs;
+	m_sFile = lpszFile;
+	m_hFile = CreateFile ( lpszFile, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+						   OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( INVALID_HANDLE_VALUE == m_hFile )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	if ( !GetFileSizeEx ( m_hFile, &liSize ) )
+	{
+		hRes = HRESULT_FROM_WIN32 ( GetLastError ( ) );
+		Close ( );
+		return hRes;
+	}
+
+	if ( FAILED ( hRes = Map ( max ( (ULONGLONG) liSize.QuadPart, (ULONGLONG) SEARCH_INITIAL_SIZE ) ) ) )
+	{
+		Close ( );
+		return hRes;
+	}
+
+	if ( SEARCH_MAGIC != Header ( ) -> ulMagic ||
+		 SEARCH_VERSION != Header ( ) -> ulVersion ||
+		 Header ( ) -> cbUsed < sizeof ( SEARCHFILEHEADER ) ||
+		 Header ( ) -> cbUsed > m_cbMapped )
+		hRes = Reset ( );
+	else
+		hRes = Load ( );
+
+	if ( SUCCEEDED ( hRes ) &&
+		 ( m_rgSegments.size ( ) > SEARCH_MAX_SEGMENTS || m_rghDocs.size ( ) - m_cLive > m_cLive ) )
+		hRes = Compact ( );
+
+	if ( FAILED ( hRes ) )
+		Close ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Close()
+|
+|	Purpose:	Writes the messages added since the last Flush and
+|				closes the file.
+|
++---------------------------------------------------------------------
+*/
+void CSearchIndex::Close ( void )
+{
+	if ( m_pbView && m_Pending.DocCount ( ) )
+		Flush ( );
+
+	Unmap ( );
+	if ( INVALID_HANDLE_VALUE != m_hFile )
+	{
+		CloseHandle ( m_hFile );
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	m_rgSegments.clear ( );
+	m_rghDocs.clear ( );
+	m_rgfLive.clear ( );
+	m_rgiDocs.clear ( );
+	m_cLive = 0L;
+	m_Pending.Clear ( );
+}
+
+HRESULT CSearchIndex::Reset ( void )
+{
+	ZeroMemory ( m_pbView, sizeof ( SEARCHFILEHEADER ) );
+	Header ( ) -> ulMagic = SEARCH_MAGIC;
+	Header ( ) -> ulVersion = SEARCH_VERSION;
+	Header ( ) -> cbUsed = sizeof ( SEARCHFILEHEADER );
+
+	m_rgSegments.clear ( );
+	m_rghDocs.clear ( );
+	m_rgfLive.clear ( );
+	m_rgiDocs.clear ( );
+	m_cLive = 0L;
+	m_Pending.Clear ( );
+
+	return S_OK;
+}
+
+void CSearchIndex::KillDoc ( ULONG ulDoc )
+{
+	if ( m_rgfLive[ulDoc] )
+	{
+		m_rgfLive[ulDoc] = FALSE;
+		m_cLive--;
+	}
+}
+
+// Numbers the next document, which supersedes any earlier one of the
+// same message.
+void CSearchIndex::AddDoc ( MSGIDHANDLE hMsgID )
+{
+	ULONG ulDoc = (ULONG) m_rghDocs.size ( );
+
+	m_rghDocs.push_back ( hMsgID );
+	m_rgfLive.push_back ( TRUE );
+	m_cLive++;
+
+	if ( hMsgID >= m_rgiDocs.size ( ) )
+		m_rgiDocs.resize ( max ( (size_t) hMsgID + 1, 2 * m_rgiDocs.size ( ) ), 0 );
+	if ( m_rgiDocs[hMsgID] )
+		KillDoc ( m_rgiDocs[hMsgID] - 1 );
+	m_rgiDocs[hMsgID] = ulDoc + 1;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Load()
+|
+|	Purpose:	Numbers the documents of every segment record in file
+|				order, interning their message IDs, and applies the
+|				remove records.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Load ( void )
+{
+	ULONGLONG ib = sizeof ( SEARCHFILEHEADER );
+	ULONGLONG cbUsed = Header ( ) -> cbUsed;
+
+	while ( ib + sizeof ( SEARCHRECORD ) <= cbUsed )
+	{
+		SEARCHRECORD *pRecord = Record ( ib );
+		LPCSTR lpszMsgID = NULL;
+		LPCSTR lpszEnd = NULL;
+
+		if ( pRecord -> cbRecord < sizeof ( SEARCHRECORD ) ||
+			 pRecord -> cbRecord > cbUsed - ib ||
+			 pRecord -> ibDocs > pRecord -> cbRecord ||
+			 ( SEARCH_RECORD_SEGMENT == pRecord -> ulKind &&
+			   ( pRecord -> ibDict > pRecord -> ibKeys ||
+				 pRecord -> ibKeys > pRecord -> ibPostings ||
+				 pRecord -> ibPostings > pRecord -> cbRecord ||
+				 ( pRecord -> ibKeys - pRecord -> ibDict ) / sizeof ( SEARCHTERM ) != pRecord -> cTerms ) ) ||
+			 pRecord -> ulCheck != SearchCheck ( (LPBYTE) &pRecord -> ulKind,
+												 pRecord -> cbRecord - 2 * sizeof ( ULONG ) ) )
+			break;
+
+		lpszMsgID = (LPCSTR) pRecord + pRecord -> ibDocs;
+		lpszEnd = (LPCSTR) pRecord + pRecord -> cbRecord;
+
+		if ( SEARCH_RECORD_SEGMENT == pRecord -> ulKind )
+		{
+			SEGMENT Segment = { ib, (ULONG) m_rghDocs.size ( ), pRecord -> cDocs };
+
+			m_rgSegments.push_back ( Segment );
+		}
+
+		for ( ULONG i = 0; i < pRecord -> cDocs && lpszMsgID < lpszEnd; i++ )
+		{
+			MSGIDHANDLE hMsgID = m_pMsgIDs -> Intern ( lpszMsgID );
+
+			if ( MSGID_NONE == hMsgID )
+				return E_OUTOFMEMORY;
+
+			if ( SEARCH_RECORD_SEGMENT == pRecord -> ulKind )
+				AddDoc ( hMsgID );
+			else if ( hMsgID < m_rgiDocs.size ( ) && m_rgiDocs[hMsgID] )
+			{
+				KillDoc ( m_rgiDocs[hMsgID] - 1 );
+				m_rgiDocs[hMsgID] = 0;
+			}
+
+			lpszMsgID += strlen ( lpszMsgID ) + 1;
+		}
+
+		ib += pRecord -> cbRecord;
+	}
+
+	Header ( ) -> cbUsed = ib;
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Append()
+|
+|	Purpose:	Appends a record, doubling the mapping when it is full.
+|				The used size in the file header is advanced only after
+|				the record is complete.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Append ( const std::vector<BYTE> &rgbRecord )
+{
+	HRESULT hRes = S_OK;
+	ULONGLONG ib = Header ( ) -> cbUsed;
+
+	if ( ib + rgbRecord.size ( ) > m_cbMapped )
+	{
+		if ( FAILED ( hRes = Map ( max ( 2 * m_cbMapped, ib + rgbRecord.size ( ) ) ) ) )
+			return hRes;
+	}
+
+	memcpy ( m_pbView + ib, &rgbRecord[0], rgbRecord.size ( ) );
+	Header ( ) -> cbUsed = ib + rgbRecord.size ( );
+
+	return S_OK;
+}
+
+HRESULT CSearchIndex::AppendRemove ( const std::vector<MSGIDHANDLE> &rghMsgIDs )
+{
+	std::vector<BYTE> rgbRecord;
+	SEARCHRECORD Record;
+
+	ZeroMemory ( &Record, sizeof ( Record ) );
+	Record.ulKind = SEARCH_RECORD_REMOVE;
+	Record.cDocs = (ULONG) rghMsgIDs.size ( );
+	Record.ibDocs = sizeof ( SEARCHRECORD );
+
+	rgbRecord.assign ( (LPBYTE) &Record, (LPBYTE) ( &Record + 1 ) );
+	for ( size_t i = 0; i < rghMsgIDs.size ( ); i++ )
+	{
+		LPCSTR lpszMsgID = m_pMsgIDs -> Get ( rghMsgIDs[i] );
+
+		rgbRecord.insert ( rgbRecord.end ( ), lpszMsgID, lpszMsgID + strlen ( lpszMsgID ) + 1 );
+	}
+	rgbRecord.resize ( (size_t) SEARCH_ALIGN ( rgbRecord.size ( ) ), 0 );
+
+	( (SEARCHRECORD *) &rgbRecord[0] ) -> cbRecord = (ULONG) rgbRecord.size ( );
+	( (SEARCHRECORD *) &rgbRecord[0] ) -> ulCheck = SearchCheck ( &rgbRecord[2 * sizeof ( ULONG )],
+																  rgbRecord.size ( ) - 2 * sizeof ( ULONG ) );
+
+	return Append ( rgbRecord );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Flush()
+|
+|	Purpose:	Writes the messages added since the last Flush as a
+|				segment, followed by a remove record for those of them
+|				that were removed before they were written, and writes
+|				the file through to the disk. Merges the index when it
+|				has too many segments or removed documents.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Flush ( void )
+{
+	HRESULT hRes = S_OK;
+
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	if ( m_Pending.DocCount ( ) )
+	{
+		std::vector<BYTE> rgbRecord;
+		std::vector<MSGIDHANDLE> rghRemoved;
+		ULONG ulDocBase = (ULONG) m_rghDocs.size ( ) - m_Pending.DocCount ( );
+		SEGMENT Segment = { Header ( ) -> cbUsed, ulDocBase, m_Pending.DocCount ( ) };
+
+		if ( FAILED ( hRes = m_Pending.Serialize ( &rgbRecord ) ) ||
+			 FAILED ( hRes = Append ( rgbRecord ) ) )
+			return hRes;
+		m_rgSegments.push_back ( Segment );
+
+		for ( ULONG ulDoc = ulDocBase; ulDoc < m_rghDocs.size ( ); ulDoc++ )
+		{
+			if ( !m_rgfLive[ulDoc] && 0 == m_rgiDocs[m_rghDocs[ulDoc]] &&
+				 rghRemoved.end ( ) == std::find ( rghRemoved.begin ( ), rghRemoved.end ( ), m_rghDocs[ulDoc] ) )
+				rghRemoved.push_back ( m_rghDocs[ulDoc] );
+		}
+		if ( !rghRemoved.empty ( ) && FAILED ( hRes = AppendRemove ( rghRemoved ) ) )
+			return hRes;
+
+		m_Pending.Clear ( );
+	}
+
+	if ( !FlushViewOfFile ( m_pbView, (SIZE_T) Header ( ) -> cbUsed ) ||
+		 !FlushFileBuffers ( m_hFile ) )
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+
+	if ( m_rgSegments.size ( ) > SEARCH_MAX_SEGMENTS || m_rghDocs.size ( ) - m_cLive > m_cLive )
+		hRes = Compact ( );
+
+	return hRes;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Compact()
+|
+|	Purpose:	Rewrites the index as one segment of its live
+|				documents, renumbered in order, to a temporary file
+|				that then replaces the index file.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Compact ( void )
+{
+	HRESULT hRes = S_OK;
+	std::string sTempFile = m_sFile + ".tmp";
+	std::string sFile = m_sFile;
+	CIndexBuilder Merged;
+	std::vector<ULONG> rgulNewDoc ( m_rghDocs.size ( ), 0 );
+	std::vector<ULONG> rgulPositions;
+	std::string sKey;
+	CSearchIndex Compacted;
+
+	for ( ULONG ulDoc = 0; ulDoc < m_rghDocs.size ( ); ulDoc++ )
+	{
+		if ( m_rgfLive[ulDoc] )
+		{
+			rgulNewDoc[ulDoc] = Merged.DocCount ( );
+			Merged.AddDocument ( m_pMsgIDs -> Get ( m_rghDocs[ulDoc] ) );
+		}
+	}
+
+	// Segments hold increasing document numbers, so every key's postings
+	// are added in document order.
+	for ( size_t iSegment = 0; iSegment < m_rgSegments.size ( ); iSegment++ )
+	{
+		const SEGMENT &Segment = m_rgSegments[iSegment];
+		SEARCHRECORD *pRecord = Record ( Segment.ibRecord );
+		const SEARCHTERM *pTerm = (const SEARCHTERM *) ( (LPBYTE) pRecord + pRecord -> ibDict );
+		const BYTE *pbKeys = (LPBYTE) pRecord + pRecord -> ibKeys;
+		const BYTE *pbPostings = (LPBYTE) pRecord + pRecord -> ibPostings;
+
+		for ( ULONG iTerm = 0; iTerm < pRecord -> cTerms; iTerm++, pTerm++ )
+		{
+			SEARCHCURSOR Cursor;
+
+			Cursor.pbDocs = pbPostings + pTerm -> ibDocList;
+			Cursor.pbDocsEnd = Cursor.pbDocs + pTerm -> cbDocList;
+			Cursor.pbPositions = pbPostings + pTerm -> ibPositions;
+			Cursor.pbPositionsEnd = Cursor.pbPositions + pTerm -> cbPositions;
+			Cursor.ulNextDoc = 0;
+			sKey.assign ( (LPCSTR) pbKeys + pTerm -> ibKey, pTerm -> cchKey );
+
+			while ( CursorNext ( &Cursor, TRUE ) )
+			{
+				ULONG ulDoc = Segment.ulDocBase + Cursor.ulDoc;
+
+				if ( m_rgfLive[ulDoc] && !Cursor.rgulPositions.empty ( ) )
+					Merged.AddPostings ( sKey, rgulNewDoc[ulDoc], &Cursor.rgulPositions[0], (ULONG) Cursor.rgulPositions.size ( ) );
+			}
+		}
+	}
+
+	if ( m_Pending.DocCount ( ) )
+	{
+		ULONG ulDocBase = (ULONG) m_rghDocs.size ( ) - m_Pending.DocCount ( );
+
+		for ( auto it = m_Pending.Terms ( ).begin ( ); it != m_Pending.Terms ( ).end ( ); ++it )
+		{
+			SEARCHCURSOR Cursor;
+
+			Cursor.pbDocs = &it -> second.rgbDocs[0];
+			Cursor.pbDocsEnd = Cursor.pbDocs + it -> second.rgbDocs.size ( );
+			Cursor.pbPositions = it -> second.rgbPositions.empty ( ) ? NULL : &it -> second.rgbPositions[0];
+			Cursor.pbPositionsEnd = Cursor.pbPositions + it -> second.rgbPositions.size ( );
+			Cursor.ulNextDoc = 0;
+
+			while ( CursorNext ( &Cursor, TRUE ) )
+			{
+				ULONG ulDoc = ulDocBase + Cursor.ulDoc;
+
+				if ( m_rgfLive[ulDoc] && !Cursor.rgulPositions.empty ( ) )
+					Merged.AddPostings ( it -> first, rgulNewDoc[ulDoc], &Cursor.rgulPositions[0], (ULONG) Cursor.rgulPositions.size ( ) );
+			}
+		}
+	}
+
+	DeleteFile ( sTempFile.c_str ( ) );
+	if ( FAILED ( hRes = Compacted.Open ( sTempFile.c_str ( ), m_pMsgIDs ) ) )
+		return hRes;
+	if ( Merged.DocCount ( ) )
+	{
+		Compacted.m_Pending.Append ( Merged );
+		for ( ULONG ulDoc = 0; ulDoc < Merged.DocCount ( ); ulDoc++ )
+			Compacted.AddDoc ( m_pMsgIDs -> Find ( Merged.MsgID ( ulDoc ) ) );
+		hRes = Compacted.Flush ( );
+	}
+	Compacted.Close ( );
+
+	if ( FAILED ( hRes ) )
+	{
+		DeleteFile ( sTempFile.c_str ( ) );
+		return hRes;
+	}
+
+	// Everything pending is in the new file.
+	m_Pending.Clear ( );
+	Close ( );
+	if ( !MoveFileEx ( sTempFile.c_str ( ), sFile.c_str ( ), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+	{
+		DeleteFile ( sTempFile.c_str ( ) );
+		return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+	}
+
+	return Open ( sFile.c_str ( ), m_pMsgIDs );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Add()
+|
+|	Purpose:	Indexes a message, replacing what was indexed for it
+|				before. It can be found at once and is written to the
+|				file by the next Flush.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Add ( MSGIDHANDLE hMsgID, LPCSTR lpszSubject, LPCSTR lpszSenderName,
+							LPCSTR lpszSenderAddress, LPCSTR lpszBody )
+{
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	m_Pending.AddMessage ( m_pMsgIDs -> Get ( hMsgID ), lpszSubject, lpszSenderName, lpszSenderAddress, lpszBody );
+	AddDoc ( hMsgID );
+
+	if ( m_Pending.DocCount ( ) >= SEARCH_FLUSH_DOCS )
+		return Flush ( );
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	AddBuilder()
+|
+|	Purpose:	Indexes the messages of a builder filled elsewhere, as
+|				Add does for each.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::AddBuilder ( const CIndexBuilder &Builder )
+{
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	for ( ULONG ulDoc = 0; ulDoc < Builder.DocCount ( ); ulDoc++ )
+	{
+		MSGIDHANDLE hMsgID = m_pMsgIDs -> Intern ( Builder.MsgID ( ulDoc ) );
+
+		if ( MSGID_NONE == hMsgID )
+			return E_OUTOFMEMORY;
+		AddDoc ( hMsgID );
+	}
+	m_Pending.Append ( Builder );
+
+	if ( m_Pending.DocCount ( ) >= SEARCH_FLUSH_DOCS )
+		return Flush ( );
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Remove()
+|
+|	Purpose:	Drops messages from the index. Those already written
+|				are recorded at once; those still pending are recorded
+|				when they are written.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Remove ( const std::vector<MSGIDHANDLE> &rghMsgIDs )
+{
+	std::vector<MSGIDHANDLE> rghWritten;
+	ULONG ulPendingBase = (ULONG) m_rghDocs.size ( ) - m_Pending.DocCount ( );
+
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+
+	for ( size_t i = 0; i < rghMsgIDs.size ( ); i++ )
+	{
+		MSGIDHANDLE hMsgID = rghMsgIDs[i];
+
+		if ( hMsgID < m_rgiDocs.size ( ) && m_rgiDocs[hMsgID] )
+		{
+			ULONG ulDoc = m_rgiDocs[hMsgID] - 1;
+
+			KillDoc ( ulDoc );
+			m_rgiDocs[hMsgID] = 0;
+			if ( ulDoc < ulPendingBase )
+				rghWritten.push_back ( hMsgID );
+		}
+	}
+
+	if ( rghWritten.empty ( ) )
+		return S_OK;
+
+	return AppendRemove ( rghWritten );
+}
+
+BOOL CSearchIndex::IsIndexed ( MSGIDHANDLE hMsgID )
+{
+	return hMsgID < m_rgiDocs.size ( ) && m_rgiDocs[hMsgID];
+}
+
+void CSearchIndex::GetIndexed ( std::vector<MSGIDHANDLE> *prghMsgIDs )
+{
+	prghMsgIDs -> clear ( );
+	for ( MSGIDHANDLE hMsgID = 0; hMsgID < m_rgiDocs.size ( ); hMsgID++ )
+	{
+		if ( m_rgiDocs[hMsgID] )
+			prghMsgIDs -> push_back ( hMsgID );
+	}
+}
+
+void CSearchIndex::GetStats ( LPSEARCHSTATS lpStats )
+{
+	ZeroMemory ( lpStats, sizeof ( SEARCHSTATS ) );
+	lpStats -> cDocs = m_cLive;
+	lpStats -> cDeadDocs = (ULONG) m_rghDocs.size ( ) - m_cLive;
+	lpStats -> cSegments = (ULONG) m_rgSegments.size ( );
+	lpStats -> cPending = m_Pending.DocCount ( );
+	lpStats -> cbFile = m_pbView ? Header ( ) -> cbUsed : 0;
+}
+
+static bool SizeLess ( const std::vector<ULONG> &rgul1, const std::vector<ULONG> &rgul2 )
+{
+	return rgul1.size ( ) < rgul2.size ( );
+}
+
+// Binary search of a segment's dictionary.
+const SEARCHTERM *CSearchIndex::FindTerm ( const SEGMENT &Segment, const std::string &sKey )
+{
+	SEARCHRECORD *pRecord = Record ( Segment.ibRecord );
+	const SEARCHTERM *rgTerms = (const SEARCHTERM *) ( (LPBYTE) pRecord + pRecord -> ibDict );
+	LPCSTR lpszKeys = (LPCSTR) pRecord + pRecord -> ibKeys;
+	ULONG iLow = 0;
+	ULONG iHigh = pRecord -> cTerms;
+
+	while ( iLow < iHigh )
+	{
+		ULONG iMid = iLow + ( iHigh - iLow ) / 2;
+		const SEARCHTERM &Term = rgTerms[iMid];
+		size_t cch = min ( (size_t) Term.cchKey, sKey.size ( ) );
+		int nCompare = memcmp ( lpszKeys + Term.ibKey, sKey.c_str ( ), cch );
+
+		if ( 0 == nCompare )
+			nCompare = Term.cchKey < sKey.size ( ) ? -1 : Term.cchKey > sKey.size ( ) ? 1 : 0;
+		if ( 0 == nCompare )
+			return &Term;
+		if ( nCompare < 0 )
+			iLow = iMid + 1;
+		else
+			iHigh = iMid;
+	}
+
+	return NULL;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	MatchKey()
+|
+|	Purpose:	Adds to prgulDocs the live documents in which the keys
+|				occur one after the other, from every segment and the
+|				pending messages.
+|
++---------------------------------------------------------------------
+*/
+void CSearchIndex::MatchKey ( const std::vector<std::string> &rgsKeys, std::vector<ULONG> *prgulDocs )
+{
+	std::vector<SEARCHCURSOR> rgCursors ( rgsKeys.size ( ) );
+
+	for ( size_t iSegment = 0; iSegment < m_rgSegments.size ( ); iSegment++ )
+	{
+		const SEGMENT &Segment = m_rgSegments[iSegment];
+		SEARCHRECORD *pRecord = Record ( Segment.ibRecord );
+		const BYTE *pbPostings = (LPBYTE) pRecord + pRecord -> ibPostings;
+		BOOL fFound = TRUE;
+
+		for ( size_t i = 0; i < rgsKeys.size ( ) && fFound; i++ )
+		{
+			const SEARCHTERM *pTerm = FindTerm ( Segment, rgsKeys[i] );
+
+			if ( NULL == pTerm )
+			{
+				fFound = FALSE;
+				break;
+			}
+			rgCursors[i].pbDocs = pbPostings + pTerm -> ibDocList;
+			rgCursors[i].pbDocsEnd = rgCursors[i].pbDocs + pTerm -> cbDocList;
+			rgCursors[i].pbPositions = pbPostings + pTerm -> ibPositions;
+			rgCursors[i].pbPositionsEnd = rgCursors[i].pbPositions + pTerm -> cbPositions;
+			rgCursors[i].ulNextDoc = 0;
+		}
+		if ( fFound )
+			MatchCursors ( rgCursors, Segment.ulDocBase, m_rgfLive, prgulDocs );
+	}
+
+	if ( m_Pending.DocCount ( ) )
+	{
+		BOOL fFound = TRUE;
+
+		for ( size_t i = 0; i < rgsKeys.size ( ) && fFound; i++ )
+		{
+			const CIndexBuilder::POSTINGS *pPostings = m_Pending.Find ( rgsKeys[i] );
+
+			if ( NULL == pPostings )
+			{
+				fFound = FALSE;
+				break;
+			}
+			rgCursors[i].pbDocs = &pPostings -> rgbDocs[0];
+			rgCursors[i].pbDocsEnd = rgCursors[i].pbDocs + pPostings -> rgbDocs.size ( );
+			rgCursors[i].pbPositions = pPostings -> rgbPositions.empty ( ) ? NULL : &pPostings -> rgbPositions[0];
+			rgCursors[i].pbPositionsEnd = rgCursors[i].pbPositions + pPostings -> rgbPositions.size ( );
+			rgCursors[i].ulNextDoc = 0;
+		}
+		if ( fFound )
+			MatchCursors ( rgCursors, (ULONG) m_rghDocs.size ( ) - m_Pending.DocCount ( ), m_rgfLive, prgulDocs );
+	}
+}
+
+// Sorted live documents matching a word or phrase, in its field or any.
+void CSearchIndex::MatchUnit ( const QUERYUNIT &Unit, std::vector<ULONG> *prgulDocs )
+{
+	static const char rgchFields[] = { SEARCH_FIELD_SUBJECT, SEARCH_FIELD_SENDER, SEARCH_FIELD_BODY };
+	std::vector<std::string> rgsKeys ( Unit.rgsWords.size ( ) );
+
+	prgulDocs -> clear ( );
+
+	for ( size_t iField = 0; iField < _countof ( rgchFields ); iField++ )
+	{
+		if ( Unit.chField && Unit.chField != rgchFields[iField] )
+			continue;
+
+		for ( size_t i = 0; i < Unit.rgsWords.size ( ); i++ )
+			rgsKeys[i] = rgchFields[iField] + Unit.rgsWords[i];
+		MatchKey ( rgsKeys, prgulDocs );
+	}
+
+	if ( !Unit.chField )
+	{
+		std::sort ( prgulDocs -> begin ( ), prgulDocs -> end ( ) );
+		prgulDocs -> erase ( std::unique ( prgulDocs -> begin ( ), prgulDocs -> end ( ) ), prgulDocs -> end ( ) );
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Parse()
+|
+|	Purpose:	Splits a query into clauses that must all match, each
+|				a word or phrase or several joined by OR. A word that
+|				splits into more than one, such as e-mail, is taken as
+|				a phrase. Returns MAPI_E_INVALID_PARAMETER for a
+|				phrase without its closing quote or a query with
+|				nothing to search for.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Parse ( LPCSTR lpszQuery, std::vector<QUERYCLAUSE> *prgClauses )
+{
+	static const struct { LPCSTR lpszPrefix; char chField; } rgFields[] =
+	{
+		{ "subject:", SEARCH_FIELD_SUBJECT },
+		{ "from:", SEARCH_FIELD_SENDER },
+		{ "body:", SEARCH_FIELD_BODY }
+	};
+	LPCSTR lpsz = lpszQuery;
+	BOOL fOr = FALSE;
+	std::string sText;
+
+	prgClauses -> clear ( );
+
+	for ( ;; )
+	{
+		QUERYUNIT Unit;
+		BOOL fNegate = FALSE;
+
+		while ( ' ' == *lpsz || '\t' == *lpsz )
+			lpsz++;
+		if ( '\0' == *lpsz )
+			break;
+
+		if ( '-' == *lpsz )
+		{
+			fNegate = TRUE;
+			lpsz++;
+		}
+
+		Unit.chField = 0;
+		for ( size_t i = 0; i < _countof ( rgFields ); i++ )
+		{
+			size_t cch = strlen ( rgFields[i].lpszPrefix );
+
+			if ( 0 == _strnicmp ( lpsz, rgFields[i].lpszPrefix, cch ) )
+			{
+				Unit.chField = rgFields[i].chField;
+				lpsz += cch;
+				break;
+			}
+		}
+
+		if ( '"' == *lpsz )
+		{
+			LPCSTR lpszClose = strchr ( lpsz + 1, '"' );
+
+			if ( NULL == lpszClose )
+				return MAPI_E_INVALID_PARAMETER;
+			sText.assign ( lpsz + 1, lpszClose );
+			lpsz = lpszClose + 1;
+		}
+		else
+		{
+			LPCSTR lpszStart = lpsz;
+
+			while ( *lpsz && ' ' != *lpsz && '\t' != *lpsz )
+				lpsz++;
+			sText.assign ( lpszStart, lpsz );
+
+			if ( !fNegate && !Unit.chField && "OR" == sText )
+			{
+				fOr = TRUE;
+				continue;
+			}
+		}
+
+		CIndexBuilder::Tokenize ( sText.c_str ( ), &Unit.rgsWords );
+		if ( Unit.rgsWords.empty ( ) )
+			continue;
+
+		if ( fOr && !fNegate && !prgClauses -> empty ( ) && !prgClauses -> back ( ).fNegate )
+			prgClauses -> back ( ).rgUnits.push_back ( Unit );
+		else
+		{
+			QUERYCLAUSE Clause;
+
+			Clause.rgUnits.push_back ( Unit );
+			Clause.fNegate = fNegate;
+			prgClauses -> push_back ( Clause );
+		}
+		fOr = FALSE;
+	}
+
+	return prgClauses -> empty ( ) ? MAPI_E_INVALID_PARAMETER : S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Query()
+|
+|	Purpose:	Returns the messages matching a query (SrchIdx.h), in
+|				the order they were indexed. The clauses that must
+|				match are intersected smallest first; a query of only
+|				exclusions starts from every indexed message.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSearchIndex::Query ( LPCSTR lpszQuery, std::vector<MSGIDHANDLE> *prghMsgIDs )
+{
+	HRESULT hRes = S_OK;
+	std::vector<QUERYCLAUSE> rgClauses;
+	std::vector< std::vector<ULONG> > rgrgulMust;
+	std::vector< std::vector<ULONG> > rgrgulNot;
+	std::vector<ULONG> rgulResult;
+	std::vector<ULONG> rgulUnit;
+	std::vector<ULONG> rgulMerged;
+
+	prghMsgIDs -> clear ( );
+
+	if ( NULL == m_pbView )
+		return E_UNEXPECTED;
+	if ( FAILED ( hRes = Parse ( lpszQuery, &rgClauses ) ) )
+		return hRes;
+
+	for ( size_t iClause = 0; iClause < rgClauses.size ( ); iClause++ )
+	{
+		std::vector<ULONG> rgulClause;
+
+		for ( size_t iUnit = 0; iUnit < rgClauses[iClause].rgUnits.size ( ); iUnit++ )
+		{
+			MatchUnit ( rgClauses[iClause].rgUnits[iUnit], &rgulUnit );
+			rgulMerged.clear ( );
+			std::set_union ( rgulClause.begin ( ), rgulClause.end ( ), rgulUnit.begin ( ), rgulUnit.end ( ),
+							 std::back_inserter ( rgulMerged ) );
+			rgulClause.swap ( rgulMerged );
+		}
+
+		if ( rgClauses[iClause].fNegate )
+			rgrgulNot.push_back ( rgulClause );
+		else
+			rgrgulMust.push_back ( rgulClause );
+	}
+
+	if ( rgrgulMust.empty ( ) )
+	{
+		for ( ULONG ulDoc = 0; ulDoc < m_rghDocs.size ( ); ulDoc++ )
+		{
+			if ( m_rgfLive[ulDoc] )
+				rgulResult.push_back ( ulDoc );
+		}
+	}
+	else
+	{
+		std::sort ( rgrgulMust.begin ( ), rgrgulMust.end ( ), SizeLess );
+		rgulResult.swap ( rgrgulMust[0] );
+		for ( size_t i = 1; i < rgrgulMust.size ( ) && !rgulResult.empty ( ); i++ )
+		{
+			rgulMerged.clear ( );
+			std::set_intersection ( rgulResult.begin ( ), rgulResult.end ( ), rgrgulMust[i].begin ( ), rgrgulMust[i].end ( ),
+									std::back_inserter ( rgulMerged ) );
+			rgulResult.swap ( rgulMerged );
+		}
+	}
+
+	for ( size_t i = 0; i < rgrgulNot.size ( ) && !rgulResult.empty ( ); i++ )
+	{
+		rgulMerged.clear ( );
+		std::set_difference ( rgulResult.begin ( ), rgulResult.end ( ), rgrgulNot[i].begin ( ), rgrgulNot[i].end ( ),
+							  std::back_inserter ( rgulMerged ) );
+		rgulResult.swap ( rgulMerged );
+	}
+
+	prghMsgIDs -> reserve ( rgulResult.size ( ) );
+	for ( size_t i = 0; i < rgulResult.size ( ); i++ )
+		prghMsgIDs -> push_back ( m_rghDocs[rgulResult[i]] );
+
+	return S_OK;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cOpenSearchIndex ( )
+|
+|	Parameters:	[IN] lpszIndexFile == Index file, created if missing.
+|
+|	Purpose:	Opens the full-text index in place of any index this object
+|				already has open. Once it is open, every message whose text
+|				is read through this object is added to it.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cOpenSearchIndex ( LPCSTR lpszIndexFile )
+{
+	HRESULT hRes = S_OK;
+
+	if ( NULL == m_pSearchIndex )
+		m_pSearchIndex = new CSearchIndex;
+
+	if ( FAILED ( hRes = m_pSearchIndex -> Open ( lpszIndexFile, m_pMsgIDs ) ) )
+	{
+		delete m_pSearchIndex;
+		m_pSearchIndex = NULL;
+		return MAPI_E_FAILURE;
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cGetSearchIndexStats ( )
+|
+|	Parameters:	[OUT] lpStats == Receives the counts of the open index.
+|
+|	Purpose:	Reports the size of the search index. Returns
+|				MAPI_E_FAILURE if no index is open.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cGetSearchIndexStats ( LPSEARCHSTATS lpStats )
+{
+	if ( NULL == m_pSearchIndex )
+		return MAPI_E_FAILURE;
+
+	m_pSearchIndex -> GetStats ( lpStats );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cIndexMessage ( )
+|
+|	Parameters:	[IN] hMsgID == The message lpMessage was read from.
+|
+|				[IN] lpMessage == The message, read with its note text.
+|
+|	Purpose:	Adds a message that has just been read to the search index,
+|				if one is open and the message is not in it yet.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cIndexMessage ( MSGIDHANDLE hMsgID, lpMapiMessage lpMessage )
+{
+	lpMapiRecipDesc lpOriginator = NULL;
+
+	if ( NULL == m_pSearchIndex || NULL == lpMessage || MSGID_NONE == hMsgID ||
+		 m_pSearchIndex -> IsIndexed ( hMsgID ) )
+		return SUCCESS_SUCCESS;
+
+	lpOriginator = lpMessage -> lpOriginator;
+	if ( FAILED ( m_pSearchIndex -> Add ( hMsgID, lpMessage -> lpszSubject,
+										  lpOriginator ? lpOriginator -> lpszName : NULL,
+										  lpOriginator ? lpOriginator -> lpszAddress : NULL,
+										  lpMessage -> lpszNoteText ) ) )
+		return MAPI_E_FAILURE;
+
+	return SUCCESS_SUCCESS;
+}
+
+// State shared by the workers of cBuildSearchIndex.
+typedef struct _INDEXCONTEXT
+{
+	CApp						*pApp;
+	const std::vector<MSGIDHANDLE>	*prghMsgIDs;	// Messages to index
+	volatile LONG				iNext;				// Next of *prghMsgIDs to claim
+	volatile LONG				cSessions;			// Workers that logged on
+	std::vector<CIndexBuilder>	rgBuilders;			// By worker
+	std::vector<HRESULT>		rghRes;				// By worker; first read error
+} INDEXCONTEXT;
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	IndexWorker()
+|
+|	Purpose:	Logs on to a session of its own and claims messages one
+|				at a time, reading their text and adding them to the
+|				worker's builder. Messages deleted since the Inbox was
+|				walked are skipped.
+|
++---------------------------------------------------------------------
+*/
+static DWORD IndexWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	INDEXCONTEXT *pCtx = (INDEXCONTEXT *) lpvContext;
+	CIndexBuilder &Builder = pCtx -> rgBuilders[iWorker];
+	CApp Session;
+	HRESULT hRes = pCtx -> pApp -> cCloneSession ( &Session );
+	LONG iMsg = 0;
+
+	pCtx -> rghRes[iWorker] = hRes;
+	if ( SUCCESS_SUCCESS != hRes )
+		return hRes;
+	InterlockedIncrement ( &pCtx -> cSessions );
+
+	while ( ( iMsg = InterlockedIncrement ( &pCtx -> iNext ) - 1 ) < (LONG) pCtx -> prghMsgIDs -> size ( ) )
+	{
+		MSGIDHANDLE hMsgID = ( *pCtx -> prghMsgIDs )[iMsg];
+		lpMapiMessage lpMessage = NULL;
+		lpMapiRecipDesc lpOriginator = NULL;
+
+		hRes = Session.cReadMessage ( hMsgID, MAPI_PEEK | MAPI_SUPPRESS_ATTACH, &lpMessage );
+		if ( SUCCESS_SUCCESS != hRes )
+		{
+			if ( MAPI_E_INVALID_MESSAGE != hRes && SUCCESS_SUCCESS == pCtx -> rghRes[iWorker] )
+				pCtx -> rghRes[iWorker] = hRes;
+			continue;
+		}
+
+		lpOriginator = lpMessage -> lpOriginator;
+		Builder.AddMessage ( Session.cMsgIDText ( hMsgID ), lpMessage -> lpszSubject,
+							 lpOriginator ? lpOriginator -> lpszName : NULL,
+							 lpOriginator ? lpOriginator -> lpszAddress : NULL,
+							 lpMessage -> lpszNoteText );
+		Session.cFreeBuffer ( lpMessage );
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+// cEnumInboxHeaders callback that collects the message IDs of the Inbox.
+static BOOL IndexCollectMsgID ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	( (std::vector<MSGIDHANDLE> *) lpvContext ) -> push_back ( pHeader -> hMsgID );
+
+	return TRUE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cBuildSearchIndex ( )
+|
+|	Parameters:	[IN] cWorkers == Number of sessions reading messages.
+|
+|				[OUT] pcAdded == Receives the number of messages added;
+|				may be NULL.
+|
+|	Purpose:	Brings the search index up to date with the Inbox, opening
+|				szSEARCHINDEXFILE if no index is open. Messages that have
+|				left the Inbox are dropped. Those not yet indexed are read
+|				by cWorkers sessions, each building postings of its own in
+|				memory, and the postings are then joined and written.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cBuildSearchIndex ( ULONG cWorkers, ULONG *pcAdded )
+{
+	HRESULT hRes = S_OK;
+	std::vector<MSGIDHANDLE> rghInbox;
+	std::vector<MSGIDHANDLE> rghIndexed;
+	std::vector<MSGIDHANDLE> rghGone;
+	std::vector<MSGIDHANDLE> rghNew;
+	CWorkerThreads Workers;
+	INDEXCONTEXT Ctx;
+
+	if ( pcAdded )
+		*pcAdded = 0L;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( NULL == m_pSearchIndex && SUCCESS_SUCCESS != cOpenSearchIndex ( szSEARCHINDEXFILE ) )
+		return MAPI_E_FAILURE;
+
+	if ( SUCCESS_SUCCESS != ( hRes = cEnumInboxHeaders ( NULL, IndexCollectMsgID, &rghInbox ) ) )
+		return hRes;
+
+	std::sort ( rghInbox.begin ( ), rghInbox.end ( ) );
+	m_pSearchIndex -> GetIndexed ( &rghIndexed );
+	std::set_difference ( rghIndexed.begin ( ), rghIndexed.end ( ), rghInbox.begin ( ), rghInbox.end ( ),
+						  std::back_inserter ( rghGone ) );
+	if ( !rghGone.empty ( ) && FAILED ( m_pSearchIndex -> Remove ( rghGone ) ) )
+		return MAPI_E_FAILURE;
+
+	std::set_difference ( rghInbox.begin ( ), rghInbox.end ( ), rghIndexed.begin ( ), rghIndexed.end ( ),
+						  std::back_inserter ( rghNew ) );
+
+	if ( !rghNew.empty ( ) )
+	{
+		if ( 0 == cWorkers )
+			cWorkers = 1;
+		if ( cWorkers > rghNew.size ( ) )
+			cWorkers = (ULONG) rghNew.size ( );
+
+		Ctx.pApp = this;
+		Ctx.prghMsgIDs = &rghNew;
+		Ctx.iNext = 0;
+		Ctx.cSessions = 0;
+		Ctx.rgBuilders.resize ( cWorkers );
+		Ctx.rghRes.assign ( cWorkers, SUCCESS_SUCCESS );
+
+		if ( FAILED ( hRes = Workers.Start ( cWorkers, IndexWorker, &Ctx ) ) )
+		{
+			Workers.Join ( );
+			return MAPI_E_FAILURE;
+		}
+		Workers.Join ( );
+
+		if ( 0 == Ctx.cSessions )
+			return MAPI_E_LOGIN_FAILURE;
+
+		for ( ULONG i = 0; i < cWorkers; i++ )
+		{
+			if ( pcAdded )
+				*pcAdded += Ctx.rgBuilders[i].DocCount ( );
+			if ( FAILED ( m_pSearchIndex -> AddBuilder ( Ctx.rgBuilders[i] ) ) )
+				return MAPI_E_FAILURE;
+			Ctx.rgBuilders[i].Clear ( );
+		}
+	}
+
+	if ( FAILED ( m_pSearchIndex -> Flush ( ) ) )
+		return MAPI_E_FAILURE;
+
+	// Report a read error only if some messages could not be indexed.
+	for ( ULONG i = 0; i < Ctx.rghRes.size ( ); i++ )
+	{
+		if ( SUCCESS_SUCCESS != Ctx.rghRes[i] && MAPI_E_LOGIN_FAILURE != Ctx.rghRes[i] )
+			return Ctx.rghRes[i];
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSearchInbox ( )
+|
+|	Parameters:	[IN] lpszQuery == Words, "phrases", OR, -exclusions and
+|				subject:, from: or body: prefixes (SrchIdx.h).
+|
+|				[OUT] prghMsgIDs == Receives the matching messages.
+|
+|	Purpose:	Looks a query up in the search index, opening
+|				szSEARCHINDEXFILE if no index is open. Only messages that
+|				have been indexed are found. Returns MAPI_E_INVALID_PARAMETER
+|				for a query that cannot be parsed.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSearchInbox ( LPCSTR lpszQuery, std::vector<MSGIDHANDLE> *prghMsgIDs )
+{
+	HRESULT hRes = S_OK;
+
+	prghMsgIDs -> clear ( );
+
+	if ( NULL == m_pSearchIndex && SUCCESS_SUCCESS != cOpenSearchIndex ( szSEARCHINDEXFILE ) )
+		return MAPI_E_FAILURE;
+
+	hRes = m_pSearchIndex -> Query ( lpszQuery, prghMsgIDs );
+	if ( MAPI_E_INVALID_PARAMETER == hRes )
+		return hRes;
+	if ( FAILED ( hRes ) )
+		return MAPI_E_FAILURE;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSearchInboxMessages ( )
+|
+|	Purpose:	Asks the user for a query and prints the date, sender and
+|				subject of each message that matches it. Only the index is
+|				searched: messages read since it was last brought up to
+|				date are in it, and cIndexInboxMessages adds the rest.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSearchInboxMessages ( )
+{
+	HRESULT hRes = S_OK;
+	LPSTR lpszQuery = NULL;
+	std::vector<MSGIDHANDLE> rghMsgIDs;
+	SEARCHSTATS Stats;
+	DWORD dwStart = 0;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	if ( NULL == m_pSearchIndex && SUCCESS_SUCCESS != cOpenSearchIndex ( szSEARCHINDEXFILE ) )
+	{
+		printf ( "The search index could not be opened.\r\n" );
+		return MAPI_E_FAILURE;
+	}
+	cGetSearchIndexStats ( &Stats );
+	if ( 0 == Stats.cDocs )
+		printf ( "The search index is empty; update it ([25]) to search the whole Inbox.\r\n" );
+
+	if ( FAILED ( hRes = cCaptureText ( "Search for: ", &lpszQuery ) ) )
+		return hRes;
+
+	dwStart = GetTickCount ( );
+	hRes = cSearchInbox ( lpszQuery, &rghMsgIDs );
+	if ( SUCCESS_SUCCESS == hRes )
+	{
+		DWORD dwElapsed = GetTickCount ( ) - dwStart;
+
+		for ( size_t i = 0; i < rghMsgIDs.size ( ); i++ )
+		{
+			MSGHEADER Header;
+
+			if ( SUCCESS_SUCCESS == cReadHeader ( (LPSTR) cMsgIDText ( rghMsgIDs[i] ), &Header ) )
+				g_StdOut.Printf ( "%s  %-24.24s  %s\r\n", Header.szDateReceived, Header.sOriginator.c_str ( ),
+								  Header.sSubject.c_str ( ) );
+		}
+		g_StdOut.Flush ( );
+
+		printf ( "%lu matching messages in %lu ms.\r\n", (ULONG) rghMsgIDs.size ( ), dwElapsed );
+	}
+	else if ( MAPI_E_INVALID_PARAMETER == hRes )
+		printf ( "Enter words or \"phrases\", optionally joined by OR, preceded by - to exclude\r\n"
+				 "or by subject:, from: or body: to search one field.\r\n" );
+	else
+		printf ( "Search failed due to error code %d.\r\n", hRes );
+
+	cFreeBuffer ( lpszQuery );
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cIndexInboxMessages ( )
+|
+|	Purpose:	Brings the search index up to date with the Inbox on one
+|				session per processor and prints what it added and how
+|				long that took.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cIndexInboxMessages ( )
+{
+	HRESULT hRes = S_OK;
+	ULONG cAdded = 0L;
+	SEARCHSTATS Stats;
+	DWORD dwStart = 0;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	dwStart = GetTickCount ( );
+	if ( SUCCESS_SUCCESS != ( hRes = cBuildSearchIndex ( CWorkerThreads::ProcessorCount ( ), &cAdded ) ) )
+	{
+		printf ( "Indexing the Inbox failed due to error code %d.\r\n", hRes );
+		return hRes;
+	}
+
+	cGetSearchIndexStats ( &Stats );
+	printf ( "Indexed %lu new messages in %lu ms; %lu messages can be searched.\r\n",
+			 cAdded, GetTickCount ( ) - dwStart, Stats.cDocs );
+
+	return SUCCESS_SUCCESS;
+}
@@ -0,0 +1,219 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		SrchIdx.h
+|
+|   Purpose:	Declares CSearchIndex, the persistent full-text index of
+|				the Inbox, and CIndexBuilder, which turns messages into
+|				postings in memory.
+|
+|				Words are runs of letters and digits, lower-cased, and
+|				are indexed per field: subject, sender (name and
+|				address) and body. Every word of a field has a postings
+|				list of the documents it occurs in, each a gap from the
+|				document before and the word's count in the document,
+|				and beside it the word's positions in the field, also as
+|				gaps. Both are written as variable-length integers, so a
+|				query for a word reads only the document list and a
+|				phrase query reads the positions as well.
+|
+|				The index file is mapped, like the header cache, and
+|				holds a header and appended records. A segment record
+|				holds the message IDs of its documents, a dictionary of
+|				its words sorted for binary search and their postings.
+|				A remove record drops messages. A message indexed again
+|				is found through its newest document only. Messages are
+|				added in memory and written as a segment every
+|				SEARCH_FLUSH_DOCS messages or on Flush; once there are
+|				more than SEARCH_MAX_SEGMENTS segments, or removed
+|				documents outnumber live ones, the index is merged into
+|				one segment.
+|
+|				Queries are words and "quoted phrases". A message must
+|				match every one; words joined by OR match if either
+|				does, and a leading - excludes the messages that match.
+|				subject:, from: and body: limit a word or phrase to
+|				that field.
+|
+|				A CSearchIndex is not thread safe. A CIndexBuilder is
+|				used by one thread; builders made in parallel are
+|				joined with Append.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _SRCHIDX_H
+#define _SRCHIDX_H
+
+#include "swap.h"
+#include <unordered_map>
+
+#define SEARCH_MAGIC			0x58444953		// "SIDX"
+#define SEARCH_VERSION			1
+#define SEARCH_INITIAL_SIZE		( 1024 * 1024 )
+#define SEARCH_RECORD_SEGMENT	1
+#define SEARCH_RECORD_REMOVE	2
+#define SEARCH_MAX_TERM			32				// Longer words are indexed by their first 32 bytes
+#define SEARCH_FLUSH_DOCS		1024
+#define SEARCH_MAX_SEGMENTS		16
+
+// Field a word was found in, the first byte of its dictionary key.
+#define SEARCH_FIELD_SUBJECT	'S'
+#define SEARCH_FIELD_SENDER		'F'
+#define SEARCH_FIELD_BODY		'B'
+
+// First 64 bytes of the index file.
+typedef struct _SEARCHFILEHEADER
+{
+	ULONG		ulMagic;
+	ULONG		ulVersion;
+	ULONGLONG	cbUsed;			// Bytes in use, this header included
+	BYTE		rgbReserved[48];
+} SEARCHFILEHEADER;
+
+// Every record starts with this header. Offsets are from the start of the
+// record. A segment has cDocs NUL-terminated message IDs at ibDocs, cTerms
+// SEARCHTERMs at ibDict sorted by key, the keys at ibKeys and the postings
+// at ibPostings. A remove record has cDocs message IDs at ibDocs. Records
+// are padded to a multiple of 8 bytes.
+typedef struct _SEARCHRECORD
+{
+	ULONG		cbRecord;		// Whole record, padding included
+	ULONG		ulCheck;		// FNV-1a 32 of the bytes after this field
+	ULONG		ulKind;			// SEARCH_RECORD_SEGMENT or SEARCH_RECORD_REMOVE
+	ULONG		cDocs;
+	ULONG		cTerms;
+	ULONG		ibDocs;
+	ULONG		ibDict;
+	ULONG		ibKeys;
+	ULONG		ibPostings;
+	ULONG		ulReserved;
+} SEARCHRECORD;
+
+// Dictionary entry of a segment. Offsets are from the record's ibKeys and
+// ibPostings.
+typedef struct _SEARCHTERM
+{
+	ULONG		ibKey;
+	ULONG		cchKey;
+	ULONG		cDocs;
+	ULONG		ibDocList;
+	ULONG		cbDocList;
+	ULONG		ibPositions;
+	ULONG		cbPositions;
+	ULONG		ulReserved;
+} SEARCHTERM;
+
+class CIndexBuilder
+{
+public:
+	// Postings of one key. Documents are numbered from 0 in the builder.
+	typedef struct _POSTINGS
+	{
+		std::vector<BYTE>	rgbDocs;		// Per document: gap, count
+		std::vector<BYTE>	rgbPositions;	// Per document: count position gaps
+		ULONG				cDocs;
+		ULONG				ulNextDoc;		// Last document + 1; gaps are from here
+	} POSTINGS;
+
+	typedef std::unordered_map<std::string, POSTINGS> TERMMAP;
+
+private:
+	TERMMAP									m_Terms;
+	std::vector<std::string>				m_rgsMsgIDs;	// By document
+	std::unordered_map<std::string, std::vector<ULONG> >	m_DocTerms;		// Scratch for AddMessage
+
+	void	AddField ( char chField, LPCSTR lpszText, ULONG *pulPosition );
+
+public:
+	CIndexBuilder ( ) { }
+
+	void	AddMessage ( LPCSTR lpszMsgID, LPCSTR lpszSubject, LPCSTR lpszSenderName,
+						 LPCSTR lpszSenderAddress, LPCSTR lpszBody );
+	void	AddDocument ( LPCSTR lpszMsgID );
+	void	AddPostings ( const std::string &sKey, ULONG ulDoc, const ULONG *pulPositions, ULONG cPositions );
+	void	Append ( const CIndexBuilder &Other );
+	HRESULT	Serialize ( std::vector<BYTE> *prgbRecord ) const;
+	void	Clear ( void );
+
+	ULONG			DocCount ( void ) const { return (ULONG) m_rgsMsgIDs.size ( ); }
+	LPCSTR			MsgID ( ULONG ulDoc ) const { return m_rgsMsgIDs[ulDoc].c_str ( ); }
+	const POSTINGS	*Find ( const std::string &sKey ) const;
+	const TERMMAP	&Terms ( void ) const { return m_Terms; }
+
+	static void		Tokenize ( LPCSTR lpszText, std::vector<std::string> *prgsWords );
+};
+
+class CSearchIndex
+{
+private:
+	// A segment record in the mapping and the global document numbers it holds.
+	typedef struct _SEGMENT
+	{
+		ULONGLONG	ibRecord;
+		ULONG		ulDocBase;
+		ULONG		cDocs;
+	} SEGMENT;
+
+	// One word or phrase of a parsed query.
+	typedef struct _QUERYUNIT
+	{
+		char						chField;	// SEARCH_FIELD_ constant, or 0 for any field
+		std::vector<std::string>	rgsWords;
+	} QUERYUNIT;
+
+	// Units joined by OR. A negated clause excludes what it matches.
+	typedef struct _QUERYCLAUSE
+	{
+		std::vector<QUERYUNIT>	rgUnits;
+		BOOL					fNegate;
+	} QUERYCLAUSE;
+
+	CMsgIDTable				*m_pMsgIDs;
+	std::string				m_sFile;
+	HANDLE					m_hFile;
+	HANDLE					m_hMapping;
+	LPBYTE					m_pbView;
+	ULONGLONG				m_cbMapped;
+	std::vector<SEGMENT>	m_rgSegments;
+	std::vector<MSGIDHANDLE>	m_rghDocs;		// By document, written and pending
+	std::vector<BYTE>		m_rgfLive;			// By document
+	std::vector<ULONG>		m_rgiDocs;			// By MSGIDHANDLE; newest document + 1, 0 == none
+	ULONG					m_cLive;
+	CIndexBuilder			m_Pending;			// Documents from m_rghDocs.size ( ) - m_Pending.DocCount ( )
+
+	SEARCHFILEHEADER *Header ( void ) { return (SEARCHFILEHEADER *) m_pbView; }
+	SEARCHRECORD *Record ( ULONGLONG ib ) { return (SEARCHRECORD *) ( m_pbView + ib ); }
+
+	HRESULT	Map ( ULONGLONG cbSize );
+	void	Unmap ( void );
+	HRESULT	Reset ( void );
+	HRESULT	Load ( void );
+	HRESULT	Append ( const std::vector<BYTE> &rgbRecord );
+	HRESULT	AppendRemove ( const std::vector<MSGIDHANDLE> &rghMsgIDs );
+	HRESULT	Compact ( void );
+	void	AddDoc ( MSGIDHANDLE hMsgID );
+	void	KillDoc ( ULONG ulDoc );
+	const SEARCHTERM *FindTerm ( const SEGMENT &Segment, const std::string &sKey );
+	HRESULT	Parse ( LPCSTR lpszQuery, std::vector<QUERYCLAUSE> *prgClauses );
+	void	MatchUnit ( const QUERYUNIT &Unit, std::vector<ULONG> *prgulDocs );
+	void	MatchKey ( const std::vector<std::string> &rgsKeys, std::vector<ULONG> *prgulDocs );
+
+public:
+	CSearchIndex ( );
+	~CSearchIndex ( );
+
+	HRESULT		Open ( LPCSTR lpszFile, CMsgIDTable *pMsgIDs );
+	void		Close ( void );
+	HRESULT		Flush ( void );
+	HRESULT		Add ( MSGIDHANDLE hMsgID, LPCSTR lpszSubject, LPCSTR lpszSenderName,
+					  LPCSTR lpszSenderAddress, LPCSTR lpszBody );
+	HRESULT		AddBuilder ( const CIndexBuilder &Builder );
+	HRESULT		Remove ( const std::vector<MSGIDHANDLE> &rghMsgIDs );
+	BOOL		IsIndexed ( MSGIDHANDLE hMsgID );
+	void		GetIndexed ( std::vector<MSGIDHANDLE> *prghMsgIDs );
+	HRESULT		Query ( LPCSTR lpszQuery, std::vector<MSGIDHANDLE> *prghMsgIDs );
+	void		GetStats ( LPSEARCHSTATS lpStats );
+};
+
+#endif
@@ -0,0 +1,690 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		StandIn.cpp
+|
+|   Purpose:	Implementation of the in-process stand-in Simple MAPI
+|				provider. Messages are generated into an in-memory
+|				store by StandInCreateStore. Message IDs are long hex
+|				strings, like the entry IDs a real store returns with
+|				MAPI_LONG_MSGID, that end in the message's index.
+|
++---------------------------------------------------------------------
+*/
+
+#include "standin.h"
+#include "convtree.h"
+
+#define STANDIN_ID_PREFIX	"00000000A1B2C3D4E5F60718293A4B5C6D7E8F90ABCDEF0123456789FEDCBA9876543210"
+#define STANDIN_ID_DIGITS	8
+
+// One message held by the stand-in store.
+typedef struct _STANDINMSG
+{
+	std::string	sSubject;
+	std::string	sOriginatorName;
+	std::string	sOriginatorAddress;
+	std::string	sDateReceived;
+	std::string	sNoteText;
+	std::string	sConversationID;	// PR_CONVERSATION_INDEX in hex, or empty
+	FLAGS		flFlags;
+	BOOL		fDeleted;
+} STANDINMSG;
+
+// The store and its lock. Every entry point takes the lock, so any number
+// of sessions can use the store from different threads.
+class CStandInStore
+{
+public:
+	CRITICAL_SECTION			m_csLock;
+	std::vector<STANDINMSG>		m_Messages;
+	ULONG						m_ulCallLatency;	// Milliseconds added to every call
+	ULONG						m_ulReadLatency;	// Milliseconds added to MAPIReadMail
+	ULONG						m_cMaxRecips;		// Recipients per sent message; 0 for any number
+	LONG						m_lNextSession;
+	STANDINSTATS				m_Stats;
+
+	CStandInStore ( )
+	{
+		InitializeCriticalSection ( &m_csLock );
+		m_ulCallLatency = 0L;
+		m_ulReadLatency = 0L;
+		m_cMaxRecips = 0L;
+		m_lNextSession = 0L;
+		ZeroMemory ( &m_Stats, sizeof ( STANDINSTATS ) );
+	}
+
+	~CStandInStore ( )
+	{
+		DeleteCriticalSection ( &m_csLock );
+	}
+};
+
+static CStandInStore g_Store;
+
+static const char *g_rgszSenders[] = { "Alice Adams", "Bob Brown", "Carol Clark", "Dan Davis",
+									   "Erin Evans", "Frank Fisher", "Grace Green", "Henry Hill" };
+static const char *g_rgszTopics[]  = { "Quarterly report", "Build break", "Lunch on Friday",
+									   "Customer escalation", "Design review", "Travel plans",
+									   "Release notes", "Budget approval" };
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInWait()
+|
+|	Purpose:	Models the round-trip to a remote server by sleeping for
+|				the configured latency, plus ulExtraMs. Called outside
+|				the store lock so concurrent sessions overlap their waits.
+|
++---------------------------------------------------------------------
+*/
+static void StandInWait ( ULONG ulExtraMs = 0L )
+{
+	ULONG ulMs = g_Store.m_ulCallLatency + ulExtraMs;
+
+	if ( ulMs )
+		Sleep ( ulMs );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInIndexFromID()
+|
+|	Purpose:	Returns the store index encoded in a stand-in message ID,
+|				or -1 if the ID was not issued by this store.
+|
++---------------------------------------------------------------------
+*/
+static LONG StandInIndexFromID ( LPCSTR lpszMessageID )
+{
+	size_t cchPrefix = sizeof ( STANDIN_ID_PREFIX ) - 1;
+	ULONG ulIndex = 0L;
+
+	if ( NULL == lpszMessageID ||
+		 strlen ( lpszMessageID ) != cchPrefix + STANDIN_ID_DIGITS ||
+		 0 != strncmp ( lpszMessageID, STANDIN_ID_PREFIX, cchPrefix ) )
+		return -1;
+
+	ulIndex = strtoul ( lpszMessageID + cchPrefix, NULL, 16 );
+	if ( ulIndex >= g_Store.m_Messages.size ( ) )
+		return -1;
+
+	return (LONG) ulIndex;
+}
+
+static void StandInIDFromIndex ( ULONG ulIndex, LPSTR lpszMessageID )
+{
+	sprintf ( lpszMessageID, "%s%08lX", STANDIN_ID_PREFIX, ulIndex );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInConversationID()
+|
+|	Purpose:	Builds the hex conversation index of generated message
+|				ulIndex: a 22-byte header for the thread, the first
+|				message of every four, and a 5-byte block per reply.
+|				Every tenth thread, and the last message of every third,
+|				has none, so clients must fall back on the subject.
+|
++---------------------------------------------------------------------
+*/
+static void StandInConversationID ( ULONG ulIndex, std::string *psConversationID )
+{
+	static const char szHex[] = "0123456789ABCDEF";
+	ULONG ulThread = ulIndex / 4;
+	ULONG ulReply = ulIndex % 4;
+	ULONG ulSeed = ulThread * 2654435761UL + 1;
+	BYTE rgbIndex[CONV_ROOT_SIZE + 2 * CONV_BLOCK_SIZE];
+	ULONG cbIndex = CONV_ROOT_SIZE;
+
+	psConversationID -> clear ( );
+	if ( 9 == ulThread % 10 || ( 3 == ulReply && 2 == ulThread % 3 ) )
+		return;
+
+	// Reserved byte, five bytes of the thread's start time and a GUID.
+	rgbIndex[0] = 0x01;
+	for ( ULONG i = 1; i < 6; i++ )
+		rgbIndex[i] = (BYTE) ( ( ulThread * 4 ) >> ( 8 * ( 5 - i ) ) );
+	for ( ULONG i = 6; i < CONV_ROOT_SIZE; i++ )
+	{
+		ulSeed = ulSeed * 1103515245 + 12345;
+		rgbIndex[i] = (BYTE) ( ulSeed >> 16 );
+	}
+
+	// The first two replies answer the thread's first message; the third
+	// answers the first reply.
+	if ( ulReply )
+	{
+		ULONG rgulPath[2] = { 3 == ulReply ? 1 : ulReply, 3 };
+		ULONG cBlocks = 3 == ulReply ? 2 : 1;
+
+		for ( ULONG iBlock = 0; iBlock < cBlocks; iBlock++ )
+		{
+			ZeroMemory ( &rgbIndex[cbIndex], CONV_BLOCK_SIZE );
+			rgbIndex[cbIndex + 3] = (BYTE) rgulPath[iBlock];
+			cbIndex += CONV_BLOCK_SIZE;
+		}
+	}
+
+	for ( ULONG i = 0; i < cbIndex; i++ )
+	{
+		*psConversationID += szHex[rgbIndex[i] >> 4];
+		*psConversationID += szHex[rgbIndex[i] & 0x0F];
+	}
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInCreateStore()
+|
+|	Parameters:	[IN] cMessages == Number of messages to generate.
+|
+|	Purpose:	Replaces the store contents with cMessages generated
+|				messages, one minute apart, a third of them unread,
+|				in threads of four. The contents are deterministic so
+|				runs are comparable.
+|
++---------------------------------------------------------------------
+*/
+void StandInCreateStore ( ULONG cMessages )
+{
+	SYSTEMTIME stBase = { 2019, 1, 0, 1, 8, 0, 0, 0 };
+	ULARGE_INTEGER uliBase;
+	FILETIME ftBase;
+
+	SystemTimeToFileTime ( &stBase, &ftBase );
+	uliBase.LowPart = ftBase.dwLowDateTime;
+	uliBase.HighPart = ftBase.dwHighDateTime;
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+
+	g_Store.m_Messages.clear ( );
+	g_Store.m_Messages.resize ( cMessages );
+
+	for ( ULONG i = 0; i < cMessages; i++ )
+	{
+		STANDINMSG &Msg = g_Store.m_Messages[i];
+		ULARGE_INTEGER uliTime;
+		FILETIME ftTime;
+		SYSTEMTIME stTime;
+		char szText[128];
+		ULONG ulSender = ( i * 7 ) % _countof ( g_rgszSenders );
+		ULONG iRoot = i - i % 4;
+
+		// Messages come in threads of four: a message, two replies to it
+		// and a reply to the first reply.
+		sprintf ( szText, "%s #%lu", g_rgszTopics[( iRoot * 3 ) % _countof ( g_rgszTopics )], iRoot );
+		Msg.sSubject = szText;
+		if ( i != iRoot )
+			Msg.sSubject.insert ( 0, "RE: " );
+		StandInConversationID ( i, &Msg.sConversationID );
+
+		Msg.sOriginatorName = g_rgszSenders[ulSender];
+		Msg.sOriginatorAddress = g_rgszSenders[ulSender];
+		Msg.sOriginatorAddress.erase ( Msg.sOriginatorAddress.find ( ' ' ) );
+		Msg.sOriginatorAddress += "@example.com";
+
+		uliTime.QuadPart = uliBase.QuadPart + (ULONGLONG) i * 60 * 10000000;
+		ftTime.dwLowDateTime = uliTime.LowPart;
+		ftTime.dwHighDateTime = uliTime.HighPart;
+		FileTimeToSystemTime ( &ftTime, &stTime );
+		sprintf ( szText, "%04u/%02u/%02u %02u:%02u",
+				  stTime.wYear, stTime.wMonth, stTime.wDay, stTime.wHour, stTime.wMinute );
+		Msg.sDateReceived = szText;
+
+		// Bodies range from a few hundred bytes to about 8 KB.
+		Msg.sNoteText = "Hello,\r\n\r\n";
+		for ( ULONG j = 0; j < 4 + ( i * 13 ) % 120; j++ )
+			Msg.sNoteText += "This paragraph stands in for the body of a real message. ";
+		Msg.sNoteText += "\r\n\r\nRegards,\r\n";
+		Msg.sNoteText += Msg.sOriginatorName;
+
+		Msg.flFlags = ( i % 3 == 0 ) ? MAPI_UNREAD : 0L;
+		Msg.fDeleted = FALSE;
+	}
+
+	LeaveCriticalSection ( &g_Store.m_csLock );
+}
+
+void StandInSetLatency ( ULONG ulCallMs, ULONG ulReadMs )
+{
+	g_Store.m_ulCallLatency = ulCallMs;
+	g_Store.m_ulReadLatency = ulReadMs;
+}
+
+void StandInSetRecipientLimit ( ULONG cMaxRecips )
+{
+	g_Store.m_cMaxRecips = cMaxRecips;
+}
+
+void StandInGetStats ( LPSTANDINSTATS lpStats )
+{
+	EnterCriticalSection ( &g_Store.m_csLock );
+	*lpStats = g_Store.m_Stats;
+	LeaveCriticalSection ( &g_Store.m_csLock );
+}
+
+void StandInResetStats ( void )
+{
+	EnterCriticalSection ( &g_Store.m_csLock );
+	ZeroMemory ( &g_Store.m_Stats, sizeof ( STANDINSTATS ) );
+	LeaveCriticalSection ( &g_Store.m_csLock );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInCopyMessages()
+|
+|	Parameters:	[IN] ulEvery == Copy one message in this many.
+|
+|	Purpose:	Appends an exact copy of every ulEvery'th message in
+|				the store, as a careless import would, to give the
+|				duplicate scanner something to find.
+|
++---------------------------------------------------------------------
+*/
+void StandInCopyMessages ( ULONG ulEvery )
+{
+	EnterCriticalSection ( &g_Store.m_csLock );
+
+	for ( size_t i = 0, cMessages = g_Store.m_Messages.size ( ); ulEvery && i < cMessages; i += ulEvery )
+	{
+		if ( !g_Store.m_Messages[i].fDeleted )
+			g_Store.m_Messages.push_back ( STANDINMSG ( g_Store.m_Messages[i] ) );
+	}
+
+	LeaveCriticalSection ( &g_Store.m_csLock );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInLogon() / StandInLogoff()
+|
+|	Purpose:	Every logon returns a new session handle. No profile or
+|				password is required.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInLogon ( ULONG_PTR ulUIParam, LPSTR lpszProfileName, LPSTR lpszPassword,
+								FLAGS flFlags, ULONG ulReserved, LPLHANDLE lplhSession )
+{
+	StandInWait ( );
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+	g_Store.m_Stats.cLogon++;
+	*lplhSession = (LHANDLE) ++g_Store.m_lNextSession;
+	LeaveCriticalSection ( &g_Store.m_csLock );
+
+	return SUCCESS_SUCCESS;
+}
+
+ULONG FAR PASCAL StandInLogoff ( LHANDLE lhSession, ULONG_PTR ulUIParam, FLAGS flFlags, ULONG ulReserved )
+{
+	return lhSession ? SUCCESS_SUCCESS : MAPI_E_INVALID_SESSION;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInFindNext()
+|
+|	Purpose:	Returns the ID of the first message after the seed, in
+|				store order, that is not deleted and, with
+|				MAPI_UNREAD_ONLY, is unread. Store order is delivery
+|				order, so MAPI_GUARANTEE_FIFO is always honoured. A seed
+|				that was never issued or has been deleted fails with
+|				MAPI_E_INVALID_MESSAGE.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInFindNext ( LHANDLE lhSession, ULONG_PTR ulUIParam, LPSTR lpszMessageType,
+								   LPSTR lpszSeedMessageID, FLAGS flFlags, ULONG ulReserved,
+								   LPSTR lpszMessageID )
+{
+	ULONG ulResult = MAPI_E_NO_MESSAGES;
+	size_t iMsg = 0;
+
+	if ( !lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	StandInWait ( );
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+	g_Store.m_Stats.cFindNext++;
+
+	if ( lpszSeedMessageID && lpszSeedMessageID[0] )
+	{
+		LONG lSeed = StandInIndexFromID ( lpszSeedMessageID );
+
+		if ( lSeed < 0 || g_Store.m_Messages[lSeed].fDeleted )
+			ulResult = MAPI_E_INVALID_MESSAGE;
+		iMsg = (size_t) lSeed + 1;
+	}
+
+	if ( MAPI_E_INVALID_MESSAGE != ulResult )
+	{
+		for ( ; iMsg < g_Store.m_Messages.size ( ); iMsg++ )
+		{
+			const STANDINMSG &Msg = g_Store.m_Messages[iMsg];
+
+			if ( Msg.fDeleted )
+				continue;
+			if ( ( flFlags & MAPI_UNREAD_ONLY ) && !( Msg.flFlags & MAPI_UNREAD ) )
+				continue;
+
+			StandInIDFromIndex ( (ULONG) iMsg, lpszMessageID );
+			ulResult = SUCCESS_SUCCESS;
+			break;
+		}
+	}
+
+	LeaveCriticalSection ( &g_Store.m_csLock );
+
+	return ulResult;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInReadMail()
+|
+|	Purpose:	Returns a copy of a message in a single block freed by
+|				StandInFreeBuffer. MAPI_ENVELOPE_ONLY omits the note
+|				text. Unless MAPI_PEEK is set the message is marked read.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInReadMail ( LHANDLE lhSession, ULONG_PTR ulUIParam, LPSTR lpszMessageID,
+								   FLAGS flFlags, ULONG ulReserved, lpMapiMessage FAR *lppMessage )
+{
+	ULONG ulResult = SUCCESS_SUCCESS;
+	LONG lIndex = 0;
+
+	*lppMessage = NULL;
+
+	if ( !lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	StandInWait ( g_Store.m_ulReadLatency );
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+	g_Store.m_Stats.cReadMail++;
+
+	lIndex = StandInIndexFromID ( lpszMessageID );
+	if ( lIndex < 0 || g_Store.m_Messages[lIndex].fDeleted )
+	{
+		ulResult = MAPI_E_INVALID_MESSAGE;
+	}
+	else
+	{
+		STANDINMSG &Msg = g_Store.m_Messages[lIndex];
+		BOOL fBody = !( flFlags & MAPI_ENVELOPE_ONLY );
+		size_t cbBlock = sizeof ( MapiMessage ) + sizeof ( MapiRecipDesc ) +
+						 Msg.sSubject.size ( ) + 1 +
+						 Msg.sDateReceived.size ( ) + 1 +
+						 Msg.sOriginatorName.size ( ) + 1 +
+						 Msg.sOriginatorAddress.size ( ) + 1 +
+						 Msg.sConversationID.size ( ) + 1 +
+						 ( fBody ? Msg.sNoteText.size ( ) + 1 : 0 );
+		LPBYTE lpBlock = (LPBYTE) malloc ( cbBlock );
+
+		if ( NULL == lpBlock )
+		{
+			ulResult = MAPI_E_INSUFFICIENT_MEMORY;
+		}
+		else
+		{
+			lpMapiMessage lpMessage = (lpMapiMessage) lpBlock;
+			lpMapiRecipDesc lpOriginator = (lpMapiRecipDesc) ( lpMessage + 1 );
+			LPSTR lpszNext = (LPSTR) ( lpOriginator + 1 );
+
+			ZeroMemory ( lpMessage, sizeof ( MapiMessage ) );
+			ZeroMemory ( lpOriginator, sizeof ( MapiRecipDesc ) );
+
+			lpMessage -> lpszSubject = lpszNext;
+			strcpy ( lpszNext, Msg.sSubject.c_str ( ) );
+			lpszNext += Msg.sSubject.size ( ) + 1;
+
+			lpMessage -> lpszDateReceived = lpszNext;
+			strcpy ( lpszNext, Msg.sDateReceived.c_str ( ) );
+			lpszNext += Msg.sDateReceived.size ( ) + 1;
+
+			lpOriginator -> ulRecipClass = MAPI_ORIG;
+			lpOriginator -> lpszName = lpszNext;
+			strcpy ( lpszNext, Msg.sOriginatorName.c_str ( ) );
+			lpszNext += Msg.sOriginatorName.size ( ) + 1;
+
+			lpOriginator -> lpszAddress = lpszNext;
+			strcpy ( lpszNext, Msg.sOriginatorAddress.c_str ( ) );
+			lpszNext += Msg.sOriginatorAddress.size ( ) + 1;
+
+			if ( !Msg.sConversationID.empty ( ) )
+			{
+				lpMessage -> lpszConversationID = lpszNext;
+				strcpy ( lpszNext, Msg.sConversationID.c_str ( ) );
+			}
+			lpszNext += Msg.sConversationID.size ( ) + 1;
+
+			if ( fBody )
+			{
+				lpMessage -> lpszNoteText = lpszNext;
+				strcpy ( lpszNext, Msg.sNoteText.c_str ( ) );
+			}
+
+			lpMessage -> lpOriginator = lpOriginator;
+			lpMessage -> flFlags = Msg.flFlags;
+
+			if ( !( flFlags & MAPI_PEEK ) )
+				Msg.flFlags &= ~MAPI_UNREAD;
+
+			*lppMessage = lpMessage;
+		}
+	}
+
+	LeaveCriticalSection ( &g_Store.m_csLock );
+
+	return ulResult;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInSaveMail()
+|
+|	Purpose:	Appends a new message to the store, or replaces the
+|				subject and text of an existing one when lpszMessageID
+|				names it. The ID of the saved message is returned in
+|				lpszMessageID.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInSaveMail ( LHANDLE lhSession, ULONG_PTR ulUIParam, lpMapiMessage lpMessage,
+								   FLAGS flFlags, ULONG ulReserved, LPSTR lpszMessageID )
+{
+	ULONG ulResult = SUCCESS_SUCCESS;
+	LONG lIndex = -1;
+
+	if ( !lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	StandInWait ( );
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+	g_Store.m_Stats.cSaveMail++;
+
+	if ( lpszMessageID[0] )
+	{
+		lIndex = StandInIndexFromID ( lpszMessageID );
+		if ( lIndex < 0 || g_Store.m_Messages[lIndex].fDeleted )
+			ulResult = MAPI_E_INVALID_MESSAGE;
+	}
+	else
+	{
+		STANDINMSG Msg;
+
+		Msg.sOriginatorName = "Stand-in User";
+		Msg.sOriginatorAddress = "user@example.com";
+		Msg.sDateReceived = g_Store.m_Messages.empty ( ) ? "2019/01/01 08:00"
+														 : g_Store.m_Messages.back ( ).sDateReceived;
+		Msg.flFlags = MAPI_UNREAD;
+		Msg.fDeleted = FALSE;
+
+		lIndex = (LONG) g_Store.m_Messages.size ( );
+		g_Store.m_Messages.push_back ( Msg );
+	}
+
+	if ( SUCCESS_SUCCESS == ulResult )
+	{
+		STANDINMSG &Msg = g_Store.m_Messages[lIndex];
+
+		Msg.sSubject = lpMessage -> lpszSubject ? lpMessage -> lpszSubject : "";
+		Msg.sNoteText = lpMessage -> lpszNoteText ? lpMessage -> lpszNoteText : "";
+		Msg.sConversationID = lpMessage -> lpszConversationID ? lpMessage -> lpszConversationID : "";
+		StandInIDFromIndex ( (ULONG) lIndex, lpszMessageID );
+	}
+
+	LeaveCriticalSection ( &g_Store.m_csLock );
+
+	return ulResult;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInDeleteMail()
+|
+|	Purpose:	Marks a message deleted. Its index is not reused, so
+|				the IDs of the other messages stay valid.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInDeleteMail ( LHANDLE lhSession, ULONG_PTR ulUIParam, LPSTR lpszMessageID,
+									 FLAGS flFlags, ULONG ulReserved )
+{
+	ULONG ulResult = SUCCESS_SUCCESS;
+	LONG lIndex = -1;
+
+	if ( !lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	StandInWait ( );
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+	g_Store.m_Stats.cDeleteMail++;
+
+	lIndex = StandInIndexFromID ( lpszMessageID );
+	if ( lIndex < 0 || g_Store.m_Messages[lIndex].fDeleted )
+		ulResult = MAPI_E_INVALID_MESSAGE;
+	else
+		g_Store.m_Messages[lIndex].fDeleted = TRUE;
+
+	LeaveCriticalSection ( &g_Store.m_csLock );
+
+	return ulResult;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInSendMail()
+|
+|	Purpose:	Accepts any message with at least one recipient, no
+|				more than the limit of StandInSetRecipientLimit and
+|				attachments that exist. Sent messages are counted but
+|				not stored.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInSendMail ( LHANDLE lhSession, ULONG_PTR ulUIParam, lpMapiMessage lpMessage,
+								   FLAGS flFlags, ULONG ulReserved )
+{
+	if ( !lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	StandInWait ( );
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+	g_Store.m_Stats.cSendMail++;
+	LeaveCriticalSection ( &g_Store.m_csLock );
+
+	if ( 0 == lpMessage -> nRecipCount || NULL == lpMessage -> lpRecips )
+		return MAPI_E_INVALID_RECIPS;
+	if ( g_Store.m_cMaxRecips && lpMessage -> nRecipCount > g_Store.m_cMaxRecips )
+		return MAPI_E_TOO_MANY_RECIPIENTS;
+	for ( ULONG i = 0; i < lpMessage -> nFileCount; i++ )
+	{
+		if ( NULL == lpMessage -> lpFiles[i].lpszPathName ||
+			 INVALID_FILE_ATTRIBUTES == GetFileAttributes ( lpMessage -> lpFiles[i].lpszPathName ) )
+			return MAPI_E_ATTACHMENT_NOT_FOUND;
+	}
+
+	EnterCriticalSection ( &g_Store.m_csLock );
+	g_Store.m_Stats.cSentRecips += (LONG) lpMessage -> nRecipCount;
+	LeaveCriticalSection ( &g_Store.m_csLock );
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInResolveName()
+|
+|	Purpose:	Resolves any name to a recipient whose display name and
+|				address are both the name given.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInResolveName ( LHANDLE lhSession, ULONG_PTR ulUIParam, LPSTR lpszName,
+									  FLAGS flFlags, ULONG ulReserved, lpMapiRecipDesc FAR *lppRecip )
+{
+	size_t cchName = 0;
+	lpMapiRecipDesc lpRecip = NULL;
+
+	*lppRecip = NULL;
+
+	if ( !lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( NULL == lpszName || '\0' == lpszName[0] )
+		return MAPI_E_UNKNOWN_RECIPIENT;
+
+	StandInWait ( );
+
+	cchName = strlen ( lpszName );
+	lpRecip = (lpMapiRecipDesc) malloc ( sizeof ( MapiRecipDesc ) + cchName + 1 );
+	if ( NULL == lpRecip )
+		return MAPI_E_INSUFFICIENT_MEMORY;
+
+	ZeroMemory ( lpRecip, sizeof ( MapiRecipDesc ) );
+	lpRecip -> ulRecipClass = MAPI_TO;
+	lpRecip -> lpszName = (LPSTR) ( lpRecip + 1 );
+	lpRecip -> lpszAddress = lpRecip -> lpszName;
+	strcpy ( lpRecip -> lpszName, lpszName );
+
+	*lppRecip = lpRecip;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	StandInFreeBuffer()
+|
+|	Purpose:	Frees a block returned by any stand-in entry point.
+|
++---------------------------------------------------------------------
+*/
+ULONG FAR PASCAL StandInFreeBuffer ( LPVOID pv )
+{
+	free ( pv );
+
+	return SUCCESS_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		StandIn.h
+|
+|   Purpose:	Declares the in-process stand-in Simple MAPI provider.
+|				The stand-in functions have the same signatures as the
+|				MAPI32.DLL entry points so CApp can bind them in place
+|				of the real provider (see CApp::cInitStandIn). The
+|				store is generated in memory, is safe to use from
+|				several sessions at once and can inject a fixed latency
+|				into every call, plus an extra one into MAPIReadMail,
+|				to model a remote server. It can also refuse messages
+|				with more recipients than a limit, as servers do.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _STANDIN_H
+#define _STANDIN_H
+
+#include "swap.h"
+
+// Number of calls made to each stand-in entry point since the last
+// StandInResetStats.
+typedef struct _STANDINSTATS
+{
+	LONG	cLogon;
+	LONG	cFindNext;
+	LONG	cReadMail;
+	LONG	cSaveMail;
+	LONG	cSendMail;
+	LONG	cDeleteMail;
+	LONG	cSentRecips;		// Recipients of the messages sent
+} STANDINSTATS, *LPSTANDINSTATS;
+
+/* Store control */
+
+void StandInCreateStore		( ULONG cMessages );
+void StandInSetLatency		( ULONG ulCallMs, ULONG ulReadMs );
+void StandInSetRecipientLimit ( ULONG cMaxRecips );
+void StandInGetStats		( LPSTANDINSTATS lpStats );
+void StandInResetStats		( void );
+void StandInCopyMessages	( ULONG ulEvery );
+
+/* Simple MAPI entry points */
+
+MAPILOGON			StandInLogon;
+MAPILOGOFF			StandInLogoff;
+MAPISENDMAIL		StandInSendMail;
+MAPIFINDNEXT		StandInFindNext;
+MAPIREADMAIL		StandInReadMail;
+MAPISAVEMAIL		StandInSaveMail;
+MAPIDELETEMAIL		StandInDeleteMail;
+MAPIRESOLVENAME		StandInResolveName;
+
+ULONG FAR PASCAL StandInFreeBuffer ( LPVOID pv );
+
+#endif
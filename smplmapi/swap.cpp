@@ -19,6 +19,21 @@
 */
 
 #include "swap.h"
+#include "standin.h"
+#include "hdrcache.h"
+#include "inboxtbl.h"
+#include "msgidtbl.h"
+#include "output.h"
+#include "readahead.h"
+#include "message.h"
+#include "bodycache.h"
+#include "srchidx.h"
+#include "convtree.h"
+#include "outbox.h"
+#include "attach.h"
+#include "rtfcomp.h"
+#include "workpool.h"
+#include <algorithm>
 
 
 CApp::CApp ( ) 
@@ -35,10 +50,67 @@ CApp::CApp ( )
 	m_MAPISendDocuments	= NULL;
 	m_MAPISendMail		= NULL;
 	m_MAPISaveMail		= NULL;
+	m_MAPIDeleteMail	= NULL;
+	m_MAPIInitialize	= NULL;
+	m_MAPIUninitialize	= NULL;
+	m_MAPILogonEx		= NULL;
+	m_fClone			= FALSE;
+	m_szProfileName[0]	= '\0';
+	m_pHeaderCache		= NULL;
+	m_pInboxTable		= NULL;
+	m_fNoInboxTable		= FALSE;
+	m_fInboxIDsChecked	= FALSE;
+	m_pMsgIDs			= new CMsgIDTable;
+	m_fOwnMsgIDs		= TRUE;
+	m_pReadAhead		= NULL;
+	m_cReadAhead		= READAHEAD_WINDOW;
+	m_hUnreadSeed		= MSGID_NONE;
+	m_fUnreadWrapped	= FALSE;
+	m_dwReadMarkFirst	= 0L;
+	m_cReadMarkBatch	= READMARK_BATCH;
+	m_ulReadMarkInterval	= READMARK_INTERVAL;
+	m_cRecipLimit		= RECIPIENT_LIMIT;
+	m_pBodyCache		= NULL;
+	m_cbBodyCache		= BODYCACHE_BUDGET;
+	m_pSearchIndex		= NULL;
+	m_pConversations	= NULL;
+	m_pOutbox			= NULL;
+	m_pAttachCache		= NULL;
+	m_pSessionPool		= NULL;
 }
 
 CApp::~CApp ( ) 
 {
+	// The read-ahead worker marks what was read before its session goes.
+	delete m_pReadAhead;
+	m_pReadAhead		= NULL;
+	delete m_pOutbox;
+	m_pOutbox			= NULL;
+	delete m_pSessionPool;
+	m_pSessionPool		= NULL;
+	if ( m_lhSession )
+		cFlushReadMarks ( );
+
+	// Sessions opened by cCloneSession belong to this object.
+	if ( m_fClone && m_lhSession )
+		m_MAPILogoff ( m_lhSession, 0L, 0L, 0L );
+
+	delete m_pHeaderCache;
+	m_pHeaderCache		= NULL;
+	delete m_pInboxTable;
+	m_pInboxTable		= NULL;
+	delete m_pBodyCache;
+	m_pBodyCache		= NULL;
+	delete m_pSearchIndex;
+	m_pSearchIndex		= NULL;
+	delete m_pConversations;
+	m_pConversations	= NULL;
+	delete m_pAttachCache;
+	m_pAttachCache		= NULL;
+	if ( m_fOwnMsgIDs )
+		delete m_pMsgIDs;
+	m_pMsgIDs			= NULL;
+
 	m_lhSession			= 0L;
 	m_MAPIAddress		= NULL;
 	m_MAPIDetails		= NULL;
@@ -51,6 +123,7 @@ CApp::~CApp ( )
 	m_MAPISendDocuments = NULL;
 	m_MAPISendMail		= NULL;
 	m_MAPISaveMail		= NULL;
+	m_MAPIDeleteMail	= NULL;
 }
 
 /*
@@ -163,9 +236,8 @@ STDMETHODIMP CApp::cAddress ( ULONG *pcOutRecips, lpMapiRecipDesc *ppOutRecips )
 |
 |	Parameters:	[IN] lpszPrompt == Text that user will see printed to console
 |
-|				[OUT] lpszTextOut == Buffer for text captured by console. The
-|				Maximum character length permitted by this function is 
-|				MAX_TEXT_LENGTH
+|				[OUT] lpszTextOut == Buffer for text captured by console, of
+|				whatever length the user typed.
 |
 |	Purpose:	Generic text retrieval function. User supplies prompt and 
 |				buffer for text storage. Users of this function must free
@@ -174,19 +246,30 @@ STDMETHODIMP CApp::cAddress ( ULONG *pcOutRecips, lpMapiRecipDesc *ppOutRecips )
 |
 +------------------------------------------------------------------------------
 */
-STDMETHODIMP CApp::cCaptureText(LPSTR lpszPrompt, LPSTR *lpszTextOut )
+STDMETHODIMP CApp::cCaptureText(LPCSTR lpszPrompt, LPSTR *lpszTextOut )
 {
 
 	// Any user of this method MUST release the lpszTextOut buffer
 	// when done with it using MAPIFreeBuffer or cFreeBuffer.
 
 	HRESULT hRes = S_OK;
-	char lpszTextIn[MAX_TEXT_LENGTH];
+	std::string sTextIn;
+	int chIn = 0;
 	BOOL HadToForceInit = FALSE;
 
-	// Prompt the user and capture text from console
+	// Prompt the user and capture text from console. Leading white space,
+	// including empty lines, is skipped; the rest of the line may be of any
+	// length, such as a long path.
 	printf ( lpszPrompt );
-	scanf ( "\n%[^\n]", lpszTextIn );
+	while ( EOF != ( chIn = getchar ( ) ) && isspace ( chIn ) )
+		;
+	while ( EOF != chIn && '\n' != chIn )
+	{
+		sTextIn += (char) chIn;
+		chIn = getchar ( );
+	}
+	if ( !sTextIn.empty ( ) && '\r' == sTextIn[sTextIn.size ( ) - 1] )
+		sTextIn.erase ( sTextIn.size ( ) - 1 );
 
 	// If not logged on, call MAPIInitialize so allocation will succeed.
 	if ( MAPI_E_INVALID_SESSION == cValidateSession ( ) )
@@ -196,8 +279,8 @@ STDMETHODIMP CApp::cCaptureText(LPSTR lpszPrompt, LPSTR *lpszTextOut )
 	}
 	
 	// Allocate buffer and set out parameter accordingly
-	if ( SUCCEEDED ( hRes = MAPIAllocateBuffer ( strlen ( lpszTextIn ) + 1, ( LPVOID * ) lpszTextOut ) ) )		
-		strcpy ( *lpszTextOut, lpszTextIn );
+	if ( SUCCEEDED ( hRes = MAPIAllocateBuffer ( (ULONG) sTextIn.size ( ) + 1, ( LPVOID * ) lpszTextOut ) ) )		
+		strcpy ( *lpszTextOut, sTextIn.c_str ( ) );
 
 	// If we had to force initialization, uninitialize MAPI.
 	if ( HadToForceInit )
@@ -209,6 +292,96 @@ STDMETHODIMP CApp::cCaptureText(LPSTR lpszPrompt, LPSTR *lpszTextOut )
 
 
 
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cCloneSession()
+|
+|	Parameters:	[OUT] pClone == Object to bind to this object's provider.
+|
+|	Purpose:	Logs pClone on to a new session of the provider this object
+|				uses, with the profile given to cLogon and without UI. The
+|				clone logs itself off when it is destroyed. Used to give
+|				each worker thread a session of its own.
+|
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cCloneSession ( CApp *pClone )
+{
+	HRESULT hRes = S_OK;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	// The clone shares this object's message ID table, so the handles in
+	// the headers it reads mean the same here.
+	if ( pClone -> m_fOwnMsgIDs )
+		delete pClone -> m_pMsgIDs;
+
+	*pClone = *this;
+	pClone -> m_lhSession = 0L;
+	pClone -> m_fClone = TRUE;
+	pClone -> m_fOwnMsgIDs = FALSE;
+	pClone -> m_pHeaderCache = NULL;
+	pClone -> m_pInboxTable = NULL;
+	pClone -> m_pReadAhead = NULL;
+	pClone -> m_cReadAhead = 0L;
+	pClone -> m_hUnreadSeed = MSGID_NONE;
+	pClone -> m_fUnreadWrapped = FALSE;
+	pClone -> m_rghReadMarks.clear ( );
+	pClone -> m_cReadMarkBatch = 0L;
+	pClone -> m_pBodyCache = NULL;
+	pClone -> m_cbBodyCache = 0L;
+	pClone -> m_pSearchIndex = NULL;
+	pClone -> m_pConversations = NULL;
+	pClone -> m_pOutbox = NULL;
+	pClone -> m_pAttachCache = NULL;
+	pClone -> m_pSessionPool = NULL;
+
+	hRes = m_MAPILogon ( 0L,
+						 m_szProfileName[0] ? m_szProfileName : NULL,
+						 NULL,
+						 MAPI_NEW_SESSION,
+						 0L,
+						 &pClone -> m_lhSession );
+
+	if ( SUCCESS_SUCCESS != hRes )
+		pClone -> m_lhSession = 0L;
+
+	return hRes;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cCloneScanSession()
+|
+|	Parameters:	[OUT] pClone == Object to bind to this object's provider.
+|
+|	Purpose:	Clones the session as cCloneSession does, but gives the
+|				clone a message ID table of its own. A walk of the whole
+|				Inbox on the clone interns every ID there, and they are
+|				freed with the clone instead of staying in this object's
+|				table for the rest of the session. Handles of the clone
+|				mean nothing here; cMsgIDText on the clone gives the text.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cCloneScanSession ( CApp *pClone )
+{
+	HRESULT hRes = S_OK;
+
+	if ( SUCCESS_SUCCESS != ( hRes = cCloneSession ( pClone ) ) )
+		return hRes;
+
+	pClone -> m_pMsgIDs = new CMsgIDTable;
+	pClone -> m_fOwnMsgIDs = TRUE;
+
+	return SUCCESS_SUCCESS;
+}
+
+
+
+
 /*
 +------------------------------------------------------------------------------
 |
@@ -307,6 +480,201 @@ STDMETHODIMP CApp::cCreateMessage( FLAGS flFlags, lpMapiMessage *lppMessage, LPT
 
 
 
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cEnumInboxHeaders ( )
+|
+|	Parameters:	[IN] lpszSeedMsgID == Message to continue after, or NULL or
+|				an empty string to start at the first message in the Inbox.
+|				Passing the ID of the last header seen resumes an earlier
+|				enumeration that was stopped.
+|
+|				[IN] lpfnCallback == Called with each header in delivery
+|				order. Returns FALSE to stop the enumeration.
+|
+|				[IN] lpvContext == Passed through to lpfnCallback.
+|
+|	Purpose:	Hands each Inbox header to lpfnCallback as it is read. Headers
+|				are not accumulated, only the handles of their message IDs.
+|				From the start of the Inbox, headers come from the Extended
+|				MAPI contents table (InboxTbl.h) when the provider has one.
+|				Otherwise envelopes are read by PREFETCH_WORKERS sessions
+|				through cEnumInboxHeadersParallel, or HEADER_BATCH_SIZE at a
+|				time on this session if no extra session can be opened. If
+|				the message the walk would continue after is deleted
+|				meanwhile, it starts again from the top of the Inbox without
+|				handing any header over twice.
+|				Returns SUCCESS_SUCCESS once every message has been
+|				enumerated and MAPI_USER_ABORT if the callback stopped it.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cEnumInboxHeaders ( LPCSTR lpszSeedMsgID, LPHEADERCALLBACK lpfnCallback, LPVOID lpvContext )
+{
+	HRESULT hRes = S_OK;
+	char szSeedMsgID[MAX_MSGID] = {0};
+	MSGHEADERLIST Headers;
+	std::vector<MSGIDHANDLE> rghSeen;
+	size_t cSorted = 0;
+	std::string sRestartSeed;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	// A contents table cannot continue after a seed, so only a walk from
+	// the start of the Inbox can use it. If it fails before handing over a
+	// header, the Simple MAPI paths below still can.
+	if ( ( NULL == lpszSeedMsgID || '\0' == lpszSeedMsgID[0] ) &&
+		 SUCCESS_SUCCESS == cOpenInboxTable ( ) )
+	{
+		ULONG cRows = 0L;
+
+		hRes = m_pInboxTable -> Enum ( NULL, lpfnCallback, lpvContext, &cRows );
+		if ( SUCCESS_SUCCESS == hRes || MAPI_USER_ABORT == hRes || cRows )
+			return hRes;
+	}
+
+	hRes = cEnumInboxHeadersParallel ( PREFETCH_WORKERS, lpszSeedMsgID, lpfnCallback, lpvContext );
+	if ( MAPI_E_LOGIN_FAILURE != hRes )
+		return hRes;
+
+	if ( lpszSeedMsgID )
+	{
+		strncpy ( szSeedMsgID, lpszSeedMsgID, MAX_MSGID - 1 );
+		szSeedMsgID[MAX_MSGID - 1] = '\0';
+	}
+
+	for ( ;; )
+	{
+		while ( SUCCESS_SUCCESS == ( hRes = cFetchInboxHeaders ( szSeedMsgID, HEADER_BATCH_SIZE, &Headers ) ) )
+		{
+			for ( size_t i = 0; i < Headers.size ( ); i++ )
+			{
+				if ( cSorted && std::binary_search ( rghSeen.begin ( ), rghSeen.begin ( ) + cSorted, Headers[i].hMsgID ) )
+					continue;
+				if ( !lpfnCallback ( &Headers[i], lpvContext ) )
+					return MAPI_USER_ABORT;
+				rghSeen.push_back ( Headers[i].hMsgID );
+			}
+			Headers.clear ( );
+		}
+
+		// The last message handed over has been deleted, so there is no
+		// position to continue from. Start again from the top of the Inbox
+		// and pass over the messages already handed over. The same seed
+		// failing twice is not a deletion, so that ends the walk.
+		if ( MAPI_E_INVALID_MESSAGE != hRes || '\0' == szSeedMsgID[0] || sRestartSeed == szSeedMsgID )
+			break;
+
+		sRestartSeed = szSeedMsgID;
+		szSeedMsgID[0] = '\0';
+		std::sort ( rghSeen.begin ( ), rghSeen.end ( ) );
+		cSorted = rghSeen.size ( );
+	}
+
+	if ( MAPI_E_NO_MESSAGES == hRes )
+		hRes = SUCCESS_SUCCESS;
+
+	return hRes;
+}
+
+
+
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cFetchInboxHeaders ( )
+|
+|	Parameters:	[IN/OUT] lpszSeedMsgID == Buffer of MAX_MSGID characters
+|				holding the ID of the last message already returned. An
+|				empty string starts at the first message in the Inbox. On
+|				return it holds the ID of the last message fetched so the
+|				next call continues where this one stopped.
+|
+|				[IN] cMaxHeaders == Maximum number of headers to fetch.
+|
+|				[OUT] pHeaders == List the new header records are appended to.
+|
+|	Purpose:	Fetches up to cMaxHeaders envelopes from the Inbox in
+|				delivery order without marking them read. With a contents
+|				table (InboxTbl.h) the whole batch is one QueryRows, which
+|				goes on from the last row the previous call returned.
+|				Otherwise each message costs a MAPIFindNext and a
+|				MAPIReadMail. Returns SUCCESS_SUCCESS if at least one
+|				header was appended, MAPI_E_NO_MESSAGES once the Inbox is
+|				exhausted and MAPI_E_INVALID_MESSAGE if the seed message
+|				has been deleted, in which case the caller starts again
+|				from an empty seed.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cFetchInboxHeaders ( LPSTR lpszSeedMsgID, ULONG cMaxHeaders, MSGHEADERLIST *pHeaders )
+{
+	HRESULT hRes = S_OK;
+	ULONG cFetched = 0L;
+	char szMsgID[MAX_MSGID];
+	std::string sSkipped;
+	MSGHEADER Header;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	// The table can only go on from where it stopped, so any other seed, or
+	// a table that fails, falls back to Simple MAPI.
+	if ( SUCCESS_SUCCESS == cOpenInboxTable ( ) )
+	{
+		hRes = m_pInboxTable -> Fetch ( lpszSeedMsgID, cMaxHeaders, pHeaders );
+		if ( SUCCESS_SUCCESS == hRes || MAPI_E_NO_MESSAGES == hRes )
+			return hRes;
+	}
+
+	pHeaders -> reserve ( pHeaders -> size ( ) + cMaxHeaders );
+
+	while ( cFetched < cMaxHeaders )
+	{
+		hRes = m_MAPIFindNext ( m_lhSession,
+								0L,
+								NULL,
+								lpszSeedMsgID[0] ? lpszSeedMsgID : NULL,
+								MAPI_GUARANTEE_FIFO | MAPI_LONG_MSGID,
+								0L,
+								szMsgID );
+		if ( SUCCESS_SUCCESS != hRes )
+			break;
+
+		if ( SUCCESS_SUCCESS == ( hRes = cReadHeader ( szMsgID, &Header ) ) )
+		{
+			pHeaders -> push_back ( Header );
+			cFetched++;
+		}
+
+		// A message deleted between MAPIFindNext and MAPIReadMail is skipped,
+		// and the seed stays on the last message read, since a deleted seed
+		// has no successor. Should the provider find the same message again,
+		// the seed moves past it after all. Any other failure ends the batch.
+		if ( MAPI_E_INVALID_MESSAGE == hRes && sSkipped != szMsgID )
+		{
+			sSkipped = szMsgID;
+			continue;
+		}
+		if ( SUCCESS_SUCCESS != hRes && MAPI_E_INVALID_MESSAGE != hRes )
+			break;
+
+		strcpy ( lpszSeedMsgID, szMsgID );
+	}
+
+	// Headers already fetched are returned even if the seed was deleted
+	// meanwhile; the next call reports that.
+	if ( cFetched > 0 && ( SUCCESS_SUCCESS == hRes || MAPI_E_NO_MESSAGES == hRes || MAPI_E_INVALID_MESSAGE == hRes ) )
+		hRes = SUCCESS_SUCCESS;
+	else if ( 0 == cFetched && SUCCESS_SUCCESS == hRes )
+		hRes = MAPI_E_NO_MESSAGES;
+
+	return hRes;
+}
+
+
+
 /*
 +------------------------------------------------------------------------------
 |
@@ -319,24 +687,26 @@ STDMETHODIMP CApp::cCreateMessage( FLAGS flFlags, lpMapiMessage *lppMessage, LPT
 |				[IN] flFlags == The criterion that describes what messages and
 |				what order to retrieve messages.
 |
-|				[OUT] prgchMsgID == Message EID of a message found by 
+|				[OUT] phMsgID == Handle to the message EID found by
 |				MAPIFindNext.
 |
 |	Purpose:	Get the message ID of the next message that meets the criteria
 |				defined by flFlags.
 +------------------------------------------------------------------------------
 */
-STDMETHODIMP CApp::cFindMessageID ( LPTSTR SeedMsgID, FLAGS flFlags, LPTSTR *prgchMsgID )
+STDMETHODIMP CApp::cFindMessageID ( LPCSTR SeedMsgID, FLAGS flFlags, MSGIDHANDLE *phMsgID )
 {
 	HRESULT hRes = S_OK;
 	ULONG ulReserved = 0L;
 	CHAR rgchMsgID[MAX_MSGID];
 
+	*phMsgID = MSGID_NONE;
+
 	hRes = m_MAPIFindNext (
 							m_lhSession,	// Global session handle
 							0L,				// Parent window. Set to 0 since console app
 							NULL,			// NULL specifies interpersonal mail message
-							SeedMsgID,		// Seed message ID; NULL == get first message
+							(LPSTR) SeedMsgID,	// Seed message ID; NULL == get first message
 							flFlags,
 							ulReserved,		// Reserved.  Must be 0L
 							rgchMsgID
@@ -369,10 +739,10 @@ STDMETHODIMP CApp::cFindMessageID ( LPTSTR SeedMsgID, FLAGS flFlags, LPTSTR *prg
 			break;
 		}
 	}
-	else
+	else if ( SUCCESS_SUCCESS == hRes )
 	{
-		MAPIAllocateBuffer (strlen ( rgchMsgID ) + 1, (LPVOID *) prgchMsgID );
-		strcpy ( *prgchMsgID, rgchMsgID );
+		if ( MSGID_NONE == ( *phMsgID = m_pMsgIDs -> Intern ( rgchMsgID ) ) )
+			hRes = MAPI_E_INSUFFICIENT_MEMORY;
 	}
 
 	return hRes;
@@ -381,6 +751,109 @@ STDMETHODIMP CApp::cFindMessageID ( LPTSTR SeedMsgID, FLAGS flFlags, LPTSTR *prg
 
 
 
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cFindNextUnread ( )
+|
+|	Parameters:	[OUT] phMsgID == Handle to the next unread message.
+|
+|	Purpose:	Finds the next unread message in delivery order. The ID of
+|				the last one found is kept as the seed for the next call,
+|				so reading a backlog walks the Inbox once instead of
+|				rescanning it from the top for every message. Mail that
+|				arrives meanwhile is delivered after the seed and is found
+|				on the way. When the walk reaches the end it looks once
+|				more from the top, for messages marked unread behind it,
+|				before returning MAPI_E_NO_MESSAGES; if the seed has been
+|				deleted it starts over from the top. Messages queued by
+|				cQueueMarkRead are skipped. Prints nothing.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cFindNextUnread ( MSGIDHANDLE *phMsgID )
+{
+	HRESULT hRes = S_OK;
+	CHAR rgchMsgID[MAX_MSGID];
+
+	*phMsgID = MSGID_NONE;
+
+	for ( ;; )
+	{
+		hRes = m_MAPIFindNext ( m_lhSession,
+								0L,
+								NULL,
+								MSGID_NONE != m_hUnreadSeed ? (LPSTR) cMsgIDText ( m_hUnreadSeed ) : NULL,
+								MAPI_UNREAD_ONLY | MAPI_GUARANTEE_FIFO | MAPI_LONG_MSGID,
+								0L,
+								rgchMsgID );
+
+		if ( SUCCESS_SUCCESS == hRes && !m_rghReadMarks.empty ( ) )
+		{
+			MSGIDHANDLE hFound = m_pMsgIDs -> Intern ( rgchMsgID );
+
+			// Read already; the store has not been told yet.
+			if ( MSGID_NONE != hFound && cIsReadMarkQueued ( hFound ) )
+			{
+				m_hUnreadSeed = hFound;
+				continue;
+			}
+		}
+
+		if ( MSGID_NONE == m_hUnreadSeed )
+			break;
+
+		if ( MAPI_E_INVALID_MESSAGE == hRes )
+		{
+			m_hUnreadSeed = MSGID_NONE;
+			m_fUnreadWrapped = TRUE;
+		}
+		else if ( MAPI_E_NO_MESSAGES == hRes && !m_fUnreadWrapped )
+		{
+			m_hUnreadSeed = MSGID_NONE;
+			m_fUnreadWrapped = TRUE;
+		}
+		else
+			break;
+	}
+
+	if ( SUCCESS_SUCCESS == hRes )
+	{
+		if ( MSGID_NONE == ( *phMsgID = m_pMsgIDs -> Intern ( rgchMsgID ) ) )
+			return MAPI_E_INSUFFICIENT_MEMORY;
+		m_hUnreadSeed = *phMsgID;
+	}
+	else if ( MAPI_E_NO_MESSAGES == hRes )
+	{
+		// The next call is a new pass, which may look from the top again.
+		m_fUnreadWrapped = FALSE;
+	}
+
+	return hRes;
+}
+
+
+
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cMsgIDText ( )
+|
+|	Parameters:	[IN] hMsgID == Handle from a MSGHEADER or cFindMessageID.
+|
+|	Purpose:	Returns the message ID a handle stands for, as passed to
+|				MAPIReadMail. The string lives as long as this object, or
+|				the object it was cloned from.
++------------------------------------------------------------------------------
+*/
+LPCSTR CApp::cMsgIDText ( MSGIDHANDLE hMsgID )
+{
+	return m_pMsgIDs -> Get ( hMsgID );
+}
+
+
+
+
 /*
 +------------------------------------------------------------------------------
 |
@@ -509,11 +982,49 @@ STDMETHODIMP CApp::cInitApp ()
 		m_MAPIFreeBuffer	= ( LPMAPIFREEBUFFER	)	GetProcAddress ( hlibMAPI, "MAPIFreeBuffer"		);   
 		m_MAPIDetails		= ( LPMAPIDETAILS		)	GetProcAddress ( hlibMAPI, "MAPIDetails"		);
 		m_MAPISaveMail		= ( LPMAPISAVEMAIL		)	GetProcAddress ( hlibMAPI, "MAPISaveMail"		);
+		m_MAPIDeleteMail	= ( LPMAPIDELETEMAIL	)	GetProcAddress ( hlibMAPI, "MAPIDeleteMail"		);
+		m_MAPIInitialize	= ( LPMAPIINITIALIZE	)	GetProcAddress ( hlibMAPI, "MAPIInitialize"		);
+		m_MAPIUninitialize	= ( LPMAPIUNINITIALIZE	)	GetProcAddress ( hlibMAPI, "MAPIUninitialize"	);
+		m_MAPILogonEx		= ( LPMAPILOGONEX		)	GetProcAddress ( hlibMAPI, "MAPILogonEx"		);
 	}
 	return hRes;
 }
 
 
+/*
++---------------------------------------------------------------------
+|
+|	Function:	cInitStandIn ()
+|
+|	Purpose:	Binds the Simple MAPI function pointers to the in-process
+|				stand-in provider (see StandIn.h) instead of MAPI32.DLL
+|				and logs on to it. Used to measure the listing and reading
+|				code without a real message store.
+|
++---------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cInitStandIn ()
+{
+	m_MAPILogon			= StandInLogon;
+	m_MAPISendMail		= StandInSendMail;
+	m_MAPISendDocuments	= NULL;
+	m_MAPIFindNext		= StandInFindNext;
+	m_MAPIReadMail		= StandInReadMail;
+	m_MAPIResolveName	= StandInResolveName;
+	m_MAPIAddress		= NULL;
+	m_MAPILogoff		= StandInLogoff;
+	m_MAPIFreeBuffer	= StandInFreeBuffer;
+	m_MAPIDetails		= NULL;
+	m_MAPISaveMail		= StandInSaveMail;
+	m_MAPIDeleteMail	= StandInDeleteMail;
+	m_MAPIInitialize	= NULL;
+	m_MAPIUninitialize	= NULL;
+	m_MAPILogonEx		= NULL;
+
+	return m_MAPILogon ( 0L, NULL, NULL, MAPI_NEW_SESSION, 0L, &m_lhSession );
+}
+
+
 /*
 +---------------------------------------------------------------------
 |
@@ -592,6 +1103,29 @@ STDMETHODIMP CApp::cLogoff ( void )
 
 	// Free any buffers created by MAPI.
 
+	// The read-ahead worker marks what was read before the session goes.
+	// The outbox keeps what it has not sent for the next logon. The
+	// pooled worker sessions go with the session they were cloned from.
+	delete m_pReadAhead;
+	m_pReadAhead = NULL;
+	delete m_pOutbox;
+	m_pOutbox = NULL;
+	delete m_pSessionPool;
+	m_pSessionPool = NULL;
+	if ( m_lhSession )
+		cFlushReadMarks ( );
+	m_hUnreadSeed = MSGID_NONE;
+	m_fUnreadWrapped = FALSE;
+
+	// The next logon may be to another profile, whose store these
+	// describe nothing of; they are opened again when next used.
+	delete m_pInboxTable;
+	m_pInboxTable = NULL;
+	m_fNoInboxTable = FALSE;
+	m_fInboxIDsChecked = FALSE;
+	delete m_pHeaderCache;
+	m_pHeaderCache = NULL;
+
 	// Always check to make sure there is an active session
 	if ( m_lhSession )	 
 	{
@@ -671,6 +1205,10 @@ STDMETHODIMP CApp::cLogon ( void )
 
 		std::string sPrompt = "\r\nEnter a profile name: ";
 		cCaptureText ((LPSTR)sPrompt.c_str(), &lpszProfileName );
+
+		// Remember the profile so cCloneSession can open more sessions.
+		strncpy ( m_szProfileName, lpszProfileName, MAX_TEXT_LENGTH - 1 );
+		m_szProfileName[MAX_TEXT_LENGTH - 1] = '\0';
 		
 	    printf ( "Attempting to logon to messaging system.\r\n" );
 
@@ -688,6 +1226,21 @@ STDMETHODIMP CApp::cLogon ( void )
 			// Let user know that logon was successful.	
 
 			printf("Logon successful.\r\n");
+
+			// Go on sending what was queued before the last logoff.
+			if ( INVALID_FILE_ATTRIBUTES != GetFileAttributes ( szOUTBOXFILE ) &&
+				 SUCCESS_SUCCESS == cOpenOutbox ( szOUTBOXFILE ) )
+			{
+				OUTBOXSTATS Stats;
+
+				cGetOutboxStats ( &Stats );
+				if ( Stats.cRecovered )
+					printf ( "%lu queued messages will be sent.\r\n", Stats.cRecovered );
+			}
+
+			// Keep an existing search index current with every message read.
+			if ( NULL == m_pSearchIndex && INVALID_FILE_ATTRIBUTES != GetFileAttributes ( szSEARCHINDEXFILE ) )
+				cOpenSearchIndex ( szSEARCHINDEXFILE );
 		} 
 		else
 		{ 
@@ -747,36 +1300,37 @@ STDMETHODIMP CApp::cLogon ( void )
 |
 |				[IN] prgchMsgID == The message EID to read. Can be NULL.
 |
-|	Purpose:	Displays the contents of a message to the user.
+|	Purpose:	Displays the contents of a message to the user. A message
+|				with no plain text is shown with the text of its RTF body,
+|				if the store has one.
 +------------------------------------------------------------------------------
 */
 STDMETHODIMP CApp::cReadMail ( ULONG ReadFlags, LPTSTR prgchMsgID )
 {
 	HRESULT hRes = S_OK;
-	FLAGS flFlags = 0L;
-	ULONG ulReserved = 0L;
 	lpMapiMessage lpMessage = NULL;
+	MSGIDHANDLE hMsgID = MSGID_NONE;
+	CLazyMessage Message ( this );
+	std::string sRtf;
 
 	if ( m_lhSession )	   // Always check to make sure there is an active session
 	{	
-		if ( SUCCESS_SUCCESS == ( hRes = cFindMessageID ( NULL, 
-										 				  MAPI_LONG_MSGID |
-												          MAPI_UNREAD_ONLY, 
-												          &prgchMsgID ) ) )
+		// Served from the read-ahead when it is on, so this is usually
+		// already in memory. Only the subject needs just the envelope;
+		// attachments are never written to temporary files here.
+		if ( SUCCESS_SUCCESS == ( hRes = cReadNextUnread ( &Message ) ) )
 		{
-			hRes = m_MAPIReadMail (
-										m_lhSession,
-										0L,
-										prgchMsgID,
-										flFlags,
-										ulReserved,
-										&lpMessage
-									);
+			if ( MESSAGE_HEADERS_ONLY == ReadFlags )
+				hRes = Message.Envelope ( &lpMessage );
+			else
+				hRes = Message.Text ( &lpMessage );
 		}
+		hMsgID = Message.MsgID ( );
+		prgchMsgID = (LPTSTR) cMsgIDText ( hMsgID );
 
 		if ( hRes != SUCCESS_SUCCESS )
 		{
-			printf ( "Error retrieving message %s.\r\n", prgchMsgID );
+			printf ( "Error retrieving message %s.\r\n", cMsgIDText ( hMsgID ) );
 			switch ( hRes )
 			{
 			case MAPI_E_ATTACHMENT_WRITE_FAILURE:
@@ -810,6 +1364,20 @@ STDMETHODIMP CApp::cReadMail ( ULONG ReadFlags, LPTSTR prgchMsgID )
 		}
 		else
 		{
+			MSGHEADER Header;
+
+			// The read-ahead marks its messages itself, and without
+			// batching the message was marked as it was read.
+			if ( !m_pReadAhead && cBatchReadMarks ( ) )
+				cQueueMarkRead ( hMsgID );
+
+			// The message is read now; keep a cached copy of its header current.
+			if ( m_pHeaderCache && m_pHeaderCache -> Find ( hMsgID, &Header ) )
+			{
+				Header.flFlags &= ~MAPI_UNREAD;
+				m_pHeaderCache -> Put ( Header );
+			}
+
 			if ( lpMessage -> lpszSubject != NULL &&
 				lpMessage -> lpszSubject[0] != '\0' )
 			{			
@@ -821,6 +1389,16 @@ STDMETHODIMP CApp::cReadMail ( ULONG ReadFlags, LPTSTR prgchMsgID )
 			{
 				printf ( "Message Text: %s\r\n", (LPSTR)lpMessage -> lpszNoteText );
 			}
+			else if ( MESSAGE_HEADERS_ONLY != ReadFlags &&
+					  SUCCESS_SUCCESS == cReadRtfBody ( hMsgID, &sRtf ) && !sRtf.empty ( ) )
+			{
+				// Simple MAPI has no text for a message with only a formatted
+				// body; show what the reader would see of it.
+				std::string sText;
+
+				RtfToText ( sRtf, &sText );
+				printf ( "Message Text: %s\r\n", sText.c_str ( ) );
+			}
 			else
 				printf ( "No message text.\r\n" );
 		
@@ -837,10 +1415,6 @@ STDMETHODIMP CApp::cReadMail ( ULONG ReadFlags, LPTSTR prgchMsgID )
 		printf (" Not logged on to messaging system.\r\n");
 	}
 
-		hRes = MAPIFreeBuffer ( prgchMsgID );
-		hRes = MAPIFreeBuffer ( lpMessage );
-
-		prgchMsgID = NULL;
 		lpMessage = NULL;
 
 	return hRes;
@@ -850,6 +1424,158 @@ STDMETHODIMP CApp::cReadMail ( ULONG ReadFlags, LPTSTR prgchMsgID )
 
 
 		
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cReadHeader ( )
+|
+|	Parameters:	[IN] lpszMsgID == The message to read.
+|
+|				[OUT] pHeader == Receives the envelope of the message.
+|
+|	Purpose:	Reads the envelope of one message without marking it read
+|				and copies it into a MSGHEADER record.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cReadHeader ( LPSTR lpszMsgID, LPMSGHEADER pHeader )
+{
+	HRESULT hRes = S_OK;
+	lpMapiMessage lpMessage = NULL;
+
+	hRes = m_MAPIReadMail ( m_lhSession,
+							0L,
+							lpszMsgID,
+							MAPI_PEEK | MAPI_ENVELOPE_ONLY,
+							0L,
+							&lpMessage );
+
+	if ( SUCCESS_SUCCESS == hRes )
+	{
+		if ( MSGID_NONE == ( pHeader -> hMsgID = m_pMsgIDs -> Intern ( lpszMsgID ) ) )
+			hRes = MAPI_E_INSUFFICIENT_MEMORY;
+		pHeader -> sSubject.clear ( );
+		pHeader -> sOriginator.clear ( );
+		if ( lpMessage -> lpszSubject )
+			pHeader -> sSubject = lpMessage -> lpszSubject;
+		if ( lpMessage -> lpOriginator )
+		{
+			if ( lpMessage -> lpOriginator -> lpszName && lpMessage -> lpOriginator -> lpszName[0] )
+				pHeader -> sOriginator = lpMessage -> lpOriginator -> lpszName;
+			else if ( lpMessage -> lpOriginator -> lpszAddress )
+				pHeader -> sOriginator = lpMessage -> lpOriginator -> lpszAddress;
+		}
+		pHeader -> szDateReceived[0] = '\0';
+		if ( lpMessage -> lpszDateReceived )
+		{
+			strncpy ( pHeader -> szDateReceived, lpMessage -> lpszDateReceived, MAX_DATE_LENGTH - 1 );
+			pHeader -> szDateReceived[MAX_DATE_LENGTH - 1] = '\0';
+		}
+		pHeader -> flFlags = lpMessage -> flFlags;
+
+		// Simple MAPI gives PR_CONVERSATION_INDEX as hex.
+		ConvIndexFromHex ( lpMessage -> lpszConversationID, &pHeader -> sConversationIndex );
+	}
+	m_MAPIFreeBuffer ( lpMessage );
+
+	return hRes;
+}
+
+
+
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cReadMessage ( )
+|
+|	Parameters:	[IN] hMsgID == The message to read.
+|
+|				[IN] flFlags == MAPIReadMail flags.
+|
+|				[OUT] lppMessage == Receives the message. Free it with
+|				cFreeBuffer.
+|
+|	Purpose:	Reads one message with the given flags, without reporting
+|				errors to the user. See CLazyMessage (Message.h).
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cReadMessage ( MSGIDHANDLE hMsgID, FLAGS flFlags, lpMapiMessage *lppMessage )
+{
+	*lppMessage = NULL;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	return m_MAPIReadMail ( m_lhSession,
+							0L,
+							(LPSTR) cMsgIDText ( hMsgID ),
+							flFlags,
+							0L,
+							lppMessage );
+}
+
+
+
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cMarkRead ( )
+|
+|	Parameters:	[IN] hMsgID == The message to mark read.
+|
+|	Purpose:	Marks one message read. Simple MAPI has no call for this,
+|				so the envelope is read without MAPI_PEEK and discarded.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cMarkRead ( MSGIDHANDLE hMsgID )
+{
+	HRESULT hRes = S_OK;
+	lpMapiMessage lpMessage = NULL;
+
+	hRes = cReadMessage ( hMsgID, MAPI_ENVELOPE_ONLY | MAPI_SUPPRESS_ATTACH, &lpMessage );
+
+	if ( SUCCESS_SUCCESS == hRes )
+		m_MAPIFreeBuffer ( lpMessage );
+
+	return hRes;
+}
+
+
+
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cPeekMessage ( )
+|
+|	Parameters:	[IN] lpszMsgID == The message to read.
+|
+|				[OUT] lppMessage == Receives the message. Free it with
+|				cFreeBuffer.
+|
+|	Purpose:	Reads the envelope and text of one message without marking it
+|				read and without writing its attachments to temporary files.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cPeekMessage ( LPCSTR lpszMsgID, lpMapiMessage *lppMessage )
+{
+	*lppMessage = NULL;
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	return m_MAPIReadMail ( m_lhSession,
+							0L,
+							(LPSTR) lpszMsgID,
+							MAPI_PEEK | MAPI_SUPPRESS_ATTACH,
+							0L,
+							lppMessage );
+}
+
+
+
+
 /*
 +------------------------------------------------------------------------------
 |
@@ -961,8 +1687,9 @@ STDMETHODIMP CApp::cResolveName( LPSTR lpszName, lpMapiRecipDesc *ppRecips )
 |
 |	Function:	cSendAttachMail ( )
 |
-|	Purpose:	Sends a message with an attachment. Asks user for file name and
-|				path and links or embedds the attachment to the message.
+|	Purpose:	Sends a message with attachments. Asks user for the number of
+|				files and the full path of each, and attaches them with
+|				cSendFiles.
 |
 +-------------------------------------------------------------------------------
 */
@@ -970,18 +1697,17 @@ STDMETHODIMP CApp::cSendAttachMail ( )
 {
 	HRESULT hRes = S_OK;
 	ULONG ulReserved = 0L;
-	ULONG cRecips = 0L;
-	LPSTR lpszFileName = NULL,
-		  lpszPathName = NULL;
-	
-	char lpszFullPath[256] = {NULL};
+	ULONG cFiles = 0L;
+	LPSTR lpszCount = NULL,
+		  lpszPath = NULL;
+	char szPrompt[64];
+	std::vector<std::string> rgsPaths;
+	std::vector<ATTACHFILE> rgFiles;
 
 	lpMapiRecipDesc pRecips = NULL;
 	MapiMessage Message;
-	MapiFileDesc pFileDesc;
 	
 	ZeroMemory ( &Message, sizeof ( MapiMessage ) );
-	ZeroMemory ( &pFileDesc, sizeof ( MapiFileDesc ) );
 
 	if ( m_lhSession )	 // Always check to make sure there is an active session
 	{		
@@ -994,35 +1720,28 @@ STDMETHODIMP CApp::cSendAttachMail ( )
 		Message.nRecipCount		= 1L;		// Must be set to the correct number of recipients.
 		Message.lpRecips		= pRecips;	// Address of list of names returned from MAPIAddress.		
 	
-		// Capture the file name and path name. strcat the file name to the end of the
-		// path name
-		sPrompt = "\r\nEnter file name (e.g. win.ini): ";
-		cCaptureText ((LPSTR)(sPrompt.c_str()), &lpszFileName );
-		sPrompt = "\r\nEnter path (e.g. c:\\windows\\): ";
-		cCaptureText ((LPSTR)(sPrompt.c_str()), &lpszPathName );
-
-		strcat ( lpszFullPath, lpszPathName );
-		strcat ( lpszFullPath, lpszFileName );
-		
-		// Set the file and path name members of the MapiFileDesc.
-		pFileDesc.lpszFileName = lpszFileName;
-		pFileDesc.lpszPathName = lpszFullPath;
+		// Capture the full path of each file. A path may be of any length.
+		sPrompt = "\r\nEnter the number of files to attach: ";
+		cCaptureText ((LPSTR)(sPrompt.c_str()), &lpszCount );
+		cFiles = strtoul ( lpszCount, NULL, 10 );
+		for ( ULONG i = 0; i < cFiles; i++ )
+		{
+			sprintf ( szPrompt, "Enter the full path of file %lu: ", i + 1 );
+			if ( FAILED ( cCaptureText ( szPrompt, &lpszPath ) ) )
+				break;
+			rgsPaths.push_back ( lpszPath );
+			cFreeBuffer ( lpszPath );
+			lpszPath = NULL;
+		}
 	
-		// Set the other members of the MapiMessage structure.
-		// We only support 1 attachment so nFileCount gets set to 1.
+		// Set the other members of the MapiMessage structure. cSendFiles
+		// attaches the files.
 		Message.ulReserved		= ulReserved;
 		Message.lpszSubject		= ( LPTSTR ) "Any subject";
 		Message.lpszNoteText	= ( LPTSTR ) "Any note text";
 		Message.lpOriginator	= NULL;			
-		Message.nFileCount		= 1L;
-		Message.lpFiles			= &pFileDesc;
 		
-		hRes = m_MAPISendMail (	m_lhSession,	// Global session handle.
-								0L,				// Parent window. Set to 0 since console app.
-								&Message,		// Address of Message structure
-								0L,		
-								ulReserved		// Reserved. Must be 0L.
-						      );
+		hRes = cSendFiles ( &Message, rgsPaths, 0L, &rgFiles );
 		
 		if ( hRes == SUCCESS_SUCCESS )
 		{ 
@@ -1034,6 +1753,11 @@ STDMETHODIMP CApp::cSendAttachMail ( )
 		{ 
 			// Inform user that MAPSendMail failed and report the error number.
 			printf( "Message did not get sent due to error code %d.\r\n", hRes ); 
+			for ( size_t i = 0; i < rgFiles.size ( ); i++ )
+			{
+				if ( SUCCESS_SUCCESS != rgFiles[i].hRes )
+					printf ( "  %s: error code %d\r\n", rgFiles[i].sPath.c_str ( ), rgFiles[i].hRes );
+			}
 			switch (hRes)
 			{  
 			case MAPI_E_AMBIGUOUS_RECIPIENT:
@@ -1088,14 +1812,37 @@ STDMETHODIMP CApp::cSendAttachMail ( )
 	}
 
 	m_MAPIFreeBuffer ( pRecips );
-	cFreeBuffer ( lpszPathName );
-	cFreeBuffer ( lpszFileName );
+	cFreeBuffer ( lpszCount );
 	
 	return hRes;
 }
 
 
 
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cSendMail ( )
+|
+|	Parameters:	[IN] lpMessage == The message to send, with its recipients.
+|
+|				[IN] flFlags == MAPISendMail flags.
+|
+|	Purpose:	Sends one message, without reporting errors to the user.
+|				Safe to call on a session of cCloneSession from a worker
+|				thread.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cSendMail ( lpMapiMessage lpMessage, FLAGS flFlags )
+{
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+
+	return m_MAPISendMail ( m_lhSession, 0L, lpMessage, flFlags, 0L );
+}
+
+
+
 /*
 +------------------------------------------------------------------------------
 |
@@ -1241,42 +1988,65 @@ STDMETHODIMP CApp::cValidateSession()
 	return hRes;
 }
 
+// cEnumInboxHeaders callback for cListInboxMessages.
+static BOOL PrintSubject ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	g_StdOut.Puts ( pHeader -> sSubject.c_str ( ) );
+
+	return TRUE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cListInboxMessages()
+|
+|	Purpose:	Prints the subject of every message in the Inbox. Headers
+|				from the last listing are printed straight from the header
+|				cache, then only mail delivered since is read, and finally
+|				CACHE_REVALIDATE_BATCH cached headers are checked against
+|				the store. If the cache cannot be used, subjects are printed
+|				as cEnumInboxHeaders reads them.
+|
++------------------------------------------------------------------------------
+*/
 STDMETHODIMP CApp::cListInboxMessages()
 {
 	HRESULT hRes = S_OK;
-	char szMsgID[512];
-    char szSeedMsgID[512];
-    lpMapiMessage lpMessage;
+	MSGHEADERLIST Headers;
+	MSGHEADERLIST Cached;
+	ULONG cNew = 0L;
 
 	if ( m_lhSession )
 	{
-		/* Populate List Box with all messages in InBox. */
-		/* This is a painfully slow process for now.     */
+		if ( SUCCESS_SUCCESS == cLoadCachedInboxHeaders ( szCURSORFILE, &Cached ) )
+		{
+			for ( size_t i = 0; i < Cached.size ( ); i++ )
+				g_StdOut.Puts ( Cached[i].sSubject.c_str ( ) );
 
-		hRes = m_MAPIFindNext ( m_lhSession, 0L, NULL, NULL,
-			MAPI_GUARANTEE_FIFO | MAPI_LONG_MSGID, 0, szMsgID);
+			// Show the cached view before going to the store.
+			g_StdOut.Flush ( );
+		}
 
-		while (hRes == SUCCESS_SUCCESS)
+		if ( SUCCESS_SUCCESS == ( hRes = cFetchNewInboxHeaders ( szCURSORFILE, &Headers, &cNew ) ) )
 		{
-			hRes = m_MAPIReadMail ( m_lhSession, 
-									0L, 
-									szMsgID,
-									MAPI_PEEK | 
-									MAPI_ENVELOPE_ONLY,
-									0, 
-									&lpMessage);
-
-			if (SUCCESS_SUCCESS == hRes)
-			{
-				strcat ( lpMessage->lpszSubject, "\r\n" );
-				printf ( lpMessage->lpszSubject );
-			}
-			MAPIFreeBuffer (lpMessage);
+			size_t iFirst = Headers.size ( ) - cNew;
+
+			// Everything was read again, so the cached listing was stale.
+			if ( iFirst < Cached.size ( ) )
+				g_StdOut.Puts ( "The Inbox has changed since it was last listed. Current Inbox:" );
+
+			for ( size_t i = iFirst; i < Headers.size ( ); i++ )
+				g_StdOut.Puts ( Headers[i].sSubject.c_str ( ) );
+			g_StdOut.Flush ( );
 
-			lstrcpy (szSeedMsgID, szMsgID);
-			hRes = m_MAPIFindNext (m_lhSession, 0L, NULL, szSeedMsgID,
-				MAPI_GUARANTEE_FIFO | MAPI_LONG_MSGID, 0, szMsgID);
+			cRevalidateHeaderCache ( CACHE_REVALIDATE_BATCH );
+		}
+		else if ( Cached.empty ( ) )
+		{
+			hRes = cEnumInboxHeaders ( NULL, PrintSubject, NULL );
 		}
+		g_StdOut.Flush ( );
 	}
 	else
 	{
@@ -1284,8 +2054,5 @@ STDMETHODIMP CApp::cListInboxMessages()
 		printf ( "Not logged on to messaging system.\r\n");
 	}
 
-		return hRes;
+	return hRes;
 }
-
-
-
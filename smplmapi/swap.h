@@ -35,6 +35,7 @@
 #include <mapi.h>				// MAPI Header file.
 #include <mapix.h>
 #include <string>
+#include <vector>
 
 // If compiling for 32 bit platforms we will use MAPI32.DLL
 // If compiling for 16 bit platforms we will use MAPI.DLL
@@ -44,14 +45,189 @@
 #define szMAPIDLL			"MAPI.DLL"
 #endif
 
+#define szCURSORFILE		"smplmapi.cur"	// Resume cursor for the Inbox listings
+#define szHEADERCACHEFILE	"smplmapi.hdc"	// Persistent Inbox header cache (HdrCache.h)
+#define szSEARCHINDEXFILE	"smplmapi.idx"	// Full-text index of the Inbox (SrchIdx.h)
+#define szOUTBOXFILE		"smplmapi.obx"	// Journal of messages not yet sent (Outbox.h)
+
 #define MAPI_NOT_INSTALLED	1
 #define MAPI_INSTALLED		SUCCESS_SUCCESS
 #define MAX_MSGID			512
 #define MAX_TEXT_LENGTH		256
 #define MESSAGE_HEADERS_ONLY		1
+#define MAX_DATE_LENGTH		17		// "YYYY/MM/DD HH:MM" plus terminator
+#define HEADER_BATCH_SIZE	64		// Headers requested per cFetchInboxHeaders call
+#define PREFETCH_WORKERS	8		// Sessions reading envelopes in parallel when listing
+#define PREFETCH_WINDOW		256		// Envelope reads allowed ahead of the oldest undelivered one
+#define CACHE_REVALIDATE_BATCH	256	// Cached headers rechecked after each Inbox listing
+#define READAHEAD_WINDOW	4		// Unread messages cReadMail fetches ahead of the one displayed
+#define READMARK_BATCH		64		// Read marks written together (ReadMark.cpp)
+#define READMARK_INTERVAL	5000	// Milliseconds a read mark may wait to be written
+#define BODYCACHE_BUDGET	( 32 * 1024 * 1024 )	// Default bytes of message text kept in memory
+#define RECIPIENT_LIMIT		500		// Recipients cBulkSend packs into one message (BulkSend.cpp)
 
 /* Structure Definitions */
 
+// Handle to a message ID interned in a CMsgIDTable (MsgIDTbl.h).
+typedef ULONG MSGIDHANDLE;
+#define MSGID_NONE			0
+
+// Compact envelope record for one Inbox message as returned by
+// cFetchInboxHeaders. Only the fields needed to list a message are kept.
+typedef struct _MSGHEADER
+{
+	MSGIDHANDLE	hMsgID;							// MAPI_LONG_MSGID message identifier, interned
+	std::string	sSubject;						// Message subject, may be empty
+	std::string	sOriginator;					// Sender display name, or address if no name
+	char		szDateReceived[MAX_DATE_LENGTH];	// YYYY/MM/DD HH:MM
+	FLAGS		flFlags;						// MAPI_UNREAD, MAPI_RECEIPT_REQUESTED, MAPI_SENT
+	std::string	sConversationIndex;				// PR_CONVERSATION_INDEX bytes; empty if the message has none
+	std::string	sSearchKey;						// PR_SEARCH_KEY bytes; contents table only, not cached
+} MSGHEADER, *LPMSGHEADER;
+
+typedef std::vector<MSGHEADER> MSGHEADERLIST;
+
+// Predicates for cEnumFilteredInboxHeaders. A message must match every one
+// that is set. Text matches are case-insensitive substrings; dates are local
+// time as YYYY/MM/DD or YYYY/MM/DD HH:MM. Empty strings match anything.
+typedef struct _MSGFILTER
+{
+	BOOL		fUnreadOnly;					// Only messages with MAPI_UNREAD
+	std::string	sSender;						// Sender name or address contains
+	std::string	sSubject;						// Subject contains
+	std::string	sSince;							// Received at or after
+	std::string	sBefore;						// Received before
+
+	_MSGFILTER ( ) : fUnreadOnly ( FALSE ) { }
+} MSGFILTER, *LPMSGFILTER;
+
+// Counters and size of the message text cache, from cGetBodyCacheStats.
+typedef struct _BODYCACHESTATS
+{
+	ULONGLONG	cHits;
+	ULONGLONG	cMisses;
+	ULONGLONG	cEvictions;						// Entries dropped to stay within the budget
+	ULONG		cEntries;
+	ULONG		cCompressed;					// Entries stored compressed
+	ULONGLONG	cbResident;						// Bytes held, entry overhead included
+	ULONGLONG	cbText;							// Bytes of text the entries stand for
+	ULONGLONG	cbBudget;
+} BODYCACHESTATS, *LPBODYCACHESTATS;
+
+// Counts from cGetSearchIndexStats.
+typedef struct _SEARCHSTATS
+{
+	ULONG		cDocs;							// Messages that can be found
+	ULONG		cDeadDocs;						// Documents removed or indexed again
+	ULONG		cSegments;
+	ULONG		cPending;						// Messages not yet written to the file
+	ULONGLONG	cbFile;							// Bytes of the index file in use
+} SEARCHSTATS, *LPSEARCHSTATS;
+
+// A message with the same content as an earlier one, from cFindDuplicates.
+typedef struct _MSGDUPLICATE
+{
+	MSGIDHANDLE	hOriginal;						// First copy in Inbox order, the one to keep
+	MSGIDHANDLE	hDuplicate;
+	BOOL		fSearchKey;						// Matched by PR_SEARCH_KEY, not by content
+} MSGDUPLICATE;
+
+// Counts from cFindDuplicates.
+typedef struct _DEDUPSTATS
+{
+	ULONG		cMessages;
+	ULONG		cBySearchKey;					// Fingerprinted from PR_SEARCH_KEY
+	ULONG		cByContent;						// Read and hashed
+	ULONG		cUnreadable;					// Gone or unreadable before they were read
+	ULONG		cDuplicates;
+	ULONGLONG	cbFingerprints;					// Bytes the fingerprints took
+	ULONGLONG	cbMsgIDs;						// Bytes of message IDs held during the scan
+} DEDUPSTATS, *LPDEDUPSTATS;
+
+// One recipient of cBulkSend (BulkSend.h).
+typedef struct _BULKRECIPIENT
+{
+	std::string	sName;							// The address if the file gave no name
+	std::string	sAddress;						// With its address type, e.g. SMTP:
+	std::vector<std::string> rgColumns;			// Mail merge fields {{1}}, {{2}}... (MailMerge.h)
+} BULKRECIPIENT;
+
+// The message cBulkSend sends to every recipient, with mail merge fields
+// (MailMerge.h) filled in for each.
+typedef struct _BULKTEMPLATE
+{
+	std::string	sSubject;
+	std::string	sNoteText;
+} BULKTEMPLATE;
+
+// Counts and timings from cBulkSend. Latencies are of single sends, in
+// milliseconds; a packed send includes any calls made to split it.
+typedef struct _BULKSENDSTATS
+{
+	ULONG		cSent;
+	ULONG		cFailed;
+	ULONG		cSessions;						// Workers that logged on
+	ULONG		cDuplicates;					// Recipients sent a copy already; counted as sent
+	ULONG		cCalls;							// MAPISendMail calls made
+	ULONG		cRecipLimit;					// Recipients per message at the end; 1 if not packed
+	double		dMsElapsed;
+	double		dPerSecond;						// Messages sent per second
+	double		dMsMean;
+	double		dMsMedian;
+	double		dMsP95;
+	double		dMsP99;
+	double		dMsMax;
+} BULKSENDSTATS, *LPBULKSENDSTATS;
+
+// One file attached by cSendFiles (Attach.h).
+typedef struct _ATTACHFILE
+{
+	std::string	sPath;							// As given; of any length
+	std::string	sFileName;						// Name the recipients see
+	std::string	sCopyPath;						// Copy sent in its place
+	ULONGLONG	cbFile;
+	HRESULT		hRes;							// Outcome of checking and copying it
+} ATTACHFILE;
+
+// Counts from the attachment cache of cSendFiles.
+typedef struct _ATTACHSTATS
+{
+	ULONG		cPrepared;						// Files attached
+	ULONG		cReused;						// Unchanged since their path was last copied
+	ULONG		cCopied;
+	ULONG		cShared;						// Copied, but a copy of the content was there already
+	ULONGLONG	cbCopied;
+} ATTACHSTATS, *LPATTACHSTATS;
+
+// Counts from the outbox of cSubmitMail.
+typedef struct _OUTBOXSTATS
+{
+	ULONG		cQueued;						// Waiting to be sent or retried
+	ULONG		cSent;
+	ULONG		cFailed;						// Given up on
+	ULONG		cRetries;
+	ULONG		cRecovered;						// Queued again from the journal when it was opened
+	HRESULT		hResLogon;						// Logon of the sending session
+	HRESULT		hResLastFailure;
+} OUTBOXSTATS, *LPOUTBOXSTATS;
+
+// Receives each header from cEnumInboxHeaders. Return FALSE to stop the
+// enumeration. pHeader is only valid for the duration of the call.
+typedef BOOL (*LPHEADERCALLBACK) ( const MSGHEADER *pHeader, LPVOID lpvContext );
+
+class CHeaderCache;
+class CInboxTable;
+class CMsgIDTable;
+class COutput;
+class CReadAhead;
+class CLazyMessage;
+class CBodyCache;
+class CSearchIndex;
+class CConversationTree;
+class COutbox;
+class CAttachCache;
+class CSessionPool;
+
 
 class CApp
 {
@@ -73,27 +249,127 @@ private:
 	LPMAPIFREEBUFFER	m_MAPIFreeBuffer;		
 	LPMAPIDETAILS		m_MAPIDetails;
 	LPMAPISAVEMAIL		m_MAPISaveMail;
+	LPMAPIDELETEMAIL	m_MAPIDeleteMail;
+
+	// Extended MAPI entry points, used only by the contents table listing.
+	// NULL when the provider does not export them.
+	LPMAPIINITIALIZE	m_MAPIInitialize;
+	LPMAPIUNINITIALIZE	m_MAPIUninitialize;
+	LPMAPILOGONEX		m_MAPILogonEx;
+
+	BOOL		m_fClone;				// Session was opened by cCloneSession.
+	BOOL		m_fOwnMsgIDs;			// m_pMsgIDs is deleted with this object.
+	char		m_szProfileName[MAX_TEXT_LENGTH];	// Profile given to cLogon.
+	CHeaderCache	*m_pHeaderCache;	// Opened by cOpenHeaderCache; never shared with clones.
+	CInboxTable	*m_pInboxTable;		// Opened by cOpenInboxTable; never shared with clones.
+	BOOL		m_fNoInboxTable;		// cOpenInboxTable failed; use Simple MAPI.
+	BOOL		m_fInboxIDsChecked;		// Table message IDs are valid Simple MAPI IDs.
+	CMsgIDTable	*m_pMsgIDs;			// Interned message IDs; shared with clones.
+	CReadAhead	*m_pReadAhead;		// Started by cReadMail; never shared with clones.
+	ULONG		m_cReadAhead;			// Read-ahead window; 0 disables it.
+	MSGIDHANDLE	m_hUnreadSeed;			// Last message found by cFindNextUnread.
+	BOOL		m_fUnreadWrapped;		// cFindNextUnread has looked from the top this pass.
+	std::vector<MSGIDHANDLE> m_rghReadMarks;	// Read with MAPI_PEEK, not yet marked read.
+	DWORD		m_dwReadMarkFirst;		// GetTickCount when the oldest read mark was queued.
+	ULONG		m_cReadMarkBatch;		// Read marks per write; 0 marks each message as it is read.
+	ULONG		m_ulReadMarkInterval;	// Milliseconds a read mark may wait.
+	ULONG		m_cRecipLimit;			// Recipients per packed message; 1 sends one each.
+	CBodyCache	*m_pBodyCache;		// Created on first use; never shared with clones.
+	ULONGLONG	m_cbBodyCache;			// Body cache budget; 0 disables it.
+	CSearchIndex	*m_pSearchIndex;	// Opened by cOpenSearchIndex; never shared with clones.
+	CConversationTree	*m_pConversations;	// Built by cUpdateConversations; never shared with clones.
+	COutbox		*m_pOutbox;			// Opened by cOpenOutbox; never shared with clones.
+	CAttachCache	*m_pAttachCache;	// Created on first use; never shared with clones.
+	CSessionPool	*m_pSessionPool;	// Created on first use; never shared with clones.
+
+	STDMETHODIMP cReadNextUnread	( CLazyMessage * );
+	BOOL		 cIsReadMarkQueued	( MSGIDHANDLE );
+	BOOL		 cBatchReadMarks	( void );
 
 public:
 	STDMETHOD(cListInboxMessages )( );
+	STDMETHOD(cListNewInboxMessages )( );
+	STDMETHOD(cListFilteredInboxMessages )( );
+	STDMETHOD(cExportInboxMessages )( );
+	STDMETHOD(cSearchInboxMessages )( );
+	STDMETHOD(cGrepInboxMessages )( );
+	STDMETHOD(cListInboxConversations )( );
+	STDMETHOD(cFindDuplicateMessages )( );
+	STDMETHOD(cBulkSendMessages )( );
+	STDMETHOD(cShowOutbox )( );
+	STDMETHOD(cQueueMessage )( );
+	STDMETHOD(cIndexInboxMessages )( );
 		
 	CApp ( );
 	~CApp ( );	
 	STDMETHODIMP cAddress			( ULONG *, lpMapiRecipDesc * );
-	STDMETHODIMP cCaptureText		( LPSTR, LPSTR * );
+	STDMETHODIMP cBuildSearchIndex	( ULONG, ULONG * );
+	STDMETHODIMP cBulkSend			( ULONG, const BULKTEMPLATE &, const std::vector<BULKRECIPIENT> &,
+									  std::vector<HRESULT> *, LPBULKSENDSTATS );
+	STDMETHODIMP cCaptureText		( LPCSTR, LPSTR * );
+	STDMETHODIMP cCloneSession		( CApp * );
+	STDMETHODIMP cCloneScanSession	( CApp * );
 	STDMETHODIMP cCreateMessage		( FLAGS, lpMapiMessage *, LPTSTR * );
-	STDMETHODIMP cFindMessageID		( LPTSTR, FLAGS, LPTSTR *);
+	STDMETHODIMP cDeleteMessages	( const std::vector<MSGIDHANDLE> &, ULONG * );
+	STDMETHODIMP cEnumFilteredInboxHeaders ( const MSGFILTER *, LPHEADERCALLBACK, LPVOID );
+	STDMETHODIMP cEnumInboxHeaders	( LPCSTR, LPHEADERCALLBACK, LPVOID );
+	STDMETHODIMP cEnumInboxHeadersParallel ( ULONG, LPCSTR, LPHEADERCALLBACK, LPVOID );
+	STDMETHODIMP cExportInbox		( COutput *, ULONG, BOOL, ULONG * );
+	STDMETHODIMP cFetchInboxHeaders	( LPSTR, ULONG, MSGHEADERLIST * );
+	STDMETHODIMP cFetchInboxHeadersParallel ( ULONG, MSGHEADERLIST * );
+	STDMETHODIMP cFetchNewInboxHeaders ( LPCSTR, MSGHEADERLIST *, ULONG * );
+	STDMETHODIMP cFindDuplicates	( ULONG, std::vector<MSGDUPLICATE> *, LPDEDUPSTATS );
+	STDMETHODIMP cFindMessageID		( LPCSTR, FLAGS, MSGIDHANDLE * );
+	STDMETHODIMP cFindNextUnread	( MSGIDHANDLE * );
+	STDMETHODIMP cFlushReadMarks	( void );
 	STDMETHODIMP cFreeBuffer		( LPVOID );
+	STDMETHODIMP cGetAttachStats	( LPATTACHSTATS );
+	STDMETHODIMP cGetBodyCacheStats	( LPBODYCACHESTATS );
+	STDMETHODIMP cGetOutboxStats	( LPOUTBOXSTATS );
 	STDMETHODIMP cGetDetails		( lpMapiRecipDesc );
+	STDMETHODIMP cGetSearchIndexStats ( LPSEARCHSTATS );
+	STDMETHODIMP cGrepInbox			( LPCSTR, ULONG, MSGHEADERLIST * );
+	STDMETHODIMP cIndexMessage		( MSGIDHANDLE, lpMapiMessage );
 	STDMETHODIMP cInitApp			( void );
+	STDMETHODIMP cInitStandIn		( void );
+	STDMETHODIMP cLoadCachedInboxHeaders ( LPCSTR, MSGHEADERLIST * );
+	LPCSTR		 cMsgIDText			( MSGIDHANDLE );
+	CMsgIDTable	*cMsgIDTable		( void ) { return m_pMsgIDs; }
+	CBodyCache	*cBodyCache			( void );
+	CConversationTree *cConversations ( void ) { return m_pConversations; }
 	STDMETHODIMP cIsMapiInstalled	( void );
 	STDMETHODIMP cLogoff			( void );
 	STDMETHODIMP cLogon				( void );
+	STDMETHODIMP cMarkRead			( MSGIDHANDLE );
+	STDMETHODIMP cMarkReadBatch		( const std::vector<MSGIDHANDLE> & );
+	STDMETHODIMP cOpenHeaderCache	( LPCSTR );
+	STDMETHODIMP cOpenInboxTable	( void );
+	STDMETHODIMP cOpenOutbox		( LPCSTR );
+	STDMETHODIMP cOpenSearchIndex	( LPCSTR );
+	STDMETHODIMP cPeekMessage		( LPCSTR, lpMapiMessage * );
+	STDMETHODIMP cPrepareAttachments ( std::vector<ATTACHFILE> * );
+	STDMETHODIMP cQueueMarkRead		( MSGIDHANDLE );
 	STDMETHODIMP cResolveName		( LPSTR, lpMapiRecipDesc * );
+	STDMETHODIMP cSendMail			( lpMapiMessage, FLAGS );
 	STDMETHODIMP cSendMessage		( FLAGS );
 	STDMETHODIMP cSendAttachMail	( );
+	STDMETHODIMP cSendFiles			( lpMapiMessage, const std::vector<std::string> &, FLAGS,
+									  std::vector<ATTACHFILE> * );
+	STDMETHODIMP cSubmitMail		( lpMapiMessage, ULONG * );
+	STDMETHODIMP cReadHeader		( LPSTR, LPMSGHEADER );
+	STDMETHODIMP cReadBody			( MSGIDHANDLE, std::string * );
 	STDMETHODIMP cReadMail			( ULONG, LPTSTR );
+	STDMETHODIMP cReadMessage		( MSGIDHANDLE, FLAGS, lpMapiMessage * );
+	STDMETHODIMP cReadRtfBody		( MSGIDHANDLE, std::string * );
+	STDMETHODIMP cRevalidateHeaderCache ( ULONG );
+	STDMETHODIMP cSearchInbox		( LPCSTR, std::vector<MSGIDHANDLE> * );
+	STDMETHODIMP cSetBodyCacheBudget ( ULONGLONG );
+	STDMETHODIMP cSetReadAhead		( ULONG );
+	STDMETHODIMP cSetReadMarkBatch	( ULONG, ULONG );
+	STDMETHODIMP cSetRecipientLimit	( ULONG );
+	STDMETHODIMP cUpdateConversations ( ULONG * );
 	STDMETHODIMP cValidateSession	( );	
+	STDMETHODIMP cWaitOutbox		( DWORD );
 };
 
 typedef CApp *lpCApp;
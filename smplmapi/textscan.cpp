@@ -0,0 +1,488 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		TextScan.cpp
+|
+|   Purpose:	Implementation of CTextScanner, and of the CApp methods
+|				that grep the Inbox with it.
+|
++---------------------------------------------------------------------
+*/
+
+#include "textscan.h"
+#include "bodycache.h"
+#include "workpool.h"
+#include "output.h"
+
+#if defined ( _M_IX86 ) || defined ( _M_X64 )
+#define SCAN_X86
+#include <intrin.h>
+#endif
+
+// Lower-cased byte, for the ASCII letters only.
+static struct SCANFOLDTABLE
+{
+	BYTE	rgb[256];
+
+	SCANFOLDTABLE ( )
+	{
+		for ( int i = 0; i < 256; i++ )
+			rgb[i] = (BYTE) ( ( i >= 'A' && i <= 'Z' ) ? i - 'A' + 'a' : i );
+	}
+} g_ScanFold;
+
+static inline BYTE ScanLetterMask ( BYTE b )
+{
+	return ( b >= 'a' && b <= 'z' ) ? 0x20 : 0;
+}
+
+CTextScanner::CTextScanner ( )
+{
+	m_ulLevel = SCAN_SCALAR;
+	m_bFirstMask = 0;
+	m_bLastMask = 0;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	CpuLevel()
+|
+|	Purpose:	Returns the best SCAN_ level the processor and the
+|				operating system support. AVX2 needs the OS to save the
+|				YMM registers as well as the CPUID bit.
+|
++---------------------------------------------------------------------
+*/
+ULONG CTextScanner::CpuLevel ( void )
+{
+#ifdef SCAN_X86
+	static LONG s_lLevel = -1;
+	int rgnRegs[4] = {0};
+	LONG lLevel = SCAN_SCALAR;
+
+	if ( s_lLevel >= 0 )
+		return (ULONG) s_lLevel;
+
+	__cpuid ( rgnRegs, 1 );
+	if ( rgnRegs[3] & ( 1 << 26 ) )
+		lLevel = SCAN_SSE2;
+
+	// OSXSAVE and AVX, then the XMM and YMM state enabled in XCR0.
+	if ( ( rgnRegs[2] & ( 1 << 27 ) ) && ( rgnRegs[2] & ( 1 << 28 ) ) &&
+		 6 == ( _xgetbv ( 0 ) & 6 ) )
+	{
+		__cpuid ( rgnRegs, 0 );
+		if ( rgnRegs[0] >= 7 )
+		{
+			__cpuidex ( rgnRegs, 7, 0 );
+			if ( rgnRegs[1] & ( 1 << 5 ) )
+				lLevel = SCAN_AVX2;
+		}
+	}
+
+	InterlockedExchange ( &s_lLevel, lLevel );
+
+	return (ULONG) lLevel;
+#else
+	return SCAN_SCALAR;
+#endif
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Init()
+|
+|	Parameters:	[IN] lpszPattern == Text to look for; not empty.
+|
+|				[IN] ulLevel == SCAN_ level to use, or SCAN_BEST. A level
+|				the processor lacks is lowered to one it has.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CTextScanner::Init ( LPCSTR lpszPattern, ULONG ulLevel )
+{
+	if ( NULL == lpszPattern || '\0' == lpszPattern[0] )
+		return MAPI_E_INVALID_PARAMETER;
+
+	m_sPattern = lpszPattern;
+	for ( size_t i = 0; i < m_sPattern.size ( ); i++ )
+		m_sPattern[i] = (char) g_ScanFold.rgb[(BYTE) m_sPattern[i]];
+
+	m_bFirstMask = ScanLetterMask ( (BYTE) m_sPattern[0] );
+	m_bLastMask = ScanLetterMask ( (BYTE) m_sPattern[m_sPattern.size ( ) - 1] );
+	m_ulLevel = min ( ulLevel, CpuLevel ( ) );
+
+	return S_OK;
+}
+
+// Compares the pattern, less its first and last bytes, with the text
+// following pb.
+inline BOOL CTextScanner::MatchRest ( const BYTE *pb ) const
+{
+	const BYTE *pbPattern = (const BYTE *) m_sPattern.c_str ( );
+	size_t cb = m_sPattern.size ( );
+
+	for ( size_t i = 1; i + 1 < cb; i++ )
+	{
+		if ( g_ScanFold.rgb[pb[i]] != pbPattern[i] )
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+// Checks every start from pb up to pbEnd, where pbEnd is the last start
+// the text has room for, plus one.
+const BYTE *CTextScanner::FindScalar ( const BYTE *pb, const BYTE *pbEnd ) const
+{
+	BYTE bFirst = (BYTE) m_sPattern[0];
+	BYTE bLast = (BYTE) m_sPattern[m_sPattern.size ( ) - 1];
+	size_t ibLast = m_sPattern.size ( ) - 1;
+
+	for ( ; pb < pbEnd; pb++ )
+	{
+		if ( ( pb[0] | m_bFirstMask ) == bFirst && ( pb[ibLast] | m_bLastMask ) == bLast && MatchRest ( pb ) )
+			return pb;
+	}
+
+	return NULL;
+}
+
+#ifdef SCAN_X86
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	FindSse2()
+|
+|	Purpose:	Tests 16 starts at a time. ORing 0x20 into the text
+|				makes an upper case letter equal to its lower case
+|				pattern byte and nothing else, since the pattern byte
+|				is a lower case letter whenever the mask is set.
+|
++---------------------------------------------------------------------
+*/
+const BYTE *CTextScanner::FindSse2 ( const BYTE *pb, const BYTE *pbEnd ) const
+{
+	size_t ibLast = m_sPattern.size ( ) - 1;
+	__m128i xFirst = _mm_set1_epi8 ( m_sPattern[0] );
+	__m128i xLast = _mm_set1_epi8 ( m_sPattern[ibLast] );
+	__m128i xFirstMask = _mm_set1_epi8 ( (char) m_bFirstMask );
+	__m128i xLastMask = _mm_set1_epi8 ( (char) m_bLastMask );
+
+	for ( ; pbEnd - pb >= 16; pb += 16 )
+	{
+		__m128i xStart = _mm_or_si128 ( _mm_loadu_si128 ( (const __m128i *) pb ), xFirstMask );
+		__m128i xEnd = _mm_or_si128 ( _mm_loadu_si128 ( (const __m128i *) ( pb + ibLast ) ), xLastMask );
+		unsigned long ulBits = (unsigned long) _mm_movemask_epi8 ( _mm_and_si128 ( _mm_cmpeq_epi8 ( xStart, xFirst ),
+																				   _mm_cmpeq_epi8 ( xEnd, xLast ) ) );
+		unsigned long iBit = 0;
+
+		while ( _BitScanForward ( &iBit, ulBits ) )
+		{
+			if ( MatchRest ( pb + iBit ) )
+				return pb + iBit;
+			ulBits &= ulBits - 1;
+		}
+	}
+
+	return FindScalar ( pb, pbEnd );
+}
+
+// As FindSse2, 32 starts at a time.
+const BYTE *CTextScanner::FindAvx2 ( const BYTE *pb, const BYTE *pbEnd ) const
+{
+	size_t ibLast = m_sPattern.size ( ) - 1;
+	__m256i yFirst = _mm256_set1_epi8 ( m_sPattern[0] );
+	__m256i yLast = _mm256_set1_epi8 ( m_sPattern[ibLast] );
+	__m256i yFirstMask = _mm256_set1_epi8 ( (char) m_bFirstMask );
+	__m256i yLastMask = _mm256_set1_epi8 ( (char) m_bLastMask );
+	const BYTE *pbFound = NULL;
+
+	for ( ; NULL == pbFound && pbEnd - pb >= 32; pb += 32 )
+	{
+		__m256i yStart = _mm256_or_si256 ( _mm256_loadu_si256 ( (const __m256i *) pb ), yFirstMask );
+		__m256i yEnd = _mm256_or_si256 ( _mm256_loadu_si256 ( (const __m256i *) ( pb + ibLast ) ), yLastMask );
+		unsigned long ulBits = (unsigned long) (UINT32) _mm256_movemask_epi8 ( _mm256_and_si256 ( _mm256_cmpeq_epi8 ( yStart, yFirst ),
+																								 _mm256_cmpeq_epi8 ( yEnd, yLast ) ) );
+		unsigned long iBit = 0;
+
+		while ( _BitScanForward ( &iBit, ulBits ) )
+		{
+			if ( MatchRest ( pb + iBit ) )
+			{
+				pbFound = pb + iBit;
+				break;
+			}
+			ulBits &= ulBits - 1;
+		}
+	}
+
+	// Leave the AVX state before returning to SSE2 or scalar code.
+	_mm256_zeroupper ( );
+
+	return pbFound ? pbFound : FindSse2 ( pb, pbEnd );
+}
+
+#else
+
+const BYTE *CTextScanner::FindSse2 ( const BYTE *pb, const BYTE *pbEnd ) const
+{
+	return FindScalar ( pb, pbEnd );
+}
+
+const BYTE *CTextScanner::FindAvx2 ( const BYTE *pb, const BYTE *pbEnd ) const
+{
+	return FindScalar ( pb, pbEnd );
+}
+
+#endif
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Find()
+|
+|	Purpose:	Returns the first occurrence of the pattern in the
+|				cchText bytes at lpszText, or NULL. The text need not
+|				be terminated; no byte past cchText is read.
+|
++---------------------------------------------------------------------
+*/
+LPCSTR CTextScanner::Find ( LPCSTR lpszText, size_t cchText ) const
+{
+	const BYTE *pb = (const BYTE *) lpszText;
+	const BYTE *pbEnd = NULL;
+
+	if ( m_sPattern.empty ( ) || cchText < m_sPattern.size ( ) )
+		return NULL;
+
+	// The last start with room for the whole pattern, plus one. The vector
+	// loads at a start read up to the end of the pattern at the last lane,
+	// which this keeps inside the text.
+	pbEnd = pb + ( cchText - m_sPattern.size ( ) + 1 );
+
+	switch ( m_ulLevel )
+	{
+	case SCAN_AVX2:
+		return (LPCSTR) FindAvx2 ( pb, pbEnd );
+	case SCAN_SSE2:
+		return (LPCSTR) FindSse2 ( pb, pbEnd );
+	default:
+		return (LPCSTR) FindScalar ( pb, pbEnd );
+	}
+}
+
+// State shared by the workers of cGrepInbox.
+typedef struct _GREPCONTEXT
+{
+	CApp					*pApp;
+	CBodyCache				*pCache;		// The owner's; may be NULL
+	const CTextScanner		*pScanner;
+	const MSGHEADERLIST		*pHeaders;		// Messages to scan
+	volatile LONG			iNext;			// First of the next batch to claim
+	std::vector<BYTE>		rgfMatch;		// By message
+	std::vector<HRESULT>	rghRes;			// By worker; first error
+} GREPCONTEXT;
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	GrepWorker()
+|
+|	Purpose:	Claims SCAN_BATCH messages at a time and scans the
+|				subject, then the text. Text is taken from the body
+|				cache when it is there; otherwise it is read on a
+|				session of the worker's own, logged on at the first
+|				such read, and cached. Messages deleted since the
+|				Inbox was walked are skipped.
+|
++---------------------------------------------------------------------
+*/
+static DWORD GrepWorker ( ULONG iWorker, LPVOID lpvContext )
+{
+	GREPCONTEXT *pCtx = (GREPCONTEXT *) lpvContext;
+	LONG cHeaders = (LONG) pCtx -> pHeaders -> size ( );
+	CApp Session;
+	BOOL fLoggedOn = FALSE;
+	std::string sText;
+	LONG iFirst = 0;
+
+	while ( ( iFirst = InterlockedExchangeAdd ( &pCtx -> iNext, SCAN_BATCH ) ) < cHeaders )
+	{
+		for ( LONG i = iFirst; i < iFirst + SCAN_BATCH && i < cHeaders; i++ )
+		{
+			const MSGHEADER &Header = ( *pCtx -> pHeaders )[i];
+			lpMapiMessage lpMessage = NULL;
+			HRESULT hRes = SUCCESS_SUCCESS;
+
+			if ( pCtx -> pScanner -> Find ( Header.sSubject.c_str ( ), Header.sSubject.size ( ) ) )
+			{
+				pCtx -> rgfMatch[i] = TRUE;
+				continue;
+			}
+
+			if ( pCtx -> pCache && pCtx -> pCache -> Get ( Header.hMsgID, &sText ) )
+			{
+				pCtx -> rgfMatch[i] = NULL != pCtx -> pScanner -> Find ( sText.c_str ( ), sText.size ( ) );
+				continue;
+			}
+
+			if ( !fLoggedOn )
+			{
+				if ( SUCCESS_SUCCESS != ( hRes = pCtx -> pApp -> cCloneSession ( &Session ) ) )
+				{
+					pCtx -> rghRes[iWorker] = hRes;
+					return hRes;
+				}
+				fLoggedOn = TRUE;
+			}
+
+			hRes = Session.cReadMessage ( Header.hMsgID, MAPI_PEEK | MAPI_SUPPRESS_ATTACH, &lpMessage );
+			if ( SUCCESS_SUCCESS != hRes )
+			{
+				if ( MAPI_E_INVALID_MESSAGE != hRes && SUCCESS_SUCCESS == pCtx -> rghRes[iWorker] )
+					pCtx -> rghRes[iWorker] = hRes;
+				continue;
+			}
+
+			if ( lpMessage -> lpszNoteText )
+				pCtx -> rgfMatch[i] = pCtx -> pScanner -> Contains ( lpMessage -> lpszNoteText );
+			if ( pCtx -> pCache )
+				pCtx -> pCache -> Put ( Header.hMsgID, lpMessage -> lpszNoteText );
+			Session.cFreeBuffer ( lpMessage );
+		}
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+// cEnumInboxHeaders callback that collects the headers for cGrepInbox.
+static BOOL GrepAppendHeader ( const MSGHEADER *pHeader, LPVOID lpvContext )
+{
+	( (MSGHEADERLIST *) lpvContext ) -> push_back ( *pHeader );
+
+	return TRUE;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cGrepInbox ( )
+|
+|	Parameters:	[IN] lpszPattern == Text to look for, case-insensitive.
+|
+|				[IN] cWorkers == Number of threads scanning messages.
+|
+|				[OUT] pMatches == Receives the headers of the messages
+|				whose subject or text contains the pattern, in Inbox order.
+|
+|	Purpose:	Scans every message in the Inbox without a search index.
+|				Text already in the body cache is scanned from there; the
+|				rest is read, scanned and cached, so a second grep of the
+|				same Inbox need not call MAPI for it. Returns
+|				MAPI_E_INVALID_PARAMETER for an empty pattern.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cGrepInbox ( LPCSTR lpszPattern, ULONG cWorkers, MSGHEADERLIST *pMatches )
+{
+	HRESULT hRes = S_OK;
+	MSGHEADERLIST Headers;
+	CTextScanner Scanner;
+	CWorkerThreads Workers;
+	GREPCONTEXT Ctx;
+
+	pMatches -> clear ( );
+
+	if ( !m_lhSession )
+		return MAPI_E_INVALID_SESSION;
+	if ( FAILED ( Scanner.Init ( lpszPattern, SCAN_BEST ) ) )
+		return MAPI_E_INVALID_PARAMETER;
+
+	if ( SUCCESS_SUCCESS != ( hRes = cEnumInboxHeaders ( NULL, GrepAppendHeader, &Headers ) ) )
+		return hRes;
+	if ( Headers.empty ( ) )
+		return SUCCESS_SUCCESS;
+
+	if ( 0 == cWorkers )
+		cWorkers = 1;
+	if ( cWorkers > ( Headers.size ( ) + SCAN_BATCH - 1 ) / SCAN_BATCH )
+		cWorkers = (ULONG) ( ( Headers.size ( ) + SCAN_BATCH - 1 ) / SCAN_BATCH );
+
+	Ctx.pApp = this;
+	Ctx.pCache = cBodyCache ( );
+	Ctx.pScanner = &Scanner;
+	Ctx.pHeaders = &Headers;
+	Ctx.iNext = 0;
+	Ctx.rgfMatch.assign ( Headers.size ( ), FALSE );
+	Ctx.rghRes.assign ( cWorkers, SUCCESS_SUCCESS );
+
+	if ( FAILED ( Workers.Start ( cWorkers, GrepWorker, &Ctx ) ) )
+	{
+		Workers.Join ( );
+		return MAPI_E_FAILURE;
+	}
+	Workers.Join ( );
+
+	for ( size_t i = 0; i < Headers.size ( ); i++ )
+	{
+		if ( Ctx.rgfMatch[i] )
+			pMatches -> push_back ( Headers[i] );
+	}
+
+	for ( ULONG i = 0; i < cWorkers; i++ )
+	{
+		if ( SUCCESS_SUCCESS != Ctx.rghRes[i] )
+			return Ctx.rghRes[i];
+	}
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++------------------------------------------------------------------------------
+|
+|	Function:	cGrepInboxMessages ( )
+|
+|	Purpose:	Asks the user for text and prints the date, sender and
+|				subject of each Inbox message whose subject or text
+|				contains it.
++------------------------------------------------------------------------------
+*/
+STDMETHODIMP CApp::cGrepInboxMessages ( )
+{
+	HRESULT hRes = S_OK;
+	LPSTR lpszPattern = NULL;
+	MSGHEADERLIST Matches;
+	DWORD dwStart = 0;
+
+	if ( !m_lhSession )
+	{
+		printf ( "Not logged on to messaging system.\r\n" );
+		return MAPI_E_INVALID_SESSION;
+	}
+
+	if ( FAILED ( hRes = cCaptureText ( "Text to look for: ", &lpszPattern ) ) )
+		return hRes;
+
+	dwStart = GetTickCount ( );
+	hRes = cGrepInbox ( lpszPattern, CWorkerThreads::ProcessorCount ( ), &Matches );
+
+	for ( size_t i = 0; i < Matches.size ( ); i++ )
+		g_StdOut.Printf ( "%s  %-24.24s  %s\r\n", Matches[i].szDateReceived, Matches[i].sOriginator.c_str ( ),
+						  Matches[i].sSubject.c_str ( ) );
+	g_StdOut.Flush ( );
+
+	if ( SUCCESS_SUCCESS == hRes )
+		printf ( "%lu matching messages in %lu ms.\r\n", (ULONG) Matches.size ( ), GetTickCount ( ) - dwStart );
+	else if ( MAPI_E_INVALID_PARAMETER == hRes )
+		printf ( "Enter the text to look for.\r\n" );
+	else
+		printf ( "Grep failed due to error code %d.\r\n", hRes );
+
+	cFreeBuffer ( lpszPattern );
+
+	return hRes;
+}
@@ -0,0 +1,62 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		TextScan.h
+|
+|   Purpose:	Declares CTextScanner, a case-insensitive substring
+|				matcher for grepping message text where there is no
+|				search index (SrchIdx.h) to ask.
+|
+|				Only the ASCII letters are folded; other bytes must
+|				match exactly. The scanner compares the pattern's first
+|				and last bytes against 16 or 32 positions of the text
+|				at once with SSE2 or AVX2, and compares the rest of the
+|				pattern only where both match. Which instructions are
+|				used is decided at run time; hosts without either, or
+|				that are not x86, use a scalar loop that tests the same
+|				two bytes first.
+|
+|				A CTextScanner is read-only once Init has returned, so
+|				one may be shared by any number of threads.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _TEXTSCAN_H
+#define _TEXTSCAN_H
+
+#include "swap.h"
+
+// Instruction sets for CTextScanner, in increasing order.
+#define SCAN_SCALAR			0
+#define SCAN_SSE2			1
+#define SCAN_AVX2			2
+#define SCAN_BEST			0xFFFFFFFF		// Best the processor supports
+
+#define SCAN_BATCH			64				// Messages a grep worker claims at a time
+
+class CTextScanner
+{
+private:
+	std::string		m_sPattern;		// Lower-cased
+	ULONG			m_ulLevel;		// SCAN_ constant in use
+	BYTE			m_bFirstMask;	// 0x20 where the first byte is a letter, else 0
+	BYTE			m_bLastMask;	// Likewise for the last byte
+
+	BOOL	MatchRest ( const BYTE *pb ) const;
+	const BYTE *FindScalar ( const BYTE *pb, const BYTE *pbEnd ) const;
+	const BYTE *FindSse2 ( const BYTE *pb, const BYTE *pbEnd ) const;
+	const BYTE *FindAvx2 ( const BYTE *pb, const BYTE *pbEnd ) const;
+
+public:
+	CTextScanner ( );
+
+	HRESULT		Init ( LPCSTR lpszPattern, ULONG ulLevel );
+	LPCSTR		Find ( LPCSTR lpszText, size_t cchText ) const;
+	BOOL		Contains ( LPCSTR lpszText ) const { return lpszText && Find ( lpszText, strlen ( lpszText ) ); }
+	ULONG		Level ( void ) const { return m_ulLevel; }
+
+	static ULONG	CpuLevel ( void );
+};
+
+#endif
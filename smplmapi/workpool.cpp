@@ -0,0 +1,182 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		WorkPool.cpp
+|
+|   Purpose:	Implementation of CWorkerThreads and CSessionPool.
+|
++---------------------------------------------------------------------
+*/
+
+#include "workpool.h"
+
+CWorkerThreads::CWorkerThreads ( )
+{
+	m_lpfnProc = NULL;
+	m_lpvContext = NULL;
+}
+
+CWorkerThreads::~CWorkerThreads ( )
+{
+	Join ( );
+}
+
+DWORD WINAPI CWorkerThreads::ThreadStart ( LPVOID lpvStart )
+{
+	WORKERSTART *pStart = (WORKERSTART *) lpvStart;
+
+	return pStart -> pOwner -> m_lpfnProc ( pStart -> iWorker, pStart -> pOwner -> m_lpvContext );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Start()
+|
+|	Parameters:	[IN] cThreads == Number of threads to start.
+|				[IN] lpfnProc == Procedure every thread runs.
+|				[IN] lpvContext == Passed to lpfnProc.
+|
+|	Purpose:	Starts the worker threads. If not every thread can be
+|				created, an error is returned and the threads already
+|				started are left running: they may be waiting for work
+|				only the caller can end, e.g. by closing a queue, so
+|				the caller does that and then calls Join.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CWorkerThreads::Start ( ULONG cThreads, LPWORKERPROC lpfnProc, LPVOID lpvContext )
+{
+	Join ( );
+
+	m_lpfnProc = lpfnProc;
+	m_lpvContext = lpvContext;
+	m_rgStart.resize ( cThreads );
+
+	for ( ULONG i = 0; i < cThreads; i++ )
+	{
+		HANDLE hThread = NULL;
+
+		m_rgStart[i].pOwner = this;
+		m_rgStart[i].iWorker = i;
+
+		hThread = CreateThread ( NULL, 0, ThreadStart, &m_rgStart[i], 0, NULL );
+		if ( NULL == hThread )
+			return HRESULT_FROM_WIN32 ( GetLastError ( ) );
+		m_rgThreads.push_back ( hThread );
+	}
+
+	return S_OK;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Join()
+|
+|	Purpose:	Waits for every worker thread to return.
+|
++---------------------------------------------------------------------
+*/
+void CWorkerThreads::Join ( void )
+{
+	for ( size_t i = 0; i < m_rgThreads.size ( ); i++ )
+	{
+		WaitForSingleObject ( m_rgThreads[i], INFINITE );
+		CloseHandle ( m_rgThreads[i] );
+	}
+	m_rgThreads.clear ( );
+}
+
+ULONG CWorkerThreads::ProcessorCount ( void )
+{
+	SYSTEM_INFO SysInfo;
+
+	GetSystemInfo ( &SysInfo );
+
+	return SysInfo.dwNumberOfProcessors ? SysInfo.dwNumberOfProcessors : 1;
+}
+
+CSessionPool::CSessionPool ( )
+{
+	InitializeCriticalSection ( &m_csLock );
+}
+
+CSessionPool::~CSessionPool ( )
+{
+	for ( size_t i = 0; i < m_rgpIdle.size ( ); i++ )
+		delete m_rgpIdle[i];
+	m_rgpIdle.clear ( );
+
+	DeleteCriticalSection ( &m_csLock );
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Get()
+|
+|	Parameters:	[IN] pOwner == Session the pool belongs to.
+|				[OUT] ppSession == Receives a session of the same
+|				provider and profile, to be given back with Put.
+|
+|	Purpose:	Hands out an idle session, or clones pOwner when none
+|				is idle. Safe to call from any thread.
+|
++---------------------------------------------------------------------
+*/
+HRESULT CSessionPool::Get ( CApp *pOwner, CApp **ppSession )
+{
+	HRESULT hRes = S_OK;
+	CApp *pSession = NULL;
+
+	*ppSession = NULL;
+
+	EnterCriticalSection ( &m_csLock );
+	if ( !m_rgpIdle.empty ( ) )
+	{
+		pSession = m_rgpIdle.back ( );
+		m_rgpIdle.pop_back ( );
+	}
+	LeaveCriticalSection ( &m_csLock );
+
+	if ( NULL == pSession )
+	{
+		pSession = new CApp;
+		if ( SUCCESS_SUCCESS != ( hRes = pOwner -> cCloneSession ( pSession ) ) )
+		{
+			delete pSession;
+			return hRes;
+		}
+	}
+
+	*ppSession = pSession;
+
+	return SUCCESS_SUCCESS;
+}
+
+/*
++---------------------------------------------------------------------
+|
+|	Function:	Put()
+|
+|	Parameters:	[IN] pSession == Session from Get.
+|				[IN] fKeep == FALSE if the session failed and should
+|				be logged off rather than handed out again.
+|
+|	Purpose:	Takes a session back. Safe to call from any thread.
+|
++---------------------------------------------------------------------
+*/
+void CSessionPool::Put ( CApp *pSession, BOOL fKeep )
+{
+	if ( !fKeep )
+	{
+		delete pSession;
+		return;
+	}
+
+	EnterCriticalSection ( &m_csLock );
+	m_rgpIdle.push_back ( pSession );
+	LeaveCriticalSection ( &m_csLock );
+}
@@ -0,0 +1,149 @@
+/*
++---------------------------------------------------------------------
+|
+|   File:		WorkPool.h
+|
+|   Purpose:	Threading helpers shared by the parallel listing,
+|				reading and sending code: a set of worker threads that
+|				all run the same procedure, a bounded blocking queue
+|				used to hand work to them, and a pool of the sessions
+|				they read on.
+|
++---------------------------------------------------------------------
+*/
+
+#ifndef _WORKPOOL_H
+#define _WORKPOOL_H
+
+#include "swap.h"
+#include <deque>
+
+// Procedure run by every worker thread. iWorker is 0 .. cThreads - 1.
+typedef DWORD ( *LPWORKERPROC ) ( ULONG iWorker, LPVOID lpvContext );
+
+class CWorkerThreads
+{
+private:
+	typedef struct _WORKERSTART
+	{
+		CWorkerThreads	*pOwner;
+		ULONG			iWorker;
+	} WORKERSTART;
+
+	std::vector<HANDLE>			m_rgThreads;
+	std::vector<WORKERSTART>	m_rgStart;
+	LPWORKERPROC				m_lpfnProc;
+	LPVOID						m_lpvContext;
+
+	static DWORD WINAPI ThreadStart ( LPVOID lpvStart );
+
+public:
+	CWorkerThreads ( );
+	~CWorkerThreads ( );
+
+	HRESULT	Start ( ULONG cThreads, LPWORKERPROC lpfnProc, LPVOID lpvContext );
+	void	Join ( void );
+
+	static ULONG ProcessorCount ( void );
+};
+
+// Sessions opened by cCloneSession and kept for the life of the session
+// they were cloned from, so a parallel operation does not log on afresh
+// each time. A session is used by one thread at a time: Get hands it out
+// and Put takes it back. Idle sessions are logged off with the pool.
+class CSessionPool
+{
+private:
+	CRITICAL_SECTION	m_csLock;
+	std::vector<CApp *>	m_rgpIdle;
+
+public:
+	CSessionPool ( );
+	~CSessionPool ( );
+
+	HRESULT	Get ( CApp *pOwner, CApp **ppSession );
+	void	Put ( CApp *pSession, BOOL fKeep );
+};
+
+// Bounded first-in first-out queue. Push blocks while the queue is full and
+// Pop blocks while it is empty. After Close, Push fails and Pop drains the
+// remaining items and then fails.
+template <class T>
+class CBoundedQueue
+{
+private:
+	CRITICAL_SECTION	m_csLock;
+	CONDITION_VARIABLE	m_cvNotFull;
+	CONDITION_VARIABLE	m_cvNotEmpty;
+	std::deque<T>		m_Items;
+	size_t				m_cMaxItems;
+	BOOL				m_fClosed;
+
+public:
+	CBoundedQueue ( size_t cMaxItems )
+	{
+		InitializeCriticalSection ( &m_csLock );
+		InitializeConditionVariable ( &m_cvNotFull );
+		InitializeConditionVariable ( &m_cvNotEmpty );
+		m_cMaxItems = cMaxItems ? cMaxItems : 1;
+		m_fClosed = FALSE;
+	}
+
+	~CBoundedQueue ( )
+	{
+		DeleteCriticalSection ( &m_csLock );
+	}
+
+	BOOL Push ( const T &Item )
+	{
+		BOOL fPushed = FALSE;
+
+		EnterCriticalSection ( &m_csLock );
+		while ( !m_fClosed && m_Items.size ( ) >= m_cMaxItems )
+			SleepConditionVariableCS ( &m_cvNotFull, &m_csLock, INFINITE );
+		if ( !m_fClosed )
+		{
+			m_Items.push_back ( Item );
+			fPushed = TRUE;
+		}
+		LeaveCriticalSection ( &m_csLock );
+
+		if ( fPushed )
+			WakeConditionVariable ( &m_cvNotEmpty );
+
+		return fPushed;
+	}
+
+	BOOL Pop ( T *pItem )
+	{
+		BOOL fPopped = FALSE;
+
+		EnterCriticalSection ( &m_csLock );
+		while ( !m_fClosed && m_Items.empty ( ) )
+			SleepConditionVariableCS ( &m_cvNotEmpty, &m_csLock, INFINITE );
+		if ( !m_Items.empty ( ) )
+		{
+			*pItem = m_Items.front ( );
+			m_Items.pop_front ( );
+			fPopped = TRUE;
+		}
+		LeaveCriticalSection ( &m_csLock );
+
+		if ( fPopped )
+			WakeConditionVariable ( &m_cvNotFull );
+
+		return fPopped;
+	}
+
+	void Close ( void )
+	{
+		EnterCriticalSection ( &m_csLock );
+		m_fClosed = TRUE;
+		LeaveCriticalSection ( &m_csLock );
+
+		WakeAllConditionVariable ( &m_cvNotFull );
+		WakeAllConditionVariable ( &m_cvNotEmpty );
+	}
+};
+
+#endif